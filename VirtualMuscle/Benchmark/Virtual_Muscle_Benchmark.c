@@ -0,0 +1,486 @@
+/* VIRTUAL_MUSCLE_BENCHMARK.C
+ * Synopsis: Microbenchmark of the S-function callbacks outside Simulink. Virtual_Muscle_SFunction.c is
+ *          built against the stand-in simstruc.h of this directory, and mdlOutputs and mdlDerivatives
+ *          are timed for the recruitment types 2, 3 and 4, 1 to 10 fiber types and 1 to 5000 motor
+ *          units (Natural Continuous: one motor unit per fiber type).
+ *
+ *          vm_benchmark [-h | --help] [-m | -e] [CSV file] [time per callback (s)] [parameter index, value] ...
+ *
+ *          CSV file            output file, "-" or none for stdout
+ *          time per callback   minimum time each callback is timed for at every point, default 0.2 s;
+ *                              with -m or -e the simulated time of every run, default 0.5 s (-m)
+ *                              or 0.05 s (-e)
+ *          index, value        optional parameter overrides, any number of pairs
+ *          -m                  discrete motor units comparison instead of the callback timings
+ *          -e                  ensemble throughput against ensemble width instead of the callback timings
+ *          -h, --help          prints the usage and exits
+ *
+ *          Any other first argument starting with "-" is taken for a mistyped option, not a file name:
+ *          the usage is printed and the exit status is 2, as for a time that is not positive or an
+ *          index without a value.
+ *
+ *          The parameters are those of Virtual_Muscle_StandInBlock.h, the BuildMuscles.m defaults for
+ *          a 10 g muscle. Optional scalar parameters (STATELAYOUT onwards) may be overridden by their
+ *          index (see Virtual_Muscle_Params.h), e.g. "58 2" for the structure of arrays state layout,
+ *          or "65 8" for 8 threads.
+ *
+ *          Every point starts from the initial conditions and is first simulated for 20 ms (Euler)
+ *          at half activation; each callback is then called repeatedly at that state, with the
+ *          activation changing between calls, for at least the given time (default 0.2 s). The
+ *          results are written as CSV (default stdout), one line per point:
+ *          rtype, fiber_types, motor_units, states, ns_outputs, ns_derivatives, states_per_s
+ *          where states_per_s is the number of state derivatives (mdlOutputs then mdlDerivatives) per
+ *          second.
+ *
+ *          Discrete motor units (-m): a Natural Discrete muscle of 2 fiber types of 500 motor units is
+ *          simulated with forward Euler steps of 10 us and a 2 Hz sinusoidal activation (0.05 to 0.55)
+ *          from the initial conditions, with continuous motor units (MUSTEP 0) and with discrete ones
+ *          updated every MUSTEP of 0.1, 0.5 and 1 ms, without and with MULTIRATE. The callbacks are
+ *          those of a Simulink step: mdlOutputs, mdlUpdate at the motor unit sample hits, then
+ *          mdlDerivatives. One line per run:
+ *          mu_step, multirate, motor_units, s_per_simulated_s, speedup, max_force_error
+ *          where speedup is the run time of MUSTEP 0 over that of the run, and max_force_error the
+ *          largest difference of the force from that of MUSTEP 0, relative to its peak.
+ *
+ *          Ensembles (-e): 1 to 64 muscles of 2 fiber types (Natural Discrete: 50 motor units each), with
+ *          activations spread from 0.3 to 0.7, are simulated with fixed step RK4 (20 us) as one ensemble
+ *          (Virtual_Muscle_Ensemble.h) and as independent runs of VM_Simulate, for the recruitment types
+ *          2, 3 and 4. One line per ensemble:
+ *          rtype, motor_units, members, lanes, af_isa, ensemble_member_s_per_s,
+ *          independent_member_s_per_s, speedup, max_force_difference
+ *          where member_s_per_s is the simulated time of all the members per second of run time, af_isa
+ *          the instruction set of the ensemble Af kernel (VM_ISA_*) and max_force_difference the largest
+ *          difference of the final forces of the ensemble from those of the independent runs, relative
+ *          to them. The lane loops of the ensemble are only vectorized when the build targets the
+ *          processor (e.g. -O3 -march=native).
+ *
+ * Date: 10-17-26
+ *
+ * Build (from VirtualMuscle): cc -O2 -DVM_STANDALONE -IBenchmark -I. Benchmark/Virtual_Muscle_Benchmark.c
+ *          Virtual_Muscle_Engine.c Virtual_Muscle_Ensemble.c Virtual_Muscle_SIMD.c Virtual_Muscle_Threads.c
+ *          Virtual_Muscle_Surrogate.c -lm -lpthread -o vm_benchmark
+ */
+
+#include "Virtual_Muscle_SFunction.c"
+#include "Virtual_Muscle_StandInBlock.h"
+#include "Virtual_Muscle_Ensemble.h"
+#include <time.h>
+
+#define WARMUP_TIME         0.02    //s
+#define WARMUP_STEP         1e-5    //s
+#define NUM_ACT             256     //activations cycled through while timing
+#define MR_STEP             1e-5    //s, continuous step of the discrete motor units comparison (-m)
+#define MR_TYPES            2
+#define MR_UNITS            500     //per fiber type
+#define ENS_STEP            2e-5    //s, RK4 step of the ensemble comparison (-e)
+#define ENS_TYPES           2
+#define ENS_UNITS           50      //per fiber type, Natural Discrete
+#define ENS_MAX_MEMBERS     64
+
+static real_T Act_table[NUM_ACT];
+
+
+
+/* Function: SetInputs
+*  Description: Activation, path length and (FES) frequency inputs
+*/
+static void SetInputs(real_T *u, real_T Act)
+{
+    u[0] = Act;
+    u[1] = 0.155;
+    u[2] = 40*Act;
+}
+
+
+
+/* Function: Warmup
+*  Description: Forward Euler simulation at half activation, calling mdlUpdate at the motor unit sample
+*              hits, so that the motor unit states are those of a contracting muscle
+*/
+static void Warmup(SimStruct *S, real_T *u)
+{
+    VM_MuscleSet *Set   = (VM_MuscleSet*)ssGetPWorkValue(S,0);
+    real_T MU_step      = Set->Model[0]->MU_step;
+    int_T Steps         = (int_T)(WARMUP_TIME/WARMUP_STEP+0.5);
+    int_T Hit_steps     = (MU_step > 0) ? (int_T)(MU_step/WARMUP_STEP+0.5) : 0;
+    int_T s             = 0;
+    int_T i             = 0;
+
+    SetInputs(u, 0.5);
+    for(s=0; s<Steps; s++){
+        S->Sample_hit = (Hit_steps > 0 && s%Hit_steps == 0);
+        mdlOutputs(S, 0);
+        mdlUpdate(S, 0);
+        mdlDerivatives(S);
+        for(i=0; i<S->Num_cont_states; i++)
+            S->x[i] += WARMUP_STEP*S->dx[i];
+    }
+    S->Sample_hit = 0;
+}
+
+
+
+/* Function: TimeCallback
+*  Description: Average time (ns) of one call of mdlOutputs (Derivatives 0) or mdlDerivatives, over at
+*              least Min_time seconds of calls
+*/
+static double TimeCallback(SimStruct *S, real_T *u, int_T Derivatives, double Min_time)
+{
+    long Calls      = 16;
+    long c          = 0;
+    clock_t Start   = 0;
+    double Elapsed  = 0.0;
+
+    for(;;){
+        Start = clock();
+        for(c=0; c<Calls; c++){
+            SetInputs(u, Act_table[c%NUM_ACT]);
+            if (Derivatives)
+                mdlDerivatives(S);
+            else
+                mdlOutputs(S, 0);
+        }
+        Elapsed = (double)(clock()-Start)/CLOCKS_PER_SEC;
+        if (Elapsed >= Min_time)
+            break;
+        Calls *= 2;
+    }
+    return Elapsed*1e9/Calls;
+}
+
+
+
+/* Function: Usage
+*  Description: Prints the command line arguments to Out
+*/
+static void Usage(FILE *Out, const char *Name)
+{
+    fprintf(Out, "usage: %s [-h | --help] [-m | -e] [CSV file | -] [time per callback (s)] [optional parameter index, value] ...\n",
+            Name);
+}
+
+
+
+/* Function: RunPoint
+*  Description: Benchmarks one muscle and writes its CSV line. Returns 0 on error.
+*/
+static int_T RunPoint(FILE *Out, int_T Rtype, int_T Types, int_T Units, double Min_time)
+{
+    SimStruct S;
+    BenchParams B;
+    real_T u[3]         = {0.0, 0.0, 0.0};
+    const real_T *Ptr[3];
+    double ns_out       = 0.0;
+    double ns_der       = 0.0;
+    int_T Ok            = 0;
+
+    memset(&B, 0, sizeof(B));
+    if (!BuildParams(&B, Rtype, Types, Units)) {
+        fprintf(stderr, "Could not allocate the parameters\n");
+        return 0;
+    }
+    if (OpenBlock(&S, &B, u, Ptr)) {
+        SetInputs(u, 0.0);
+        mdlInitializeConditions(&S);
+        Warmup(&S, u);
+        ns_out = TimeCallback(&S, u, 0, Min_time);
+        ns_der = TimeCallback(&S, u, 1, Min_time);
+        fprintf(Out, "%d,%d,%d,%d,%.1f,%.1f,%.4g\n", (int)Rtype, (int)Types, (int)(Types*Units),
+                (int)(S.Num_cont_states+S.Num_disc_states), ns_out, ns_der,
+                (S.Num_cont_states+S.Num_disc_states)*1e9/(ns_out+ns_der));
+        fflush(Out);
+        Ok = 1;
+    }
+    else {
+        fprintf(stderr, "RTYPE %d, %d fiber types, %d motor units: %s\n", (int)Rtype, (int)Types,
+                (int)(Types*Units), S.Error);
+    }
+    CloseBlock(&S, Ok);
+    free(B.Values);
+    return Ok;
+}
+
+
+
+/* Function: SimulateForce
+*  Description: Steps forward Euler steps of MR_STEP from the initial conditions, with mdlUpdate at the
+*              motor unit sample hits; Force[s] is the force of step s. Returns the run time (s).
+*/
+static double SimulateForce(SimStruct *S, real_T *u, int_T Steps, real_T *Force)
+{
+    VM_MuscleSet *Set   = (VM_MuscleSet*)ssGetPWorkValue(S,0);
+    real_T MU_step      = Set->Model[0]->MU_step;
+    int_T Hit_steps     = (MU_step > 0) ? (int_T)(MU_step/MR_STEP+0.5) : 0;
+    clock_t Start       = 0;
+    int_T s             = 0;
+    int_T i             = 0;
+
+    SetInputs(u, 0.3);
+    mdlInitializeConditions(S);
+    Start = clock();
+    for(s=0; s<Steps; s++){
+        SetInputs(u, 0.3+0.25*sin(2*3.14159265358979*2.0*s*MR_STEP));
+        S->Sample_hit = (Hit_steps > 0 && s%Hit_steps == 0);
+        mdlOutputs(S, 0);
+        mdlUpdate(S, 0);
+        mdlDerivatives(S);
+        for(i=0; i<S->Num_cont_states; i++)
+            S->x[i] += MR_STEP*S->dx[i];
+        Force[s] = S->Output[0][0];
+    }
+    S->Sample_hit = 0;
+    return (double)(clock()-Start)/CLOCKS_PER_SEC;
+}
+
+
+
+/* Function: RunMultirate
+*  Description: Discrete motor units comparison (-m) over Sim_time seconds. Returns the number of runs that
+*              failed.
+*/
+static int_T RunMultirate(FILE *Out, double Sim_time)
+{
+    static const real_T MU_steps[]  = {0.0, 1e-4, 1e-4, 5e-4, 5e-4, 1e-3, 1e-3};
+    static const int_T Multirate[]  = {0, 0, 1, 0, 1, 0, 1};
+    SimStruct S;
+    BenchParams B;
+    real_T u[3]         = {0.0, 0.0, 0.0};
+    const real_T *Ptr[3];
+    int_T Steps         = (int_T)(Sim_time/MR_STEP+0.5);
+    int_T User_overrides = Num_overrides;
+    real_T *Reference   = (real_T*)malloc(Steps*sizeof(real_T));
+    real_T *Force       = (real_T*)malloc(Steps*sizeof(real_T));
+    double Reference_time = 0.0;
+    double Time         = 0.0;
+    real_T Peak         = 0.0;
+    real_T Error        = 0.0;
+    int_T Errors        = 0;
+    int_T Ok            = 0;
+    int_T r             = 0;
+    int_T s             = 0;
+
+    if (Reference == NULL || Force == NULL || Num_overrides+2 > MAX_OVERRIDES) {
+        fprintf(stderr, (Reference == NULL || Force == NULL) ? "Could not allocate the forces\n"
+                                                             : "Too many parameter overrides\n");
+        free(Reference);
+        free(Force);
+        return 1;
+    }
+    fprintf(Out, "mu_step,multirate,motor_units,s_per_simulated_s,speedup,max_force_error\n");
+    for(r=0; r<(int_T)(sizeof(MU_steps)/sizeof(MU_steps[0])); r++){
+        Override_idx[User_overrides]        = MUSTEP_IDX;
+        Override_value[User_overrides]      = MU_steps[r];
+        Override_idx[User_overrides+1]      = MULTIRATE_IDX;
+        Override_value[User_overrides+1]    = Multirate[r];
+        Num_overrides = User_overrides+2;
+        memset(&B, 0, sizeof(B));
+        Ok = BuildParams(&B, 2, MR_TYPES, MR_UNITS) && OpenBlock(&S, &B, u, Ptr);
+        if (Ok) {
+            Time = SimulateForce(&S, u, Steps, (r == 0) ? Reference : Force);
+            if (r == 0) {
+                Reference_time = Time;
+                for(s=0; s<Steps; s++){
+                    if (fabs(Reference[s]) > Peak)
+                        Peak = fabs(Reference[s]);
+                }
+            }
+            Error = 0.0;
+            for(s=0; s<Steps && r > 0; s++){
+                if (fabs(Force[s]-Reference[s]) > Error)
+                    Error = fabs(Force[s]-Reference[s]);
+            }
+            fprintf(Out, "%g,%d,%d,%.4g,%.3g,%.3g\n", MU_steps[r], (int)Multirate[r], MR_TYPES*MR_UNITS,
+                    Time/Sim_time, Reference_time/Time, (Peak > 0) ? Error/Peak : Error);
+            fflush(Out);
+        }
+        else {
+            fprintf(stderr, "MUSTEP %g, MULTIRATE %d: %s\n", MU_steps[r], (int)Multirate[r],
+                    (B.Values == NULL) ? "Could not allocate the parameters" : S.Error);
+            Errors++;
+            if (r == 0) //no reference
+                r = (int_T)(sizeof(MU_steps)/sizeof(MU_steps[0]));
+        }
+        if (B.Values != NULL)
+            CloseBlock(&S, Ok);
+        free(B.Values);
+    }
+    Num_overrides = User_overrides;
+    free(Reference);
+    free(Force);
+    return Errors;
+}
+
+
+
+/* Function: RunEnsemble
+*  Description: Ensemble of Members muscles of the recruitment type Rtype against independent runs, over
+*              Sim_time seconds. Returns 0 on error.
+*/
+static int_T RunEnsemble(FILE *Out, int_T Rtype, int_T Members, double Sim_time)
+{
+    BenchParams B;
+    VM_ParamSet P;
+    VM_MuscleModel *Models[ENS_MAX_MEMBERS];
+    VM_Ensemble *E      = NULL;
+    VM_Simulation *Sim  = NULL;
+    VM_SolverOptions Options = {VM_SOLVER_RK4, ENS_STEP, 0.0, 0.0, 0.0, 0.0};
+    const char *Error   = NULL;
+    clock_t Start       = 0;
+    double Ensemble_time = 0.0;
+    double Single_time  = 0.0;
+    real_T Difference   = 0.0;
+    real_T Force        = 0.0;
+    int_T Created       = 0;
+    int_T Ok            = 0;
+    int_T m             = 0;
+    int_T k             = 0;
+
+    memset(&B, 0, sizeof(B));
+    if (!BuildParams(&B, Rtype, ENS_TYPES, (Rtype == 2) ? ENS_UNITS : 1)) {
+        fprintf(stderr, "Could not allocate the parameters\n");
+        return 0;
+    }
+    P.Num_params = NPARAMS;
+    for(k=0; k<NPARAMS; k++){
+        P.Value[k] = B.Param[k].pr;
+        P.Count[k] = (int_T)B.Param[k].n;
+    }
+    for(Created=0; Created<Members && Error == NULL; Created++){
+        Models[Created] = VM_CreateModel(&P, &Error);
+        if (Models[Created] == NULL)
+            break;
+    }
+    if (Error == NULL)
+        E = VM_CreateEnsemble(Models, Members, &Error);
+
+    if (E != NULL) {
+        for(m=0; m<Members; m++){
+            E->u[m].Act     = (Members > 1) ? 0.3+0.4*m/(Members-1) : 0.5;
+            E->u[m].Path    = 0.155;
+            E->u[m].Freq    = 40*E->u[m].Act;
+        }
+        Start = clock();
+        VM_InitializeEnsemble(E, 0.0, NULL, NULL);
+        VM_SimulateEnsemble(E, ENS_STEP, Sim_time, NULL, NULL, NULL);
+        Ensemble_time = (double)(clock()-Start)/CLOCKS_PER_SEC;
+
+        for(m=0; m<Members && Error == NULL; m++){
+            Sim = VM_CreateSimulation(Models[m]);
+            if (Sim == NULL) {
+                Error = "Could not allocate the simulation";
+                break;
+            }
+            Sim->u = E->u[m];
+            Start = clock();
+            VM_InitializeSimulation(Sim, 0.0, NULL, NULL);
+            VM_Simulate(Sim, &Options, Sim_time, NULL, NULL, NULL);
+            Single_time += (double)(clock()-Start)/CLOCKS_PER_SEC;
+            Force = E->y[VM_OUT_FSE*Members+m];
+            if (fabs(Force-Sim->y[VM_OUT_FSE]) > Difference*fabs(Sim->y[VM_OUT_FSE]))
+                Difference = fabs(Force-Sim->y[VM_OUT_FSE])/fabs(Sim->y[VM_OUT_FSE]);
+            VM_FreeSimulation(Sim);
+        }
+    }
+    if (E != NULL && Error == NULL) {
+        fprintf(Out, "%d,%d,%d,%d,%d,%.4g,%.4g,%.3g,%.3g\n", (int)Rtype, (int)E->Total_Munits, (int)Members,
+                VM_ENSEMBLE_LANES, (int)E->Af_isa, Members*Sim_time/Ensemble_time, Members*Sim_time/Single_time,
+                Single_time/Ensemble_time, Difference);
+        fflush(Out);
+        Ok = 1;
+    }
+    else {
+        fprintf(stderr, "RTYPE %d, %d members: %s\n", (int)Rtype, (int)Members, Error);
+    }
+    VM_FreeEnsemble(E);
+    for(m=0; m<Created; m++){
+        VM_FreeModel(Models[m]);
+    }
+    free(B.Values);
+    return Ok;
+}
+
+
+
+int main(int argc, char **argv)
+{
+    static const int_T Rtypes[]     = {2, 3, 4};
+    static const int_T Types[]      = {1, 2, 3, 5, 10};
+    static const int_T Units[]      = {1, 10, 100, 1000, 5000};     //in the muscle
+    FILE *Out           = stdout;
+    int_T Multirate     = (argc > 1 && strcmp(argv[1], "-m") == 0);
+    int_T Ensemble      = (argc > 1 && strcmp(argv[1], "-e") == 0);
+    int_T a             = (Multirate || Ensemble) ? 2 : 1;  //first argument after the option
+    double Min_time     = (argc > a+1) ? atof(argv[a+1]) : (Multirate ? 0.5 : (Ensemble ? 0.05 : 0.2));
+    int_T Errors        = 0;
+    int_T r             = 0;
+    int_T t             = 0;
+    int_T n             = 0;
+    int_T k             = 0;
+
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+        Usage(stdout, argv[0]);
+        return 0;
+    }
+    if ((argc > a && argv[a][0] == '-' && strcmp(argv[a], "-") != 0) || (argc > a+1 && !(Min_time > 0)) ||
+        (argc > a+2 && (argc-a-2)%2 != 0)) {
+        Usage(stderr, argv[0]);
+        return 2;
+    }
+    for(k=a+2; k+1<argc; k+=2){
+        if (Num_overrides == MAX_OVERRIDES || atoi(argv[k]) < STATELAYOUT_IDX || atoi(argv[k]) >= NPARAMS) {
+            Usage(stderr, argv[0]);
+            return 2;
+        }
+        Override_idx[Num_overrides]     = atoi(argv[k]);
+        Override_value[Num_overrides]   = atof(argv[k+1]);
+        Num_overrides++;
+    }
+    if (argc > a && strcmp(argv[a], "-") != 0) {
+        Out = fopen(argv[a], "w");
+        if (Out == NULL) {
+            fprintf(stderr, "Could not open %s\n", argv[a]);
+            return 1;
+        }
+    }
+    if (Multirate) {
+        Errors = RunMultirate(Out, Min_time);
+        if (Out != stdout)
+            fclose(Out);
+        return (Errors == 0) ? 0 : 1;
+    }
+    if (Ensemble) {
+        fprintf(Out, "rtype,motor_units,members,lanes,af_isa,ensemble_member_s_per_s,independent_member_s_per_s,"
+                     "speedup,max_force_difference\n");
+        for(r=0; r<3; r++){
+            for(n=1; n<=ENS_MAX_MEMBERS; n*=2){
+                Errors += !RunEnsemble(Out, Rtypes[r], n, Min_time);
+            }
+        }
+        if (Out != stdout)
+            fclose(Out);
+        return (Errors == 0) ? 0 : 1;
+    }
+    for(k=0; k<NUM_ACT; k++){
+        Act_table[k] = 0.5+0.4*sin(2*3.14159265358979*k/NUM_ACT);
+    }
+
+    fprintf(Out, "rtype,fiber_types,motor_units,states,ns_outputs,ns_derivatives,states_per_s\n");
+    for(r=0; r<3; r++){
+        for(t=0; t<5; t++){
+            for(n=0; n<5; n++){
+                if (Rtypes[r] == 3) { //one motor unit per fiber type
+                    if (n > 0)
+                        break;
+                    Errors += !RunPoint(Out, Rtypes[r], Types[t], 1, Min_time);
+                }
+                else if (Units[n] >= Types[t]) {
+                    Errors += !RunPoint(Out, Rtypes[r], Types[t], Units[n]/Types[t], Min_time);
+                }
+            }
+        }
+    }
+
+    if (Out != stdout)
+        fclose(Out);
+    return (Errors == 0) ? 0 : 1;
+}
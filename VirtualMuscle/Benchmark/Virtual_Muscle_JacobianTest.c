@@ -0,0 +1,253 @@
+/* VIRTUAL_MUSCLE_JACOBIANTEST.C
+ * Synopsis: Test of the analytic Jacobian of the S-function (VM_Jacobian, mdlJacobian) against central
+ *          finite differences of the derivatives, outside Simulink.
+ *
+ *          vm_jacobian_test
+ *
+ *          The muscle of Virtual_Muscle_StandInBlock.h, 2 fiber types of 5 motor units (1 with FES, which
+ *          recruits one unit per fiber type), is simulated (Euler) with an activation stepping from 0 to
+ *          0.7 at 20 ms and to 0.2 at 150 ms and a sinusoidal path length, and the Jacobian is checked
+ *          during the rise (30 ms) and the fall (170 ms) of the transient. Every case runs with ZEROCROSS 1: the rise/fall and FV modes of
+ *          the work vector are those of the major step at the checked states and are held while the
+ *          states are perturbed, as VM_Jacobian holds them, so no perturbation crosses the rise/fall
+ *          switch. Column c of the finite differences perturbs state c by 1e-7 of its magnitude (at
+ *          least 1e-10), restoring the work vector before each evaluation of the outputs and
+ *          derivatives. A case fails if the number of entries is not VM_JACOBIAN_NZ, the rows of a
+ *          column are not increasing, a finite difference falls outside the sparsity pattern, or an
+ *          entry differs from its finite difference by more than JAC_TOL relative. The cases are the
+ *          recruitment types 2 (Natural Discrete), 3 (Natural Continuous) and 4 (FES) in both state
+ *          layouts. One line per case is written to stdout; the exit status is 1 if a case fails.
+ *
+ * Date: 10-17-26
+ *
+ * Build (from VirtualMuscle): cc -O2 -DVM_STANDALONE -IBenchmark -I. Benchmark/Virtual_Muscle_JacobianTest.c
+ *          Virtual_Muscle_Engine.c Virtual_Muscle_SIMD.c Virtual_Muscle_Threads.c Virtual_Muscle_Surrogate.c -lm
+ *          -lpthread -o vm_jacobian_test
+ */
+
+#include "Virtual_Muscle_SFunction.c"
+#include "Virtual_Muscle_StandInBlock.h"
+
+#define TEST_TYPES          2
+#define TEST_UNITS          5       //per fiber type, 1 with FES (RTYPE 4)
+#define SIM_STEP            1e-5    //s
+#define REL_STEP            1e-7    //finite difference step, relative to the state
+#define MIN_STEP            1e-10   //finite difference step of states near 0
+#define JAC_TOL             1e-4    //relative
+#define ABS_TOL             1e-8    //differences below it are not compared
+
+static const real_T Check_times[] = {0.03, 0.17};   //s, rise and fall of the activation
+#define NUM_TIMES ((int_T)(sizeof(Check_times)/sizeof(Check_times[0])))
+
+
+
+/* Function: SetInputs
+*  Description: Activation, path length and FES frequency at time t
+*/
+static void SetInputs(real_T *u, real_T t)
+{
+    u[0] = (t < 0.02) ? 0.0 : ((t < 0.15) ? 0.7 : 0.2);
+    u[1] = 0.155+0.01*sin(20.0*t);
+    u[2] = 40.0*u[0];
+}
+
+
+
+/* Function: Simulate
+*  Description: Forward Euler simulation from time *t to time End
+*/
+static void Simulate(SimStruct *S, real_T *u, real_T *t, real_T End)
+{
+    int_T i             = 0;
+
+    while(*t < End-0.5*SIM_STEP){
+        SetInputs(u, *t);
+        mdlOutputs(S, 0);
+        mdlDerivatives(S);
+        for(i=0; i<S->Num_cont_states; i++)
+            S->x[i] += SIM_STEP*S->dx[i];
+        *t += SIM_STEP;
+    }
+}
+
+
+
+/* Function: Derivatives
+*  Description: Derivatives dx at the states x with the work vector W0, whose modes are held
+*/
+static void Derivatives(SimStruct *S, const VM_MuscleSet *Set, const real_T *W0, real_T *x, real_T *dx)
+{
+    memcpy(S->RWork, W0, S->Num_rwork*sizeof(real_T));
+    VM_MuscleSetOutputs(Set, x, S->RWork, Set->u, Set->y);
+    VM_MuscleSetDerivatives(Set, x, S->RWork, Set->u, dx);
+}
+
+
+
+/* Function: CheckJacobian
+*  Description: Compares the Jacobian at the states of S with the finite differences. Returns the largest
+*              relative error, or -1 if the sparsity pattern is wrong (the reason in *Error).
+*/
+static real_T CheckJacobian(SimStruct *S, const char **Error)
+{
+    VM_MuscleSet *Set   = (VM_MuscleSet*)ssGetPWorkValue(S,0);
+    int_T n             = S->Num_cont_states;
+    int_T Nz            = 0;
+    int_T *Ir           = (int_T*)malloc(S->Jacobian_nz*sizeof(int_T));
+    int_T *Jc           = (int_T*)malloc((n+1)*sizeof(int_T));
+    real_T *Pr          = (real_T*)malloc(S->Jacobian_nz*sizeof(real_T));
+    real_T *x0          = (real_T*)malloc(n*sizeof(real_T));
+    real_T *xp          = (real_T*)malloc(n*sizeof(real_T));
+    real_T *dxp         = (real_T*)malloc(n*sizeof(real_T));
+    real_T *dxm         = (real_T*)malloc(n*sizeof(real_T));
+    real_T *Column      = (real_T*)malloc(n*sizeof(real_T));
+    real_T *W0          = (real_T*)malloc(S->Num_rwork*sizeof(real_T));
+    real_T Worst        = 0.0;
+    real_T e            = 0.0;
+    real_T fd           = 0.0;
+    real_T Diff         = 0.0;
+    int_T c             = 0;
+    int_T r             = 0;
+    int_T q             = 0;
+
+    *Error = NULL;
+    if (Ir == NULL || Jc == NULL || Pr == NULL || x0 == NULL || xp == NULL || dxp == NULL || dxm == NULL ||
+        Column == NULL || W0 == NULL) {
+        *Error = "Could not allocate the Jacobian";
+    }
+    if (*Error == NULL) {
+        //Modes of the major step at x0, then the Jacobian with the work vector they leave
+        mdlOutputs(S, 0);
+        mdlDerivatives(S);
+        memcpy(x0, S->x, n*sizeof(real_T));
+        memcpy(W0, S->RWork, S->Num_rwork*sizeof(real_T));
+        Nz = VM_MuscleSetJacobian(Set, x0, S->RWork, Set->u, Ir, Jc, Pr);
+        if (Nz != S->Jacobian_nz || Jc[n] != Nz) {
+            *Error = "wrong number of entries";
+        }
+    }
+    for(c=0; c<n && *Error == NULL; c++){
+        for(q=Jc[c]; q<Jc[c+1]; q++){
+            if (Ir[q] < 0 || Ir[q] >= n || (q > Jc[c] && Ir[q] <= Ir[q-1]))
+                *Error = "rows of a column out of range or not increasing";
+        }
+    }
+
+    for(c=0; c<n && *Error == NULL; c++){
+        e = REL_STEP*fabs(x0[c]);
+        if (e < MIN_STEP)
+            e = MIN_STEP;
+        memcpy(xp, x0, n*sizeof(real_T));
+        xp[c] = x0[c]+e;
+        Derivatives(S, Set, W0, xp, dxp);
+        xp[c] = x0[c]-e;
+        Derivatives(S, Set, W0, xp, dxm);
+
+        memset(Column, 0, n*sizeof(real_T));
+        for(q=Jc[c]; q<Jc[c+1]; q++)
+            Column[Ir[q]] = 1.0;
+        for(r=0; r<n; r++){
+            fd = (dxp[r]-dxm[r])/(2.0*e);
+            if (fd != 0.0 && Column[r] == 0.0)
+                *Error = "finite difference outside the sparsity pattern";
+        }
+        for(q=Jc[c]; q<Jc[c+1]; q++){
+            r = Ir[q];
+            fd = (dxp[r]-dxm[r])/(2.0*e);
+            Diff = fabs(fd-Pr[q]);
+            if (Diff > ABS_TOL && Diff/(fabs(fd)+fabs(Pr[q])) > Worst)
+                Worst = Diff/(fabs(fd)+fabs(Pr[q]));
+        }
+    }
+    memcpy(S->x, x0, n*sizeof(real_T));
+    memcpy(S->RWork, W0, S->Num_rwork*sizeof(real_T));
+
+    free(Ir);
+    free(Jc);
+    free(Pr);
+    free(x0);
+    free(xp);
+    free(dxp);
+    free(dxm);
+    free(Column);
+    free(W0);
+    return (*Error == NULL) ? Worst : -1.0;
+}
+
+
+
+/* Function: RunCase
+*  Description: Recruitment type Rtype in the state layout Layout. Returns the number of failed checks.
+*/
+static int_T RunCase(int_T Rtype, int_T Layout)
+{
+    SimStruct S;
+    BenchParams B;
+    real_T u[3]         = {0.0, 0.155, 0.0};
+    const real_T *Ptr[3];
+    const char *Error   = NULL;
+    real_T t            = 0.0;
+    real_T Worst        = 0.0;
+    int_T Started       = 0;
+    int_T Failures      = 0;
+    int_T k             = 0;
+
+    memset(&B, 0, sizeof(B));
+    Num_overrides       = 2;
+    Override_idx[0]     = STATELAYOUT_IDX;
+    Override_value[0]   = Layout;
+    Override_idx[1]     = ZEROCROSS_IDX;
+    Override_value[1]   = 1;
+    if (!BuildParams(&B, Rtype, TEST_TYPES, (Rtype == 4) ? 1 : TEST_UNITS)) {
+        fprintf(stderr, "Could not allocate the parameters\n");
+        return NUM_TIMES;
+    }
+    Started = OpenBlock(&S, &B, u, Ptr);
+    if (Started) {
+        SetInputs(u, 0.0);
+        mdlInitializeConditions(&S);
+        for(k=0; k<NUM_TIMES; k++){
+            Simulate(&S, u, &t, Check_times[k]);
+            SetInputs(u, t);
+            Worst = CheckJacobian(&S, &Error);
+            if (Error == NULL && Worst <= JAC_TOL) {
+                printf("RTYPE %d STATELAYOUT %d t %-5g largest relative error %-10.3g ok\n",
+                       (int)Rtype, (int)Layout, t, Worst);
+            }
+            else if (Error == NULL) {
+                printf("RTYPE %d STATELAYOUT %d t %-5g largest relative error %-10.3g FAILED\n",
+                       (int)Rtype, (int)Layout, t, Worst);
+                Failures++;
+            }
+            else {
+                printf("RTYPE %d STATELAYOUT %d t %-5g %s FAILED\n", (int)Rtype, (int)Layout, t, Error);
+                Failures++;
+            }
+        }
+    }
+    else {
+        printf("RTYPE %d STATELAYOUT %d %s FAILED\n", (int)Rtype, (int)Layout, S.Error);
+        Failures = NUM_TIMES;
+    }
+    CloseBlock(&S, Started);
+    free(B.Values);
+    return Failures;
+}
+
+
+
+int main(void)
+{
+    static const int_T Rtypes[] = {2, 3, 4};
+    int_T Failures      = 0;
+    int_T r             = 0;
+    int_T l             = 0;
+
+    for(r=0; r<3; r++){
+        for(l=VM_LAYOUT_INTERLEAVED; l<=VM_LAYOUT_SOA; l++){
+            Failures += RunCase(Rtypes[r], l);
+        }
+    }
+    printf("%d of %d cases failed\n", (int)Failures, (int)(3*2*NUM_TIMES));
+    return (Failures == 0) ? 0 : 1;
+}
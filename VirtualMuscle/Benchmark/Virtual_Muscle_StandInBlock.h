@@ -0,0 +1,199 @@
+/* VIRTUAL_MUSCLE_STANDINBLOCK.H
+ * Synopsis: S-function block outside Simulink, for the programs of this directory that include
+ *          Virtual_Muscle_SFunction.c (built against the stand-in simstruc.h): the parameters of a test
+ *          muscle, and the allocation of the SimStruct states, work vectors and ports.
+ *
+ *          The parameters are the BuildMuscles.m defaults for a 10 g muscle, with the slow and fast
+ *          twitch fiber types of the Virtual Muscle database alternating, equal fractional PCSA and
+ *          the default apportion method. Scalar parameters may be overridden by their index (see
+ *          Virtual_Muscle_Params.h), Num_overrides of them. SURROGATE is '' (the full model); a surrogate
+ *          block points Param[SURROGATE_IDX].str at the table file and sets .n to its length.
+ *
+ * Date: 10-17-26
+ */
+
+#ifndef VIRTUAL_MUSCLE_STANDINBLOCK_H
+#define VIRTUAL_MUSCLE_STANDINBLOCK_H
+
+#define MAX_OVERRIDES       16
+
+//Slow and fast twitch fiber types, in the order of RRANK_IDX .. CH3_IDX (RRANK is the fiber type number)
+static const real_T Slow_fiber[CH3_IDX-RRANK_IDX+1] = {
+    0, 0, 8.5, 0.5, 2, 1.26, 2.30, 1.62, -7.88, 5.88, 0, -4.70, 8.41, -5.34, 0.35, 0.56, 2.1, 5,
+    0.088, 34.3, 22.7, 47.0, 25.2, 1, 1, 43, 0.35, 0.1, 200, 0, 0, 0, 0};
+static const real_T Fast_fiber[CH3_IDX-RRANK_IDX+1] = {
+    0, 0, 34, 0.5, 2, 0.75, 1.55, 2.12, -9.15, -5.7, 9.18, -1.53, 0, 0, 0.69, 0.56, 2.1, 3.3,
+    0.088, 20.6, 13.6, 28.2, 15.1, 1.76, 0.96, 43, 0, 0, 0, 0, 0, 0, 0};
+
+//Parameters of one block: one block of values per parameter
+typedef struct {
+    mxArray Param[NPARAMS_SFUNCTION];
+    real_T* Values;
+} BenchParams;
+
+static int_T Num_overrides = 0;
+static int_T Override_idx[MAX_OVERRIDES];
+static real_T Override_value[MAX_OVERRIDES];
+
+
+
+/* Function: SetParam
+*  Description: Points parameter k at the next n values of the block
+*/
+static real_T* SetParam(BenchParams *B, int_T k, real_T **Next, int_T n)
+{
+    B->Param[k].pr  = *Next;
+    B->Param[k].n   = n;
+    *Next          += n;
+    return B->Param[k].pr;
+}
+
+
+
+/* Function: BuildParams
+*  Description: Parameters of a muscle of Types fiber types of Units motor units each. Returns 0 if the
+*              allocation fails.
+*/
+static int_T BuildParams(BenchParams *B, int_T Rtype, int_T Types, int_T Units)
+{
+    real_T *Next    = NULL;
+    real_T *v       = NULL;
+    real_T Sum      = 0.0;
+    int_T i         = 0;
+    int_T k         = 0;
+
+    B->Values = (real_T*)calloc(NPARAMS + 5 + (CH3_IDX-RRANK_IDX+4)*Types + Types*Units, sizeof(real_T));
+    if (B->Values == NULL) {
+        return 0;
+    }
+    Next = B->Values;
+
+    //General parameters (BuildFiberTypes.m defaults)
+    *SetParam(B, TOFMUSFIB_IDX, &Next, 1) = Types;
+    *SetParam(B, SARCLEN_IDX, &Next, 1) = 2.4;
+    *SetParam(B, SPTEN_IDX, &Next, 1)   = 31.8;
+    *SetParam(B, VISC_IDX, &Next, 1)    = 0.01;
+    *SetParam(B, C1_IDX, &Next, 1)      = 23;
+    *SetParam(B, K1_IDX, &Next, 1)      = 0.046;
+    *SetParam(B, LR1_IDX, &Next, 1)     = 1.17;
+    *SetParam(B, C2_IDX, &Next, 1)      = -0.02;
+    *SetParam(B, K2_IDX, &Next, 1)      = -18.7;
+    *SetParam(B, LR2_IDX, &Next, 1)     = 0.79;
+    *SetParam(B, CT_IDX, &Next, 1)      = 27.8;
+    *SetParam(B, KT_IDX, &Next, 1)      = 0.0047;
+    *SetParam(B, LRT_IDX, &Next, 1)     = 0.964;
+
+    //Fiber types, slow and fast alternating
+    for(k=RRANK_IDX; k<=CH3_IDX; k++){
+        v = SetParam(B, k, &Next, Types);
+        for(i=0; i<Types; i++){
+            v[i] = (i%2 == 0) ? Slow_fiber[k-RRANK_IDX] : Fast_fiber[k-RRANK_IDX];
+        }
+        if (k == RRANK_IDX) {
+            for(i=0; i<Types; i++)
+                v[i] = i+1;
+        }
+    }
+
+    //Muscle (BuildMuscles.m defaults)
+    *SetParam(B, RTYPE_IDX, &Next, 1)   = Rtype;
+    v = SetParam(B, ADDPORTS_IDX, &Next, 5);
+    v[0] = 1;                                       //Force (N) only
+    *SetParam(B, MMASS_IDX, &Next, 1)   = 10;
+    *SetParam(B, FASCL0_IDX, &Next, 1)  = 5;
+    *SetParam(B, TENDL0T_IDX, &Next, 1) = 10;
+    *SetParam(B, LPATH_IDX, &Next, 1)   = 16;
+    *SetParam(B, UR_IDX, &Next, 1)      = 0.8;
+    v = SetParam(B, NUMOFUNITS_IDX, &Next, Types);
+    for(i=0; i<Types; i++)
+        v[i] = Units;
+    v = SetParam(B, FPCSA_IDX, &Next, Types);       //equal, adding up to 1 exactly
+    for(i=0; i+1<Types; i++){
+        v[i] = 1.0/Types;
+        Sum += v[i];
+    }
+    v[Types-1] = 1.0-Sum;
+    SetParam(B, UPCSA_IDX, &Next, Types*Units);     //set by the apportion method
+    *SetParam(B, APPORTMTD_IDX, &Next, 1) = 2;      //Default algorithm
+    *SetParam(B, GEOPCSA_IDX, &Next, 1) = 0;
+
+    //Optional parameters at their defaults, then the overrides
+    *SetParam(B, STATELAYOUT_IDX, &Next, 1) = 1;
+    *SetParam(B, CURVETOL_IDX, &Next, 1) = 0;
+    *SetParam(B, NUMMUSCLES_IDX, &Next, 1) = 1;
+    *SetParam(B, MUSTEP_IDX, &Next, 1) = 0;
+    *SetParam(B, MULTIRATE_IDX, &Next, 1) = 0;
+    *SetParam(B, ACTIVETOL_IDX, &Next, 1) = 0;
+    *SetParam(B, ZEROCROSS_IDX, &Next, 1) = 0;
+    *SetParam(B, NUMTHREADS_IDX, &Next, 1) = 1;
+    *SetParam(B, PRECISION_IDX, &Next, 1) = 1;
+    *SetParam(B, INITSTATE_IDX, &Next, 1) = 1;
+    B->Param[SURROGATE_IDX].str = "";
+    B->Param[SURROGATE_IDX].n   = 0;
+    for(k=0; k<Num_overrides; k++){
+        B->Param[Override_idx[k]].pr[0] = Override_value[k];
+    }
+    return 1;
+}
+
+
+
+/* Function: OpenBlock
+*  Description: Block of the parameters B with the inputs u[3] (activation, path length, frequency):
+*              sizes, states, work vectors and ports, then mdlStart. Returns 0, with the reason in
+*              S->Error, on error; CloseBlock frees what was allocated in either case.
+*/
+static int_T OpenBlock(SimStruct *S, BenchParams *B, real_T *u, const real_T **Ptr)
+{
+    int_T k             = 0;
+
+    memset(S, 0, sizeof(*S));
+    S->Num_params = NPARAMS_SFUNCTION;
+    for(k=0; k<NPARAMS_SFUNCTION; k++)
+        S->Params[k] = &B->Param[k];
+    for(k=0; k<3; k++){
+        Ptr[k] = &u[k];
+        S->Input[k] = &Ptr[k];
+    }
+
+    mdlInitializeSizes(S);
+    if (S->Error == NULL) {
+        S->x     = (real_T*)calloc(S->Num_cont_states, sizeof(real_T));
+        S->dx    = (real_T*)calloc(S->Num_cont_states, sizeof(real_T));
+        S->xd    = (real_T*)calloc(S->Num_disc_states+1, sizeof(real_T));
+        S->RWork = (real_T*)calloc(S->Num_rwork, sizeof(real_T));
+        S->PWork = (void**)calloc(S->Num_pwork, sizeof(void*));
+        for(k=0; k<S->Num_outputs; k++)
+            S->Output[k] = (real_T*)calloc(S->Output_width[k], sizeof(real_T));
+        if (S->x == NULL || S->dx == NULL || S->xd == NULL || S->RWork == NULL || S->PWork == NULL) {
+            S->Error = "Could not allocate the states and work vectors";
+        }
+    }
+    if (S->Error == NULL) {
+        mdlInitializeSampleTimes(S);
+        mdlStart(S);
+    }
+    return S->Error == NULL;
+}
+
+
+
+/* Function: CloseBlock
+*  Description: mdlTerminate if the block was started (Started), then frees the block of OpenBlock
+*/
+static void CloseBlock(SimStruct *S, int_T Started)
+{
+    int_T k             = 0;
+
+    if (Started)
+        mdlTerminate(S);
+    free(S->x);
+    free(S->dx);
+    free(S->xd);
+    free(S->RWork);
+    free(S->PWork);
+    for(k=0; k<S->Num_outputs; k++)
+        free(S->Output[k]);
+}
+
+#endif /* VIRTUAL_MUSCLE_STANDINBLOCK_H */
@@ -0,0 +1,258 @@
+/* VIRTUAL_MUSCLE_TUNABLETEST.C
+ * Synopsis: Test of the tunable parameters of the S-function outside Simulink: a recruitment parameter
+ *          changed during the simulation must change the recruitment even if the activation input
+ *          stays constant (the last recruitment is cached in RWork, see VM_InvalidateRecruitment).
+ *
+ *          vm_tunable_test
+ *
+ *          The muscle of Virtual_Muscle_StandInBlock.h, Natural Discrete recruitment (RTYPE 2) with 2
+ *          fiber types of 50 motor units, is simulated for 20 ms (Euler) at a constant activation of
+ *          0.5. UR, FMIN, FMAX or RRANK is then changed, as Simulink does, by rewriting the parameter
+ *          and calling mdlProcessParameters, and mdlOutputs is called at the same activation. The fenv
+ *          values of the work vector must be those of the thresholds, slopes and Fmin of the rebuilt
+ *          model, and differ from the ones before the change. Every case runs with every motor unit
+ *          evaluated (ACTIVETOL 0) and with the active set (ACTIVETOL 1e-3).
+ *
+ *          The threaded motor unit loops (NUMTHREADS) must not change the results: a muscle of 2 fiber
+ *          types of 300 motor units, enough for the pool to be used (VM_THREAD_MIN_MUNITS), is
+ *          simulated for 20 ms (Euler) with NUMTHREADS 1 and 4 side by side, with the activation
+ *          ramping from 0 to 1, at both activation tolerances. The states and the force must be equal
+ *          bit for bit after every step.
+ *
+ *          One line per case is written to stdout; the exit status is 1 if a case fails.
+ *
+ * Date: 10-17-26
+ *
+ * Build (from VirtualMuscle): cc -O2 -DVM_STANDALONE -IBenchmark -I. Benchmark/Virtual_Muscle_TunableTest.c
+ *          Virtual_Muscle_Engine.c Virtual_Muscle_SIMD.c Virtual_Muscle_Threads.c Virtual_Muscle_Surrogate.c -lm
+ *          -lpthread -o vm_tunable_test
+ */
+
+#include "Virtual_Muscle_SFunction.c"
+#include "Virtual_Muscle_StandInBlock.h"
+
+#define TEST_TYPES          2
+#define TEST_UNITS          50      //per fiber type
+#define TEST_ACT            0.5
+#define WARMUP_TIME         0.02    //s
+#define WARMUP_STEP         1e-5    //s
+#define FENV_TOL            1e-12   //pps/f05
+#define THREAD_UNITS        300     //per fiber type, VM_THREAD_MIN_MUNITS in all
+#define THREAD_COUNT        4
+
+//Parameter change of a case: every value of parameter Param times Scale, plus Offset
+typedef struct {
+    const char* Name;
+    int_T   Param;
+    real_T  Scale;
+    real_T  Offset;
+} TunableCase;
+
+static const TunableCase Cases[] = {
+    {"UR",      UR_IDX,     0.75,  0.0},
+    {"FMIN",    FMIN_IDX,   1.5,   0.0},
+    {"FMAX",    FMAX_IDX,   0.8,   0.0},
+    {"RRANK",   RRANK_IDX,  1.0,  10.0}
+};
+#define NUM_CASES ((int_T)(sizeof(Cases)/sizeof(Cases[0])))
+
+
+
+/* Function: Warmup
+*  Description: Forward Euler simulation at the constant activation of u
+*/
+static void Warmup(SimStruct *S)
+{
+    int_T Steps         = (int_T)(WARMUP_TIME/WARMUP_STEP+0.5);
+    int_T s             = 0;
+    int_T i             = 0;
+
+    for(s=0; s<Steps; s++){
+        mdlOutputs(S, 0);
+        mdlDerivatives(S);
+        for(i=0; i<S->Num_cont_states; i++)
+            S->x[i] += WARMUP_STEP*S->dx[i];
+    }
+}
+
+
+
+/* Function: RecruitmentError
+*  Description: Largest difference between fenv of the work vector and the Natural Discrete recruitment of
+*              the model at the activation Act; *Changed is set if fenv differs from Before
+*/
+static real_T RecruitmentError(const VM_MuscleModel *Model, const real_T *fenv, real_T Act, const real_T *Before,
+                               int_T *Changed)
+{
+    real_T Expected     = 0.0;
+    real_T Error        = 0.0;
+    int_T j             = 0;
+
+    *Changed = 0;
+    for(j=0; j<Model->Total_Munits; j++){
+        Expected = (Act >= Model->Threshold[j]) ? Model->fenv_slope[j]*(Act-Model->Threshold[j])+Model->Unit_Fmin[j]
+                                                : 0.0;
+        if (fabs(fenv[j]-Expected) > Error)
+            Error = fabs(fenv[j]-Expected);
+        if (fenv[j] != Before[j])
+            *Changed = 1;
+    }
+    return Error;
+}
+
+
+
+/* Function: RunCase
+*  Description: One parameter change at the activation tolerance Active_tol. Returns 0 if it fails.
+*/
+static int_T RunCase(const TunableCase *C, real_T Active_tol)
+{
+    SimStruct S;
+    BenchParams B;
+    VM_MuscleSet *Set   = NULL;
+    real_T u[3]         = {TEST_ACT, 0.155, 0.0};
+    const real_T *Ptr[3];
+    real_T Before[TEST_TYPES*TEST_UNITS];
+    real_T *fenv        = NULL;
+    real_T Error        = 0.0;
+    int_T Changed       = 0;
+    int_T Started       = 0;
+    int_T Ok            = 0;
+    int_T k             = 0;
+
+    memset(&B, 0, sizeof(B));
+    Num_overrides       = 1;
+    Override_idx[0]     = ACTIVETOL_IDX;
+    Override_value[0]   = Active_tol;
+    if (!BuildParams(&B, 2, TEST_TYPES, TEST_UNITS)) {
+        fprintf(stderr, "Could not allocate the parameters\n");
+        return 0;
+    }
+    Started = OpenBlock(&S, &B, u, Ptr);
+    if (Started) {
+        mdlInitializeConditions(&S);
+        Warmup(&S);
+        Set = (VM_MuscleSet*)ssGetPWorkValue(&S,0);
+        fenv = S.RWork+Set->Work_offset[0]+VM_WORK_FENV(Set->Model[0]->Total_Munits);
+        memcpy(Before, fenv, sizeof(Before));
+
+        //The tunable parameter changes, the activation does not
+        for(k=0; k<(int_T)B.Param[C->Param].n; k++)
+            B.Param[C->Param].pr[k] = B.Param[C->Param].pr[k]*C->Scale+C->Offset;
+        mdlProcessParameters(&S);
+    }
+    if (S.Error == NULL) {
+        mdlOutputs(&S, 0);
+        Set = (VM_MuscleSet*)ssGetPWorkValue(&S,0);
+        fenv = S.RWork+Set->Work_offset[0]+VM_WORK_FENV(Set->Model[0]->Total_Munits);
+        Error = RecruitmentError(Set->Model[0], fenv, TEST_ACT, Before, &Changed);
+        Ok = (Error <= FENV_TOL && Changed);
+        printf("%-6s ACTIVETOL %-6g fenv error %-10.3g %s%s\n", C->Name, Active_tol, Error,
+               Changed ? "" : "(fenv unchanged) ", Ok ? "ok" : "FAILED");
+    }
+    else {
+        printf("%-6s ACTIVETOL %-6g %s FAILED\n", C->Name, Active_tol, S.Error);
+    }
+    CloseBlock(&S, Started);
+    free(B.Values);
+    return Ok;
+}
+
+
+
+/* Function: OpenThreadBlock
+*  Description: Block of the threads case with Num_threads threads at the activation tolerance Active_tol
+*/
+static int_T OpenThreadBlock(SimStruct *S, BenchParams *B, real_T *u, const real_T **Ptr, int_T Num_threads,
+                             real_T Active_tol)
+{
+    memset(B, 0, sizeof(*B));
+    Num_overrides       = 2;
+    Override_idx[0]     = ACTIVETOL_IDX;
+    Override_value[0]   = Active_tol;
+    Override_idx[1]     = NUMTHREADS_IDX;
+    Override_value[1]   = Num_threads;
+    if (!BuildParams(B, 2, TEST_TYPES, THREAD_UNITS)) {
+        memset(S, 0, sizeof(*S));
+        S->Error = "Could not allocate the parameters";
+        return 0;
+    }
+    return OpenBlock(S, B, u, Ptr);
+}
+
+
+
+/* Function: RunThreadCase
+*  Description: NUMTHREADS 1 and THREAD_COUNT side by side at the activation tolerance Active_tol. Returns 0
+*              if they differ.
+*/
+static int_T RunThreadCase(real_T Active_tol)
+{
+    SimStruct S[2];
+    BenchParams B[2];
+    real_T u[2][3]      = {{0.0, 0.155, 0.0}, {0.0, 0.155, 0.0}};
+    const real_T *Ptr[2][3];
+    const char *Error   = NULL;
+    int_T Steps         = (int_T)(WARMUP_TIME/WARMUP_STEP+0.5);
+    int_T Started[2]    = {0, 0};
+    int_T Differ        = -1;   //first step whose results differ
+    int_T s             = 0;
+    int_T b             = 0;
+    int_T i             = 0;
+
+    Started[0] = OpenThreadBlock(&S[0], &B[0], u[0], Ptr[0], 1, Active_tol);
+    Started[1] = OpenThreadBlock(&S[1], &B[1], u[1], Ptr[1], THREAD_COUNT, Active_tol);
+    Error = (S[0].Error != NULL) ? S[0].Error : S[1].Error;
+    if (Error == NULL && ssGetPWorkValue(&S[1],1) == NULL)
+        Error = "no thread pool";
+    if (Error == NULL) {
+        for(b=0; b<2; b++)
+            mdlInitializeConditions(&S[b]);
+        for(s=0; s<Steps && Differ < 0; s++){
+            for(b=0; b<2; b++){
+                u[b][0] = (real_T)s/Steps;
+                mdlOutputs(&S[b], 0);
+                mdlDerivatives(&S[b]);
+                for(i=0; i<S[b].Num_cont_states; i++)
+                    S[b].x[i] += WARMUP_STEP*S[b].dx[i];
+            }
+            if (memcmp(S[0].x, S[1].x, S[0].Num_cont_states*sizeof(real_T)) != 0 ||
+                memcmp(S[0].Output[0], S[1].Output[0], S[0].Output_width[0]*sizeof(real_T)) != 0)
+                Differ = s;
+        }
+        if (Differ < 0)
+            printf("NUMTHREADS 1 and %d ACTIVETOL %-6g states and force equal ok\n", THREAD_COUNT, Active_tol);
+        else
+            printf("NUMTHREADS 1 and %d ACTIVETOL %-6g states or force differ at step %d FAILED\n",
+                   THREAD_COUNT, Active_tol, (int)Differ);
+    }
+    else {
+        printf("NUMTHREADS 1 and %d ACTIVETOL %-6g %s FAILED\n", THREAD_COUNT, Active_tol, Error);
+    }
+    for(b=0; b<2; b++){
+        CloseBlock(&S[b], Started[b]);
+        free(B[b].Values);
+    }
+    return Error == NULL && Differ < 0;
+}
+
+
+
+int main(void)
+{
+    static const real_T Active_tols[] = {0.0, 1e-3};
+    int_T Failures      = 0;
+    int_T c             = 0;
+    int_T a             = 0;
+
+    for(c=0; c<NUM_CASES; c++){
+        for(a=0; a<2; a++){
+            Failures += !RunCase(&Cases[c], Active_tols[a]);
+        }
+    }
+    for(a=0; a<2; a++){
+        Failures += !RunThreadCase(Active_tols[a]);
+    }
+    printf("%d of %d cases failed\n", (int)Failures, (int)(2*NUM_CASES+2));
+    return (Failures == 0) ? 0 : 1;
+}
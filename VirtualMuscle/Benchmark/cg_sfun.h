@@ -0,0 +1,47 @@
+/* CG_SFUN.H (benchmark stand-in)
+ * Synopsis: Stand-in for the Simulink code generation registration included at the end of
+ *          Virtual_Muscle_SFunction.c. The programs of this directory call the callbacks themselves.
+ *
+ * Date: 10-17-26
+ */
+
+//Every callback is registered, as the real registration does; the programs call them directly
+typedef struct {
+    void (*InitializeSizes)(SimStruct *S);
+    void (*InitializeSampleTimes)(SimStruct *S);
+    void (*Outputs)(SimStruct *S, int_T tid);
+    void (*Update)(SimStruct *S, int_T tid);
+    void (*Other[7])(SimStruct *S);
+} VM_StandIn_Callbacks;
+
+const VM_StandIn_Callbacks VM_StandIn_callbacks = {
+    mdlInitializeSizes,
+    mdlInitializeSampleTimes,
+    mdlOutputs,
+#if defined(MDL_UPDATE)
+    mdlUpdate,
+#else
+    NULL,
+#endif
+    {
+#if defined(MDL_INITIALIZE_CONDITIONS)
+        mdlInitializeConditions,
+#endif
+#if defined(MDL_PROCESS_PARAMETERS)
+        mdlProcessParameters,
+#endif
+#if defined(MDL_START)
+        mdlStart,
+#endif
+#if defined(MDL_DERIVATIVES)
+        mdlDerivatives,
+#endif
+#if defined(MDL_ZERO_CROSSINGS)
+        mdlZeroCrossings,
+#endif
+#if defined(MDL_JACOBIAN)
+        mdlJacobian,
+#endif
+        mdlTerminate
+    }
+};
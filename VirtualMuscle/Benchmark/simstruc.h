@@ -0,0 +1,104 @@
+/* SIMSTRUC.H (benchmark stand-in)
+ * Synopsis: Minimal stand-in for the Simulink simstruc.h and mxArray, enough to build
+ *          Virtual_Muscle_SFunction.c natively for Virtual_Muscle_Benchmark.c. The SimStruct only
+ *          holds what the S-function uses: parameters, states, work vectors, ports and the sample
+ *          hit flag; every call is a major time step. Sizes, sample times and options are recorded or ignored, as the benchmark
+ *          calls the callbacks itself.
+ *
+ * Date: 10-17-26
+ */
+
+#ifndef SIMSTRUC_H
+#define SIMSTRUC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Virtual_Muscle_Types.h"
+
+#define SS_MAX_PARAMS   69
+#define SS_MAX_PORTS    5
+
+typedef const real_T* const* InputRealPtrsType;
+
+typedef struct {
+    real_T* pr;
+    size_t  n;
+    const char* str;                    //Char arrays (SURROGATE), NULL for the others
+} mxArray;
+
+#define mxGetPr(a)                  ((a)->pr)
+#define mxIsDouble(a)               ((a)->str == NULL)
+#define mxIsChar(a)                 ((a)->str != NULL)
+#define mxGetNumberOfElements(a)    ((a)->n)
+#define mxGetString(a,buf,len)      (snprintf((buf), (len), "%s", (a)->str) >= (int)(len))
+
+#define CONTINUOUS_SAMPLE_TIME          0.0
+#define SS_OPTION_EXCEPTION_FREE_CODE   1
+
+typedef struct SimStruct {
+    const mxArray*  Params[SS_MAX_PARAMS];
+    int_T           Num_params;         //Parameters given to the block
+    int_T           Num_params_expected;
+    const char*     Error;
+    int_T           Num_cont_states;
+    int_T           Num_disc_states;
+    int_T           Num_rwork;
+    int_T           Num_pwork;
+    int_T           Num_inputs;
+    int_T           Num_outputs;
+    int_T           Input_width[SS_MAX_PORTS];
+    int_T           Output_width[SS_MAX_PORTS];
+    int_T           Jacobian_nz;
+    int_T           Num_zcs;
+    real_T*         x;                  //Continuous states
+    real_T*         dx;
+    real_T*         xd;                 //Discrete states
+    real_T*         RWork;
+    void**          PWork;
+    const real_T**  Input[SS_MAX_PORTS];   //One pointer per element
+    real_T*         Output[SS_MAX_PORTS];
+    int_T           Sample_hit;         //ssIsSampleHit of the motor unit sample time
+} SimStruct;
+
+#define ssGetSFcnParam(S,i)                         ((S)->Params[i])
+#define ssGetSFcnParamsCount(S)                     ((S)->Num_params)
+#define ssSetNumSFcnParams(S,n)                     ((S)->Num_params_expected = (n))
+#define ssGetNumSFcnParams(S)                       ((S)->Num_params_expected)
+#define ssSetErrorStatus(S,msg)                     ((S)->Error = (msg))
+#define UNUSED_ARG(arg)                             ((void)(arg))
+#define ssPrintf                                    printf
+
+#define ssSetNumContStates(S,n)                     ((S)->Num_cont_states = (n))
+#define ssSetNumDiscStates(S,n)                     ((S)->Num_disc_states = (n))
+#define ssSetNumInputPorts(S,n)                     ((S)->Num_inputs = (n), (n) <= SS_MAX_PORTS)
+#define ssSetInputPortWidth(S,p,w)                  ((S)->Input_width[p] = (w))
+#define ssSetInputPortDirectFeedThrough(S,p,f)      ((void)0)
+#define ssSetNumOutputPorts(S,n)                    ((S)->Num_outputs = (n), (n) <= SS_MAX_PORTS)
+#define ssSetOutputPortWidth(S,p,w)                 ((S)->Output_width[p] = (w))
+#define ssSetNumRWork(S,n)                          ((S)->Num_rwork = (n))
+#define ssSetNumPWork(S,n)                          ((S)->Num_pwork = (n))
+#define ssSetJacobianNzMax(S,n)                     ((S)->Jacobian_nz = (n))
+#define ssSetNumNonsampledZCs(S,n)                  ((S)->Num_zcs = (n))
+#define ssSetNumSampleTimes(S,n)                    ((void)0)
+#define ssSetSampleTime(S,i,t)                      ((void)0)
+#define ssSetOffsetTime(S,i,t)                      ((void)0)
+#define ssSetModelReferenceSampleTimeDefaultInheritance(S) ((void)0)
+#define ssSetOptions(S,o)                           ((void)0)
+#define ssIsSampleHit(S,i,tid)                      ((S)->Sample_hit)
+#define ssIsMajorTimeStep(S)                        1
+
+#define ssGetContStates(S)                          ((S)->x)
+#define ssGetdX(S)                                  ((S)->dx)
+#define ssGetRealDiscStates(S)                      ((S)->xd)
+#define ssGetRWork(S)                               ((S)->RWork)
+#define ssGetPWorkValue(S,i)                        ((S)->PWork[i])
+#define ssSetPWorkValue(S,i,v)                      ((S)->PWork[i] = (v))
+#define ssGetInputPortRealSignalPtrs(S,p)           ((InputRealPtrsType)(S)->Input[p])
+#define ssGetOutputPortRealSignal(S,p)              ((S)->Output[p])
+#define ssGetJacobianIr(S)                          ((int_T*)NULL)
+#define ssGetJacobianJc(S)                          ((int_T*)NULL)
+#define ssGetJacobianPr(S)                          ((real_T*)NULL)
+#define ssGetNonsampledZCs(S)                       ((real_T*)NULL)
+
+#endif /* SIMSTRUC_H */
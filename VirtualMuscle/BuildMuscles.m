@@ -1522,6 +1522,49 @@ global Muscle_Model_Parameters
 % CREATE SIMULINK Muscle_Block Using S-function
 %<DSadd1> 12/2007 - Modification for adding s-function to VM 
 function systemname = Create_sfun(selection)
+
+       sfunParameters = Sfun_Parameters(selection);
+
+       % Create Simulink Block
+       % Note: - Refer CreateSimulinkBlock_sfun.m
+       systemname = CreateSimulinkBlock_sfun(sfunParameters,selection);
+
+
+% CREATE ONE SIMULINK Muscle_Block FOR SEVERAL MUSCLES Using S-function
+% The parameters of the muscles are packed into one parameter set (see Virtual_Muscle_Params.h):
+% the block-level parameters are taken from the first muscle, the others are concatenated
+% muscle by muscle, and the ports of the block carry one element per muscle.
+function systemname = Create_sfun_multi(selection)
+
+    blockfields = [1 2 59 60 62 63 64 65 66 67 68 69]; %Recruitment Type, Additional Ports, State Layout, FL Table Error, MU Sample Time, Multirate, Rest Tolerance, Zero Crossings, Threads, Precision, Initial States, Surrogate Table
+    nummusclesfield = 61;
+
+    for i=1:length(selection)
+        fields(i,:) = strread(Sfun_Parameters(selection(i)),'%s','delimiter','|')';
+    end
+
+    sfunParameters = '';
+    for k=1:size(fields,2)
+        if any(k == blockfields)
+            value = fields{1,k};
+        elseif k == nummusclesfield
+            value = num2str(length(selection));
+        else
+            value = ['[' strrep(strrep(sprintf('%s ',fields{:,k}),'[',''),']','') ']'];
+        end
+        if k < size(fields,2)
+            sfunParameters = [sfunParameters value '|'];
+        else
+            sfunParameters = [sfunParameters value];
+        end
+    end
+
+    systemname = CreateSimulinkBlock_sfun(sfunParameters,selection);
+
+
+% S-FUNCTION PARAMETERS OF ONE MUSCLE
+% Returns the mask parameter string of muscle 'selection' (see CreateSimulinkBlock_sfun.m)
+function sfunParameters = Sfun_Parameters(selection)
 global Muscle_Morph   Muscle_Model_Parameters  BM_FTD_General_Parameters BM_Fiber_Type_Database Totalnumberfibertypes_sfunc sfunc_increase 
             
     % Extract number of fiber types and index of fiber types:     
@@ -1534,7 +1577,7 @@ global Muscle_Morph   Muscle_Model_Parameters  BM_FTD_General_Parameters BM_Fibe
     end
     numberfibertypes_sfunc=length(index_sfunc);
 
-    % Extract parameters to be passed to the S-Function (Total Parameters - 58)
+    % Extract parameters to be passed to the S-Function (Total Parameters - 69)
     % Note: - Refer Virtual_Muscle_SFunction.c for the list of parameters - 
 
     bb1=[BM_Fiber_Type_Database.Recruitment_Rank];
@@ -1616,7 +1659,19 @@ global Muscle_Morph   Muscle_Model_Parameters  BM_FTD_General_Parameters BM_Fibe
       end
     end
 
-    % - Assign values to all parameters passed to the S-Function (Total Parameters - 58) 
+    bb40 = 1; %Motor unit state layout (1-Interleaved, 2-Structure of arrays)
+    bb41 = 0; %Maximum FL table error (0-Exact curves)
+    bb42 = 1; %Number of muscles (see Create_sfun_multi)
+    bb43 = 0; %Motor unit sample time (0-Continuous)
+    bb44 = 0; %Multirate, recruitment and Af held between motor unit updates (0-No, 1-Yes)
+    bb45 = 0; %Motor unit rest tolerance of fint and feff (0-All units evaluated, >0-Approximate: units below it have Af 0)
+    bb46 = 0; %Zero crossing detection of the rise/fall and FV branches (0-No, 1-Yes)
+    bb47 = 1; %Threads of the motor unit loops (1-Serial)
+    bb48 = 1; %Precision of the motor unit kernels (1-Double, 2-Single)
+    bb49 = 1; %Initial states (1-Resting, 2-Steady state at the initial inputs)
+    bb50 = ''''''; %Surrogate table file ('' - Full model, see Virtual_Muscle_Surrogate.h)
+
+    % - Assign values to all parameters passed to the S-Function (Total Parameters - 69) 
     % Note, the order of parameters below corresponds to the order in the mask NOT the
     % order in the s-function!
                                      
@@ -1677,11 +1732,18 @@ global Muscle_Morph   Muscle_Model_Parameters  BM_FTD_General_Parameters BM_Fibe
           ['[' num2str(bb30(index_sfunc)) ']|']...%ch0(v)
           ['[' num2str(bb31(index_sfunc)) ']|']...%ch1 (v)
           ['[' num2str(bb32(index_sfunc)) ']|']...%ch2 (v)
-          ['[' num2str(bb33(index_sfunc)) ']']]; %ch3 (v)                                          
-              
-       % Create Simulink Block
-       % Note: - Refer CreateSimulinkBlock_sfun.m       
-       systemname = CreateSimulinkBlock_sfun(sfunParameters,selection);
+          ['[' num2str(bb33(index_sfunc)) ']|']... %ch3 (v)
+          [num2str(bb40) '|']... %Motor unit state layout (s)
+          [num2str(bb41) '|']... %Maximum FL table error (s)
+          [num2str(bb42) '|']... %Number of muscles (s)
+          [num2str(bb43) '|']... %Motor unit sample time (s)
+          [num2str(bb44) '|']... %Multirate (s)
+          [num2str(bb45) '|']... %Motor unit rest tolerance (s)
+          [num2str(bb46) '|']... %Zero crossing detection (s)
+          [num2str(bb47) '|']... %Threads of the motor unit loops (s)
+          [num2str(bb48) '|']... %Precision of the motor unit kernels (s)
+          [num2str(bb49) '|']... %Initial states (s)
+          [bb50]]; %Surrogate table file (s)
 
        
 %<DSadd1> 12/2007 - End of Create_sfun
@@ -1711,6 +1773,17 @@ global Muscle_Morph   Muscle_Model_Parameters  BM_FTD_General_Parameters BM_Fibe
         pleasewaitmsgbox = msgbox('Creating Simulink Muscle Blocks.  Please wait...');
         pause(0.1);		%This pause is necessary to ensure that the dialog box actually displays...
           
+        %S-function blocks can simulate several muscles in one block with vector ports
+        if length(selection) > 1 & ~strcmp(Muscle_Model_Parameters.Recruitment_Type,'Natural')
+            buttonname=questdlg('Create one muscle block for all the selected muscles (vector ports) or one block per muscle?',...
+                'Create block','One block','One block per muscle','One block per muscle');
+            if strcmp(buttonname,'One block')
+                systemname=Create_sfun_multi(selection);
+                open_system(systemname);
+                selection=[];
+            end
+        end
+
         for i=1:length(selection)        
               if strcmp(Muscle_Model_Parameters.Recruitment_Type,'Natural')
                   systemname=CreateSimulinkBlock(selection(i));
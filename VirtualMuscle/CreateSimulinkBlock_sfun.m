@@ -4,18 +4,25 @@
 % Authors: Giby Raphael & Dan Song (1-8-8) 
 
 function systemname=CreateSimulinkBlock_sfun(sfunParameters, musclenumber)
+%musclenumber may list several muscles; sfunParameters then packs all of them (see
+%Create_sfun_multi in BuildMuscles.m) and the ports of the block are vectors, one element per muscle
 global Muscle_Morph Muscle_Model_Parameters
 
 Recruitment_sfunc=[{'Natural'} {'Natural Discrete (s-function)'} {'Natural Continuous (s-function)'} {'Intramuscular FES (s-function)'}]; 
 
 systemhandle=new_system;	
 systemname=get_param(systemhandle,'name');	
-sys=[systemname,'/',[Muscle_Morph(musclenumber).Muscle_Name]];
+if length(musclenumber) > 1
+    sys=[systemname,'/',sprintf('%s_',Muscle_Morph(musclenumber(1:end-1)).Muscle_Name),Muscle_Morph(musclenumber(end)).Muscle_Name];
+else
+    sys=[systemname,'/',[Muscle_Morph(musclenumber).Muscle_Name]];
+end
 
 %Create muscle block
 add_block('built-in/S-Function',sys);
 open_system(sys);
 set_param(sys,'FunctionName','Virtual_Muscle_SFunction');
+set_param(sys,'SFunctionModules','Virtual_Muscle_Engine Virtual_Muscle_SIMD Virtual_Muscle_Threads Virtual_Muscle_Surrogate');
 set_param(sys,'Position',[185 90 420 200]);
 
 %create mask
@@ -29,7 +36,8 @@ set_param(sys,'Parameters',['TOFMUSFIB SARCLEN SPTEN VISC C1 K1 LR1 C2 K2 '...
                             'NF0 NF1 TL TF1 TF2 TF3 TF4 AS1 AS2 TS CY VY '...
                             'TY CH0 CH1 CH2 CH3 RTYPE ADDPORTS MMASS FASCL0 '...
                             'TENDL0T LPATH UR NUMOFUNITS FPCSA UPCSA '...
-                            'APPORTMTD GEOPCSA']); %Total 58 parameters
+                            'APPORTMTD GEOPCSA STATELAYOUT CURVETOL NUMMUSCLES MUSTEP MULTIRATE '...
+                            'ACTIVETOL ZEROCROSS NUMTHREADS PRECISION INITSTATE SURROGATE']); %Total 69 parameters
 
 
 set_param(sys,'MaskPromptString',['Recruitment Type (2-Natural Discrete, 3-Natural Continuous, 4-Intramuscular FES)|'...
@@ -60,7 +68,18 @@ set_param(sys,'MaskPromptString',['Recruitment Type (2-Natural Discrete, 3-Natur
                                   'aF|nf0|nf1|'...
                                   'TL|Tf1|Tf2|Tf3|Tf4|'...
                                   'AS1|AS2|TS|CY|VY|TY|'...
-                                  'ch0|ch1|ch2|ch3|']);
+                                  'ch0|ch1|ch2|ch3|'...
+                                  'Motor Unit State Layout (1-Interleaved, 2-Structure of Arrays)|'...
+                                  'Maximum FL Table Error (0-Exact Curves)|'...
+                                  'Number of Muscles (width of each port)|'...
+                                  'Motor Unit Sample Time (s) (0-Continuous)|'...
+                                  'Multirate: Hold Recruitment and Af Between Motor Unit Updates (0-No, 1-Yes)|'...
+                                  'Motor Unit Rest Tolerance of fint and feff (0-All Units Evaluated; >0-Approximate, Units Below It Have Af 0, Force Error up to (Tol/(af*nf))^nf of F0)|'...
+                                  'Zero Crossing Detection of the Rise/Fall and FV Branches (0-No, 1-Yes)|'...
+                                  'Threads of the Motor Unit Loops (1-Serial)|'...
+                                  'Precision of the Motor Unit Kernels (1-Double, 2-Single)|'...
+                                  'Initial States (1-Resting, 2-Steady State at the Initial Inputs)|'...
+                                  'Surrogate Table File (''''-Full Model; vm_tabulate File-Surrogate Muscle, One per Block)|']);
 
 
 %set mask style
@@ -69,24 +88,27 @@ set_param(sys,'MaskStyleString',['edit,edit,edit,edit,edit,edit,edit,edit,edit,e
                                 'edit,edit,edit,edit,edit,edit,edit,edit,edit,edit,'...
                                 'edit,edit,edit,edit,edit,edit,edit,edit,edit,edit,'...
                                 'edit,edit,edit,edit,edit,edit,edit,edit,edit,edit,'...
-                                'edit,edit,edit,edit,edit,edit,edit,edit']);
+                                'edit,edit,edit,edit,edit,edit,edit,edit,edit,edit,'...
+                                'edit,edit,edit,edit,edit,edit,edit,edit,edit']);
                             
 set_param(sys,'MaskTunableValueString',['on,on,on,on,on,on,on,on,on,on,'...
                                        'on,on,on,on,on,on,on,on,on,on,'...
                                        'on,on,on,on,on,on,on,on,on,on,'...
                                        'on,on,on,on,on,on,on,on,on,on,'...
                                        'on,on,on,on,on,on,on,on,on,on,'...
-                                       'on,on,on,on,on,on,on,on']);    
+                                       'on,on,on,on,on,on,on,on,off,on,'...
+                                       'off,off,off,off,off,off,off,off,off']);    
                                    
-%Note, Recruitment Type, Additional ports, Apportin methods, and Unit PCSA 
-%coorespionding to the Apportion methods are not editable
+%Note, Recruitment Type, Additional ports, Apportin methods, Unit PCSA
+%coorespionding to the Apportion methods, and Number of Muscles are not editable
 %Use rebuild option to edit Recruitment Type, Additional ports, and Aportion methods
 set_param(sys,'MaskEnableString',['off,off,on,on,on,on,on,on,on,on,'...
                                  'on,on,on,on,on,on,on,on,on,on,'...
                                  'on,on,on,on,on,on,on,on,on,on,'...
                                  'on,on,on,on,on,on,on,on,on,on,'...
                                  'on,on,on,on,on,on,on,on,on,on,'...
-                                 'on,on,on,on,on,on,on,on']);
+                                 'on,on,on,on,on,on,on,on,on,on,'...
+                                 'off,on,on,on,on,on,on,on,on']);
   % <DSadd6> Note Continuous Recruitment (Recruitment Type is 3), Number of Motor
   % Units is always one for each fiber type,so it's not editable                          
 %   RType=strmatch(Muscle_Model_Parameters.Recruitment_Type,Recruitment_sfunc,'exact');
@@ -104,7 +126,8 @@ set_param(sys,'MaskVisibilityString',['on,on,on,on,on,on,on,on,on,on,',...
                                      'on,on,on,on,on,on,on,on,on,on,',...
                                      'on,on,on,on,on,on,on,on,on,on,',...
                                      'on,on,on,on,on,on,on,on,on,on,',...
-                                     'on,on,on,on,on,on,on,on']);    
+                                     'on,on,on,on,on,on,on,on,on,on,',...
+                                     'on,on,on,on,on,on,on,on,on']);    
                                  
 
 set_param(sys,'MaskVariables',['RTYPE=@1;ADDPORTS=@2;FASCL0=@3;TENDL0T=@4;LPATH=@5;'...
@@ -116,7 +139,9 @@ set_param(sys,'MaskVariables',['RTYPE=@1;ADDPORTS=@2;FASCL0=@3;TENDL0T=@4;LPATH=
                             'CV0=@35;CV1=@36;AV0=@37;AV1=@38;AV2=@39;BV=@40;'...
                             'AF=@41;NF0=@42;NF1=@43;TL=@44;TF1=@45;TF2=@46;'...
                             'TF3=@47;TF4=@48;AS1=@49;AS2=@50;TS=@51;CY=@52;'...
-                            'VY=@53;TY=@54;CH0=@55;CH1=@56;CH2=@57;CH3=@58;']); %Total 58 parameters                        
+                            'VY=@53;TY=@54;CH0=@55;CH1=@56;CH2=@57;CH3=@58;'...
+                            'STATELAYOUT=@59;CURVETOL=@60;NUMMUSCLES=@61;MUSTEP=@62;MULTIRATE=@63;'...
+                            'ACTIVETOL=@64;ZEROCROSS=@65;NUMTHREADS=@66;PRECISION=@67;INITSTATE=@68;SURROGATE=@69;']); %Total 69 parameters
                             
                         
 %pass values to parameters
@@ -0,0 +1,3256 @@
+/* VIRTUAL_MUSCLE_ENGINE.C
+ * Synopsis: SimStruct-free Virtual Muscle engine (see Virtual_Muscle_Engine.h). The model functions are
+ *          the bodies of the former S-function callbacks; Virtual_Muscle_SFunction.c now only maps the
+ *          SimStruct parameters, work vectors, states and ports onto them.
+ *
+ * Comments: Please refer the user manual & paper (song et al) for 
+ *          detailed explanation of the the algorithms
+ *
+ * Date: 10-17-26
+ */
+
+#include "Virtual_Muscle_Engine.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#define VM_INLINE static __forceinline
+#define VM_RESTRICT __restrict
+#else
+#define VM_INLINE static inline __attribute__((always_inline))
+#define VM_RESTRICT __restrict__
+#endif
+
+
+
+/* Function: Max
+*  Description: Larger of a and b
+*/
+static real_T Max(real_T a, real_T b)
+{
+    return (a > b) ? a : b;
+}
+
+
+
+/*Motor unit state views
+ Pointers to the states of the first motor unit; the states of motor unit m are at index
+ m*MU_stride of each view, whatever the state layout. The rise/fall rates are not states: they
+ are kept contiguous in the work vector (VM_WORK_RATE), rate of motor unit m at index m.
+ */
+struct VM_MUStates {
+    real_T* Yield;
+    real_T* Sag;
+    real_T* fint;
+    real_T* feff;               //feff_tmp, the actual feff state
+    real_T* rate;               //feff rise/fall rate (invTf1 or invTf2), NULL for derivative views
+};
+
+//Picks the specialized motor unit kernels of each fiber type, defined with the motor unit loops
+static void SelectMUKernels(VM_MuscleModel *Model);
+
+//Structure and fiber type coefficients of the muscle: constants of the generated header in fixed muscle
+//builds (VM_FIXED_MUSCLE). MODEL_COEFS(Model,Name) is the per fiber type array Name of the model.
+#ifdef VM_FIXED_MUSCLE
+#define MODEL_TYPESOF_FIBERS(Model)     VM_FIXED_TYPESOF_FIBERS
+#define MODEL_TOTAL_MUNITS(Model)       VM_FIXED_TOTAL_MUNITS
+#define MODEL_NUM_OF_MUNITS(Model)      VM_Fixed_num_of_munits
+#define MODEL_RECRUITMENT_TYPE(Model)   VM_FIXED_RTYPE
+#define MODEL_MU_STRIDE(Model)          ((VM_FIXED_STATELAYOUT == VM_LAYOUT_SOA) ? 1 : MU_NUM_STATES)
+#define MODEL_MU_FIELD(Model)           ((VM_FIXED_STATELAYOUT == VM_LAYOUT_SOA) ? VM_FIXED_TOTAL_MUNITS : 1)
+#define MODEL_COEFS(Model,Name)         VM_Fixed_##Name
+#else
+#define MODEL_TYPESOF_FIBERS(Model)     ((Model)->TypesOf_fibers)
+#define MODEL_TOTAL_MUNITS(Model)       ((Model)->Total_Munits)
+#define MODEL_NUM_OF_MUNITS(Model)      ((const int_T*)(Model)->Num_of_Munits)
+#define MODEL_RECRUITMENT_TYPE(Model)   ((Model)->Recruitment_Type)
+#define MODEL_MU_STRIDE(Model)          ((Model)->MU_stride)
+#define MODEL_MU_FIELD(Model)           ((Model)->MU_field)
+#define MODEL_COEFS(Model,Name)         ((const real_T*)(Model)->Name)
+#endif
+
+
+
+//How each parameter of a multi-muscle parameter set is packed (see Virtual_Muscle_Params.h)
+#define VM_PACK_BLOCK       0       //Shared by all the muscles
+#define VM_PACK_MUSCLE      1       //One value per muscle
+#define VM_PACK_FIBER       2       //TOFMUSFIB values per muscle
+#define VM_PACK_UNIT        3       //Total_Munits values per muscle
+
+/* Function: ParamPacking
+*  Description: Packing (VM_PACK_*) of parameter k
+*/
+static int_T ParamPacking(int_T k)
+{
+    switch (k) {
+        case RTYPE_IDX:
+        case ADDPORTS_IDX:
+        case STATELAYOUT_IDX:
+        case CURVETOL_IDX:
+        case NUMMUSCLES_IDX:
+        case MUSTEP_IDX:
+        case MULTIRATE_IDX:
+        case ACTIVETOL_IDX:
+        case ZEROCROSS_IDX:
+        case NUMTHREADS_IDX:
+        case PRECISION_IDX:
+        case INITSTATE_IDX:
+            return VM_PACK_BLOCK;
+        case NUMOFUNITS_IDX:
+        case FPCSA_IDX:
+            return VM_PACK_FIBER;
+        case UPCSA_IDX:
+            return VM_PACK_UNIT;
+        default:
+            return (k >= RRANK_IDX && k <= CH3_IDX) ? VM_PACK_FIBER : VM_PACK_MUSCLE;
+    }
+}
+
+
+
+/* Function: VM_GetMuscleParams
+*  Description: Parameter set of muscle Muscle of the (multi-muscle) parameter set P, a single muscle
+*              parameter set (NUMMUSCLES 1). The values are not copied: Muscle_params points into P.
+*/
+void VM_GetMuscleParams(const VM_ParamSet *P, int_T Muscle, VM_ParamSet *Muscle_params)
+{
+    static const real_T One         = 1.0;
+    const real_T* TypesOf_fibers    = VM_PARAM(P,TOFMUSFIB_IDX);
+    const real_T* Num_of_Munits     = VM_PARAM(P,NUMOFUNITS_IDX);
+    int_T Fiber_offset              = 0;
+    int_T Unit_offset               = 0;
+    int_T m                         = 0;
+    int_T i                         = 0;
+    int_T k                         = 0;
+
+    for(m=0; m<Muscle; m++){
+        for(i=0; i<TypesOf_fibers[m]; i++){
+            Unit_offset += (int_T)Num_of_Munits[Fiber_offset+i];
+        }
+        Fiber_offset += (int_T)TypesOf_fibers[m];
+    }
+
+    Muscle_params->Num_params = P->Num_params;
+    for(k=0; k<NPARAMS; k++){
+        Muscle_params->Value[k] = P->Value[k];
+        Muscle_params->Count[k] = P->Count[k];
+        if (k >= P->Num_params)
+            continue;
+        switch (ParamPacking(k)) {
+            case VM_PACK_MUSCLE:
+                Muscle_params->Value[k] += Muscle;
+                Muscle_params->Count[k] = 1;
+                break;
+            case VM_PACK_FIBER:
+                Muscle_params->Value[k] += Fiber_offset;
+                Muscle_params->Count[k] = (int_T)TypesOf_fibers[Muscle];
+                break;
+            case VM_PACK_UNIT:
+                Muscle_params->Value[k] += Unit_offset;
+                Muscle_params->Count[k] = 0;
+                for(i=0; i<TypesOf_fibers[Muscle]; i++){
+                    Muscle_params->Count[k] += (int_T)Num_of_Munits[Fiber_offset+i];
+                }
+                break;
+        }
+    }
+    if (P->Num_params > NUMMUSCLES_IDX) {
+        Muscle_params->Value[NUMMUSCLES_IDX] = &One;
+    }
+}
+
+
+
+/* Function: ParamMunits
+*  Description: Motor units of the parameters (NUMOFUNITS summed over the fiber types), the number of
+*              UPCSA values
+*/
+static int_T ParamMunits(int_T TypesOf_fibers, const real_T *Num_of_Munits)
+{
+    int_T Total_Munits  = 0;
+    int_T i             = 0;
+    int_T j             = 0;
+
+    for(i=0; i<TypesOf_fibers; i++){
+        for(j=0; j<Num_of_Munits[i]; j++){
+            Total_Munits++;
+        }
+    }
+    return Total_Munits;
+}
+
+
+
+/* Function: ModelMunits
+*  Description: Motor units the model allocates: those of the parameters, or one per fiber type for
+*              Natural Continuous recruitment, which recruits and activates the fiber types as a whole
+*              (Type_threshold)
+*/
+static int_T ModelMunits(int_T Recruitment_Type, int_T TypesOf_fibers, const real_T *Num_of_Munits)
+{
+    return (Recruitment_Type == 3) ? TypesOf_fibers : ParamMunits(TypesOf_fibers, Num_of_Munits);
+}
+
+
+
+/* Function: VM_GetSizes
+*  Description: Number of muscles, motor units, states, work vector elements and ports of the block
+*              described by the parameters P.
+*/
+void VM_GetSizes(const VM_ParamSet *P, VM_Sizes *Sizes)
+{
+    const real_T* Outputports   = VM_PARAM(P,ADDPORTS_IDX);
+    int_T Recruitment_Type      = (int_T)*VM_PARAM(P,RTYPE_IDX);
+    int_T Num_muscles           = (int_T)VM_OPTIONAL_PARAM_VALUE(P,NUMMUSCLES_IDX,1);
+    int_T TypesOf_fibers        = 0;
+    const real_T* Num_of_Munits = NULL;
+    int_T Total_Munits          = 0;
+    VM_ParamSet Muscle_params;
+    int_T m                     = 0;
+    int_T i                     = 0;
+
+    Sizes->Num_muscles      = Num_muscles;
+    Sizes->TypesOf_fibers   = 0;
+    Sizes->Total_Munits     = 0;
+    Sizes->Num_states       = 0;
+    Sizes->Work_size        = 0;
+    Sizes->Jacobian_nz      = 0;
+    Sizes->Num_zcs          = 0;
+    Sizes->MU_step          = VM_OPTIONAL_PARAM_VALUE(P,MUSTEP_IDX,0.0);
+    Sizes->Num_threads      = 1;
+    for(m=0; m<Num_muscles; m++){
+        VM_GetMuscleParams(P, m, &Muscle_params);
+        TypesOf_fibers  = (int_T)*VM_PARAM(&Muscle_params,TOFMUSFIB_IDX);
+        Num_of_Munits   = VM_PARAM(&Muscle_params,NUMOFUNITS_IDX);
+
+        //Find total number of motor units
+        Total_Munits = ModelMunits(Recruitment_Type, TypesOf_fibers, Num_of_Munits);
+        Sizes->TypesOf_fibers   += TypesOf_fibers;
+        Sizes->Total_Munits     += Total_Munits;
+        Sizes->Num_states       += VM_NUM_STATES(Total_Munits);
+        Sizes->Work_size        += VM_WORK_SIZE(Total_Munits) + VM_WORK_PROFILE_SIZE(Total_Munits,TypesOf_fibers);
+        Sizes->Jacobian_nz      += VM_JACOBIAN_NZ(Total_Munits);
+        if (VM_OPTIONAL_PARAM_VALUE(P,ZEROCROSS_IDX,0) == 1)
+            Sizes->Num_zcs      += VM_NUM_ZCS(Total_Munits,Sizes->MU_step);
+        if (Total_Munits >= VM_THREAD_MIN_MUNITS)
+            Sizes->Num_threads   = (int_T)VM_OPTIONAL_PARAM_VALUE(P,NUMTHREADS_IDX,1);
+    }
+    if (Sizes->MU_step > 0) { //Discrete motor units: the muscle states only are continuous
+        Sizes->Num_cont_states  = VM_NUM_MUSCLE_STATES*Num_muscles;
+        Sizes->Num_disc_states  = Sizes->Num_states-VM_NUM_MUSCLE_STATES*Num_muscles;
+        Sizes->Jacobian_nz      = 0;
+    }
+    else {
+        Sizes->Num_cont_states  = Sizes->Num_states;
+        Sizes->Num_disc_states  = 0;
+    }
+    Sizes->Num_inputs       = (Recruitment_Type == 4) ? 3 : 2;
+    Sizes->Num_outputs      = 1; //Default [Force]
+    for(i=1; i<5; i++){ //[0]-None
+        Sizes->Num_outputs += (int_T)Outputports[i];
+    }
+    Sizes->Profile_port     = 0;
+#ifdef VM_PROFILE
+    if (P->Count[ADDPORTS_IDX] > VM_PORT_PROFILE && Outputports[VM_PORT_PROFILE]) {
+        Sizes->Profile_port = 1;
+        Sizes->Num_outputs++;
+    }
+#endif
+}
+
+
+
+/* Function: FL_Exact
+*  Description: Force-length curve FL = exp(-|(Lce^beta-1)/omega|^rho)
+*/
+VM_INLINE real_T FL_Exact(real_T Lce, real_T FL_omega, real_T FL_beta, real_T FL_rho)
+{
+    real_T temp = (pow(Lce,FL_beta)-1)/FL_omega;
+    
+    if(temp<0.0)
+        temp = -temp;
+    return exp(-pow(temp,FL_rho));
+}
+
+
+
+/* Function: FL_ExactSlope
+*  Description: d(FL)/d(Lce) of FL_Exact
+*/
+VM_INLINE real_T FL_ExactSlope(real_T Lce, real_T FL_omega, real_T FL_beta, real_T FL_rho)
+{
+    real_T temp = (pow(Lce,FL_beta)-1)/FL_omega;
+    real_T sign = 1.0;
+
+    if(temp == 0.0)
+        return 0.0;
+    if(temp<0.0){
+        temp = -temp;
+        sign = -1.0;
+    }
+    return -exp(-pow(temp,FL_rho))*FL_rho*pow(temp,FL_rho-1)*sign*FL_beta*pow(Lce,FL_beta-1)/FL_omega;
+}
+
+
+
+/* Function: BuildFLTables
+*  Description: Tabulates the FL curve of each fiber type when CURVETOL > 0. Each interval holds the cubic 
+*              through the exact curve at its ends and at its thirds (Lce = 1 is always an interval end). The 
+*              number of intervals is doubled until the error, checked at VM_FL_TABLE_CHECKS points per 
+*              interval, is below CURVETOL. The error achieved is kept in FL_error. Returns 0 if the allocation fails.
+*/
+static int_T BuildFLTables(const VM_ParamSet *P, VM_MuscleModel *Model)
+{
+    int_T   TypesOf_fibers  = Model->TypesOf_fibers;
+    int_T   Intervals       = VM_FL_TABLE_MIN_INTERVALS;
+    real_T  Max_error       = 0.0;
+    real_T  h               = 0.0;
+    real_T  f[4];
+    real_T  d1, d2, d3, L, s, e;
+    real_T* c               = NULL;
+    int_T   i, k, m;
+    
+    Model->Curve_tol   = VM_OPTIONAL_PARAM_VALUE(P,CURVETOL_IDX,0.0);
+    Model->FL_table    = NULL;
+    Model->FL_error    = 0.0;
+    Model->FL_intervals= 0;
+    if (Model->Curve_tol <= 0) {
+        return 1;
+    }
+    
+    for(;;){
+        Model->FL_table = (real_T*)malloc(TypesOf_fibers*Intervals*4*sizeof(real_T));
+        if (Model->FL_table == NULL) {
+            return 0;
+        }
+        h = VM_FL_TABLE_LMAX/Intervals;
+        Max_error = 0.0;
+        for(i=0; i<TypesOf_fibers; i++){
+            for(k=0; k<Intervals; k++){
+                for(m=0; m<4; m++){
+                    f[m] = FL_Exact((k+m/3.0)*h, Model->FL_omega[i], Model->FL_beta[i], Model->FL_rho[i]);
+                }
+                //Forward differences at step 1/3 -> coefficients in s = (Lce-k*h)/h
+                d1 = f[1]-f[0];
+                d2 = f[2]-2*f[1]+f[0];
+                d3 = f[3]-3*f[2]+3*f[1]-f[0];
+                c = Model->FL_table + (i*Intervals+k)*4;
+                c[0] = f[0];
+                c[1] = 3*(d1-d2/2+d3/3);
+                c[2] = 9*(d2/2-d3/2);
+                c[3] = 27*(d3/6);
+                for(m=0; m<VM_FL_TABLE_CHECKS; m++){
+                    s = (m+0.5)/VM_FL_TABLE_CHECKS;
+                    L = (k+s)*h;
+                    e = fabs(c[0]+s*(c[1]+s*(c[2]+s*c[3]))
+                             - FL_Exact(L, Model->FL_omega[i], Model->FL_beta[i], Model->FL_rho[i]));
+                    if(!(e <= Max_error)) //also catches NaN
+                        Max_error = e;
+                }
+            }
+        }
+        if (Max_error <= Model->Curve_tol || Intervals >= VM_FL_TABLE_MAX_INTERVALS) {
+            break;
+        }
+        free(Model->FL_table);
+        Intervals *= 2;
+    }
+    
+    Model->FL_intervals = Intervals;
+    Model->FL_invh      = Intervals/VM_FL_TABLE_LMAX;
+    Model->FL_error     = Max_error;
+    return 1;
+}
+
+
+
+/* Function: VM_FreeModel
+*  Description: Frees the model and its tables
+*/
+void VM_FreeModel(VM_MuscleModel *Model)
+{
+    if (Model != NULL) {
+        free(Model->FL_table);
+        free(Model);
+    }
+}
+
+
+
+#ifdef VM_FIXED_MUSCLE
+/* Function: VM_GetFixedParams
+*  Description: Parameter set of the muscle of the fixed muscle header (values of the header, not copied)
+*/
+void VM_GetFixedParams(VM_ParamSet *P)
+{
+    int_T k         = 0;
+    int_T offset    = 0;
+
+    P->Num_params = VM_FIXED_NUM_PARAMS;
+    for(k=0; k<NPARAMS; k++){
+        P->Value[k] = (k < VM_FIXED_NUM_PARAMS) ? VM_Fixed_values+offset : NULL;
+        P->Count[k] = (k < VM_FIXED_NUM_PARAMS) ? VM_Fixed_count[k] : 0;
+        offset     += P->Count[k];
+    }
+}
+
+
+
+/* Function: FixedStructure
+*  Description: Whether the model has the structure the engine was built for (VM_FIXED_MUSCLE)
+*/
+static int_T FixedStructure(const VM_MuscleModel *Model)
+{
+    int_T i = 0;
+
+    if (Model->TypesOf_fibers != VM_FIXED_TYPESOF_FIBERS || Model->Total_Munits != VM_FIXED_TOTAL_MUNITS
+        || Model->Recruitment_Type != VM_FIXED_RTYPE || Model->State_layout != VM_FIXED_STATELAYOUT)
+        return 0;
+    for(i=0; i<VM_FIXED_TYPESOF_FIBERS; i++){
+        if (Model->Num_of_Munits[i] != VM_Fixed_num_of_munits[i])
+            return 0;
+    }
+    return 1;
+}
+
+
+
+/* Function: FixedCoefficients
+*  Description: Whether the fiber type coefficients of the model (VM_FIXED_COEFS) are those of the header the
+*              engine was built for, which the motor unit kernels read instead of the model's (VM_FIXED_MUSCLE)
+*/
+static int_T FixedCoefficients(const VM_MuscleModel *Model)
+{
+    int_T i = 0;
+
+    for(i=0; i<VM_FIXED_TYPESOF_FIBERS; i++){
+#define FIXED_COEF_DIFFERS(Name) || Model->Name[i] != VM_Fixed_##Name[i]
+        if (0 VM_FIXED_COEFS(FIXED_COEF_DIFFERS))
+            return 0;
+#undef FIXED_COEF_DIFFERS
+    }
+    return 1;
+}
+#endif
+
+
+
+/* Function: VM_CreateModel
+*  Description: Allocates the model and fills it from the parameters. The unit PCSA values are apportioned
+*              here according to the apportion method. Returns NULL, with the reason in *Error (may be NULL),
+*              if the fractional PCSA values add up to more than 1 or if the allocation fails (or, in fixed
+*              muscle builds, if the muscle does not have the structure and fiber types of the build).
+*/
+VM_MuscleModel* VM_CreateModel(const VM_ParamSet *P, const char **Error)
+{
+    VM_MuscleModel *Model  = NULL;
+    real_T *Mem             = NULL;
+    
+    int_T TypesOf_fibers    = (int_T)*VM_PARAM(P,TOFMUSFIB_IDX);
+    const real_T* Num_of_Munits   =  VM_PARAM(P,NUMOFUNITS_IDX);
+    const real_T* Outputports     =  VM_PARAM(P,ADDPORTS_IDX);
+    int_T Apportion_mtd     = (int_T)*VM_PARAM(P,APPORTMTD_IDX);
+    real_T Geometric_fr     = *VM_PARAM(P,GEOPCSA_IDX);
+    const real_T* Fract_PCSA      =  VM_PARAM(P,FPCSA_IDX);    
+    const real_T* Unit_PCSA       =  VM_PARAM(P,UPCSA_IDX);        
+    const real_T* Recruit_Rank    =  VM_PARAM(P,RRANK_IDX);
+    real_T Sp_Tension       = *VM_PARAM(P,SPTEN_IDX);
+    real_T Lpath            = *VM_PARAM(P,LPATH_IDX);
+
+    const real_T* f05             =  VM_PARAM(P,F05_IDX);
+    const real_T* Fmin            =  VM_PARAM(P,FMIN_IDX);
+    const real_T* Fmax            =  VM_PARAM(P,FMAX_IDX);
+    const real_T* Tf1             =  VM_PARAM(P,TF1_IDX);
+    const real_T* Tf2             =  VM_PARAM(P,TF2_IDX);
+    const real_T* Tf3             =  VM_PARAM(P,TF3_IDX);
+    const real_T* Tf4             =  VM_PARAM(P,TF4_IDX);
+    const real_T* Ts              =  VM_PARAM(P,TS_IDX);
+    const real_T* aS1             =  VM_PARAM(P,AS1_IDX);
+    const real_T* aS2             =  VM_PARAM(P,AS2_IDX);
+    const real_T* cY              =  VM_PARAM(P,CY_IDX);
+    const real_T* VY              =  VM_PARAM(P,VY_IDX);
+    const real_T* af              =  VM_PARAM(P,AF_IDX);
+    const real_T* nf0             =  VM_PARAM(P,NF0_IDX);
+    const real_T* nf1             =  VM_PARAM(P,NF1_IDX);
+    const real_T* FL_omega        =  VM_PARAM(P,FLOMEGA_IDX);
+    const real_T* FL_beta         =  VM_PARAM(P,FLBETA_IDX);
+    const real_T* FL_rho          =  VM_PARAM(P,FLRHO_IDX);
+    const real_T* Vmax            =  VM_PARAM(P,VMAX_IDX);
+    const real_T* cV0             =  VM_PARAM(P,CV0_IDX);
+    const real_T* cV1             =  VM_PARAM(P,CV1_IDX);
+    const real_T* aV0             =  VM_PARAM(P,AV0_IDX);
+    const real_T* aV1             =  VM_PARAM(P,AV1_IDX);
+    const real_T* aV2             =  VM_PARAM(P,AV2_IDX);
+    const real_T* bV              =  VM_PARAM(P,BV_IDX);
+  
+    real_T Passive_Force        = 0;
+    real_T Normalized_SE_Length = 0;
+    real_T SE_Length            = 0;
+    real_T Total_FPCSA          = 0;
+    int_T Total_Munits          = 0;    
+    int_T  i                    = 0;
+    int_T  j                    = 0;
+    real_T denominator          = 0.0; 
+    real_T correction           = 0.0;
+    real_T  total               = 0.0;
+    int_T  offset               = 0;
+    int_T  Compact              = ((int_T)*VM_PARAM(P,RTYPE_IDX) == 3); //one motor unit per fiber type
+    int_T  Param_munits         = 0;
+    real_T *PCSA                = NULL; //unit PCSA values of the motor units of the parameters
+
+    //Find total number of motor units
+    Param_munits = ParamMunits(TypesOf_fibers, Num_of_Munits);
+    Total_Munits = Compact ? TypesOf_fibers : Param_munits;
+
+    //One allocation: record, real_T arrays, kernel pointers, then int_T arrays
+    Model = (VM_MuscleModel*)calloc(1, sizeof(VM_MuscleModel)
+                                        + (VM_NUM_FIBER_ARRAYS*TypesOf_fibers + VM_NUM_UNIT_ARRAYS*Total_Munits)*sizeof(real_T)
+                                        + TypesOf_fibers*(sizeof(VM_MUDerivativesFcn)+sizeof(VM_MUActivationFcn))
+                                        + TypesOf_fibers*sizeof(int_T));
+    if (Model == NULL) {
+        if (Error != NULL)
+            *Error = "Could not allocate the muscle model";
+        return NULL;
+    }
+    Mem = (real_T*)(Model+1);
+    Model->Fmin          = Mem; Mem += TypesOf_fibers;
+    Model->Fmax          = Mem; Mem += TypesOf_fibers;
+    Model->invf05        = Mem; Mem += TypesOf_fibers;
+    Model->Fract_PCSA    = Mem; Mem += TypesOf_fibers;
+    Model->Tf1           = Mem; Mem += TypesOf_fibers;
+    Model->Tf2           = Mem; Mem += TypesOf_fibers;
+    Model->Tf3           = Mem; Mem += TypesOf_fibers;
+    Model->Tf4           = Mem; Mem += TypesOf_fibers;
+    Model->invTs         = Mem; Mem += TypesOf_fibers;
+    Model->aS1           = Mem; Mem += TypesOf_fibers;
+    Model->aS2           = Mem; Mem += TypesOf_fibers;
+    Model->cY            = Mem; Mem += TypesOf_fibers;
+    Model->VY            = Mem; Mem += TypesOf_fibers;
+    Model->af            = Mem; Mem += TypesOf_fibers;
+    Model->nf0           = Mem; Mem += TypesOf_fibers;
+    Model->nf1           = Mem; Mem += TypesOf_fibers;
+    Model->FL_omega      = Mem; Mem += TypesOf_fibers;
+    Model->FL_beta       = Mem; Mem += TypesOf_fibers;
+    Model->FL_rho        = Mem; Mem += TypesOf_fibers;
+    Model->Vmax          = Mem; Mem += TypesOf_fibers;
+    Model->cV0           = Mem; Mem += TypesOf_fibers;
+    Model->cV1           = Mem; Mem += TypesOf_fibers;
+    Model->aV0           = Mem; Mem += TypesOf_fibers;
+    Model->aV1           = Mem; Mem += TypesOf_fibers;
+    Model->aV2           = Mem; Mem += TypesOf_fibers;
+    Model->bV            = Mem; Mem += TypesOf_fibers;
+    Model->Type_threshold = Mem; Mem += TypesOf_fibers;
+    Model->Unit_PCSA     = Mem; Mem += Total_Munits;
+    Model->Threshold     = Mem; Mem += Total_Munits;
+    Model->fenv_slope    = Mem; Mem += Total_Munits;
+    Model->Unit_Fmin     = Mem; Mem += Total_Munits;
+    Model->MU_derivatives = (VM_MUDerivativesFcn*)Mem;
+    Model->MU_activation = (VM_MUActivationFcn*)(Model->MU_derivatives+TypesOf_fibers);
+    Model->Num_of_Munits = (int_T*)(Model->MU_activation+TypesOf_fibers);
+    
+    //Muscle values
+    Model->TypesOf_fibers      = TypesOf_fibers;
+    Model->Total_Munits        = Total_Munits;
+    Model->Recruitment_Type    = (int_T)*VM_PARAM(P,RTYPE_IDX);
+    for(i=0; i<5; i++){
+        Model->Outputports[i]  = (int_T)Outputports[i];
+    }
+    Model->Outputports[VM_PORT_PROFILE] = 0;
+#ifdef VM_PROFILE
+    if (P->Count[ADDPORTS_IDX] > VM_PORT_PROFILE)
+        Model->Outputports[VM_PORT_PROFILE] = (int_T)Outputports[VM_PORT_PROFILE];
+#endif
+    Model->State_layout        = (int_T)VM_OPTIONAL_PARAM_VALUE(P,STATELAYOUT_IDX,VM_LAYOUT_INTERLEAVED);
+    Model->MU_stride           = (Model->State_layout == VM_LAYOUT_SOA) ? 1 : MU_NUM_STATES;
+    Model->MU_field            = (Model->State_layout == VM_LAYOUT_SOA) ? Total_Munits : 1;
+    Model->Single_precision    = (VM_OPTIONAL_PARAM_VALUE(P,PRECISION_IDX,1) == 2);
+    Model->Af_batch            = Model->Single_precision ? VM_SelectAfBatchFloat(&Model->Af_isa)
+                                                         : VM_SelectAfBatch(&Model->Af_isa);
+    Model->MU_step             = VM_OPTIONAL_PARAM_VALUE(P,MUSTEP_IDX,0.0);
+    Model->Act_hold            = (Model->MU_step > 0 && VM_OPTIONAL_PARAM_VALUE(P,MULTIRATE_IDX,0) == 1);
+    Model->Active_tol          = (Model->Recruitment_Type == 2) ? VM_OPTIONAL_PARAM_VALUE(P,ACTIVETOL_IDX,0.0) : 0.0;
+    Model->Zero_cross          = (VM_OPTIONAL_PARAM_VALUE(P,ZEROCROSS_IDX,0) == 1);
+    Model->Num_zcs             = Model->Zero_cross ? VM_NUM_ZCS(Total_Munits,Model->MU_step) : 0;
+    Model->Steady_init         = (VM_OPTIONAL_PARAM_VALUE(P,INITSTATE_IDX,1) == 2);
+    Model->Viscocity           = *VM_PARAM(P,VISC_IDX);
+    Model->c1                  = *VM_PARAM(P,C1_IDX);
+    Model->k1                  = *VM_PARAM(P,K1_IDX);
+    Model->Lr1                 = *VM_PARAM(P,LR1_IDX);
+    Model->c2                  = *VM_PARAM(P,C2_IDX);
+    Model->k2                  = *VM_PARAM(P,K2_IDX);
+    Model->Lr2                 = *VM_PARAM(P,LR2_IDX);
+    Model->cT                  = *VM_PARAM(P,CT_IDX);
+    Model->kT                  = *VM_PARAM(P,KT_IDX);
+    Model->LrT                 = *VM_PARAM(P,LRT_IDX);
+    Model->Mass                = *VM_PARAM(P,MMASS_IDX);
+    Model->L0                  = *VM_PARAM(P,FASCL0_IDX);
+    Model->L0T                 = *VM_PARAM(P,TENDL0T_IDX);
+    Model->Ur                  = *VM_PARAM(P,UR_IDX);
+    Model->invL0               = 1/(Model->L0/100);
+    Model->invL0T              = 1/Model->L0T;
+    Model->invMass             = 1/(Model->Mass/2000);
+
+    Model->MUSCDENSITY     = 1.06;
+    Model->MUSCPCSA        = Model->Mass/Model->MUSCDENSITY/Model->L0;
+    Model->MUSCF0          = Model->MUSCPCSA * Sp_Tension;
+
+    Passive_Force           = Model->c1*Model->k1*log( exp( (1-Model->Lr1)/Model->k1 )+1 ); //Passive force of a muscle stretched to its anatomical maximum
+    Normalized_SE_Length    = Model->kT*log( exp(Passive_Force/Model->cT/Model->kT)-1 )+ Model->LrT; //normalized length of SE stretched by that force
+    SE_Length               = Model->L0T*Normalized_SE_Length; //length of SE stretched by passive force
+    Model->FASCLMAX        = (Lpath-SE_Length)/Model->L0;
+
+    //Fiber type values
+    for(i=0; i<TypesOf_fibers; i++){
+        Model->Fmin[i]          = Fmin[i];
+        Model->Fmax[i]          = Fmax[i];
+        Model->invf05[i]        = 1/f05[i];
+        Model->Fract_PCSA[i]    = Fract_PCSA[i];
+        Model->Tf1[i]           = Tf1[i]/1000;
+        Model->Tf2[i]           = Tf2[i]/1000;
+        Model->Tf3[i]           = Tf3[i]/1000;
+        Model->Tf4[i]           = Tf4[i]/1000;
+        Model->invTs[i]         = 1/(Ts[i]/1000);
+        Model->aS1[i]           = aS1[i];
+        Model->aS2[i]           = aS2[i];
+        Model->cY[i]            = cY[i];
+        Model->VY[i]            = VY[i];
+        Model->af[i]            = af[i];
+        Model->nf0[i]           = nf0[i];
+        Model->nf1[i]           = nf1[i];
+        Model->FL_omega[i]      = FL_omega[i];
+        Model->FL_beta[i]       = FL_beta[i];
+        Model->FL_rho[i]        = FL_rho[i];
+        Model->Vmax[i]          = Vmax[i];
+        Model->cV0[i]           = cV0[i];
+        Model->cV1[i]           = cV1[i];
+        Model->aV0[i]           = aV0[i];
+        Model->aV1[i]           = aV1[i];
+        Model->aV2[i]           = aV2[i];
+        Model->bV[i]            = bV[i];
+        Model->Num_of_Munits[i] = 0;
+        for(j=0; j<Num_of_Munits[i]; j++){
+            Model->Num_of_Munits[i]++;
+        }
+        if (Compact)
+            Model->Num_of_Munits[i] = 1;
+    }
+#ifdef VM_FIXED_MUSCLE
+    if (!FixedStructure(Model) || !FixedCoefficients(Model)) {
+        if (Error != NULL)
+            *Error = "The muscle does not have the structure and fiber types this engine was built for (VM_FIXED_MUSCLE)";
+        VM_FreeModel(Model);
+        return NULL;
+    }
+#endif
+    SelectMUKernels(Model);
+    
+    //Check fractional PCSA values to see if it adds up to 1, else ERROR
+    for(i=0; i<TypesOf_fibers; i++) {
+        Total_FPCSA += Fract_PCSA[i];
+        if(Total_FPCSA > 1){
+            if (Error != NULL)
+                *Error = "Error in Fractional PCSA allocation";
+            VM_FreeModel(Model);
+            return NULL;
+        }
+    }
+    
+    //Initialize Unit PCSA values based on Apportion method (0:Manual, 1:Default, 2:Geometric, 3:Equal),
+    //for the motor units of the parameters: summed per fiber type below if the model has one unit per type
+    PCSA = Compact ? (real_T*)malloc((Param_munits+1)*sizeof(real_T)) : Model->Unit_PCSA;
+    if (PCSA == NULL) {
+        if (Error != NULL)
+            *Error = "Could not allocate the muscle model";
+        VM_FreeModel(Model);
+        return NULL;
+    }
+    for(offset=0; offset<Param_munits; offset++){
+        PCSA[offset] = Unit_PCSA[offset];
+    }
+    switch (Apportion_mtd) {
+    
+        case 1: //Manaul- do nothig, User sets unit PCSA            
+            break;
+        case 2: //Default
+            offset = 0;            
+            for(i=0; i<TypesOf_fibers; i++){
+                denominator = 0;
+                for(j=0; j<Num_of_Munits[i]; j++){
+                    denominator += Recruit_Rank[i] + j + 1;
+                }
+                for(j=0; j<Num_of_Munits[i]; j++){
+                    PCSA[offset]= Fract_PCSA[i] * (Recruit_Rank[i]+j+1 ) / denominator;
+                    offset++;
+                }                
+            }
+            break;
+        case 4: //Geometric 
+            offset = 0;
+            for(i=0; i<TypesOf_fibers; i++){
+                for(j=0; j<Num_of_Munits[i]; j++){
+                    total += pow((1+Geometric_fr),(j+1-1));
+                   
+                }
+                
+                correction = Fract_PCSA[i]/total;
+                for(j=0; j<Num_of_Munits[i]; j++){
+                    PCSA[offset]= pow((1+Geometric_fr),(j+1-1)) * correction;
+                    offset++;
+                }
+            }
+            break;
+        case 3: //Equal
+            offset = 0;
+            for(i=0; i<TypesOf_fibers; i++){
+                for(j=0; j<Num_of_Munits[i]; j++){
+                    PCSA[offset]= Fract_PCSA[i]/Num_of_Munits[i];
+                    offset++;  
+                }
+            }
+
+            break;
+    }
+    if (Compact) {
+        offset = 0;
+        for(i=0; i<TypesOf_fibers; i++){
+            for(j=0; j<Num_of_Munits[i]; j++){
+                Model->Unit_PCSA[i] += PCSA[offset];
+                offset++;
+            }
+        }
+        free(PCSA);
+    }
+    
+    //Natural recruitment thresholds in recruitment order, as VM_Activation used to rebuild them on every call
+    offset = 0;
+    total = 0.0;
+    for(i=0; i<TypesOf_fibers; i++){
+        for(j=0; j<Model->Num_of_Munits[i]; j++){
+            total += Model->Unit_PCSA[offset];
+            Model->Threshold[offset]  = Max(total * Model->Ur, 0.001);
+            Model->fenv_slope[offset] = (Model->Fmax[i]-Model->Fmin[i])/(1-Model->Threshold[offset]);
+            Model->Unit_Fmin[offset]  = Model->Fmin[i];
+            offset++;
+        }
+    }
+    
+    //Natural Continuous thresholds of the fiber types (one motor unit each)
+    if (Model->Recruitment_Type == 3) {
+        total = 0.0;
+        Model->Type_threshold[0] = 0.001;
+        for(i=0; i+1<TypesOf_fibers; i++){
+            total += Model->Unit_PCSA[i];
+            Model->Type_threshold[i+1] = Max(total * Model->Ur, 0.001);
+        }
+    }
+    
+    if (!BuildFLTables(P, Model)) {
+        if (Error != NULL)
+            *Error = "Could not allocate the muscle model";
+        free(Model);
+        return NULL;
+    }
+        
+    return Model;
+}
+
+
+
+/* Function: GetMUStates
+*  Description: Points the motor unit state views at the state (or derivative) vector x
+*              according to the state layout, and the rate view at Rate, the rates of the work vector
+*              from the same first motor unit (NULL for derivative views).
+*/
+static void GetMUStates(const VM_MuscleModel *Model, const real_T *x, const real_T *Rate, VM_MUStates *States)
+{
+    real_T *xv      = (real_T*)x; //views of a const x (VM_Derivatives) are only read
+
+    States->Yield   = xv;
+    States->Sag     = xv + 1*MODEL_MU_FIELD(Model);
+    States->fint    = xv + 2*MODEL_MU_FIELD(Model);
+    States->feff    = xv + 3*MODEL_MU_FIELD(Model);
+    States->rate    = (real_T*)Rate;
+}
+
+
+
+/* Function: MU_RiseFallFloat
+*  Description: MU_RiseFall in float (PRECISION 2): the rates are computed in single precision from the
+*              rounded inputs, the rise/fall choice is made on the double states
+*/
+VM_INLINE void MU_RiseFallFloat(real_T* VM_RESTRICT rate, const real_T* VM_RESTRICT fint, const real_T* VM_RESTRICT feff,
+                                const real_T* VM_RESTRICT fenv, const real_T* VM_RESTRICT Af, const real_T* VM_RESTRICT Rise,
+                                float Tf1_Lce2, float Tf2, float Tf3, float Tf4, float Lce, int_T n, int_T Mu_stride)
+{
+    float  invTf1   = 0.0f;
+    float  invTf2   = 0.0f;
+    int_T  j        = 0;
+
+    if (Rise != NULL) {
+        for(j=0; j<n; j++){
+            invTf1 = 1.0f/(Tf1_Lce2+Tf2*(float)fenv[j]); //feff'>0
+            invTf2 = Lce/(Tf3+Tf4*(float)Af[j]); //feff'<0
+            rate[j] = (Rise[j] > 0) ? invTf1 : invTf2;
+        }
+        return;
+    }
+    for(j=0; j<n; j++){
+        invTf1 = 1.0f/(Tf1_Lce2+Tf2*(float)fenv[j]); //feff'>0
+        invTf2 = Lce/(Tf3+Tf4*(float)Af[j]); //feff'<0
+        rate[j] = ((fint[j*Mu_stride]-feff[j*Mu_stride])>=0) ? invTf1 : invTf2;
+    }
+}
+
+
+
+/* Function: MU_RiseFall
+*  Description: Chooses the feff rise (invTf1) or fall (invTf2) rate of the n motor units of fiber type i
+*              and writes it into rate (contiguous): rise if fint >= feff, or if the held mode Rise is set
+*              (ZEROCROSS, NULL otherwise). Mu_stride is the distance between two motor units in the state
+*              vector; the loops have no branches and vectorize when it is 1.
+*/
+VM_INLINE void MU_RiseFall(real_T* VM_RESTRICT rate, const real_T* VM_RESTRICT fint, const real_T* VM_RESTRICT feff,
+                           const real_T* VM_RESTRICT fenv, const real_T* VM_RESTRICT Af, const real_T* VM_RESTRICT Rise,
+                           const VM_MuscleModel *Model, int_T i, real_T Lce, int_T n, int_T Mu_stride)
+{
+    real_T Tf1_Lce2 = MODEL_COEFS(Model,Tf1)[i]*pow(Lce,2);
+    real_T Tf2      = MODEL_COEFS(Model,Tf2)[i];
+    real_T Tf3      = MODEL_COEFS(Model,Tf3)[i];
+    real_T Tf4      = MODEL_COEFS(Model,Tf4)[i];
+    real_T invTf1   = 0.0;
+    real_T invTf2   = 0.0;
+    int_T  j        = 0;
+
+    if (Model->Single_precision) {
+        MU_RiseFallFloat(rate, fint, feff, fenv, Af, Rise, (float)Tf1_Lce2, (float)Tf2, (float)Tf3, (float)Tf4,
+                         (float)Lce, n, Mu_stride);
+        return;
+    }
+    if (Rise != NULL) {
+        for(j=0; j<n; j++){
+            invTf1 = 1/(Tf1_Lce2+Tf2*fenv[j]); //feff'>0
+            invTf2 = Lce/(Tf3+Tf4*Af[j]); //feff'<0
+            rate[j] = (Rise[j] > 0) ? invTf1 : invTf2;
+        }
+        return;
+    }
+    for(j=0; j<n; j++){
+        invTf1 = 1/(Tf1_Lce2+Tf2*fenv[j]); //feff'>0
+        invTf2 = Lce/(Tf3+Tf4*Af[j]); //feff'<0
+        rate[j] = ((fint[j*Mu_stride]-feff[j*Mu_stride])>=0) ? invTf1 : invTf2;
+    }
+}
+
+
+
+/* Function: MU_ActivationKernel
+*  Description: Af of n interleaved motor units (MU_NUM_STATES apart) with the yield, sag and precision
+*              fixed by the instance (MU_ACTIVATION): fiber types without yield or sag use 1.0 instead of
+*              the state
+*/
+VM_INLINE void MU_ActivationKernel(real_T* VM_RESTRICT Af, const real_T* VM_RESTRICT Yield, const real_T* VM_RESTRICT Sag,
+                                   const real_T* VM_RESTRICT feff, int_T n, real_T af_nf, real_T nf,
+                                   int_T Has_yield, int_T Has_sag, int_T Single)
+{
+    real_T Yield_Munit  = 1.0;
+    real_T Sag_Munit    = 1.0;
+    int_T  j            = 0;
+
+    if (Single) {
+        for(j=0; j<n; j++){
+            Yield_Munit = Has_yield ? Yield[j*MU_NUM_STATES] : 1.0;
+            Sag_Munit   = Has_sag ? Sag[j*MU_NUM_STATES] : 1.0;
+            Af[j] = 1.0f-expf(-powf((float)Yield_Munit*(float)Sag_Munit*(float)feff[j*MU_NUM_STATES]/(float)af_nf,(float)nf));
+        }
+        return;
+    }
+    for(j=0; j<n; j++){
+        Yield_Munit = Has_yield ? Yield[j*MU_NUM_STATES] : 1.0;
+        Sag_Munit   = Has_sag ? Sag[j*MU_NUM_STATES] : 1.0;
+        Af[j] = 1-exp(-pow(Yield_Munit*Sag_Munit*feff[j*MU_NUM_STATES]/af_nf,nf));
+    }
+}
+
+//Instance of MU_ActivationKernel (VM_MUActivationFcn)
+#define MU_ACTIVATION(NAME,HAS_YIELD,HAS_SAG,SINGLE) \
+static void NAME(real_T *Af, const real_T *Yield, const real_T *Sag, const real_T *feff, int_T n, \
+                 real_T af_nf, real_T nf) \
+{ \
+    MU_ActivationKernel(Af, Yield, Sag, feff, n, af_nf, nf, HAS_YIELD, HAS_SAG, SINGLE); \
+}
+MU_ACTIVATION(MU_Activation_D00, 0, 0, 0)
+MU_ACTIVATION(MU_Activation_D01, 0, 1, 0)
+MU_ACTIVATION(MU_Activation_D10, 1, 0, 0)
+MU_ACTIVATION(MU_Activation_D11, 1, 1, 0)
+MU_ACTIVATION(MU_Activation_F00, 0, 0, 1)
+MU_ACTIVATION(MU_Activation_F01, 0, 1, 1)
+MU_ACTIVATION(MU_Activation_F10, 1, 0, 1)
+MU_ACTIVATION(MU_Activation_F11, 1, 1, 1)
+
+//[Single][Has_yield][Has_sag]
+static const VM_MUActivationFcn MU_activation_kernels[2][2][2] = {
+    {{MU_Activation_D00, MU_Activation_D01}, {MU_Activation_D10, MU_Activation_D11}},
+    {{MU_Activation_F00, MU_Activation_F01}, {MU_Activation_F10, MU_Activation_F11}}
+};
+
+
+
+/* Function: MU_Activation
+*  Description: Af = 1-exp(-(Y*S*feff/(af*nf))^nf) of the n motor units of fiber type i. Contiguous motor
+*              units (Mu_stride 1) go through the batched kernel selected for the CPU (Virtual_Muscle_SIMD.c),
+*              interleaved ones through the instance of MU_ActivationKernel of the fiber type.
+*/
+VM_INLINE void MU_Activation(real_T* VM_RESTRICT Af, const real_T* VM_RESTRICT Yield, const real_T* VM_RESTRICT Sag,
+                             const real_T* VM_RESTRICT feff, const VM_MuscleModel *Model, int_T i, real_T Lce,
+                             int_T n, int_T Mu_stride)
+{
+    real_T nf           = MODEL_COEFS(Model,nf0)[i]+MODEL_COEFS(Model,nf1)[i]*((1/Lce)-1);
+    real_T af_nf        = MODEL_COEFS(Model,af)[i]*nf;
+    int_T  Has_yield    = MODEL_COEFS(Model,cY)[i] > 0.001; //Only slow fibers have yield
+    int_T  Has_sag      = MODEL_COEFS(Model,aS1)[i] != MODEL_COEFS(Model,aS2)[i]; //Only fast fibers have sag
+
+    if(Mu_stride == 1){
+        Model->Af_batch(Af, Has_yield ? Yield : NULL, Has_sag ? Sag : NULL, feff, n, af_nf, nf);
+        return;
+    }
+#ifdef VM_FIXED_MUSCLE
+    MU_ActivationKernel(Af, Yield, Sag, feff, n, af_nf, nf, Has_yield, Has_sag, Model->Single_precision);
+#else
+    Model->MU_activation[i](Af, Yield, Sag, feff, n, af_nf, nf);
+#endif
+}
+
+
+
+/* Function: MU_Fascicles
+*  Description: Rise/fall rates (from the Af of the previous call) then Af of the n consecutive motor units
+*              of fiber type i starting at motor unit offset. Rise: held rise/fall modes of all the units
+*              (ZEROCROSS), or NULL.
+*/
+VM_INLINE void MU_Fascicles(const VM_MUStates *States, const real_T* VM_RESTRICT fenv, real_T* VM_RESTRICT Af,
+                            const real_T *Rise, const VM_MuscleModel *Model, int_T i, int_T offset, real_T Lce, int_T n)
+{
+    if (Rise != NULL) {
+        Rise += offset;
+    }
+    if (MODEL_MU_STRIDE(Model) == 1) {
+        MU_RiseFall(States->rate+offset, States->fint+offset, States->feff+offset, fenv+offset, Af+offset, Rise,
+                    Model, i, Lce, n, 1);
+        MU_Activation(Af+offset, States->Yield+offset, States->Sag+offset, States->feff+offset,
+                      Model, i, Lce, n, 1);
+    }
+    else {
+        MU_RiseFall(States->rate+offset, States->fint+offset*MU_NUM_STATES, States->feff+offset*MU_NUM_STATES,
+                    fenv+offset, Af+offset, Rise, Model, i, Lce, n, MU_NUM_STATES);
+        MU_Activation(Af+offset, States->Yield+offset*MU_NUM_STATES, States->Sag+offset*MU_NUM_STATES,
+                      States->feff+offset*MU_NUM_STATES, Model, i, Lce, n, MU_NUM_STATES);
+    }
+}
+
+
+
+/* Function: Recruit
+*  Description: Natural Discrete recruitment (fenv) for the activation Act. The thresholds are sorted, so the
+*              recruited units are the prefix found by binary search. Only the units whose recruitment or
+*              firing rate changed since the last call (Recruited: count and activation, VM_WORK_RECRUITED)
+*              are written. Returns the number of recruited units.
+*/
+static int_T Recruit(const VM_MuscleModel *Model, real_T *fenv, real_T *Recruited, real_T Act)
+{
+    const real_T *Threshold = Model->Threshold;
+    int_T Num_previous      = (int_T)Recruited[0];
+    int_T Low               = 0;
+    int_T High              = MODEL_TOTAL_MUNITS(Model);
+    int_T Mid               = 0;
+    int_T j                 = 0;
+
+    if (Act == Recruited[1]) {
+        return Num_previous;
+    }
+    //First unit with Act < Threshold
+    while (Low < High) {
+        Mid = (Low+High)/2;
+        if (Act >= Threshold[Mid])
+            Low = Mid+1;
+        else
+            High = Mid;
+    }
+    for(j=0; j<Low; j++){
+        fenv[j] = Model->fenv_slope[j] * (Act-Threshold[j]) + Model->Unit_Fmin[j];
+    }
+    for(j=Low; j<Num_previous; j++){ //derecruited
+        fenv[j] = 0.0;
+    }
+    Recruited[0] = Low;
+    Recruited[1] = Act;
+    return Low;
+}
+
+
+
+/* Function: UpdateActiveSet
+*  Description: Active set of the motor units (Active_tol > 0): the recruited units (Recruit), then the units
+*              of the previous list beyond them while fint or feff >= Active_tol; the others rest with fenv
+*              and Af 0, an approximation (see Virtual_Muscle_Engine.h). Active is the count then the
+*              ascending list (VM_WORK_ACTIVE). Returns the number of active units.
+*/
+static int_T UpdateActiveSet(const VM_MuscleModel *Model, const VM_MUStates *States, real_T *fenv, real_T *Af,
+                             real_T *Active, real_T *Recruited, real_T Act)
+{
+    real_T *List            = Active+1;
+    int_T Num_active        = (int_T)Active[0];
+    int_T Num_recruited     = Recruit(Model, fenv, Recruited, Act);
+    int_T Num_kept          = 0;
+    int_T MU_stride         = MODEL_MU_STRIDE(Model);
+    real_T Tol              = Model->Active_tol;
+    int_T j                 = 0;
+    int_T k                 = 0;
+
+    //Derecruited units of the previous list, compacted in place, then moved after the prefix
+    for(k=0; k<Num_active; k++){
+        j = (int_T)List[k];
+        if (j < Num_recruited)
+            continue;
+        if (States->fint[j*MU_stride] >= Tol || States->feff[j*MU_stride] >= Tol)
+            List[Num_kept++] = j;
+        else
+            Af[j] = 0.0; //rests
+    }
+    memmove(List+Num_recruited, List, Num_kept*sizeof(real_T));
+    for(j=0; j<Num_recruited; j++){
+        List[j] = j;
+    }
+    Active[0] = Num_recruited+Num_kept;
+    return Num_recruited+Num_kept;
+}
+
+
+
+/* Function: VceBranches
+*  Description: Lengthening branches of the FV curves (Vce > 0) and of the yield (Vce >= 0), or for both
+*              the FV branch mode held since the last major step (ZEROCROSS)
+*/
+static void VceBranches(const VM_MuscleModel *Model, const real_T *Work_vect, real_T Vce,
+                        int_T *FV_lengthening, int_T *Yield_lengthening)
+{
+    if (Model->Zero_cross) {
+        *FV_lengthening     = Work_vect[VM_WORK_MODES(MODEL_TOTAL_MUNITS(Model))] > 0;
+        *Yield_lengthening  = *FV_lengthening;
+    }
+    else {
+        *FV_lengthening     = Vce > 0;
+        *Yield_lengthening  = Vce >= 0;
+    }
+}
+
+
+
+/* Function: MU_DerivativesKernel
+*  Description: Derivatives of the yield, sag, fint and feff states of the n motor units
+*              of fiber type i. fint is driven by fenv, or by the activation input Act when Is_FES is set
+*              (the sag switch then also follows fenv instead of feff). Lengthening selects the yield branch
+*              of Vce (see VceBranches). Is_FES, Has_yield (cY > 0), Has_sag (aS1 != aS2) and Mu_stride are
+*              constants of each instance (MU_DERIVATIVES), so the loops have no configuration branches;
+*              they vectorize when Mu_stride is 1.
+*/
+VM_INLINE void MU_DerivativesKernel(const VM_MUStates *dStates, const VM_MUStates *States, const real_T* VM_RESTRICT fenv,
+                                    real_T Act, const VM_MuscleModel *Model, int_T i, real_T Vce, int_T Lengthening,
+                                    int_T n, int_T Is_FES, int_T Has_yield, int_T Has_sag, int_T Mu_stride)
+{
+    real_T* VM_RESTRICT dYield      = dStates->Yield;
+    real_T* VM_RESTRICT dSag        = dStates->Sag;
+    real_T* VM_RESTRICT dfint       = dStates->fint;
+    real_T* VM_RESTRICT dfeff       = dStates->feff;
+    const real_T* VM_RESTRICT Yield = States->Yield;
+    const real_T* VM_RESTRICT Sag   = States->Sag;
+    const real_T* VM_RESTRICT fint  = States->fint;
+    const real_T* VM_RESTRICT feff  = States->feff;
+    const real_T* VM_RESTRICT rate  = States->rate;
+    real_T cY                       = MODEL_COEFS(Model,cY)[i];
+    real_T aS1                      = MODEL_COEFS(Model,aS1)[i];
+    real_T aS2                      = MODEL_COEFS(Model,aS2)[i];
+    real_T invTs                    = MODEL_COEFS(Model,invTs)[i];
+    real_T Yield_target             = 0.0;
+    int_T  j                        = 0;
+
+    if(Has_yield){ //yield (only for slow fibers)
+        if(Lengthening)
+            Yield_target = 1-cY*(1-exp(-Vce/MODEL_COEFS(Model,VY)[i]));
+        else
+            Yield_target = 1-cY*(1-exp(Vce/MODEL_COEFS(Model,VY)[i]));
+        for(j=0; j<n; j++)
+            dYield[j*Mu_stride] = 5*(Yield_target-Yield[j*Mu_stride]);
+    }
+    else {
+        for(j=0; j<n; j++)
+            dYield[j*Mu_stride] = 0.0;
+    }
+
+    if(Has_sag){ //sag (only for fast fibers)
+        if(Is_FES) {
+            for(j=0; j<n; j++)
+                dSag[j*Mu_stride] = invTs*(((fenv[j]>0.1) ? aS2 : aS1)-Sag[j*Mu_stride]);
+        }
+        else {
+            for(j=0; j<n; j++)
+                dSag[j*Mu_stride] = invTs*(((feff[j*Mu_stride]>0.1) ? aS2 : aS1)-Sag[j*Mu_stride]);
+        }
+    }
+    else {
+        for(j=0; j<n; j++)
+            dSag[j*Mu_stride] = 0.0;
+    }
+
+    if(Is_FES) {
+        for(j=0; j<n; j++)
+            dfint[j*Mu_stride] = (Act-fint[j*Mu_stride])*rate[j]; //d(fint)
+    }
+    else {
+        for(j=0; j<n; j++)
+            dfint[j*Mu_stride] = (fenv[j]-fint[j*Mu_stride])*rate[j]; //d(fint)
+    }
+    for(j=0; j<n; j++){
+        dfeff[j*Mu_stride] = (fint[j*Mu_stride]-feff[j*Mu_stride])*rate[j]; //d(feff_tmp)
+    }
+}
+
+//Instance of MU_DerivativesKernel (VM_MUDerivativesFcn)
+#define MU_DERIVATIVES(NAME,IS_FES,HAS_YIELD,HAS_SAG,MU_STRIDE) \
+static void NAME(const VM_MUStates *dStates, const VM_MUStates *States, const real_T *fenv, real_T Act, \
+                 const VM_MuscleModel *Model, int_T i, real_T Vce, int_T Lengthening, int_T n) \
+{ \
+    MU_DerivativesKernel(dStates, States, fenv, Act, Model, i, Vce, Lengthening, n, \
+                         IS_FES, HAS_YIELD, HAS_SAG, MU_STRIDE); \
+}
+MU_DERIVATIVES(MU_Derivatives_S_N00, 0, 0, 0, 1)
+MU_DERIVATIVES(MU_Derivatives_S_N01, 0, 0, 1, 1)
+MU_DERIVATIVES(MU_Derivatives_S_N10, 0, 1, 0, 1)
+MU_DERIVATIVES(MU_Derivatives_S_N11, 0, 1, 1, 1)
+MU_DERIVATIVES(MU_Derivatives_S_F00, 1, 0, 0, 1)
+MU_DERIVATIVES(MU_Derivatives_S_F01, 1, 0, 1, 1)
+MU_DERIVATIVES(MU_Derivatives_S_F10, 1, 1, 0, 1)
+MU_DERIVATIVES(MU_Derivatives_S_F11, 1, 1, 1, 1)
+MU_DERIVATIVES(MU_Derivatives_I_N00, 0, 0, 0, MU_NUM_STATES)
+MU_DERIVATIVES(MU_Derivatives_I_N01, 0, 0, 1, MU_NUM_STATES)
+MU_DERIVATIVES(MU_Derivatives_I_N10, 0, 1, 0, MU_NUM_STATES)
+MU_DERIVATIVES(MU_Derivatives_I_N11, 0, 1, 1, MU_NUM_STATES)
+MU_DERIVATIVES(MU_Derivatives_I_F00, 1, 0, 0, MU_NUM_STATES)
+MU_DERIVATIVES(MU_Derivatives_I_F01, 1, 0, 1, MU_NUM_STATES)
+MU_DERIVATIVES(MU_Derivatives_I_F10, 1, 1, 0, MU_NUM_STATES)
+MU_DERIVATIVES(MU_Derivatives_I_F11, 1, 1, 1, MU_NUM_STATES)
+
+//[Interleaved][Is_FES][Has_yield][Has_sag]
+static const VM_MUDerivativesFcn MU_derivatives_kernels[2][2][2][2] = {
+    {{{MU_Derivatives_S_N00, MU_Derivatives_S_N01}, {MU_Derivatives_S_N10, MU_Derivatives_S_N11}},
+     {{MU_Derivatives_S_F00, MU_Derivatives_S_F01}, {MU_Derivatives_S_F10, MU_Derivatives_S_F11}}},
+    {{{MU_Derivatives_I_N00, MU_Derivatives_I_N01}, {MU_Derivatives_I_N10, MU_Derivatives_I_N11}},
+     {{MU_Derivatives_I_F00, MU_Derivatives_I_F01}, {MU_Derivatives_I_F10, MU_Derivatives_I_F11}}}
+};
+
+
+
+/* Function: SelectMUKernels
+*  Description: Instances of MU_DerivativesKernel and MU_ActivationKernel of each fiber type, for the
+*              recruitment type, state layout and precision of the model. The yield and sag tests are
+*              those of the generic code: cY > 0 for the derivatives, cY > 0.001 for Af.
+*/
+static void SelectMUKernels(VM_MuscleModel *Model)
+{
+    int_T Interleaved   = MODEL_MU_STRIDE(Model) != 1;
+    int_T Is_FES        = MODEL_RECRUITMENT_TYPE(Model) == 4;
+    const real_T *cY    = MODEL_COEFS(Model,cY);
+    const real_T *aS1   = MODEL_COEFS(Model,aS1);
+    const real_T *aS2   = MODEL_COEFS(Model,aS2);
+    int_T i             = 0;
+
+    for(i=0; i<MODEL_TYPESOF_FIBERS(Model); i++){
+        Model->MU_derivatives[i] = MU_derivatives_kernels[Interleaved][Is_FES][cY[i] > 0][aS1[i] != aS2[i]];
+        Model->MU_activation[i]  = MU_activation_kernels[Model->Single_precision][cY[i] > 0.001][aS1[i] != aS2[i]];
+    }
+}
+
+
+
+
+/* Function: MU_Update
+*  Description: Exact exponential update over h of the yield, sag, fint and feff states of the n motor units
+*              of fiber type i (discrete motor units): x += (target-x)*(1-exp(-rate*h)), with the targets
+*              and rates of MU_DerivativesKernel at the start of the step (the fint of the start is the target
+*              of feff). The rates are those VM_Outputs wrote into the work vector.
+*/
+VM_INLINE void MU_Update(const VM_MUStates *States, const real_T* VM_RESTRICT fenv, real_T Act, int_T Is_FES,
+                         const VM_MuscleModel *Model, int_T i, real_T Vce, real_T h, int_T n, int_T Mu_stride)
+{
+    real_T* VM_RESTRICT Yield       = States->Yield;
+    real_T* VM_RESTRICT Sag         = States->Sag;
+    real_T* VM_RESTRICT fint        = States->fint;
+    real_T* VM_RESTRICT feff        = States->feff;
+    const real_T* VM_RESTRICT rate  = States->rate;
+    real_T cY                       = MODEL_COEFS(Model,cY)[i];
+    real_T aS1                      = MODEL_COEFS(Model,aS1)[i];
+    real_T aS2                      = MODEL_COEFS(Model,aS2)[i];
+    real_T Yield_target             = 0.0;
+    real_T Yield_step               = -expm1(-5*h);
+    real_T Sag_step                 = -expm1(-MODEL_COEFS(Model,invTs)[i]*h);
+    real_T Step                     = 0.0;
+    real_T fint_start               = 0.0;
+    int_T  j                        = 0;
+
+    if(cY > 0){ //yield (only for slow fibers)
+        if(Vce>=0)
+            Yield_target = 1-cY*(1-exp(-Vce/MODEL_COEFS(Model,VY)[i]));
+        else
+            Yield_target = 1-cY*(1-exp(Vce/MODEL_COEFS(Model,VY)[i]));
+        for(j=0; j<n; j++)
+            Yield[j*Mu_stride] += (Yield_target-Yield[j*Mu_stride])*Yield_step;
+    }
+
+    if(aS1 != aS2){ //sag (only for fast fibers)
+        if(Is_FES) {
+            for(j=0; j<n; j++)
+                Sag[j*Mu_stride] += (((fenv[j]>0.1) ? aS2 : aS1)-Sag[j*Mu_stride])*Sag_step;
+        }
+        else {
+            for(j=0; j<n; j++)
+                Sag[j*Mu_stride] += (((feff[j*Mu_stride]>0.1) ? aS2 : aS1)-Sag[j*Mu_stride])*Sag_step;
+        }
+    }
+
+    for(j=0; j<n; j++){
+        Step = -expm1(-rate[j]*h);
+        fint_start = fint[j*Mu_stride];
+        fint[j*Mu_stride] += ((Is_FES ? Act : fenv[j])-fint_start)*Step;
+        feff[j*Mu_stride] += (fint_start-feff[j*Mu_stride])*Step;
+    }
+}
+
+
+
+
+/* Function: VM_InitializeConditions
+*  Description: Fills the work vector and sets the initial states: motor units at rest, Vce 0, and the
+*              fascicle length in equilibrium with the passive and tendon forces at the path length Path (m).
+*/
+void VM_InitializeConditions(const VM_MuscleModel *Model, real_T *x0, real_T *Work_vect, real_T Path)
+{
+    real_T L0               = Model->L0;
+    real_T c1               = Model->c1;
+    real_T k1               = Model->k1;
+    real_T Lr1              = Model->Lr1;
+    real_T kT               = Model->kT;
+    real_T cT               = Model->cT;
+    real_T LrT              = Model->LrT;
+    real_T L0T              = Model->L0T;
+    real_T Lmax             = Model->FASCLMAX;
+    int_T Total_Munits      = MODEL_TOTAL_MUNITS(Model);
+    int_T MU_stride         = MODEL_MU_STRIDE(Model);
+    VM_MUStates States;
+
+    int_T  i                    = 0;
+
+    //Initialize Work Vector variables
+    Work_vect[0]            = Model->MUSCPCSA;
+    Work_vect[1]            = Model->MUSCF0;
+    Work_vect[2]            = Model->FASCLMAX;
+    Work_vect[3]            = Model->MUSCDENSITY;
+
+    //Fill the unit PCSA values in work vectors
+    for(i=0; i<Total_Munits; i++){
+        Work_vect[5+i] = Model->Unit_PCSA[i]; //UNIT_PCSA values
+    }
+    
+    //Initialize UnitPCSA_offset and Recruitment_offset in work vector array
+    Work_vect[4] = Total_Munits;                               //UNIT_PCSA offset
+    Work_vect[5+Total_Munits] = Total_Munits;                  //Recruitement offset
+    Work_vect[5+Total_Munits+1+Total_Munits] = Total_Munits;   //Activation offset
+
+    //No recruitment or activation yet, no active motor units (ACTIVETOL)
+    for(i=0; i<Total_Munits; i++){
+        Work_vect[VM_WORK_FENV(Total_Munits)+i] = 0.0;
+        Work_vect[VM_WORK_AF(Total_Munits)+i]   = 0.0;
+    }
+    Work_vect[VM_WORK_ACTIVE(Total_Munits)] = 0.0;
+    Work_vect[VM_WORK_RECRUITED(Total_Munits)]   = 0.0; //Act 0 recruits no unit
+    Work_vect[VM_WORK_RECRUITED(Total_Munits)+1] = 0.0;
+ 
+    
+    // Initialize states
+    GetMUStates(Model, x0, Work_vect+VM_WORK_RATE(Total_Munits), &States);
+    for(i=0; i<Total_Munits;i++)
+    {
+      States.Yield[i*MU_stride] = 1;  //Yield   default: 1       
+      States.Sag[i*MU_stride]   = Model->aS1[0];    //Sag     default: as1 same as parameter AS1_PARAM (slow-twitch 1, fast-twitch 1.76)
+      States.fint[i*MU_stride]  = 0.0;   //fint    default: 0.0    
+      States.feff[i*MU_stride]  = 0.0;  //feff_tmp default: 0.0		the actual feff state var    
+      States.rate[i]            = 0.0; //feff rise/fall rate, set by VM_Activation
+    }      
+  
+    x0[Total_Munits*MU_NUM_STATES]   = 0.0;  //Vce state unit is (m/s) default: 0
+    x0[Total_Munits*MU_NUM_STATES+1] = ((Path*100) -(-L0T*(kT/k1*Lr1-LrT-kT*log(c1/cT*k1/kT))))/(100*(1+kT/k1*L0T/Lmax*1/L0)); //Lce 
+    x0[Total_Munits*MU_NUM_STATES+2] = 0.0; //<DSadd22> Ulevel from Act input is zero initially (eql to fint)
+    VM_UpdateModes(Model, x0, Work_vect);
+}
+
+
+
+/* Function: VM_InvalidateRecruitment
+*  Description: Marks the last recruitment of the work vector (VM_WORK_RECRUITED) as stale, so that the next
+*              VM_Activation recruits again even at the same activation. For work vectors kept over a rebuild
+*              of the model (tunable parameters): Recruit only rewrites fenv when the activation changes,
+*              and the thresholds, slopes and Fmin of the new model may differ.
+*/
+void VM_InvalidateRecruitment(const VM_MuscleModel *Model, real_T *Work_vect)
+{
+    Work_vect[VM_WORK_RECRUITED(MODEL_TOTAL_MUNITS(Model))+1] = NAN; //equal to no activation
+}
+
+
+
+/* Function: SteadyStateResidual
+*  Description: Acceleration of the muscle mass, (Fse-Fce)/mass, at the states x: the outputs, activation
+*              and derivatives of x (dx: scratch for all the derivatives)
+*/
+static real_T SteadyStateResidual(const VM_MuscleModel *Model, real_T *x, real_T *Work_vect, const VM_Inputs *u,
+                                  real_T *dx, real_T *Arena, VM_ThreadPool *Pool)
+{
+    real_T y[VM_NUM_OUTPUTS];
+
+    VM_Outputs(Model, x, Work_vect, u, y, Pool);
+    if (Model->Act_hold) {
+        VM_Activation(Model, x, Work_vect, u, Pool);
+    }
+    VM_Derivatives(Model, x, Work_vect, u, dx, Arena, Pool);
+    return (Model->MU_step > 0) ? dx[0] : dx[MODEL_TOTAL_MUNITS(Model)*MU_NUM_STATES];
+}
+
+
+
+/* Function: SteadyStateTargets
+*  Description: Puts the states of x0 at their targets for the recruitment of the work vector and Vce 0:
+*              yield 1 (the target of both Vce branches), fint and feff at fenv (Act for Intramuscular
+*              FES), sag at aS2 above 0.1 and aS1 below, Ulevel at Act (Natural Continuous) and Vce 0.
+*              Sets the modes.
+*/
+static void SteadyStateTargets(const VM_MuscleModel *Model, real_T *x0, real_T *Work_vect, const VM_Inputs *u)
+{
+    int_T Total_Munits          = MODEL_TOTAL_MUNITS(Model);
+    int_T TypesOf_fibers        = MODEL_TYPESOF_FIBERS(Model);
+    const int_T* Num_of_Munits  = MODEL_NUM_OF_MUNITS(Model);
+    int_T MU_stride             = MODEL_MU_STRIDE(Model);
+    int_T Is_FES                = MODEL_RECRUITMENT_TYPE(Model) == 4;
+    const real_T *fenv          = Work_vect+VM_WORK_FENV(Total_Munits);
+    VM_MUStates States;
+
+    real_T Target       = 0.0;
+    int_T i             = 0;
+    int_T j             = 0;
+    int_T offset        = 0;
+
+    GetMUStates(Model, x0, Work_vect+VM_WORK_RATE(Total_Munits), &States);
+    for(i=0; i<TypesOf_fibers; i++){
+        for(j=0; j<Num_of_Munits[i]; j++){
+            Target = Is_FES ? u->Act : fenv[offset];
+            States.Yield[offset*MU_stride] = 1;
+            States.fint[offset*MU_stride]  = Target;
+            States.feff[offset*MU_stride]  = Target;
+            if (Model->aS1[i] != Model->aS2[i])
+                States.Sag[offset*MU_stride] = (((Is_FES ? fenv[offset] : Target) > 0.1) ? Model->aS2[i] : Model->aS1[i]);
+            offset++;
+        }
+    }
+    x0[Total_Munits*MU_NUM_STATES]   = 0.0;
+    x0[Total_Munits*MU_NUM_STATES+2] = (MODEL_RECRUITMENT_TYPE(Model) == 3) ? u->Act : 0.0;
+    VM_UpdateModes(Model, x0, Work_vect);
+}
+
+
+
+/* Function: VM_SteadyStateConditions
+*  Description: Steady state of the inputs u (INITSTATE 2), from the states of VM_InitializeConditions.
+*              The motor unit states go to their targets (SteadyStateTargets). Lce is then
+*              found with a damped Newton iteration on Fse-Fce, with the slope by a forward difference:
+*              a step is halved until the residual decreases. Returns 0, with the resting states back,
+*              if it does not converge or the allocation fails.
+*/
+int_T VM_SteadyStateConditions(const VM_MuscleModel *Model, real_T *x0, real_T *Work_vect, const VM_Inputs *u,
+                               real_T *Arena, VM_ThreadPool *Pool)
+{
+    int_T Total_Munits          = MODEL_TOTAL_MUNITS(Model);
+    real_T *Lce_state           = x0+Total_Munits*MU_NUM_STATES+1;
+    real_T Tolerance            = VM_STEADY_FORCE_TOL*Model->MUSCF0*Model->invMass;
+    real_T *dx                  = NULL;
+
+    real_T Residual     = 0.0;
+    real_T Trial        = 0.0;
+    real_T Slope        = 0.0;
+    real_T Step         = 0.0;
+    real_T Lce          = 0.0;
+    int_T Converged     = 0;
+    int_T Iteration     = 0;
+    int_T Halving       = 0;
+
+    dx = (real_T*)malloc(VM_NUM_STATES(Total_Munits)*sizeof(real_T));
+    if (dx == NULL) {
+        return 0;
+    }
+
+    //Recruitment of the inputs, from the resting states
+    SteadyStateResidual(Model, x0, Work_vect, u, dx, Arena, Pool);
+
+    //Motor unit and Ulevel states at their targets, Vce 0
+    SteadyStateTargets(Model, x0, Work_vect, u);
+
+    //Damped Newton iteration on Lce, which stays positive (VM_Outputs reinitializes the states otherwise)
+    Residual = SteadyStateResidual(Model, x0, Work_vect, u, dx, Arena, Pool);
+    for(Iteration=0; Iteration<VM_STEADY_MAX_ITERATIONS && !(fabs(Residual) <= Tolerance); Iteration++){
+        Lce = *Lce_state;
+        Step = VM_STEADY_FD_STEP*Lce;
+        *Lce_state = Lce+Step;
+        Slope = (SteadyStateResidual(Model, x0, Work_vect, u, dx, Arena, Pool)-Residual)/Step;
+        *Lce_state = Lce;
+        if (!(fabs(Slope) > 0) || !isfinite(Slope))
+            break;
+        Step = -Residual/Slope;
+        for(Halving=0; Halving<VM_STEADY_MAX_HALVINGS; Halving++){
+            *Lce_state = Lce+Step;
+            if (*Lce_state > 0) {
+                Trial = SteadyStateResidual(Model, x0, Work_vect, u, dx, Arena, Pool);
+                if (fabs(Trial) < fabs(Residual))
+                    break;
+            }
+            Step *= 0.5;
+        }
+        if (Halving == VM_STEADY_MAX_HALVINGS) {
+            *Lce_state = Lce;
+            break;
+        }
+        Residual = Trial;
+    }
+    Converged = (fabs(Residual) <= Tolerance);
+
+    //Work vector of the final states (or back to rest)
+    if (Converged)
+        SteadyStateResidual(Model, x0, Work_vect, u, dx, Arena, Pool);
+    else
+        VM_InitializeConditions(Model, x0, Work_vect, u->Path);
+    free(dx);
+    return Converged;
+}
+
+
+
+/* Function: VM_SteadyStateForce
+*  Description: Fce (N) with the motor unit states at their isometric targets (SteadyStateTargets) for the
+*              inputs u (Act, Freq) and the fascicle at the length Lce (Lo) and velocity Vce (Lo/s), the
+*              samples of the surrogate tables (Virtual_Muscle_Surrogate.h). The yield stays at its Vce 0
+*              target: it builds up over TY, and taken at its target for Vce it lowers the force of small
+*              lengthening velocities, a negative damping that the surrogates would oscillate on. x0 and
+*              Work_vect are scratch state and work vectors, dx scratch for all the derivatives. The path
+*              is set to the fascicle length, so that Fse is negligible and Fce is -mass*dVce.
+*/
+real_T VM_SteadyStateForce(const VM_MuscleModel *Model, real_T *x0, real_T *Work_vect, const VM_Inputs *u,
+                           real_T Lce, real_T Vce, real_T *dx, real_T *Arena)
+{
+    int_T Total_Munits  = MODEL_TOTAL_MUNITS(Model);
+    VM_Inputs Held      = *u;
+    real_T Residual     = 0.0;
+
+    Held.Path = Lce*Model->L0/100;
+    VM_InitializeConditions(Model, x0, Work_vect, Held.Path);
+    x0[Total_Munits*MU_NUM_STATES+1] = Held.Path;
+
+    //Recruitment of the inputs, then the motor units at their targets
+    SteadyStateResidual(Model, x0, Work_vect, &Held, dx, Arena, NULL);
+    SteadyStateTargets(Model, x0, Work_vect, &Held);
+    x0[Total_Munits*MU_NUM_STATES] = Vce*Model->L0/100;
+    VM_UpdateModes(Model, x0, Work_vect);
+    Residual = SteadyStateResidual(Model, x0, Work_vect, &Held, dx, Arena, NULL);
+    return Work_vect[VM_WORK_FSE(Total_Munits)]-Residual/Model->invMass;
+}
+
+
+
+/* Function: VM_UpdateModes
+*  Description: Sets the FV branch and feff rise/fall modes of the work vector from the state x. With
+*              ZEROCROSS the derivatives use these modes instead of the signs of Vce and fint-feff, and
+*              they are only updated at the major time steps, where the solver has located the switches.
+*/
+void VM_UpdateModes(const VM_MuscleModel *Model, const real_T *x, real_T *Work_vect)
+{
+    int_T Total_Munits  = MODEL_TOTAL_MUNITS(Model);
+    int_T MU_stride     = MODEL_MU_STRIDE(Model);
+    real_T *Modes       = Work_vect+VM_WORK_MODES(Total_Munits);
+    VM_MUStates States;
+    int_T j             = 0;
+
+    GetMUStates(Model, x, NULL, &States);
+    Modes[0] = (x[Total_Munits*MU_NUM_STATES] > 0) ? 1.0 : 0.0; //lengthening
+    for(j=0; j<Total_Munits; j++){
+        Modes[1+j] = ((States.fint[j*MU_stride]-States.feff[j*MU_stride])>=0) ? 1.0 : 0.0; //feff'>0
+    }
+}
+
+
+
+/* Function: VM_ZeroCrossings
+*  Description: Zero crossing signals of the modes of VM_UpdateModes (ZEROCROSS): zc[0] Vce and, with
+*              continuous motor units, zc[1+j] fint-feff of motor unit j
+*/
+void VM_ZeroCrossings(const VM_MuscleModel *Model, const real_T *x, real_T *zc)
+{
+    int_T Total_Munits  = MODEL_TOTAL_MUNITS(Model);
+    int_T MU_stride     = MODEL_MU_STRIDE(Model);
+    VM_MUStates States;
+    int_T j             = 0;
+
+    zc[0] = x[Total_Munits*MU_NUM_STATES];
+    if (Model->Num_zcs == 1) { //discrete motor units
+        return;
+    }
+    GetMUStates(Model, x, NULL, &States);
+    for(j=0; j<Total_Munits; j++){
+        zc[1+j] = States.fint[j*MU_stride]-States.feff[j*MU_stride];
+    }
+}
+
+
+
+
+#ifdef VM_PROFILE
+/* Function: VM_ResetProfile
+*  Description: Zeroes the instrumentation counters of the work vector (VM_WORK_PROFILE)
+*/
+void VM_ResetProfile(const VM_MuscleModel *Model, real_T *Work_vect)
+{
+    real_T *Profile = Work_vect+VM_WORK_PROFILE(MODEL_TOTAL_MUNITS(Model));
+    int_T k         = 0;
+
+    for(k=0; k<VM_WORK_PROFILE_SIZE(MODEL_TOTAL_MUNITS(Model),MODEL_TYPESOF_FIBERS(Model)); k++){
+        Profile[k] = 0.0;
+    }
+}
+
+
+
+/* Function: ProfileCall
+*  Description: Counts a call started at Start (ticks) in Profile[Counter] and its ticks in Profile[Counter+1]
+*/
+static void ProfileCall(real_T *Profile, int_T Counter, real_T Start)
+{
+    Profile[Counter]++;
+    Profile[Counter+1] += VM_PROFILE_TICKS()-Start;
+}
+
+
+
+/* Function: ProfileRecruitment
+*  Description: Adds the recruitment fenv to the recruited motor unit histogram of each fiber type.
+*              Natural Continuous and FES recruit per fiber type: the type is either empty or full.
+*/
+static void ProfileRecruitment(const VM_MuscleModel *Model, const real_T *fenv, real_T *Profile)
+{
+    real_T *Histogram   = Profile+VM_PROF_NUM_COUNTERS+MODEL_TOTAL_MUNITS(Model);
+    int_T Num_units     = 1;
+    int_T Recruited     = 0;
+    int_T offset        = 0;
+    int_T i             = 0;
+    int_T j             = 0;
+
+    for(i=0; i<MODEL_TYPESOF_FIBERS(Model); i++){
+        Recruited = 0;
+        if (MODEL_RECRUITMENT_TYPE(Model) == 2) {
+            Num_units = MODEL_NUM_OF_MUNITS(Model)[i];
+            for(j=offset; j<offset+Num_units; j++){
+                if (fenv[j] > 0)
+                    Recruited++;
+            }
+            offset += Num_units;
+        }
+        else if (fenv[i] > 0) {
+            Recruited = 1;
+        }
+        if (Num_units > 0)
+            Histogram[i*(VM_PROFILE_BINS+1) + Recruited*VM_PROFILE_BINS/Num_units]++;
+    }
+    Profile[VM_PROF_RECRUITMENTS]++;
+}
+
+
+
+/* Function: ProfileRiseFall
+*  Description: Counts the motor units offset to offset+n-1 whose feff branch (rise if fint >= feff, as in
+*              MU_RiseFall) changed since they were last evaluated
+*/
+static void ProfileRiseFall(const VM_MUStates *States, int_T MU_stride, real_T *Profile, int_T offset, int_T n)
+{
+    real_T *Branch  = Profile+VM_PROF_NUM_COUNTERS;
+    real_T Rise     = 0.0;
+    int_T j         = 0;
+
+    for(j=offset; j<offset+n; j++){
+        Rise = ((States->fint[j*MU_stride]-States->feff[j*MU_stride])>=0) ? 1.0 : -1.0;
+        if (Branch[j] != 0 && Branch[j] != Rise)
+            Profile[VM_PROF_FLIPS]++;
+        Branch[j] = Rise;
+    }
+}
+#endif /* VM_PROFILE */
+
+
+
+
+/* Function: UsePool
+*  Description: Whether the motor unit loops of the model run on the thread pool Pool (NUMTHREADS)
+*/
+static int_T UsePool(const VM_MuscleModel *Model, const VM_ThreadPool *Pool)
+{
+    return Pool != NULL && VM_ThreadPoolSize(Pool) > 1 && MODEL_TOTAL_MUNITS(Model) >= VM_THREAD_MIN_MUNITS;
+}
+
+
+
+/* Function: NumChunks
+*  Description: Number of tasks of the threaded motor unit loops: VM_THREAD_CHUNK consecutive motor
+*              units of one fiber type each, whatever the number of threads
+*/
+static int_T NumChunks(const VM_MuscleModel *Model)
+{
+    int_T Num_chunks    = 0;
+    int_T i             = 0;
+
+    for(i=0; i<MODEL_TYPESOF_FIBERS(Model); i++){
+        Num_chunks += (MODEL_NUM_OF_MUNITS(Model)[i]+VM_THREAD_CHUNK-1)/VM_THREAD_CHUNK;
+    }
+    return Num_chunks;
+}
+
+
+
+/* Function: ChunkRange
+*  Description: Fiber type i, first motor unit offset and number of motor units n of task Task
+*/
+static void ChunkRange(const VM_MuscleModel *Model, int_T Task, int_T *i, int_T *offset, int_T *n)
+{
+    int_T Type_chunks   = 0;
+    int_T First         = 0;
+
+    *i = 0;
+    *offset = 0;
+    for(;;){
+        Type_chunks = (MODEL_NUM_OF_MUNITS(Model)[*i]+VM_THREAD_CHUNK-1)/VM_THREAD_CHUNK;
+        if (Task < Type_chunks)
+            break;
+        Task -= Type_chunks;
+        *offset += MODEL_NUM_OF_MUNITS(Model)[*i];
+        (*i)++;
+    }
+    First = Task*VM_THREAD_CHUNK;
+    *offset += First;
+    *n = MODEL_NUM_OF_MUNITS(Model)[*i]-First;
+    if (*n > VM_THREAD_CHUNK)
+        *n = VM_THREAD_CHUNK;
+}
+
+
+
+/*Arguments of the MU_Fascicles tasks of VM_Activation*/
+typedef struct {
+    const VM_MuscleModel *Model;
+    const VM_MUStates *States;
+    const real_T *fenv;
+    real_T *Af;
+    const real_T *Rise;
+    real_T Lce;
+} VM_FasciclesTask;
+
+/* Function: FasciclesChunk
+*  Description: MU_Fascicles of the motor units of task Task (VM_RunTasks)
+*/
+static void FasciclesChunk(void *Arg, int_T Task)
+{
+    const VM_FasciclesTask *T   = (const VM_FasciclesTask*)Arg;
+    int_T i                     = 0;
+    int_T offset                = 0;
+    int_T n                     = 0;
+
+    ChunkRange(T->Model, Task, &i, &offset, &n);
+    MU_Fascicles(T->States, T->fenv, T->Af, T->Rise, T->Model, i, offset, T->Lce, n);
+}
+
+
+
+/*Arguments of MU_DerivativesRange, and of its tasks in VM_Derivatives*/
+typedef struct {
+    const VM_MuscleModel *Model;
+    const real_T *x;
+    const real_T *Rate;         //feff rise/fall rates of the work vector (VM_WORK_RATE)
+    real_T *dx;
+    const real_T *fenv;
+    real_T Act;
+    real_T Vce;
+    int_T Yield_lengthening;
+} VM_DerivativesTask;
+
+/* Function: MU_DerivativesRange
+*  Description: MU_DerivativesKernel instance of the n motor units of fiber type i starting at motor unit offset.
+*              Fixed muscle builds inline the kernel: with the constant i, offset and n of VM_FIXED_TYPES the
+*              configuration tests and coefficients fold and the loops have constant trip counts.
+*/
+VM_INLINE void MU_DerivativesRange(const VM_DerivativesTask *T, int_T i, int_T offset, int_T n)
+{
+    const VM_MuscleModel *Model = T->Model;
+    VM_MUStates States;
+    VM_MUStates dStates;
+
+    GetMUStates(Model, T->x+offset*MODEL_MU_STRIDE(Model), T->Rate+offset, &States);
+    GetMUStates(Model, T->dx+offset*MODEL_MU_STRIDE(Model), NULL, &dStates);
+#ifdef VM_FIXED_MUSCLE
+    MU_DerivativesKernel(&dStates, &States, T->fenv+offset, T->Act, Model, i, T->Vce, T->Yield_lengthening, n,
+                         MODEL_RECRUITMENT_TYPE(Model) == 4, MODEL_COEFS(Model,cY)[i] > 0,
+                         MODEL_COEFS(Model,aS1)[i] != MODEL_COEFS(Model,aS2)[i], MODEL_MU_STRIDE(Model));
+#else
+    Model->MU_derivatives[i](&dStates, &States, T->fenv+offset, T->Act, Model, i, T->Vce, T->Yield_lengthening, n);
+#endif
+}
+
+/* Function: DerivativesChunk
+*  Description: MU_DerivativesRange of the motor units of task Task (VM_RunTasks)
+*/
+static void DerivativesChunk(void *Arg, int_T Task)
+{
+    const VM_DerivativesTask *T = (const VM_DerivativesTask*)Arg;
+    int_T i                     = 0;
+    int_T offset                = 0;
+    int_T n                     = 0;
+
+    ChunkRange(T->Model, Task, &i, &offset, &n);
+    MU_DerivativesRange(T, i, offset, n);
+}
+
+
+
+
+/* Function: VM_Activation
+*  Description: Recruitment (fenv) and activation (Af) of the motor units for the state x and the inputs u:
+*              writes the feff rise/fall rates, fenv and Af into the work vector for
+*              VM_Derivatives. Called by VM_Outputs, or at the motor unit sample hits only when the
+*              activation is held between them (MULTIRATE, Act_hold).
+*/
+void VM_Activation(const VM_MuscleModel *Model, const real_T *x, real_T *Work_vect, const VM_Inputs *u,
+                   VM_ThreadPool *Pool)
+{    
+    int_T  UnitPCSA_Offset      = MODEL_TOTAL_MUNITS(Model);
+    int_T  Recruitment_Offset   = UnitPCSA_Offset; 
+    real_T *fenv                = Work_vect+5+UnitPCSA_Offset+1; //Recruitment output values (fenv) of each MU
+    real_T *Af                  = fenv+Recruitment_Offset+1; //Af_op of each MU
+    real_T *Active              = Work_vect+VM_WORK_ACTIVE(Recruitment_Offset); //Active motor units (ACTIVETOL)
+    real_T *Recruited           = Work_vect+VM_WORK_RECRUITED(Recruitment_Offset); //Last recruitment
+    int_T Num_active            = 0;
+    //Held rise/fall modes of the continuous motor units (ZEROCROSS)
+    const real_T *Rise          = (Model->Zero_cross && Model->MU_step <= 0) ? Work_vect+VM_WORK_MODES(Recruitment_Offset)+1 : NULL;
+
+    VM_MUStates States;
+    VM_FasciclesTask Fascicles_task;
+    int_T MU_stride             = MODEL_MU_STRIDE(Model);
+    
+    // Recruitment block variables   
+    const int_T* Num_of_Munits =  MODEL_NUM_OF_MUNITS(Model);
+    real_T* Fmax            =  Model->Fmax;
+    real_T* Fmin            =  Model->Fmin;
+    int_T  Recruitment_Type =  MODEL_RECRUITMENT_TYPE(Model);
+    int_T TypesOf_fibers    =  MODEL_TYPESOF_FIBERS(Model);
+    real_T* invf05          =  Model->invf05;
+    
+    //<DSadd22> add MUCR (case2)
+    const real_T* Threshold_TypeArray = Model->Type_threshold;
+    
+    int_T offset            = 0;
+    int_T Total_Munits      = MODEL_TOTAL_MUNITS(Model);
+
+    // Fascicle block variables
+    const real_T* Tf1                   =  MODEL_COEFS(Model,Tf1);
+    const real_T* Tf2                   =  MODEL_COEFS(Model,Tf2);
+    const real_T* Tf3                   =  MODEL_COEFS(Model,Tf3);
+    const real_T* Tf4                   =  MODEL_COEFS(Model,Tf4);
+    const real_T* cY                    =  MODEL_COEFS(Model,cY);
+    const real_T* nf0                   =  MODEL_COEFS(Model,nf0);
+    const real_T* nf1                   =  MODEL_COEFS(Model,nf1);
+    const real_T* af                    =  MODEL_COEFS(Model,af);
+    const real_T* aS1                   =  MODEL_COEFS(Model,aS1);
+    const real_T* aS2                   =  MODEL_COEFS(Model,aS2);
+
+    real_T Yield_Munit                  = 0.0;
+    real_T Sag_Munit                    = 0.0;
+    real_T invTf1                       = 0.0;
+    real_T invTf2                       = 0.0;
+    real_T nf                           = 0.0; 
+    real_T Lce                          = 0.0;
+    
+    //FES recruitment (works for 20 fiber types)
+    //     real_T Running_Total[20]; //TODO: Make it dynamic
+
+    //Temp variables
+    int_T i                 = 0;
+    int_T j                 = 0;
+    int_T k                 = 0;
+    int_T n                 = 0;
+#ifdef VM_PROFILE
+    real_T *Profile         = Work_vect+VM_WORK_PROFILE(Total_Munits);
+    real_T Start            = VM_PROFILE_TICKS();
+#endif
+
+           
+    GetMUStates(Model, x, Work_vect+VM_WORK_RATE(Total_Munits), &States);
+    Lce = Model->invL0*x[1+(Total_Munits*MU_NUM_STATES)];
+    
+    /*Implement Recruitment Block*/   
+    
+    switch(Recruitment_Type){
+
+        case 2: //Natural
+            if (Model->Active_tol > 0)
+                Num_active = UpdateActiveSet(Model, &States, fenv, Af, Active, Recruited, u->Act);
+            else
+                Recruit(Model, fenv, Recruited, u->Act);
+            break;
+            
+         case 3: //<DSadd22> get one more case for contineous recruitment
+            //Calculate fenv for each fiber type use the fomula: Y=(Fmax-Fmin)*X+Fmin
+            for(i=0; i<TypesOf_fibers; i++){
+                    if(u->Act >= Threshold_TypeArray[i]) {
+                        fenv[i] = ((Fmax[i]-Fmin[i])/(1-Threshold_TypeArray[i])) * (u->Act-Threshold_TypeArray[i]) + Fmin[i]; 
+                    }
+                   else {
+                        fenv[i] = 0.0;
+                    }
+                }
+                
+            break;      
+            
+        case 4: //Intramuscular FES 
+            offset = 0;                 
+            for(i=0; i<TypesOf_fibers; i++){ 
+                for(j=0; j<Num_of_Munits[i]; j++){
+                    fenv[offset] = u->Freq* invf05[i];                       
+                                  
+                    offset++;                 
+                    
+                }               
+            }                                       
+            break;    
+
+    }    
+#ifdef VM_PROFILE
+    ProfileRecruitment(Model, fenv, Profile);
+#endif
+            
+    /*Implement Fascicles (A)*/
+    if (Recruitment_Type == 4){ //Intramuscular FES 
+        for(i=0; i<TypesOf_fibers; i++){   //one unit per fiber type    
+            if(cY[i] > 0.0)
+                Yield_Munit = States.Yield[i*MU_stride]; //Only slow fibers have yield
+            else
+                Yield_Munit = 1.0;  //u1
+            
+            nf = nf0[i]+nf1[i]*((1/Lce)-1); //u2
+            
+            if(aS1[i] == aS2[i]) //u4
+               Sag_Munit = 1.0; //No sag slow fibers
+            else
+               Sag_Munit = States.Sag[i*MU_stride]; //Only fast fibers have sag
+           
+            //u3 is fenv input -> f05 output of (unit) recruiment 
+            
+            if (Model->Single_precision)
+                Af[i] = 1.0f-expf(-powf((float)Yield_Munit*(float)Sag_Munit*(float)fenv[i]/((float)af[i]*(float)nf),(float)nf));
+            else
+                Af[i] = 1-exp(-pow((Yield_Munit*Sag_Munit*(fenv[i])/(af[i]*nf)),nf));
+        }//end for i        
+    } //end if Intramuscular FES
+    else if (Model->Active_tol > 0) {
+        //Active motor units only, in runs of consecutive units of one fiber type
+        i = 0;
+        offset = 0; //first unit of fiber type i
+        k = 0;
+        while (k < Num_active) {
+            j = (int_T)Active[1+k];
+            while (j >= offset+Num_of_Munits[i]) {
+                offset += Num_of_Munits[i];
+                i++;
+            }
+            n = 1;
+            while (k+n < Num_active && (int_T)Active[1+k+n] == j+n && j+n < offset+Num_of_Munits[i])
+                n++;
+            MU_Fascicles(&States, fenv, Af, Rise, Model, i, j, Lce, n);
+#ifdef VM_PROFILE
+            ProfileRiseFall(&States, MU_stride, Profile, j, n);
+#endif
+            k += n;
+        }
+    }
+    else if (UsePool(Model, Pool)) {
+        //Every motor unit on its own, in chunks on the threads
+        Fascicles_task.Model    = Model;
+        Fascicles_task.States   = &States;
+        Fascicles_task.fenv     = fenv;
+        Fascicles_task.Af       = Af;
+        Fascicles_task.Rise     = Rise;
+        Fascicles_task.Lce      = Lce;
+        VM_RunTasks(Pool, FasciclesChunk, &Fascicles_task, NumChunks(Model));
+#ifdef VM_PROFILE
+        ProfileRiseFall(&States, MU_stride, Profile, 0, Total_Munits);
+#endif
+    }
+    else {
+#ifdef VM_FIXED_MUSCLE
+    //One MU_Fascicles per fiber type, with the constants of the header
+#define MU_FASCICLES_TYPE(I,OFFSET,N) MU_Fascicles(&States, fenv, Af, Rise, Model, I, OFFSET, Lce, N);
+    VM_FIXED_TYPES(MU_FASCICLES_TYPE)
+#undef MU_FASCICLES_TYPE
+#ifdef VM_PROFILE
+    ProfileRiseFall(&States, MU_stride, Profile, 0, Total_Munits);
+#endif
+#else
+    offset = 0;
+    for(i=0; i<TypesOf_fibers; i++){
+        
+        //Motorunit specific things (find Af_op): rise/fall rate first, it uses Af_op of the previous call
+        MU_Fascicles(&States, fenv, Af, Rise, Model, i, offset, Lce, Num_of_Munits[i]);
+#ifdef VM_PROFILE
+        ProfileRiseFall(&States, MU_stride, Profile, offset, Num_of_Munits[i]);
+#endif
+        offset += Num_of_Munits[i]; //would indicate the total # of MU
+   }
+#endif
+
+} //end for else
+
+    /* Implement rise and fall block for Intramuscular FES */
+    if (Recruitment_Type == 4){ //Intramuscular FES
+        for(i=0; i<TypesOf_fibers; i++){            
+            //u1--Lce, u2--fenv, u3 -- 1 / 0
+            if (Model->Single_precision) {
+                invTf2 = (float)Lce/((float)Tf3[i]+(float)Tf4[i]*((u->Act > 0) ? 1.0f : 0.0f)); //feff'<0
+                invTf1 = 1.0f/((float)(Tf1[i]*pow(Lce,2))+(float)Tf2[i]*(float)fenv[i]); //feff'>0
+            }
+            else {
+            if (u->Act > 0) 
+                invTf2 = Lce/(Tf3[i]+Tf4[i]*1); //feff'<0
+            else 
+                invTf2 = Lce/(Tf3[i]+Tf4[i]*0); //feff'<0
+            
+            invTf1 = 1/(Tf1[i]*pow(Lce,2)+Tf2[i]*(fenv[i])); //feff'>0
+            }
+                        
+            if((Rise != NULL) ? Rise[i] > 0 : (States.fint[i*MU_stride]-States.feff[i*MU_stride])>=0) 
+                States.rate[i] = invTf1;
+            else 
+                States.rate[i] = invTf2;                       
+        }//end for
+#ifdef VM_PROFILE
+        ProfileRiseFall(&States, MU_stride, Profile, 0, TypesOf_fibers);
+#endif
+    }//end if    
+#ifdef VM_PROFILE
+    if (Model->Act_hold) //called at the motor unit updates of mdlOutputs, else timed with VM_Outputs
+        Profile[VM_PROF_OUTPUTS_TICKS] += VM_PROFILE_TICKS()-Start;
+#endif
+    
+} //VM_Activation
+
+
+
+
+/* Function: VM_Outputs
+*  Description: Series elastic force (Fse) of the state x and the inputs u, and the recruitment and
+*              activation of VM_Activation unless they are held between motor unit updates (Act_hold).
+*              Writes Fse into the work vector for VM_Derivatives, and the outputs into y[VM_NUM_OUTPUTS].
+*              The states are initialized first if Lce is not positive (path length read as zero on the
+*              first call).
+*/
+void VM_Outputs(const VM_MuscleModel *Model, real_T *x, real_T *Work_vect, const VM_Inputs *u, real_T *y,
+                VM_ThreadPool *Pool)
+{    
+    real_T MUSCF0           = Model->MUSCF0;
+    int_T Total_Munits      = MODEL_TOTAL_MUNITS(Model);
+
+    //Muscle Mass variables
+    real_T Lce              = 0.0;
+    real_T Vce              = 0.0;
+    
+    //Series Elastic Element variables
+    real_T L0               = Model->L0;
+    real_T kT               = Model->kT;
+    real_T cT               = Model->cT;        
+    real_T LrT              = Model->LrT;
+    
+    real_T prov             = 0.0;
+    real_T Fse              = 0.0;
+#ifdef VM_PROFILE
+    real_T *Profile         = Work_vect+VM_WORK_PROFILE(Total_Munits);
+    real_T Start            = VM_PROFILE_TICKS();
+    real_T Reinit_start     = 0.0;
+#endif
+
+           
+    //Initialize the states if the path length read zero on the first iteration
+    if (x[Total_Munits*MU_NUM_STATES+1] <= 0.0) {
+#ifdef VM_PROFILE
+        Reinit_start = VM_PROFILE_TICKS();
+#endif
+        VM_InitializeConditions(Model, x, Work_vect, u->Path);
+#ifdef VM_PROFILE
+        ProfileCall(Profile, VM_PROF_REINITS, Reinit_start);
+#endif
+    }
+
+    
+    /*Implement Muscle Mass*/    
+    Lce = Model->invL0*x[1+(Total_Munits*MU_NUM_STATES)];
+    Vce = Model->invL0*x[0+(Total_Munits*MU_NUM_STATES)];  
+    
+    /*Implement Series Elastic Element*/
+    prov = Model->invL0T*((u->Path*100) - L0 * Lce); 
+    Fse = cT*kT*log( exp((prov-LrT)/kT) + 1)*MUSCF0;
+
+    //Outputs, and Fse for VM_Derivatives
+    Work_vect[VM_WORK_FSE(Total_Munits)] = Fse;
+    y[VM_OUT_FSE]   = Fse;
+    y[VM_OUT_ACT]   = u->Act;
+    y[VM_OUT_FSEF0] = Fse/MUSCF0;
+    y[VM_OUT_LCE]   = Lce;
+    y[VM_OUT_VCE]   = Vce;
+  
+    if (!Model->Act_hold) {
+        VM_Activation(Model, x, Work_vect, u, Pool);
+    }
+#ifdef VM_PROFILE
+    ProfileCall(Profile, VM_PROF_OUTPUTS, Start);
+#endif
+} //VM_Outputs
+
+
+
+
+/* Function: VM_Derivatives
+*  Description: Derivatives dx of the state x, with the fenv, Af and Fse values written into the work
+*              vector by VM_Outputs for the same x and inputs u. With discrete motor units (MU_step > 0)
+*              dx only holds the derivatives of Vce, Lce and Ulevel. Arena is the scratch memory
+*              (VM_ARENA_SIZE(TypesOf_fibers) values, see VM_CreateMuscleSet).
+*/
+  void VM_Derivatives(const VM_MuscleModel *Model, const real_T *x, const real_T *Work_vect, const VM_Inputs *u,
+                      real_T *dx, real_T *Arena, VM_ThreadPool *Pool)
+  {
+    real_T MUSCF0               = Model->MUSCF0;
+    real_T *dx_muscle           = (Model->MU_step > 0) ? dx : dx+MODEL_TOTAL_MUNITS(Model)*MU_NUM_STATES; //Vce, Lce and Ulevel
+    real_T FASCLMAX             = Model->FASCLMAX;
+    int_T  UnitPCSA_Offset      = MODEL_TOTAL_MUNITS(Model); 
+    int_T  Recruitment_Offset   = UnitPCSA_Offset; 
+    const real_T *fenv          = Work_vect+5+UnitPCSA_Offset+1; //Recruitment output values (fenv) of each MU
+    const real_T *Af_op         = fenv+Recruitment_Offset+1; //Af_op of each MU
+    VM_MUStates States;
+    VM_DerivativesTask MU_task;
+    int_T MU_stride             = MODEL_MU_STRIDE(Model);
+
+    
+    //Fascicles 
+    real_T Viscocity                    = Model->Viscocity;
+    real_T c1                           = Model->c1;
+    real_T k1                           = Model->k1;
+    real_T Lr1                          = Model->Lr1;
+    real_T c2                           = Model->c2;
+    real_T k2                           = Model->k2;
+    real_T Lr2                          = Model->Lr2;
+    const real_T* bV                    = MODEL_COEFS(Model,bV);
+    const real_T* aV0                   = MODEL_COEFS(Model,aV0);
+    const real_T* aV1                   = MODEL_COEFS(Model,aV1);
+    const real_T* aV2                   = MODEL_COEFS(Model,aV2);
+    const real_T* Vmax                  = MODEL_COEFS(Model,Vmax);
+    const real_T* cV0                   = MODEL_COEFS(Model,cV0);
+    const real_T* cV1                   = MODEL_COEFS(Model,cV1);
+    const real_T* FL_beta               = MODEL_COEFS(Model,FL_beta);
+    const real_T* FL_omega              = MODEL_COEFS(Model,FL_omega);
+    const real_T* FL_rho                = MODEL_COEFS(Model,FL_rho);
+
+    real_T Total_Force_Munits           = 0.0;
+    real_T Fpe                          = 0.0;
+    real_T Fpe1                         = 0.0;
+    real_T Fpe2                         = 0.0;
+    real_T Force_Munits                 = 0.0;
+ 
+    /*Note: any number of fiber types, PEpFLtFV is the arena */
+    real_T FL                          = 0.0;
+    real_T FV                          = 0.0;
+    real_T* PEpFLtFV                   = Arena; //[TypesOf_fibers]
+    
+    // <DSadd22> MUCR 
+    const real_T* Threshold_TypeArray  = Model->Type_threshold;
+    real_T U_deno              = 0.0;  //
+    real_T Total_PEpFLtFV      = 0.0;  //if 3 fiber types:  Total_PEpFLFV = (PEpFLFV1*(U-U1)/U_deno + PEpFLFV2*(U-U2)/U_deno + PEpFLFV3*(U-U3)/U_deno);
+    real_T Total_Af_PEpFLtFV   = 0.0;  //<DSadd24>
+    int_T  Recruitment_Type    = MODEL_RECRUITMENT_TYPE(Model);
+    real_T* Unit_PCSA          = Model->Unit_PCSA;
+    real_T* Fract_PCSA         = Model->Fract_PCSA;
+   
+    
+    // Parameters
+    int_T TypesOf_fibers    = MODEL_TYPESOF_FIBERS(Model);
+    const int_T* Num_of_Munits = MODEL_NUM_OF_MUNITS(Model);
+ 
+    // Variables
+    real_T Ftotal           = 0.0;
+    real_T Fse              = 0.0;
+    real_T Fce              = 0.0;
+    real_T Lce              = 0.0;
+    real_T Vce              = 0.0;   
+    int_T Total_Munits      = MODEL_TOTAL_MUNITS(Model);
+    
+    int_T i                 = 0;
+    int_T j                 = 0;
+    int_T k                 = 0;
+    int_T offset            = 0;
+    const real_T* Active    = Work_vect+VM_WORK_ACTIVE(Total_Munits); //Active motor units (ACTIVETOL)
+    const real_T* FL_coef   = NULL;  //FL table interval of Lce (fiber type 0)
+    real_T FL_s             = 0.0;   //position of Lce in the interval [0,1)
+    real_T Lce2             = 0.0;
+
+    //<DSadd25> He's variables:
+    real_T ActF             = 0.0;
+    real_T Af               = 0.0;
+    int_T FV_lengthening    = 0;
+    int_T Yield_lengthening = 0;
+#ifdef VM_PROFILE
+    //The counters are the only part of the work vector written here
+    real_T *Profile         = (real_T*)Work_vect+VM_WORK_PROFILE(Total_Munits);
+    real_T Start            = VM_PROFILE_TICKS();
+#endif
+    
+    //Muscle Mass
+    //duplicate it here to avoid storing Vce and Lce
+    Lce = Model->invL0*x[1+(Total_Munits*MU_NUM_STATES)];
+    Vce = Model->invL0*x[0+(Total_Munits*MU_NUM_STATES)];
+    VceBranches(Model, Work_vect, Vce, &FV_lengthening, &Yield_lengthening);
+    
+    Fpe1 = Viscocity*Vce+c1*k1*log(exp((Lce/FASCLMAX-Lr1)/k1)+1);
+    Fpe2 = c2*(exp(k2*(Lce-Lr2))-1);
+
+    if(Fpe2>0)
+        Fpe2 = 0.0;
+    
+    //FL table interval, the same for all fiber types
+    if (Model->FL_table != NULL && Lce >= 0 && Lce < VM_FL_TABLE_LMAX) {
+        FL_s = Lce*Model->FL_invh;
+        j = (int_T)FL_s;
+        if (j >= Model->FL_intervals)
+            j = Model->FL_intervals-1;
+        FL_s -= j;
+        FL_coef = Model->FL_table + j*4;
+    }
+    Lce2 = Lce*Lce;
+    
+    for(i=0; i<TypesOf_fibers; i++){
+        
+        //Only the active FV branch is evaluated
+        if(FV_lengthening)
+            FV = (bV[i]-(aV0[i]+aV1[i]*Lce+(aV2[i])*Lce2)*Vce)/(bV[i]+Vce); //lengthening
+        else 
+            FV = (Vmax[i]-Vce)/(Vmax[i]+(cV0[i]+cV1[i]*Lce)*Vce); //shortening
+        
+        if (FL_coef != NULL) {
+            FL = FL_coef[0]+FL_s*(FL_coef[1]+FL_s*(FL_coef[2]+FL_s*FL_coef[3]));
+            FL_coef += Model->FL_intervals*4;
+        }
+        else
+            FL = FL_Exact(Lce, FL_omega[i], FL_beta[i], FL_rho[i]);
+            
+        if (Recruitment_Type == 4) //IntraFES
+            PEpFLtFV[i] = FL*FV;
+        else 
+            PEpFLtFV[i] = Fpe2+(FL*FV); 
+        //Activation[]
+   }
+    
+//Start of switch for adding one more recruitment MUCR (case2) //<DSadd22>
+   //Calculate total forces based on Recruitment_Type (case2 MUCR, case 0 and 1 original)
+    switch(Recruitment_Type){
+        case 3: //<DSadd22> Af_opth*percent of Uth taken of input U
+            //Add up the denominator of (U-U1)+(U-U2)+(U-U3)
+            U_deno=0;
+            for(i=0; i<TypesOf_fibers; i++)
+                U_deno +=(x[2+(Total_Munits*MU_NUM_STATES)]-Threshold_TypeArray[i])*(x[2+(Total_Munits*MU_NUM_STATES)]>=Threshold_TypeArray[i]);//<DSadd22>
+            //To avoid divided by 0, reset U_deno=0 when U<Uth1
+            if (U_deno==0)
+                U_deno=1; 
+            //Add up all fiber type forces, motor unit i being fiber type i
+            Total_PEpFLtFV = 0.0; //if 3 fiber types:  Total_PEpFLFV = (PEpFLFV1*(U-U1)/U_deno + PEpFLFV2*(U-U2)/U_deno + PEpFLFV3*(U-U3)/U_deno);
+            Total_Af_PEpFLtFV = 0.0; //<DSadd24> sum of Weight_j*[Af_j*(FlFV+fpe2)_j]
+            for(i=0; i<TypesOf_fibers; i++){
+                Total_PEpFLtFV += PEpFLtFV[i]*(x[2+(Total_Munits*MU_NUM_STATES)]>=Threshold_TypeArray[i])*(x[2+(Total_Munits*MU_NUM_STATES)]-Threshold_TypeArray[i])/U_deno;
+                Total_Af_PEpFLtFV += Af_op[i]*PEpFLtFV[i]*(x[2+(Total_Munits*MU_NUM_STATES)]>=Threshold_TypeArray[i])*(x[2+(Total_Munits*MU_NUM_STATES)]-Threshold_TypeArray[i])/U_deno;
+             }
+             Total_Force_Munits = Total_Af_PEpFLtFV * x[2+(Total_Munits*MU_NUM_STATES)]; // <DSadd24>
+            Fce = MUSCF0 * (Fpe1 + Total_Force_Munits); 
+        break;
+       
+
+        
+        case 2: //Force and Stiffness calculation Before DSadd22-add MUCR
+            //Add up all motor unit forces based on PCSA
+            offset = 0;
+            Total_Force_Munits = 0.0;
+
+            if (Model->Active_tol > 0) { //resting units have Af_op 0, the fiber types without active units add 0
+                i = 0;
+                Force_Munits = 0.0;
+                for(k=0; k<(int_T)Active[0]; k++){
+                    j = (int_T)Active[1+k];
+                    if (j >= offset+Num_of_Munits[i]) { //next fiber type with active units
+                        if (k > 0)
+                            Total_Force_Munits += Force_Munits*PEpFLtFV[i];// Af*(Fpe2+FL*FV)
+                        Force_Munits = 0.0;
+                        while (j >= offset+Num_of_Munits[i]) {
+                            offset += Num_of_Munits[i];
+                            i++;
+                        }
+                    }
+                    Force_Munits += Af_op[j]*Unit_PCSA[j];
+                }
+                if (k > 0)
+                    Total_Force_Munits += Force_Munits*PEpFLtFV[i];
+                Fce = MUSCF0 * (Fpe1 + Total_Force_Munits);
+                break;
+            }
+            for(i=0; i<TypesOf_fibers; i++){
+                Force_Munits = 0.0; //Af_type <DSaddcomment> 
+                for(j=0; j<Num_of_Munits[i]; j++){
+                    Force_Munits += Af_op[offset]*Unit_PCSA[offset]; //Af_op*Fpcsa
+                    offset++;
+                }
+                Force_Munits = Force_Munits * PEpFLtFV[i];// Af*(Fpe2+FL*FV)
+
+                Total_Force_Munits += Force_Munits;
+            }
+            Fce = MUSCF0 * (Fpe1 + Total_Force_Munits); 
+
+          break;
+          
+        case 4: //Force and Stiffness calculation Before DSadd22-add MUCR
+            //Add up all motor unit forces based on PCSA
+            offset = 0;
+            Total_Force_Munits = 0.0;
+            GetMUStates(Model, x, NULL, &States);
+            for(i=0; i<TypesOf_fibers; i++){
+                Force_Munits = 0.0; //Af_type <DSaddcomment> 
+                for(j=0; j<Num_of_Munits[i]; j++){
+                   Force_Munits += Af_op[offset]*Fract_PCSA[i]; 
+                   offset++;
+                }
+                Af = Force_Munits;
+                Force_Munits = Force_Munits * PEpFLtFV[i];// Af*(Fpe2+FL*FV)
+                Force_Munits *= MUSCF0;
+                Fpe += Af*Fpe2;  
+                //each fiber type (unit)'s feff times each fiber type's F0 output, respectively
+                ActF += States.feff[i*MU_stride]* Force_Munits;
+            }
+            Fpe = (Fpe+Fpe1)*MUSCF0; 
+            if (Fpe < 0) 
+                Fpe = 0.0;     
+          Fce = ActF + Fpe;
+          break;
+
+    }
+    
+    //End of switch for adding one more recruitment MUCR (case2)
+
+   if(Fce < 0.0) {
+       Fce = 0.0;
+   }
+   
+    Fse = Work_vect[VM_WORK_FSE(Total_Munits)]; //Series elastic force from VM_Outputs
+    Ftotal = Fse - Fce;
+    
+    dx_muscle[0] = Ftotal * Model->invMass; //Vce = Int(Acc)
+    dx_muscle[1] = x[0+(Total_Munits*MU_NUM_STATES)]; //Lce = Int(Vce)
+    //start <DSadd22>Integrate the state Ulevel if RTYPE=3, dUlevel=(Act-Ulevel)/Tao
+    if(Recruitment_Type==3){
+            if(u->Act-x[2+(Total_Munits*MU_NUM_STATES)]>=0)
+                dx_muscle[2] = (u->Act-x[2+(Total_Munits*MU_NUM_STATES)])*1/0.03; //<DSadd23> different tao
+            else 
+                dx_muscle[2] = (u->Act-x[2+(Total_Munits*MU_NUM_STATES)])*1/0.15;
+    }
+    else 
+        dx_muscle[2] = 0.0;       
+    //end <DSadd22>Integrate the state Ulevel if RTYPE=3   
+       
+    if (Model->MU_step > 0) { //Discrete motor units, see VM_UpdateMUStates
+#ifdef VM_PROFILE
+        ProfileCall(Profile, VM_PROF_DERIVATIVES, Start);
+#endif
+        return;
+    }
+    MU_task.Model               = Model;
+    MU_task.x                   = x;
+    MU_task.Rate                = Work_vect+VM_WORK_RATE(Total_Munits);
+    MU_task.dx                  = dx;
+    MU_task.fenv                = fenv;
+    MU_task.Act                 = u->Act;
+    MU_task.Vce                 = Vce;
+    MU_task.Yield_lengthening   = Yield_lengthening;
+    if (UsePool(Model, Pool)) {
+        VM_RunTasks(Pool, DerivativesChunk, &MU_task, NumChunks(Model));
+    }
+    else {
+#ifdef VM_FIXED_MUSCLE
+#define MU_DERIVATIVES_TYPE(I,OFFSET,N) MU_DerivativesRange(&MU_task, I, OFFSET, N);
+        VM_FIXED_TYPES(MU_DERIVATIVES_TYPE)
+#undef MU_DERIVATIVES_TYPE
+#else
+        offset = 0;
+        for(i=0; i<TypesOf_fibers; i++) {
+            MU_DerivativesRange(&MU_task, i, offset, Num_of_Munits[i]);
+            offset += Num_of_Munits[i];
+        }
+#endif
+    }
+#ifdef VM_PROFILE
+    ProfileCall(Profile, VM_PROF_DERIVATIVES, Start);
+#endif
+  }
+
+
+/* Function: VM_UpdateMUStates
+*  Description: Advances the motor unit states of x over h (s) with the exact exponential update of
+*              discrete motor units (MU_Update), from the fenv values and the feff rise/fall rates written
+*              into the work vector by VM_Outputs for the same x and inputs u.
+*/
+void VM_UpdateMUStates(const VM_MuscleModel *Model, real_T *x, const real_T *Work_vect, const VM_Inputs *u,
+                       real_T h)
+{
+    int_T  Total_Munits     = MODEL_TOTAL_MUNITS(Model);
+    const real_T *fenv      = Work_vect+VM_WORK_FENV(Total_Munits);
+    real_T Vce              = Model->invL0*x[0+(Total_Munits*MU_NUM_STATES)];
+    int_T  MU_stride        = MODEL_MU_STRIDE(Model);
+#ifndef VM_FIXED_MUSCLE
+    int_T  offset           = 0;
+    int_T  i                = 0;
+#endif
+    VM_MUStates States;
+
+#ifdef VM_FIXED_MUSCLE
+#define MU_UPDATE_TYPE(I,OFFSET,N) \
+    GetMUStates(Model, x+(OFFSET)*MU_stride, Work_vect+VM_WORK_RATE(Total_Munits)+(OFFSET), &States); \
+    MU_Update(&States, fenv+(OFFSET), u->Act, MODEL_RECRUITMENT_TYPE(Model) == 4, Model, I, Vce, h, N, MU_stride);
+    VM_FIXED_TYPES(MU_UPDATE_TYPE)
+#undef MU_UPDATE_TYPE
+#else
+    for(i=0; i<MODEL_TYPESOF_FIBERS(Model); i++) {
+        GetMUStates(Model, x+offset*MU_stride, Work_vect+VM_WORK_RATE(Total_Munits)+offset, &States);
+        MU_Update(&States, fenv+offset, u->Act, MODEL_RECRUITMENT_TYPE(Model) == 4, Model, i, Vce, h,
+                  MODEL_NUM_OF_MUNITS(Model)[i], MU_stride);
+        offset += MODEL_NUM_OF_MUNITS(Model)[i];
+    }
+#endif
+}
+
+
+
+/* Function: VM_Jacobian
+*  Description: Analytic Jacobian d(dx)/dx of VM_Derivatives at the state x and inputs u, in compressed
+*              sparse column form: the rows and values of column k are Ir and Pr [Jc[k] .. Jc[k+1]-1].
+*              The outputs are differentiated through, as they are evaluated again whenever x changes:
+*              Af and Fse follow their states, and the Lce dependence of the feff rise/fall rates (work
+*              vector) goes to the Lce column. The switches (rise/fall, sag,
+*              FV branch, force limits) and the Af of the previous call in the fall rate are held. fenv is
+*              read from the work vector; it depends on the inputs only.
+*
+*              The pattern only depends on Total_Munits and the state layout (VM_JACOBIAN_NZ entries):
+*              the first 4 states of each motor unit couple to themselves and to Vce, the yield states
+*              also depend on Vce, the fint and feff states on Lce, and Vce on all the states. Entries
+*              of the pattern that are zero for the fiber type or recruitment type are kept.
+*              Returns the number of entries and sets Jc[0] .. Jc[Num_states]. Arena is the scratch memory
+*              (VM_ARENA_SIZE(TypesOf_fibers) values).
+*/
+int_T VM_Jacobian(const VM_MuscleModel *Model, const real_T *x, const real_T *Work_vect, const VM_Inputs *u,
+                  int_T *Ir, int_T *Jc, real_T *Pr, real_T *Arena)
+{
+    int_T  Total_Munits         = MODEL_TOTAL_MUNITS(Model);
+    int_T  TypesOf_fibers       = MODEL_TYPESOF_FIBERS(Model);
+    const int_T* Num_of_Munits  = MODEL_NUM_OF_MUNITS(Model);
+    int_T  Recruitment_Type     = MODEL_RECRUITMENT_TYPE(Model);
+    int_T  Is_FES               = Recruitment_Type == 4;
+    int_T  MU_stride            = MODEL_MU_STRIDE(Model);
+    int_T  MU_field             = MODEL_MU_FIELD(Model);
+    const real_T *fenv          = Work_vect+VM_WORK_FENV(Total_Munits);
+    const real_T *Af_op         = Work_vect+VM_WORK_AF(Total_Munits);
+    const real_T *Unit_weight   = (Recruitment_Type == 2) ? Model->Unit_PCSA : NULL;
+    real_T MUSCF0               = Model->MUSCF0;
+    real_T FASCLMAX             = Model->FASCLMAX;
+    real_T invL0                = Model->invL0;
+    real_T invMass              = Model->invMass;
+    VM_MUStates States;
+
+    //Rows of the muscle states, and first entries of their columns
+    int_T  Vce_row              = Total_Munits*MU_NUM_STATES;
+    int_T  Lce_row              = Total_Munits*MU_NUM_STATES+1;
+    int_T  U_row                = Total_Munits*MU_NUM_STATES+2;
+    int_T  Vce_col              = 8*Total_Munits;
+    int_T  Lce_col              = 9*Total_Munits+2;
+    int_T  U_col                = 11*Total_Munits+3;
+    //Entries of the motor unit columns (2 per state) and of their Lce column rows
+    int_T  Col_stride           = (MU_stride == 1) ? 1 : 4;
+    int_T  Col_field            = (MU_stride == 1) ? Total_Munits : 1;
+    int_T  Lce_stride           = (MU_stride == 1) ? 1 : 2;
+    int_T  Lce_field            = (MU_stride == 1) ? Total_Munits : 1;
+
+    /*Per fiber type arrays, from the arena */
+    real_T* FL                  = Arena;
+    real_T* dFL                 = FL+TypesOf_fibers;
+    real_T* FV                  = dFL+TypesOf_fibers;
+    real_T* dFV_V               = FV+TypesOf_fibers;
+    real_T* dFV_L               = dFV_V+TypesOf_fibers;
+    real_T* PEpFLtFV            = dFV_L+TypesOf_fibers;
+    real_T* dFce_dP             = PEpFLtFV+TypesOf_fibers;  //d(Fce)/d(PEpFLtFV)
+    real_T* Af_coef             = dFce_dP+TypesOf_fibers;   //d(Fce)/d(Af_op), times Unit_PCSA for Natural Discrete
+    real_T* feff_coef           = Af_coef+TypesOf_fibers;   //d(Fce)/d(feff) of Intramuscular FES
+    const real_T* Threshold_TypeArray = Model->Type_threshold;
+    
+    real_T Lce                  = invL0*x[Lce_row];
+    real_T Vce                  = invL0*x[Vce_row];
+    int_T  FV_lengthening       = 0;
+    int_T  Yield_lengthening    = 0;
+    real_T U                    = x[U_row];
+    real_T Lce2                 = Lce*Lce;
+    real_T Fpe1                 = 0.0;
+    real_T Fpe2                 = 0.0;
+    real_T dFpe1_L              = 0.0;
+    real_T dFpe2_L              = 0.0;
+    real_T Fpe                  = 0.0;
+    real_T Fpe_on               = 0.0;
+    real_T Fce                  = 0.0;
+    real_T dFce_dFpe1           = 0.0;
+    real_T dFce_dFpe2           = 0.0;
+    real_T dFce_dV              = 0.0;
+    real_T dFce_dL              = 0.0;
+    real_T dFce_dU              = 0.0;
+    real_T dFse_dx              = 0.0;
+    real_T prov                 = 0.0;
+    real_T U_deno               = 0.0;
+    real_T Weight               = 0.0;
+    real_T Total_Af_PEpFLtFV    = 0.0;
+    real_T Active_Af_PEpFLtFV   = 0.0;
+    real_T Force_Munits         = 0.0;
+    int_T  Num_active           = 0;
+    const real_T* FL_coef       = NULL;
+    real_T FL_s                 = 0.0;
+    real_T D                    = 0.0;
+
+    //Motor unit variables
+    real_T nf                   = 0.0;
+    real_T Yield_Munit          = 0.0;
+    real_T Sag_Munit            = 0.0;
+    real_T f_Munit              = 0.0;
+    real_T z                    = 0.0;
+    real_T w                    = 0.0;
+    real_T dAf_log              = 0.0; //d(Af)/d(log) of each factor of z
+    real_T dAf_L                = 0.0;
+    real_T coef                 = 0.0;
+    real_T rate                 = 0.0;
+    real_T drate_x              = 0.0;
+    real_T Yield_slope          = 0.0;
+    int_T  Has_yield            = 0;
+    int_T  Has_sag              = 0;
+    int_T  p                    = 0;
+    int_T  i                    = 0;
+    int_T  j                    = 0;
+    int_T  k                    = 0;
+    int_T  offset               = 0;
+
+    GetMUStates(Model, x, Work_vect+VM_WORK_RATE(Total_Munits), &States);
+
+    /*Passive, FL and FV curves and their slopes (as VM_Derivatives)*/
+    Fpe1 = Model->Viscocity*Vce+Model->c1*Model->k1*log(exp((Lce/FASCLMAX-Model->Lr1)/Model->k1)+1);
+    dFpe1_L = Model->c1/FASCLMAX/(1+exp(-(Lce/FASCLMAX-Model->Lr1)/Model->k1));
+    Fpe2 = Model->c2*(exp(Model->k2*(Lce-Model->Lr2))-1);
+    dFpe2_L = Model->c2*Model->k2*exp(Model->k2*(Lce-Model->Lr2));
+    if(Fpe2>0){
+        Fpe2 = 0.0;
+        dFpe2_L = 0.0;
+    }
+    
+    if (Model->FL_table != NULL && Lce >= 0 && Lce < VM_FL_TABLE_LMAX) {
+        FL_s = Lce*Model->FL_invh;
+        j = (int_T)FL_s;
+        if (j >= Model->FL_intervals)
+            j = Model->FL_intervals-1;
+        FL_s -= j;
+        FL_coef = Model->FL_table + j*4;
+    }
+    
+    VceBranches(Model, Work_vect, Vce, &FV_lengthening, &Yield_lengthening);
+    for(i=0; i<TypesOf_fibers; i++){
+        if(FV_lengthening){ //lengthening
+            D = Model->bV[i]+Vce;
+            FV[i] = (Model->bV[i]-(Model->aV0[i]+Model->aV1[i]*Lce+Model->aV2[i]*Lce2)*Vce)/D;
+            dFV_V[i] = -Model->bV[i]*(Model->aV0[i]+Model->aV1[i]*Lce+Model->aV2[i]*Lce2+1)/(D*D);
+            dFV_L[i] = -(Model->aV1[i]+2*Model->aV2[i]*Lce)*Vce/D;
+        }
+        else { //shortening
+            D = Model->Vmax[i]+(Model->cV0[i]+Model->cV1[i]*Lce)*Vce;
+            FV[i] = (Model->Vmax[i]-Vce)/D;
+            dFV_V[i] = -Model->Vmax[i]*(1+Model->cV0[i]+Model->cV1[i]*Lce)/(D*D);
+            dFV_L[i] = -(Model->Vmax[i]-Vce)*Model->cV1[i]*Vce/(D*D);
+        }
+        
+        if (FL_coef != NULL) {
+            FL[i] = FL_coef[0]+FL_s*(FL_coef[1]+FL_s*(FL_coef[2]+FL_s*FL_coef[3]));
+            dFL[i] = (FL_coef[1]+FL_s*(2*FL_coef[2]+FL_s*3*FL_coef[3]))*Model->FL_invh;
+            FL_coef += Model->FL_intervals*4;
+        }
+        else {
+            FL[i] = FL_Exact(Lce, Model->FL_omega[i], Model->FL_beta[i], Model->FL_rho[i]);
+            dFL[i] = FL_ExactSlope(Lce, Model->FL_omega[i], Model->FL_beta[i], Model->FL_rho[i]);
+        }
+        
+        PEpFLtFV[i] = Is_FES ? FL[i]*FV[i] : Fpe2+FL[i]*FV[i];
+        feff_coef[i] = 0.0;
+    }
+    
+    /*Active force and its derivatives with respect to PEpFLtFV, Af_op, Fpe1, Fpe2 and Ulevel*/
+    switch(Recruitment_Type){
+        case 3:
+            U_deno = 0.0;
+            Num_active = 0;
+            for(i=0; i<TypesOf_fibers; i++){
+                if(U>=Threshold_TypeArray[i]){
+                    U_deno += U-Threshold_TypeArray[i];
+                    Num_active++;
+                }
+            }
+            D = (U_deno == 0) ? 1 : U_deno;
+            Total_Af_PEpFLtFV = 0.0;
+            Active_Af_PEpFLtFV = 0.0;
+            for(i=0; i<TypesOf_fibers; i++){
+                Weight = (U>=Threshold_TypeArray[i]) ? (U-Threshold_TypeArray[i])/D : 0.0;
+                Total_Af_PEpFLtFV += Af_op[i]*PEpFLtFV[i]*Weight;
+                if(U>=Threshold_TypeArray[i])
+                    Active_Af_PEpFLtFV += Af_op[i]*PEpFLtFV[i]/D;
+                dFce_dP[i] = MUSCF0*U*Af_op[i]*Weight;
+                Af_coef[i] = MUSCF0*U*PEpFLtFV[i]*Weight;
+            }
+            Fce = MUSCF0*(Fpe1+Total_Af_PEpFLtFV*U);
+            dFce_dU = MUSCF0*(Total_Af_PEpFLtFV+U*Active_Af_PEpFLtFV);
+            if(U_deno != 0)
+                dFce_dU -= MUSCF0*U*Total_Af_PEpFLtFV*Num_active/D;
+            dFce_dFpe1 = MUSCF0;
+            break;
+
+        case 2:
+            offset = 0;
+            Fce = Fpe1;
+            for(i=0; i<TypesOf_fibers; i++){
+                Force_Munits = 0.0;
+                for(j=0; j<Num_of_Munits[i]; j++){
+                    Force_Munits += Af_op[offset]*Model->Unit_PCSA[offset];
+                    offset++;
+                }
+                Fce += Force_Munits*PEpFLtFV[i];
+                dFce_dP[i] = MUSCF0*Force_Munits;
+                Af_coef[i] = MUSCF0*PEpFLtFV[i];
+            }
+            Fce *= MUSCF0;
+            dFce_dFpe1 = MUSCF0;
+            break;
+
+        case 4:
+            offset = 0;
+            Fce = 0.0;
+            Fpe = 0.0;
+            Force_Munits = 0.0;
+            for(i=0; i<TypesOf_fibers; i++){
+                Weight = 0.0; //Af of the fiber type
+                for(j=0; j<Num_of_Munits[i]; j++){
+                    Weight += Af_op[offset]*Model->Fract_PCSA[i];
+                    offset++;
+                }
+                Force_Munits += Weight;
+                Fpe += Weight*Fpe2;
+                Fce += States.feff[i*MU_stride]*Weight*PEpFLtFV[i]*MUSCF0;
+                dFce_dP[i] = MUSCF0*States.feff[i*MU_stride]*Weight;
+                feff_coef[i] = MUSCF0*Weight*PEpFLtFV[i];
+            }
+            Fpe = (Fpe+Fpe1)*MUSCF0;
+            Fpe_on = (Fpe < 0) ? 0.0 : 1.0; //passive force limit
+            Fce += Fpe_on*Fpe;
+            for(i=0; i<TypesOf_fibers; i++){
+                Af_coef[i] = MUSCF0*Model->Fract_PCSA[i]*(States.feff[i*MU_stride]*PEpFLtFV[i]+Fpe_on*Fpe2);
+            }
+            dFce_dFpe1 = Fpe_on*MUSCF0;
+            dFce_dFpe2 = Fpe_on*MUSCF0*Force_Munits;
+            break;
+    }
+    if(!Is_FES){
+        for(i=0; i<TypesOf_fibers; i++){
+            dFce_dFpe2 += dFce_dP[i];
+        }
+    }
+    if(Fce < 0.0) { //force limit
+        for(i=0; i<TypesOf_fibers; i++){
+            dFce_dP[i] = 0.0;
+            Af_coef[i] = 0.0;
+            feff_coef[i] = 0.0;
+        }
+        dFce_dFpe1 = 0.0;
+        dFce_dFpe2 = 0.0;
+        dFce_dU = 0.0;
+    }
+    
+    dFce_dV = dFce_dFpe1*Model->Viscocity;
+    dFce_dL = dFce_dFpe1*dFpe1_L+dFce_dFpe2*dFpe2_L;
+    for(i=0; i<TypesOf_fibers; i++){
+        dFce_dV += dFce_dP[i]*FL[i]*dFV_V[i];
+        dFce_dL += dFce_dP[i]*(dFL[i]*FV[i]+FL[i]*dFV_L[i]);
+    }
+    
+    /*Motor unit columns, and their rows of the Vce and Lce columns*/
+    offset = 0;
+    for(i=0; i<TypesOf_fibers; i++){
+        nf = Model->nf0[i]+Model->nf1[i]*((1/Lce)-1);
+        Has_yield = Is_FES ? Model->cY[i] > 0.0 : Model->cY[i] > 0.001;
+        Has_sag = Model->aS1[i] != Model->aS2[i];
+        Yield_slope = 0.0;
+        if(Model->cY[i] > 0){
+            if(Yield_lengthening)
+                Yield_slope = -Model->cY[i]*exp(-Vce/Model->VY[i])/Model->VY[i];
+            else
+                Yield_slope = Model->cY[i]*exp(Vce/Model->VY[i])/Model->VY[i];
+        }
+        for(j=0; j<Num_of_Munits[i]; j++){
+            k = offset+j;
+            
+            //Af = 1-exp(-w), w = z^nf
+            Yield_Munit = Has_yield ? States.Yield[k*MU_stride] : 1.0;
+            Sag_Munit   = Has_sag ? States.Sag[k*MU_stride] : 1.0;
+            f_Munit     = Is_FES ? fenv[k] : States.feff[k*MU_stride];
+            z = Yield_Munit*Sag_Munit*f_Munit/(Model->af[i]*nf);
+            if(z > 0){
+                w = pow(z,nf);
+                dAf_log = exp(-w)*w*nf;
+                dAf_L = exp(-w)*w*(log(z)-1)*(-Model->nf1[i]/Lce2);
+            }
+            else {
+                dAf_log = 0.0;
+                dAf_L = 0.0;
+            }
+            coef = (Unit_weight != NULL) ? Af_coef[i]*Unit_weight[k] : Af_coef[i];
+            dFce_dL += coef*dAf_L;
+            
+            //Yield
+            p = 2*(k*Col_stride+0*Col_field);
+            Ir[p]   = k*MU_stride+0*MU_field;
+            Pr[p]   = (Model->cY[i] > 0) ? -5.0 : 0.0;
+            Ir[p+1] = Vce_row;
+            Pr[p+1] = Has_yield ? -invMass*coef*dAf_log/Yield_Munit : 0.0;
+            //Sag
+            p = 2*(k*Col_stride+1*Col_field);
+            Ir[p]   = k*MU_stride+1*MU_field;
+            Pr[p]   = Has_sag ? -Model->invTs[i] : 0.0;
+            Ir[p+1] = Vce_row;
+            Pr[p+1] = Has_sag ? -invMass*coef*dAf_log/Sag_Munit : 0.0;
+            //fint
+            rate    = States.rate[k];
+            p = 2*(k*Col_stride+2*Col_field);
+            Ir[p]   = k*MU_stride+2*MU_field;
+            Pr[p]   = -rate;
+            Ir[p+1] = k*MU_stride+3*MU_field;
+            Pr[p+1] = rate;
+            //feff
+            p = 2*(k*Col_stride+3*Col_field);
+            Ir[p]   = k*MU_stride+3*MU_field;
+            Pr[p]   = -rate;
+            Ir[p+1] = Vce_row;
+            Pr[p+1] = Is_FES ? -invMass*feff_coef[i] : -invMass*coef*dAf_log/f_Munit;
+            
+            //Vce column: yield target
+            Ir[Vce_col+k] = k*MU_stride;
+            Pr[Vce_col+k] = (Model->cY[i] > 0) ? 5*Yield_slope*invL0 : 0.0;
+            
+            //Lce column: rise rate 1/(Tf1*Lce^2+Tf2*fenv), fall rate Lce/(Tf3+Tf4*Af)
+            if((States.fint[k*MU_stride]-States.feff[k*MU_stride])>=0)
+                drate_x = -2*Model->Tf1[i]*Lce*rate*rate*invL0;
+            else
+                drate_x = rate/Lce*invL0;
+            p = Lce_col+k*Lce_stride;
+            Ir[p] = k*MU_stride+2*MU_field;
+            Pr[p] = ((Is_FES ? u->Act : fenv[k])-States.fint[k*MU_stride])*drate_x;
+            p += Lce_field;
+            Ir[p] = k*MU_stride+3*MU_field;
+            Pr[p] = (States.fint[k*MU_stride]-States.feff[k*MU_stride])*drate_x;
+        }
+        offset += Num_of_Munits[i];
+    }
+    
+    /*Muscle columns*/
+    prov = Model->invL0T*((u->Path*100) - Model->L0 * Lce);
+    dFse_dx = -Model->cT*MUSCF0/(1+exp(-(prov-Model->LrT)/Model->kT))*Model->invL0T*Model->L0*invL0;
+    
+    Ir[Vce_col+Total_Munits]    = Vce_row;
+    Pr[Vce_col+Total_Munits]    = -invMass*dFce_dV*invL0;
+    Ir[Vce_col+Total_Munits+1]  = Lce_row;
+    Pr[Vce_col+Total_Munits+1]  = 1.0;
+    
+    Ir[Lce_col+2*Total_Munits]  = Vce_row;
+    Pr[Lce_col+2*Total_Munits]  = invMass*(dFse_dx-dFce_dL*invL0);
+    
+    Ir[U_col]   = Vce_row;
+    Pr[U_col]   = -invMass*dFce_dU;
+    Ir[U_col+1] = U_row;
+    if(Recruitment_Type==3)
+        Pr[U_col+1] = (u->Act-U>=0) ? -1/0.03 : -1/0.15;
+    else
+        Pr[U_col+1] = 0.0;
+    
+    /*Column starts*/
+    for(k=0; k<Total_Munits; k++){
+        for(j=0; j<MU_NUM_STATES; j++){
+            Jc[k*MU_stride+j*MU_field] = 2*(k*Col_stride+j*Col_field);
+        }
+    }
+    Jc[Vce_row]     = Vce_col;
+    Jc[Lce_row]     = Lce_col;
+    Jc[U_row]       = U_col;
+    Jc[U_row+1]     = U_col+2;
+    
+    return U_col+2;
+}
+
+
+
+/* Function: AlignArena
+*  Description: First VM_ARENA_ALIGN aligned address of Block, which has VM_ARENA_ALIGN spare bytes
+*/
+static real_T* AlignArena(void *Block)
+{
+    return (real_T*)(((size_t)Block + VM_ARENA_ALIGN-1) & ~(size_t)(VM_ARENA_ALIGN-1));
+}
+
+
+
+/* Function: VM_FreeMuscleSet
+*  Description: Frees the muscle set and its models
+*/
+void VM_FreeMuscleSet(VM_MuscleSet *Set)
+{
+    int_T m = 0;
+
+    if (Set != NULL) {
+        for(m=0; m<Set->Num_muscles; m++){
+            VM_FreeModel(Set->Model[m]);
+        }
+        free(Set->Arena_block);
+        free(Set);
+    }
+}
+
+
+
+/* Function: VM_CreateMuscleSet
+*  Description: Creates the model of every muscle of the parameter set P. Returns NULL, with the reason
+*              in *Error (may be NULL), if one of the models cannot be created.
+*/
+VM_MuscleSet* VM_CreateMuscleSet(const VM_ParamSet *P, const char **Error)
+{
+    VM_MuscleSet *Set       = NULL;
+    VM_ParamSet Muscle_params;
+    VM_Sizes Sizes;
+    int_T Num_muscles       = (int_T)VM_OPTIONAL_PARAM_VALUE(P,NUMMUSCLES_IDX,1);
+    int_T Arena_size        = 0;
+    int_T m                 = 0;
+
+    //One allocation: set, inputs, outputs, model pointers, then offsets
+    Set = (VM_MuscleSet*)calloc(1, sizeof(VM_MuscleSet) + Num_muscles*(sizeof(VM_Inputs)
+                                   + VM_NUM_OUTPUTS*sizeof(real_T) + sizeof(VM_MuscleModel*) + 2*sizeof(int_T)));
+    if (Set == NULL) {
+        if (Error != NULL)
+            *Error = "Could not allocate the muscle model";
+        return NULL;
+    }
+    Set->u              = (VM_Inputs*)(Set+1);
+    Set->y              = (real_T*)(Set->u+Num_muscles);
+    Set->Model          = (VM_MuscleModel**)(Set->y+VM_NUM_OUTPUTS*Num_muscles);
+    Set->State_offset   = (int_T*)(Set->Model+Num_muscles);
+    Set->Work_offset    = Set->State_offset+Num_muscles;
+    Set->Num_muscles    = Num_muscles;
+
+    for(m=0; m<Num_muscles; m++){
+        VM_GetMuscleParams(P, m, &Muscle_params);
+        Set->Model[m] = VM_CreateModel(&Muscle_params, Error);
+        if (Set->Model[m] == NULL) {
+            VM_FreeMuscleSet(Set);
+            return NULL;
+        }
+        VM_GetSizes(&Muscle_params, &Sizes);
+        Set->State_offset[m]    = Set->Num_states;
+        Set->Work_offset[m]     = Set->Work_size;
+        Set->Num_states        += Sizes.Num_states;
+        Set->Work_size         += Sizes.Work_size;
+        if (VM_ARENA_SIZE(Set->Model[m]->TypesOf_fibers) > Arena_size)
+            Arena_size          = VM_ARENA_SIZE(Set->Model[m]->TypesOf_fibers);
+    }
+    
+    //Scratch arena of the largest muscle, shared by all of them
+    Set->Arena_block = malloc(Arena_size*sizeof(real_T) + VM_ARENA_ALIGN);
+    if (Set->Arena_block == NULL) {
+        if (Error != NULL)
+            *Error = "Could not allocate the muscle model";
+        VM_FreeMuscleSet(Set);
+        return NULL;
+    }
+    Set->Arena = AlignArena(Set->Arena_block);
+    return Set;
+}
+
+
+
+/* Function: VM_MuscleSetInitializeConditions
+*  Description: VM_InitializeConditions of every muscle, at the path lengths of the inputs u, then
+*              VM_SteadyStateConditions at the inputs u for the muscles with INITSTATE 2
+*/
+int_T VM_MuscleSetInitializeConditions(const VM_MuscleSet *Set, real_T *x0, real_T *Work, const VM_Inputs *u)
+{
+    int_T Not_converged = 0;
+    int_T m             = 0;
+
+    for(m=0; m<Set->Num_muscles; m++){
+        VM_InitializeConditions(Set->Model[m], x0+Set->State_offset[m], Work+Set->Work_offset[m], u[m].Path);
+        if (Set->Model[m]->Steady_init &&
+            !VM_SteadyStateConditions(Set->Model[m], x0+Set->State_offset[m], Work+Set->Work_offset[m], &u[m],
+                                      Set->Arena, Set->Pool))
+            Not_converged++;
+    }
+    return Not_converged;
+}
+
+
+
+/* Function: VM_MuscleSetOutputs
+*  Description: VM_Outputs of every muscle; output k of muscle m goes to y[k*Num_muscles+m]
+*/
+void VM_MuscleSetOutputs(const VM_MuscleSet *Set, real_T *x, real_T *Work, const VM_Inputs *u, real_T *y)
+{
+    int_T Num_muscles   = Set->Num_muscles;
+    real_T y_muscle[VM_NUM_OUTPUTS];
+    int_T m             = 0;
+    int_T k             = 0;
+
+    for(m=0; m<Num_muscles; m++){
+        VM_Outputs(Set->Model[m], x+Set->State_offset[m], Work+Set->Work_offset[m], &u[m], y_muscle, Set->Pool);
+        for(k=0; k<VM_NUM_OUTPUTS; k++){
+            y[k*Num_muscles+m] = y_muscle[k];
+        }
+    }
+}
+
+
+
+/* Function: VM_MuscleSetDerivatives
+*  Description: VM_Derivatives of every muscle (of the muscle states only with discrete motor units)
+*/
+void VM_MuscleSetDerivatives(const VM_MuscleSet *Set, const real_T *x, const real_T *Work,
+                             const VM_Inputs *u, real_T *dx)
+{
+    int_T m = 0;
+
+    for(m=0; m<Set->Num_muscles; m++){
+        VM_Derivatives(Set->Model[m], x+Set->State_offset[m], Work+Set->Work_offset[m], &u[m],
+                       dx+((Set->Model[m]->MU_step > 0) ? VM_NUM_MUSCLE_STATES*m : Set->State_offset[m]),
+                       Set->Arena, Set->Pool);
+    }
+}
+
+
+
+/* Function: VM_MuscleSetActivation
+*  Description: VM_Activation of every muscle (recruitment and Af held between motor unit updates)
+*/
+void VM_MuscleSetActivation(const VM_MuscleSet *Set, const real_T *x, real_T *Work, const VM_Inputs *u)
+{
+    int_T m = 0;
+
+    for(m=0; m<Set->Num_muscles; m++){
+        VM_Activation(Set->Model[m], x+Set->State_offset[m], Work+Set->Work_offset[m], &u[m], Set->Pool);
+    }
+}
+
+
+
+/* Function: VM_MuscleSetUpdate
+*  Description: VM_UpdateMUStates of every muscle over its sample time (discrete motor units)
+*/
+void VM_MuscleSetUpdate(const VM_MuscleSet *Set, real_T *x, const real_T *Work, const VM_Inputs *u)
+{
+    int_T m = 0;
+
+    for(m=0; m<Set->Num_muscles; m++){
+        VM_UpdateMUStates(Set->Model[m], x+Set->State_offset[m], Work+Set->Work_offset[m], &u[m],
+                          Set->Model[m]->MU_step);
+    }
+}
+
+
+
+/* Function: VM_MuscleSetJacobian
+*  Description: VM_Jacobian of every muscle; the Jacobian of the set is block diagonal, one block per muscle
+*/
+int_T VM_MuscleSetJacobian(const VM_MuscleSet *Set, const real_T *x, const real_T *Work, const VM_Inputs *u,
+                           int_T *Ir, int_T *Jc, real_T *Pr)
+{
+    int_T Nz            = 0;
+    int_T Muscle_nz     = 0;
+    int_T State_offset  = 0;
+    int_T m             = 0;
+    int_T k             = 0;
+
+    for(m=0; m<Set->Num_muscles; m++){
+        State_offset = Set->State_offset[m];
+        Muscle_nz = VM_Jacobian(Set->Model[m], x+State_offset, Work+Set->Work_offset[m], &u[m],
+                                Ir+Nz, Jc+State_offset, Pr+Nz, Set->Arena);
+        if (m > 0) { //rows and entries of muscle m
+            for(k=0; k<Muscle_nz; k++){
+                Ir[Nz+k] += State_offset;
+            }
+            for(k=0; k<VM_NUM_STATES(Set->Model[m]->Total_Munits); k++){
+                Jc[State_offset+k] += Nz;
+            }
+        }
+        Nz += Muscle_nz;
+    }
+    Jc[Set->Num_states] = Nz;
+    return Nz;
+}
+
+
+
+/* Function: VM_MuscleSetUpdateModes
+*  Description: VM_UpdateModes of every muscle (ZEROCROSS, major time steps)
+*/
+void VM_MuscleSetUpdateModes(const VM_MuscleSet *Set, const real_T *x, real_T *Work)
+{
+    int_T m = 0;
+
+    for(m=0; m<Set->Num_muscles; m++){
+        VM_UpdateModes(Set->Model[m], x+Set->State_offset[m], Work+Set->Work_offset[m]);
+    }
+}
+
+
+
+/* Function: VM_MuscleSetZeroCrossings
+*  Description: VM_ZeroCrossings of every muscle, the signals of the muscles one after the other
+*/
+void VM_MuscleSetZeroCrossings(const VM_MuscleSet *Set, const real_T *x, real_T *zc)
+{
+    int_T m = 0;
+
+    for(m=0; m<Set->Num_muscles; m++){
+        VM_ZeroCrossings(Set->Model[m], x+Set->State_offset[m], zc);
+        zc += Set->Model[m]->Num_zcs;
+    }
+}
+
+
+
+/* Function: VM_CreateSimulation
+*  Description: Allocates a simulation of the model: state, work and scratch vectors. Returns NULL if the
+*              allocation fails. The model is not copied and must outlive the simulation.
+*/
+VM_Simulation* VM_CreateSimulation(const VM_MuscleModel *Model)
+{
+    VM_Simulation *Sim  = NULL;
+    int_T Num_states    = VM_NUM_STATES(MODEL_TOTAL_MUNITS(Model));
+
+    Sim = (VM_Simulation*)calloc(1, sizeof(VM_Simulation)
+                                    + (9*Num_states + VM_WORK_SIZE(MODEL_TOTAL_MUNITS(Model))
+                                       + VM_WORK_PROFILE_SIZE(MODEL_TOTAL_MUNITS(Model),MODEL_TYPESOF_FIBERS(Model))
+                                       + VM_ARENA_SIZE(MODEL_TYPESOF_FIBERS(Model)))*sizeof(real_T) + VM_ARENA_ALIGN);
+    if (Sim == NULL) {
+        return NULL;
+    }
+    Sim->Model      = Model;
+    Sim->Num_states = Num_states;
+    Sim->x          = (real_T*)(Sim+1);
+    Sim->Scratch    = Sim->x + Num_states;
+    Sim->Work       = Sim->Scratch + 8*Num_states;
+    Sim->Arena      = AlignArena(Sim->Work + VM_WORK_SIZE(MODEL_TOTAL_MUNITS(Model))
+                                 + VM_WORK_PROFILE_SIZE(MODEL_TOTAL_MUNITS(Model),MODEL_TYPESOF_FIBERS(Model)));
+    return Sim;
+}
+
+
+
+/* Function: VM_FreeSimulation
+*  Description: Frees the simulation (not its model)
+*/
+void VM_FreeSimulation(VM_Simulation *Sim)
+{
+    free(Sim);
+}
+
+
+
+/* Function: VM_InitializeSimulation
+*  Description: Sets the time to t0, the inputs to Input(t0) (if Input is not NULL, else Sim->u is used),
+*              the initial states (steady state of the inputs with INITSTATE 2), and the outputs at t0.
+*/
+void VM_InitializeSimulation(VM_Simulation *Sim, real_T t0, VM_InputFcn Input, void *Context)
+{
+    Sim->t      = t0;
+    Sim->Step   = 0.0;
+    Sim->MU_next = t0;
+    if (Input != NULL) {
+        Input(t0, &Sim->u, Context);
+    }
+#ifdef VM_PROFILE
+    VM_ResetProfile(Sim->Model, Sim->Work);
+#endif
+    VM_InitializeConditions(Sim->Model, Sim->x, Sim->Work, Sim->u.Path);
+    if (Sim->Model->Steady_init) {
+        VM_SteadyStateConditions(Sim->Model, Sim->x, Sim->Work, &Sim->u, Sim->Arena, NULL);
+    }
+    VM_Outputs(Sim->Model, Sim->x, Sim->Work, &Sim->u, Sim->y, NULL);
+    if (Sim->Model->Act_hold) {
+        VM_Activation(Sim->Model, Sim->x, Sim->Work, &Sim->u, NULL);
+    }
+}
+
+
+
+/* Function: Evaluate
+*  Description: Inputs, outputs y and derivatives dx at (t, x), in the order Simulink calls them
+*/
+static void Evaluate(VM_Simulation *Sim, real_T t, real_T *x, real_T *dx, real_T *y,
+                     VM_InputFcn Input, void *Context)
+{
+    if (Input != NULL) {
+        Input(t, &Sim->u, Context);
+    }
+    VM_Outputs(Sim->Model, x, Sim->Work, &Sim->u, y, NULL);
+    VM_Derivatives(Sim->Model, x, Sim->Work, &Sim->u, dx, Sim->Arena, NULL);
+}
+
+
+
+/* Function: SimulateRK4
+*  Description: Fixed step 4th order Runge-Kutta (as Simulink ode4). The last step is shortened to end at
+*              t_end. The derivatives at the end of a step are those of the first stage of the next one.
+*              Discrete motor units are updated at the start of every step, after the outputs (as
+*              mdlUpdate), and only the muscle states are integrated.
+*/
+static int_T SimulateRK4(VM_Simulation *Sim, const VM_SolverOptions *Options, real_T t_end,
+                         VM_InputFcn Input, VM_OutputFcn Output, void *Context)
+{
+    int_T  Disc     = (Sim->Model->MU_step > 0) ? MU_NUM_STATES*Sim->Model->Total_Munits : 0;
+    int_T  n        = Sim->Num_states-Disc; //integrated states x[Disc] ..
+    real_T *x       = Sim->x;
+    real_T *k1      = Sim->Scratch;
+    real_T *k2      = k1+n;
+    real_T *k3      = k2+n;
+    real_T *k4      = k3+n;
+    real_T *xs      = k4+n;
+    real_T ys[VM_NUM_OUTPUTS];
+    real_T t0       = Sim->t;
+    real_T h        = 0.0;
+    int_T  Steps    = 0;
+    int_T  s        = 0;
+    int_T  i        = 0;
+
+    if (t_end <= t0) {
+        return VM_SIM_OK;
+    }
+    Steps = (int_T)ceil((t_end-t0)/Options->Step*(1-1e-12));
+    if (Steps < 1)
+        Steps = 1;
+
+    Evaluate(Sim, t0, x, k1, Sim->y, Input, Context);
+    for(s=1; s<=Steps; s++){
+        h = ((s == Steps) ? t_end : t0+s*Options->Step) - Sim->t;
+
+        if (Disc > 0) {
+            if (Sim->t >= Sim->MU_next-1e-9*Sim->Model->MU_step) { //sample hit of the motor units
+                if (Sim->Model->Act_hold) { //recruitment and Af held until the next hit
+                    VM_Activation(Sim->Model, x, Sim->Work, &Sim->u, NULL);
+                }
+                VM_UpdateMUStates(Sim->Model, x, Sim->Work, &Sim->u, Sim->Model->MU_step);
+                if (Sim->Model->Act_hold) {
+                    VM_Derivatives(Sim->Model, x, Sim->Work, &Sim->u, k1, Sim->Arena, NULL);
+                }
+                Sim->MU_next += Sim->Model->MU_step;
+            }
+            memcpy(xs, x, Disc*sizeof(real_T));
+        }
+        for(i=0; i<n; i++)
+            xs[Disc+i] = x[Disc+i]+0.5*h*k1[i];
+        Evaluate(Sim, Sim->t+0.5*h, xs, k2, ys, Input, Context);
+        for(i=0; i<n; i++)
+            xs[Disc+i] = x[Disc+i]+0.5*h*k2[i];
+        Evaluate(Sim, Sim->t+0.5*h, xs, k3, ys, Input, Context);
+        for(i=0; i<n; i++)
+            xs[Disc+i] = x[Disc+i]+h*k3[i];
+        Evaluate(Sim, Sim->t+h, xs, k4, ys, Input, Context);
+        for(i=0; i<n; i++)
+            x[Disc+i] += h/6*(k1[i]+2*k2[i]+2*k3[i]+k4[i]);
+
+        Sim->t = (s == Steps) ? t_end : t0+s*Options->Step;
+        if (Sim->Model->Zero_cross) { //modes held over the next step
+            VM_UpdateModes(Sim->Model, x, Sim->Work);
+        }
+        Evaluate(Sim, Sim->t, x, k1, Sim->y, Input, Context);
+        if (Output != NULL && Output(Sim->t, x, Sim->y, Context)) {
+            return VM_SIM_STOPPED;
+        }
+    }
+    return VM_SIM_OK;
+}
+
+
+
+//Dormand-Prince 5(4) tableau
+static const real_T DP_c[7]     = {0.0, 1.0/5, 3.0/10, 4.0/5, 8.0/9, 1.0, 1.0};
+static const real_T DP_a[7][6]  = {
+    {0.0},
+    {1.0/5},
+    {3.0/40, 9.0/40},
+    {44.0/45, -56.0/15, 32.0/9},
+    {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+    {9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656},
+    {35.0/384, 0.0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84}};
+//5th order minus 4th order weights
+static const real_T DP_e[7]     = {71.0/57600, 0.0, -71.0/16695, 71.0/1920, -17253.0/339200, 22.0/525, -1.0/40};
+
+/* Function: SimulateDOPRI5
+*  Description: Adaptive Dormand-Prince 5(4) with local extrapolation (as Simulink ode45). The error is the
+*              RMS norm of the embedded error over Abs_tol+Rel_tol*|x|; the step is scaled by
+*              0.9*error^(-1/5) within [0.2, 5] and never grows right after a rejected step. The last stage
+*              is evaluated at the new state and is the first stage of the next step.
+*/
+static int_T SimulateDOPRI5(VM_Simulation *Sim, const VM_SolverOptions *Options, real_T t_end,
+                            VM_InputFcn Input, VM_OutputFcn Output, void *Context)
+{
+    int_T  n        = Sim->Num_states;
+    real_T *x       = Sim->x;
+    real_T *k[7];
+    real_T *xs      = Sim->Scratch+7*n;
+    real_T ys[VM_NUM_OUTPUTS];
+    real_T h        = (Sim->Step > 0) ? Sim->Step : Options->Step;
+    real_T Max_step = (Options->Max_step > 0) ? Options->Max_step : t_end-Sim->t;
+    real_T Error    = 0.0;
+    real_T Scale    = 0.0;
+    real_T Factor   = 0.0;
+    real_T e        = 0.0;
+    int_T  Last     = 0;
+    int_T  Rejected = 0;
+    int_T  s        = 0;
+    int_T  j        = 0;
+    int_T  i        = 0;
+
+    for(s=0; s<7; s++)
+        k[s] = Sim->Scratch+s*n;
+    if (t_end <= Sim->t) {
+        return VM_SIM_OK;
+    }
+
+    Evaluate(Sim, Sim->t, x, k[0], Sim->y, Input, Context);
+    while (Sim->t < t_end) {
+        if (h > Max_step)
+            h = Max_step;
+        Last = (Sim->t+h >= t_end);
+        if (Last)
+            h = t_end-Sim->t;
+
+        //Stages 2-7, stage 7 at the new state
+        for(s=1; s<7; s++){
+            for(i=0; i<n; i++){
+                xs[i] = x[i];
+                for(j=0; j<s; j++)
+                    xs[i] += h*DP_a[s][j]*k[j][i];
+            }
+            Evaluate(Sim, Sim->t+DP_c[s]*h, xs, k[s], ys, Input, Context);
+        }
+
+        Error = 0.0;
+        for(i=0; i<n; i++){
+            e = 0.0;
+            for(s=0; s<7; s++)
+                e += DP_e[s]*k[s][i];
+            Scale = (fabs(x[i]) > fabs(xs[i])) ? fabs(x[i]) : fabs(xs[i]);
+            Scale = Options->Abs_tol+Options->Rel_tol*Scale;
+            e = h*e/Scale;
+            Error += e*e;
+        }
+        Error = sqrt(Error/n);
+
+        Factor = (Error == 0) ? 5.0 : 0.9*pow(Error, -0.2);
+        if (Factor > 5.0)
+            Factor = 5.0;
+        if (!(Factor >= 0.2)) //also catches NaN
+            Factor = 0.2;
+
+        if (Error <= 1.0) {
+            memcpy(x, xs, n*sizeof(real_T));
+            memcpy(k[0], k[6], n*sizeof(real_T));
+            memcpy(Sim->y, ys, sizeof(ys));
+            Sim->t = Last ? t_end : Sim->t+h;
+            if (Sim->Model->Zero_cross) { //modes held over the next step, whose first stage they change
+                VM_UpdateModes(Sim->Model, x, Sim->Work);
+                Evaluate(Sim, Sim->t, x, k[0], Sim->y, Input, Context);
+            }
+            if (Rejected && Factor > 1.0)
+                Factor = 1.0;
+            Rejected = 0;
+            h *= Factor;
+            if (!Last)
+                Sim->Step = h;
+            if (Output != NULL && Output(Sim->t, x, Sim->y, Context)) {
+                return VM_SIM_STOPPED;
+            }
+        }
+        else {
+            Rejected = 1;
+            h *= Factor;
+            if (!(h >= Options->Min_step)) {
+                return VM_SIM_STEP_FAILED;
+            }
+        }
+    }
+    return VM_SIM_OK;
+}
+
+
+
+/* Function: VM_Simulate
+*  Description: Integrates the simulation from its current time to t_end with the solver of Options. The
+*              inputs are Input(t) at every stage (Sim->u if Input is NULL). Output (may be NULL) is
+*              called after every step. Returns VM_SIM_OK or the reason the simulation stopped early.
+*              Models with discrete motor units always use RK4 with a step of MU_step. With ZEROCROSS the
+*              modes are updated at the start of every step; the switches are not located within a step.
+*/
+int_T VM_Simulate(VM_Simulation *Sim, const VM_SolverOptions *Options, real_T t_end,
+                  VM_InputFcn Input, VM_OutputFcn Output, void *Context)
+{
+    VM_SolverOptions Discrete_options;
+
+    if (Sim->Model->MU_step > 0) { //Discrete motor units: fixed step, at most MU_step
+        Discrete_options = *Options;
+        Discrete_options.Solver = VM_SOLVER_RK4;
+        if (!(Options->Step > 0 && Options->Step < Sim->Model->MU_step))
+            Discrete_options.Step = Sim->Model->MU_step;
+        return SimulateRK4(Sim, &Discrete_options, t_end, Input, Output, Context);
+    }
+    switch (Options->Solver) {
+        case VM_SOLVER_DOPRI5:
+            return SimulateDOPRI5(Sim, Options, t_end, Input, Output, Context);
+        case VM_SOLVER_RK4:
+        default:
+            return SimulateRK4(Sim, Options, t_end, Input, Output, Context);
+    }
+}
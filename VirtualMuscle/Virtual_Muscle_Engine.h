@@ -0,0 +1,511 @@
+/* VIRTUAL_MUSCLE_ENGINE.H
+ * Synopsis: SimStruct-free Virtual Muscle engine. Implements the recruitment, fascicle (activation,
+ *          yield, sag, rise/fall), FL/FV, passive, series elastic and mass dynamics of the three
+ *          recruitment models of Virtual_Muscle_SFunction.c over plain arrays, plus fixed step RK4 and
+ *          adaptive Dormand-Prince (DOPRI5) integrators for native batch simulations.
+ *
+ *          A VM_MuscleModel holds the parameters and tables only; it is not modified while simulating
+ *          and can be shared by any number of simulations. The state of one simulation is its state
+ *          vector x (VM_Sizes.Num_states) and its work vector (VM_Sizes.Work_size), as in the
+ *          S-function (continuous states and RWork).
+ *
+ *          Call order, as in Simulink: VM_InitializeConditions once, then for every evaluation
+ *          VM_Outputs followed by VM_Derivatives with the same x and inputs. VM_Outputs writes the
+ *          feff rise/fall rates, recruitment, activation and Fse values of the work vector that
+ *          VM_Derivatives reads; it only writes x when it initializes the states.
+ *
+ *          Discrete motor units (MUSTEP > 0): the yield, sag, fint and feff states are first order
+ *          relaxations and are advanced by VM_UpdateMUStates, after VM_Outputs at every sample hit,
+ *          with the exact exponential update x += (target-x)*(1-exp(-rate*h)). VM_Derivatives then
+ *          only gives the derivatives of the muscle states (dx has VM_NUM_MUSCLE_STATES elements).
+ *          With MULTIRATE the recruitment and Af (VM_Activation) are also computed at the sample hits
+ *          only, before VM_UpdateMUStates, and held in the work vector in between: VM_Outputs and
+ *          VM_Derivatives then only evaluate the fascicle mechanics.
+ *
+ *          Active set (ACTIVETOL > 0, Natural Discrete): VM_Activation keeps the ascending list of the
+ *          recruited motor units and of those still decaying (fint or feff >= ACTIVETOL) in the work
+ *          vector, updated from the previous list as the activation crosses the thresholds. Only these
+ *          get Af, rise/fall rates and force; the others rest with fenv and Af 0, and keep their
+ *          (cheap) yield, sag and decay derivatives.
+ *          This is an approximation: a resting unit has Af 0 although its fint and feff, below ACTIVETOL,
+ *          are not, and it decays at the rise/fall rate of its last active evaluation. Its Af would be at
+ *          most 1-exp(-(Y*S*ACTIVETOL/(af*nf))^nf), about (Y*S*ACTIVETOL/(af*nf))^nf, so the force left
+ *          out is at most that fraction of the maximal force of the resting units; the bound is largest
+ *          at long fascicle lengths, where nf is smallest. With a 2 Hz sinusoidal activation (0.05 to
+ *          0.55) and RK4 at 20 us the force differed from ACTIVETOL 0 by up to 1e-7, 5e-6 and 3e-4 of
+ *          the peak force at ACTIVETOL 1e-4, 1e-3 and 1e-2 (100 to 400 motor units). Steps too long for
+ *          the fascicle dynamics amplify this difference as any other perturbation (2e-3 at 0.1 ms).
+ *
+ *          Zero crossings (ZEROCROSS): the feff rise/fall choice of every motor unit and the FV
+ *          lengthening/shortening branch are modes of the work vector, set from x by VM_UpdateModes at
+ *          the major time steps only and held in between, so that the derivatives are smooth within a
+ *          solver step. VM_ZeroCrossings gives the signals (Vce, and fint-feff of the continuous motor
+ *          units) whose sign changes let a variable step solver locate the switches.
+ *
+ *          Threads (NUMTHREADS > 1): the per motor unit loops of VM_Activation (rise/fall rates and Af)
+ *          and VM_Derivatives run as tasks of VM_THREAD_CHUNK consecutive motor units of one fiber type
+ *          on a persistent pool (Virtual_Muscle_Threads.h) owned by the caller, for the muscles of at
+ *          least VM_THREAD_MIN_MUNITS motor units. Each motor unit is computed as in the serial code and
+ *          the force is summed afterwards in motor unit order, so the results are bitwise identical
+ *          for any number of threads.
+ *
+ *          Precision (PRECISION 2): the feff rise/fall rates and Af of the motor units, the
+ *          transcendental part of the per motor unit loops, are computed in float (the float Af
+ *          kernels of Virtual_Muscle_SIMD.h); the states, their derivatives, the force sum and the
+ *          integration stay in double. Virtual_Muscle_Validate.c compares the forces of both modes.
+ *
+ *          Steady state initial states (INITSTATE 2): after VM_InitializeConditions, VM_SteadyStateConditions
+ *          puts the motor unit states at their targets for the initial inputs and Vce 0 (yield 1, fint
+ *          and feff at fenv, sag at its target, Ulevel at Act), and solves Fse = Fce for Lce with a damped
+ *          Newton iteration on the right hand side itself, so that a run starts at equilibrium.
+ *
+ *          Instrumentation (compiled with -DVM_PROFILE only): calls and time of VM_Outputs,
+ *          VM_Derivatives and of the state initializations from VM_Outputs, recruited motor unit
+ *          occupancy per fiber type and feff rise/fall branch changes, counted in the work vector
+ *          (VM_WORK_PROFILE). Without VM_PROFILE none of it is compiled.
+ *
+ * Date: 10-17-26
+ */
+
+#ifndef VIRTUAL_MUSCLE_ENGINE_H
+#define VIRTUAL_MUSCLE_ENGINE_H
+
+#include "Virtual_Muscle_Types.h"
+#include "Virtual_Muscle_Params.h"
+#include "Virtual_Muscle_SIMD.h"
+#include "Virtual_Muscle_Threads.h"
+
+//Number of continuous states of each motor unit (yield, sag, fint and feff; the rise/fall rate
+//chosen by VM_Activation is held in the work vector, VM_WORK_RATE)
+#define MU_NUM_STATES 4
+//Number of muscle states (Vce, Lce and Ulevel)
+#define VM_NUM_MUSCLE_STATES 3
+//Number of states of a muscle of N motor units (motor units, then Vce, Lce and Ulevel)
+#define VM_NUM_STATES(N)    (MU_NUM_STATES*(N)+VM_NUM_MUSCLE_STATES)
+//Number of entries of the sparse Jacobian (VM_Jacobian) of a muscle of N motor units
+#define VM_JACOBIAN_NZ(N)   (11*(N)+5)
+
+/*Motor unit state layouts (STATELAYOUT)
+ The interleaved layout gives the results of the per motor unit code bit for bit. The structure of
+ arrays layout evaluates Af with the batched kernel (Af_batch); with the scalar kernel (VM_DISABLE_SIMD)
+ it gives the same results as the interleaved layout bit for bit, with the AVX2 and AVX-512 kernels
+ each Af differs by at most VM_AF_SIMD_MAX_ERROR (4 ULP of 1.0) and the force of a step from the same
+ states by a few ULP (up to 4e-14 relative measured). Over a simulation these differences accumulate,
+ and steps too long for the fascicle dynamics amplify them: with RK4 at 0.1 ms the force differed by up
+ to 1e-5 of the peak at constant activation and 2e-3 with a sinusoidal one, at 20 us by 2e-14. The DOPRI5
+ error norm of VM_Simulate sums the states in state vector order, so its steps also depend on the layout.
+ */
+#define VM_LAYOUT_INTERLEAVED   1   //state k of motor unit m at x[k+MU_NUM_STATES*m]
+#define VM_LAYOUT_SOA           2   //state k of motor unit m at x[k*Total_Munits+m]
+
+/*Work Vector variables
+ [0]                                           - MUSCPCSA; //Muscle PCSA(cm^2)
+ [1]                                           - MUSCF0; // Muscle Fo (N)
+ [2]                                           - FASCLMAX; // Fascicle LMax (Lo)
+ [3]                                           - MUSCDENSITY; //muscle density = 1.06
+ [4]                                           - UnitPCSA_Offset; //# of MU in muscle
+ [5]                                           - ...UnitPCSA values
+ [5+UnitPCSA_Offset]                           - Recruitment_Offset //# of MU in muscle
+ [5+UnitPCSA_Offset+1]                         - ...Recruitment output values (fent) of each MU
+ [5+UnitPCSA_Offset+1+Recruitment_Offset]      - Activatoin_Offset//Af_op for each motor unit
+ [5+UnitPCSA_Offset+1+Recruitment_Offset+1]    - ...Af_op for each MU
+ [5+UnitPCSA_Offset+1+Recruitment_Offset+1+Activatoin_Offset]    - Fse (Series elastic element output)
+ [VM_WORK_FSE+1]                               - Number of active motor units (ACTIVETOL > 0)
+ [VM_WORK_FSE+2]                               - ...Indices of the active motor units, ascending
+ [VM_WORK_ACTIVE+1+N]                          - Number of recruited motor units at the last recruitment
+ [VM_WORK_ACTIVE+1+N+1]                        - Activation of the last recruitment (Natural Discrete), NaN if stale
+ [VM_WORK_MODES]                               - FV branch mode (1 lengthening, 0 shortening, ZEROCROSS)
+ [VM_WORK_MODES+1]                             - ...feff rise/fall mode of each MU (1 rise, 0 fall, ZEROCROSS)
+ [VM_WORK_RATE]                                - ...feff rise/fall rate of each MU (invTf1 or invTf2, VM_Activation)
+ [VM_WORK_SIZE]                                - Instrumentation counters (VM_PROFILE), see VM_WORK_PROFILE
+ */
+#define VM_WORK_FENV(N)     (5+(N)+1)
+#define VM_WORK_AF(N)       (5+(N)+1+(N)+1)
+#define VM_WORK_FSE(N)      (5+(N)+1+(N)+1+(N))
+#define VM_WORK_ACTIVE(N)   (5+(N)+1+(N)+1+(N)+1)
+#define VM_WORK_RECRUITED(N) (5+(N)+1+(N)+1+(N)+1+1+(N))
+#define VM_WORK_MODES(N)    (5+(N)+1+(N)+1+(N)+1+1+(N)+2)
+#define VM_WORK_RATE(N)     (5+(N)+1+(N)+1+(N)+1+1+(N)+2+1+(N))
+#define VM_WORK_SIZE(N)     (5+(N)+1+(N)+1+(N)+1+1+(N)+2+1+(N)+(N))
+#define VM_WORK_PROFILE(N)  VM_WORK_SIZE(N)
+
+//Threaded motor unit loops (NUMTHREADS): motor units per task, and smallest muscle evaluated in threads
+#define VM_THREAD_CHUNK         64
+#define VM_THREAD_MIN_MUNITS    512
+
+//Zero crossing signals (ZEROCROSS) of a muscle of N motor units: Vce, then fint-feff of each motor unit
+//unless they are discrete (MU_step > 0)
+#define VM_NUM_ZCS(N,MU_step)   (1+((MU_step) > 0 ? 0 : (N)))
+
+//Outputs (VM_Outputs y[]), in the order of the additional ports (ADDPORTS)
+#define VM_OUT_FSE          0       //Force (N)
+#define VM_OUT_ACT          1       //Activation
+#define VM_OUT_FSEF0        2       //Force (F0)
+#define VM_OUT_LCE          3       //Fascicle Length (Lo)
+#define VM_OUT_VCE          4       //Fascicle Velocity (Lo/s)
+#define VM_NUM_OUTPUTS      5
+//Additional port of the instrumentation counters (ADDPORTS[5], VM_PROFILE builds only)
+#define VM_PORT_PROFILE     5
+#define VM_NUM_ADDPORTS     6
+
+/*Instrumentation counters (VM_PROFILE), at VM_WORK_PROFILE of the work vector of each muscle
+ [VM_PROF_*]                                   - Counters below
+ [VM_PROF_NUM_COUNTERS]                        - ...Last feff branch of each MU (1 rise, -1 fall, 0 not evaluated yet)
+ [VM_PROF_NUM_COUNTERS+N]                      - ...Recruited MU histogram [TypesOf_fibers][VM_PROFILE_BINS+1]:
+                                                 recruitments with k*10% to (k+1)*10% of the MU of the type
+                                                 recruited in bin k, all of them in bin VM_PROFILE_BINS
+ Kept over the state initializations, zeroed by VM_ResetProfile. The profile port (ADDPORTS[5]) gives
+ counter k of muscle m at [k*Num_muscles+m].
+ */
+#define VM_PROF_OUTPUTS             0   //VM_Outputs calls
+#define VM_PROF_OUTPUTS_TICKS       1   //Ticks in VM_Outputs, and in VM_Activation at the motor unit updates (Act_hold)
+#define VM_PROF_DERIVATIVES         2   //VM_Derivatives calls
+#define VM_PROF_DERIVATIVES_TICKS   3   //Ticks in VM_Derivatives
+#define VM_PROF_REINITS             4   //VM_InitializeConditions calls from VM_Outputs (Lce not positive)
+#define VM_PROF_REINITS_TICKS       5   //Ticks in them
+#define VM_PROF_RECRUITMENTS        6   //VM_Activation calls (histogram samples)
+#define VM_PROF_FLIPS               7   //feff rise/fall branch changes of the motor units
+#define VM_PROF_NUM_COUNTERS        8
+#define VM_PROFILE_BINS             10
+
+#ifdef VM_PROFILE
+//Time stamp counter on x86, else clock()
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define VM_PROFILE_TICKS()          ((real_T)__rdtsc())
+#define VM_PROFILE_TICK_UNIT        "cycles"
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define VM_PROFILE_TICKS()          ((real_T)__rdtsc())
+#define VM_PROFILE_TICK_UNIT        "cycles"
+#else
+#include <time.h>
+#define VM_PROFILE_TICKS()          ((real_T)clock())
+#define VM_PROFILE_TICK_UNIT        "clock ticks"
+#endif
+#define VM_WORK_PROFILE_SIZE(N,T)   (VM_PROF_NUM_COUNTERS+(N)+(VM_PROFILE_BINS+1)*(T))
+#else
+#define VM_WORK_PROFILE_SIZE(N,T)   0
+#endif
+
+/*Parameter set
+ The parameters in S-function order (see Virtual_Muscle_Params.h): Value[k] points at the Count[k]
+ values of parameter k. Num_params is NPARAMS_LEGACY to NPARAMS; missing optional parameters take
+ their default value. A parameter set may pack several muscles (NUMMUSCLES); VM_GetMuscleParams
+ gives the parameter set of one of them.
+ */
+typedef struct {
+    const real_T* Value[NPARAMS];
+    int_T   Count[NPARAMS];
+    int_T   Num_params;
+} VM_ParamSet;
+
+#define VM_PARAM(P,IDX) ((P)->Value[IDX])
+#define VM_OPTIONAL_PARAM_VALUE(P,IDX,DEFAULT) ((P)->Num_params > (IDX) ? *(P)->Value[IDX] : (DEFAULT))
+
+//Model inputs
+typedef struct {
+    real_T  Act;                //[0] Input Activation
+    real_T  Path;               //[1] Path length (m)
+    real_T  Freq;               //[2] Frequency (pps) for FES recruitment (Recruitment_Type 4 only)
+} VM_Inputs;
+
+//Dimensions of a model (summed over the muscles of a set), available before it is created
+typedef struct {
+    int_T   Num_muscles;        //Width of every input and output port
+    int_T   TypesOf_fibers;
+    int_T   Total_Munits;       //Motor units of the models, TOFMUSFIB for Natural Continuous recruitment
+    int_T   Num_states;         //States, MU_NUM_STATES*Total_Munits+3 per muscle
+    int_T   Num_cont_states;    //Continuous states: Num_states, or the muscle states with discrete motor units
+    int_T   Num_disc_states;    //Discrete states: 0, or the motor unit states with discrete motor units
+    real_T  MU_step;            //Sample time of the motor unit states (MUSTEP), 0 if continuous
+    int_T   Work_size;          //Work vector length
+    int_T   Jacobian_nz;        //Entries of the sparse Jacobian, VM_JACOBIAN_NZ(Total_Munits) per muscle
+                                //(0 with discrete motor units)
+    int_T   Num_zcs;            //Zero crossing signals (ZEROCROSS), VM_NUM_ZCS per muscle
+    int_T   Num_inputs;         //3 for Intramuscular FES, else 2
+    int_T   Num_outputs;        //Force plus the additional ports
+    int_T   Profile_port;       //Instrumentation port (ADDPORTS[5], VM_PROFILE builds only), the last one
+    int_T   Num_threads;        //Threads of the motor unit loops (NUMTHREADS), 1 if no muscle has
+                                //VM_THREAD_MIN_MUNITS motor units
+} VM_Sizes;
+
+/*Specialized motor unit kernels
+ Instances of the per motor unit loops with the recruitment type (Intramuscular FES or not), the
+ yield and sag of the fiber type and the state layout fixed at compile time, so that the loops carry
+ no configuration branches. VM_CreateModel picks the instance of each fiber type.
+ */
+typedef struct VM_MUStates VM_MUStates;
+typedef struct VM_MuscleModel VM_MuscleModel;
+//Yield, sag, fint and feff derivatives of n motor units of fiber type i (Virtual_Muscle_Engine.c, MU_Derivatives)
+typedef void (*VM_MUDerivativesFcn)(const VM_MUStates *dStates, const VM_MUStates *States, const real_T *fenv,
+                                    real_T Act, const VM_MuscleModel *Model, int_T i, real_T Vce,
+                                    int_T Lengthening, int_T n);
+//Af of n interleaved motor units (MU_NUM_STATES apart), arguments as VM_AfBatchFcn
+typedef VM_AfBatchFcn VM_MUActivationFcn;
+
+/*Muscle model
+ Typed copy of the parameters and of the values derived from them, built once by VM_CreateModel so
+ that VM_Outputs and VM_Derivatives never recount the motor units. The per fiber type and per motor
+ unit arrays are carved out of the same allocation as the model itself.
+ */
+struct VM_MuscleModel {
+    int_T   TypesOf_fibers;     //Number of muscle fiber types
+    int_T   Total_Munits;       //Number of motor units in the muscle, one per fiber type for Natural Continuous
+    int_T   Recruitment_Type;   //2-Natural Discrete, 3-Natural Continuous, 4-Intramuscular FES
+    int_T   Outputports[VM_NUM_ADDPORTS]; //Additional ports (ADDPORTS), [VM_PORT_PROFILE] 0 without VM_PROFILE
+    int_T   State_layout;       //VM_LAYOUT_INTERLEAVED or VM_LAYOUT_SOA (STATELAYOUT)
+    int_T   MU_stride;          //Distance between two motor units in the state vector
+    int_T   MU_field;           //Distance between two states of the same motor unit
+    VM_AfBatchFcn Af_batch;     //Af kernel for contiguous motor units (structure of arrays layout)
+    int_T   Af_isa;             //Instruction set of Af_batch (VM_ISA_*)
+    int_T   Single_precision;   //Rise/fall rates and Af computed in float (PRECISION 2)
+    VM_MUDerivativesFcn* MU_derivatives; //[TypesOf_fibers] motor unit derivative kernel of each fiber type
+    VM_MUActivationFcn*  MU_activation;  //[TypesOf_fibers] Af kernel of each fiber type, interleaved layout
+    real_T  MU_step;            //Sample time of the discrete motor unit update (MUSTEP), 0 if continuous
+    int_T   Act_hold;           //Recruitment and Af held between motor unit updates (MULTIRATE, MU_step > 0)
+    real_T  Active_tol;         //fint and feff below which an unrecruited motor unit rests (ACTIVETOL),
+                                //0 to evaluate every unit; Natural Discrete recruitment only
+    int_T   Zero_cross;         //Rise/fall and FV branches held as modes between major steps (ZEROCROSS)
+    int_T   Num_zcs;            //Zero crossing signals, VM_NUM_ZCS or 0
+    int_T   Steady_init;        //Initial states at the steady state of the initial inputs (INITSTATE 2)
+
+    //Derived muscle values (same as Work [0]-[3])
+    real_T  MUSCPCSA;           //Muscle PCSA(cm^2)
+    real_T  MUSCF0;             //Muscle Fo (N)
+    real_T  FASCLMAX;           //Fascicle LMax (Lo)
+    real_T  MUSCDENSITY;        //muscle density = 1.06
+
+    //Generic parameters
+    real_T  Viscocity;
+    real_T  c1, k1, Lr1;        //FPE1
+    real_T  c2, k2, Lr2;        //FPE2
+    real_T  cT, kT, LrT;        //FSE
+    real_T  Mass;               //Muscle mass
+    real_T  L0;                 //Fascicle length
+    real_T  L0T;                //Tendon length
+    real_T  Ur;                 //Maximum recruitment activation
+    real_T  invL0;              //1/(L0/100)
+    real_T  invL0T;             //1/L0T
+    real_T  invMass;            //1/(Mass/2000)
+
+    //Specific parameters to each muscle fiber type [TypesOf_fibers]
+    real_T* Fmin;
+    real_T* Fmax;
+    real_T* invf05;             // 1/f0.5
+    real_T* Fract_PCSA;
+    real_T* Tf1;                // Tf1/1000 (s)
+    real_T* Tf2;                // Tf2/1000 (s)
+    real_T* Tf3;                // Tf3/1000 (s)
+    real_T* Tf4;                // Tf4/1000 (s)
+    real_T* invTs;              // 1/(Ts/1000)
+    real_T* aS1;
+    real_T* aS2;
+    real_T* cY;
+    real_T* VY;
+    real_T* af;
+    real_T* nf0;
+    real_T* nf1;
+    real_T* FL_omega;
+    real_T* FL_beta;
+    real_T* FL_rho;
+    real_T* Vmax;
+    real_T* cV0;
+    real_T* cV1;
+    real_T* aV0;
+    real_T* aV1;
+    real_T* aV2;
+    real_T* bV;
+    real_T* Type_threshold;     //Natural Continuous threshold of the fiber type max(Ur*cumulative PCSA, 0.001)
+    int_T*  Num_of_Munits;      //NUMOFUNITS, all 1 for Natural Continuous
+
+    //Specific parameters to each motor unit [Total_Munits]
+    real_T* Unit_PCSA;          //Unit PCSA after the apportion method is applied (of the fiber type for Natural Continuous)
+    real_T* Threshold;          //Natural recruitment threshold max(Ur*cumulative PCSA, 0.001), ascending
+    real_T* fenv_slope;         //(Fmax-Fmin)/(1-Threshold) of the unit
+    real_T* Unit_Fmin;          //Fmin of the fiber type of the unit
+
+    //Tabulated FL curves (separate allocation, NULL for the exact curves)
+    real_T  Curve_tol;          //Maximum FL table error requested (CURVETOL)
+    real_T  FL_error;           //Maximum FL table error achieved
+    int_T   FL_intervals;       //Number of intervals over [0, VM_FL_TABLE_LMAX)
+    real_T  FL_invh;            //FL_intervals/VM_FL_TABLE_LMAX
+    real_T* FL_table;           //[TypesOf_fibers][FL_intervals][4] cubic coefficients
+};
+
+#define VM_NUM_FIBER_ARRAYS 27  //Number of real_T arrays per fiber type in VM_MuscleModel
+#define VM_NUM_UNIT_ARRAYS  4   //Number of real_T arrays per motor unit in VM_MuscleModel
+
+//Tabulated FL curves: piecewise cubics over [0, VM_FL_TABLE_LMAX) (Lo), exact curves outside.
+//The number of intervals is doubled until the error is below CURVETOL, up to VM_FL_TABLE_MAX_INTERVALS.
+#define VM_FL_TABLE_LMAX            2.0
+#define VM_FL_TABLE_MIN_INTERVALS   32
+#define VM_FL_TABLE_MAX_INTERVALS   16384
+#define VM_FL_TABLE_CHECKS          16      //Error check points per interval
+
+//Steady state initial states (INITSTATE 2): damped Newton iteration on Lce until |Fse-Fce| is at most
+//VM_STEADY_FORCE_TOL*F0, the slope by a forward difference of VM_STEADY_FD_STEP*Lce
+#define VM_STEADY_FORCE_TOL         1e-10
+#define VM_STEADY_FD_STEP           1e-7
+#define VM_STEADY_MAX_ITERATIONS    50
+#define VM_STEADY_MAX_HALVINGS      30
+
+//Scratch arena of VM_Derivatives (1 array) and VM_Jacobian (9 arrays) per fiber type, for a muscle of
+//T fiber types (real_T). Sets and simulations own one, aligned to VM_ARENA_ALIGN bytes.
+#define VM_ARENA_SIZE(T)            (9*(T))
+#define VM_ARENA_ALIGN              64
+
+
+/*Fixed muscle builds
+ Built with -DVM_FIXED_MUSCLE=\"<header>\", a header written by vm_generate (Virtual_Muscle_Generate.c),
+ the engine is specialized for the muscle of the header: the number of fiber types, the motor units
+ of each, the recruitment type and the state layout are compile time constants, and so are the fiber
+ type coefficients of VM_FIXED_COEFS (VM_Fixed_<name>, the values of the model: Tf1-Tf4 in s, invTs
+ in 1/s). Without threads or active set, the motor unit loops are unrolled per fiber type
+ (VM_FIXED_TYPES: index, first motor unit and motor unit count of each), so their trip counts are
+ constants and the recruitment, layout, yield and sag branches and the coefficients fold. The recruitment coefficients (UR, FMIN, FMAX, F0.5) are
+ not folded and stay tunable. VM_CreateModel rejects the parameters of a muscle of another structure
+ or other fiber type coefficients; VM_GetFixedParams gives the parameters the header was generated from.
+ */
+#define VM_FIXED_COEFS(X) \
+    X(Tf1) X(Tf2) X(Tf3) X(Tf4) X(invTs) X(aS1) X(aS2) X(cY) X(VY) X(af) X(nf0) X(nf1) \
+    X(FL_omega) X(FL_beta) X(FL_rho) X(Vmax) X(cV0) X(cV1) X(aV0) X(aV1) X(aV2) X(bV)
+#ifdef VM_FIXED_MUSCLE
+#include VM_FIXED_MUSCLE
+#endif
+
+/* Model */
+extern void VM_GetSizes(const VM_ParamSet *P, VM_Sizes *Sizes);
+extern VM_MuscleModel* VM_CreateModel(const VM_ParamSet *P, const char **Error);
+extern void VM_FreeModel(VM_MuscleModel *Model);
+#ifdef VM_FIXED_MUSCLE
+extern void VM_GetFixedParams(VM_ParamSet *P);
+#endif
+
+extern void VM_InitializeConditions(const VM_MuscleModel *Model, real_T *x0, real_T *Work, real_T Path);
+//Forces the next VM_Activation to recruit again, for a work vector kept over a rebuild of the model
+extern void VM_InvalidateRecruitment(const VM_MuscleModel *Model, real_T *Work);
+//Steady state of the inputs u from the states of VM_InitializeConditions (INITSTATE 2); returns 0, with
+//those states back, if the Newton iteration does not converge or the allocation fails
+extern int_T VM_SteadyStateConditions(const VM_MuscleModel *Model, real_T *x0, real_T *Work, const VM_Inputs *u,
+                                      real_T *Arena, VM_ThreadPool *Pool);
+//Fce (N) of the motor units at their steady state for u (Act, Freq), with the fascicle held at Lce (Lo) and
+//Vce (Lo/s); x0, Work and dx are scratch (VM_Sizes), for the surrogate tables (Virtual_Muscle_Surrogate.h)
+extern real_T VM_SteadyStateForce(const VM_MuscleModel *Model, real_T *x0, real_T *Work, const VM_Inputs *u,
+                                  real_T Lce, real_T Vce, real_T *dx, real_T *Arena);
+//Pool: threads of the motor unit loops (NUMTHREADS), NULL to evaluate them serially
+extern void VM_Outputs(const VM_MuscleModel *Model, real_T *x, real_T *Work, const VM_Inputs *u, real_T *y,
+                       VM_ThreadPool *Pool);
+//Recruitment and Af, part of VM_Outputs unless held between motor unit updates (Act_hold)
+extern void VM_Activation(const VM_MuscleModel *Model, const real_T *x, real_T *Work, const VM_Inputs *u,
+                          VM_ThreadPool *Pool);
+//Arena: VM_ARENA_SIZE(TypesOf_fibers) scratch values
+extern void VM_Derivatives(const VM_MuscleModel *Model, const real_T *x, const real_T *Work, const VM_Inputs *u,
+                           real_T *dx, real_T *Arena, VM_ThreadPool *Pool);
+//Exact exponential update of the motor unit states over h (s), for discrete motor units
+extern void VM_UpdateMUStates(const VM_MuscleModel *Model, real_T *x, const real_T *Work, const VM_Inputs *u,
+                              real_T h);
+//Sparse (compressed column) Jacobian of VM_Derivatives (continuous motor units); returns the number of entries
+extern int_T VM_Jacobian(const VM_MuscleModel *Model, const real_T *x, const real_T *Work, const VM_Inputs *u,
+                         int_T *Ir, int_T *Jc, real_T *Pr, real_T *Arena);
+//Modes of the rise/fall and FV branches from x, at major time steps (ZEROCROSS)
+extern void VM_UpdateModes(const VM_MuscleModel *Model, const real_T *x, real_T *Work);
+//Zero crossing signals zc[Num_zcs] of x (ZEROCROSS)
+extern void VM_ZeroCrossings(const VM_MuscleModel *Model, const real_T *x, real_T *zc);
+#ifdef VM_PROFILE
+//Zeroes the instrumentation counters of the work vector
+extern void VM_ResetProfile(const VM_MuscleModel *Model, real_T *Work);
+#endif
+
+
+/*Muscle set
+ The muscles of a multi-muscle parameter set, one model each. The states and work vectors of the
+ muscles are stored one after the other, muscle m starting at State_offset[m] and Work_offset[m].
+ Inputs are one VM_Inputs per muscle; output k of muscle m is y[k*Num_muscles+m] (one vector port per
+ output). u and y are input and output buffers for the caller. With discrete motor units the
+ derivatives of muscle m are dx[VM_NUM_MUSCLE_STATES*m] .. (the continuous states of the set).
+ The scratch arena is shared by the muscles, which are evaluated one after the other. Pool is the
+ thread pool of their motor unit loops: set by the caller, which owns it (NULL: serial).
+ */
+typedef struct {
+    int_T   Num_muscles;
+    int_T   Num_states;         //Sum over the muscles
+    int_T   Work_size;          //Sum over the muscles
+    VM_MuscleModel** Model;     //[Num_muscles]
+    int_T*  State_offset;       //[Num_muscles]
+    int_T*  Work_offset;        //[Num_muscles]
+    VM_Inputs* u;               //[Num_muscles]
+    real_T* y;                  //[VM_NUM_OUTPUTS*Num_muscles]
+    void*   Arena_block;        //Allocation of Arena
+    real_T* Arena;              //[VM_ARENA_SIZE(largest TypesOf_fibers)], VM_ARENA_ALIGN aligned
+    VM_ThreadPool* Pool;        //Not owned, NULL unless set by the caller
+} VM_MuscleSet;
+
+extern void VM_GetMuscleParams(const VM_ParamSet *P, int_T Muscle, VM_ParamSet *Muscle_params);
+extern VM_MuscleSet* VM_CreateMuscleSet(const VM_ParamSet *P, const char **Error);
+extern void VM_FreeMuscleSet(VM_MuscleSet *Set);
+
+//Returns the number of muscles whose steady state (INITSTATE 2) did not converge, and start at rest
+extern int_T VM_MuscleSetInitializeConditions(const VM_MuscleSet *Set, real_T *x0, real_T *Work, const VM_Inputs *u);
+extern void VM_MuscleSetOutputs(const VM_MuscleSet *Set, real_T *x, real_T *Work, const VM_Inputs *u, real_T *y);
+extern void VM_MuscleSetDerivatives(const VM_MuscleSet *Set, const real_T *x, const real_T *Work,
+                                    const VM_Inputs *u, real_T *dx);
+extern void VM_MuscleSetActivation(const VM_MuscleSet *Set, const real_T *x, real_T *Work, const VM_Inputs *u);
+extern void VM_MuscleSetUpdate(const VM_MuscleSet *Set, real_T *x, const real_T *Work, const VM_Inputs *u);
+extern int_T VM_MuscleSetJacobian(const VM_MuscleSet *Set, const real_T *x, const real_T *Work, const VM_Inputs *u,
+                                  int_T *Ir, int_T *Jc, real_T *Pr);
+extern void VM_MuscleSetUpdateModes(const VM_MuscleSet *Set, const real_T *x, real_T *Work);
+extern void VM_MuscleSetZeroCrossings(const VM_MuscleSet *Set, const real_T *x, real_T *zc);
+
+
+/* Integrators */
+
+//Solvers (VM_SolverOptions.Solver). Models with discrete motor units always use RK4, with a step of
+//at most MU_step that should divide it; the motor units are updated every MU_step at the start of a step.
+#define VM_SOLVER_RK4       1       //Fixed step 4th order Runge-Kutta
+#define VM_SOLVER_DOPRI5    2       //Adaptive Dormand-Prince 5(4)
+
+//Return values of VM_Simulate
+#define VM_SIM_OK           0
+#define VM_SIM_STEP_FAILED  1       //DOPRI5 step size fell below Min_step
+#define VM_SIM_STOPPED      2       //Stopped by the output function
+
+typedef struct {
+    int_T   Solver;
+    real_T  Step;               //RK4 step, DOPRI5 initial step (s)
+    real_T  Rel_tol;            //DOPRI5 relative tolerance
+    real_T  Abs_tol;            //DOPRI5 absolute tolerance
+    real_T  Min_step;           //DOPRI5 smallest step (s)
+    real_T  Max_step;           //DOPRI5 largest step (s)
+} VM_SolverOptions;
+
+//Inputs at time t
+typedef void (*VM_InputFcn)(real_T t, VM_Inputs *u, void *Context);
+//Called after every step with the state and outputs at its end; a nonzero return stops the simulation
+typedef int_T (*VM_OutputFcn)(real_T t, const real_T *x, const real_T *y, void *Context);
+
+/*Simulation
+ State of one simulation of a (shared) model: state and work vectors, outputs, and the integrator
+ scratch vectors and the scratch arena, all from one allocation.
+ */
+typedef struct {
+    const VM_MuscleModel *Model;
+    int_T   Num_states;
+    real_T  t;
+    real_T* x;
+    real_T* Work;
+    real_T  y[VM_NUM_OUTPUTS];
+    VM_Inputs u;
+    real_T  Step;               //DOPRI5 step for the next call
+    real_T  MU_next;            //Time of the next discrete motor unit update
+    real_T* Scratch;            //8 state vectors (stages and stage state)
+    real_T* Arena;              //[VM_ARENA_SIZE(TypesOf_fibers)], VM_ARENA_ALIGN aligned
+} VM_Simulation;
+
+extern VM_Simulation* VM_CreateSimulation(const VM_MuscleModel *Model);
+extern void VM_FreeSimulation(VM_Simulation *Sim);
+extern void VM_InitializeSimulation(VM_Simulation *Sim, real_T t0, VM_InputFcn Input, void *Context);
+extern int_T VM_Simulate(VM_Simulation *Sim, const VM_SolverOptions *Options, real_T t_end,
+                         VM_InputFcn Input, VM_OutputFcn Output, void *Context);
+
+#endif /* VIRTUAL_MUSCLE_ENGINE_H */
@@ -0,0 +1,925 @@
+/* VIRTUAL_MUSCLE_ENSEMBLE.C
+ * Synopsis: Lane per muscle ensemble of the Virtual Muscle engine, see Virtual_Muscle_Ensemble.h
+ *
+ * Comments: The pack functions follow VM_Outputs, VM_Activation and VM_Derivatives line by line, with
+ *          every scalar of the muscle replaced by a loop over the lanes. The motor unit states are stored
+ *          as in the structure of arrays layout (yield, sag, fint then feff of all the units), each value
+ *          being VM_ENSEMBLE_LANES wide. The transcendental functions of the muscle and fiber type values
+ *          (Fse, Fpe, FL, yield target) are the C library ones, once per lane; those of every motor unit
+ *          (Af) go through the lane kernel.
+ *
+ *          Build: add Virtual_Muscle_Ensemble.c to the engine sources. The lane loops are vectorized by
+ *          the compiler for the target of the build (e.g. -O3 -march=native); the Af kernel is selected
+ *          at run time.
+ *
+ * Date: 10-17-26
+ */
+
+#include "Virtual_Muscle_Ensemble.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER)
+#define VM_RESTRICT __restrict
+#else
+#define VM_RESTRICT __restrict__
+#endif
+
+#define LANES VM_ENSEMBLE_LANES
+
+#define VM_ENSEMBLE_FIBER_ARRAYS    27  //[TypesOf_fibers*LANES] arrays of a pack
+#define VM_ENSEMBLE_UNIT_ARRAYS     8   //[Total_Munits*LANES] arrays of a pack
+#define VM_ENSEMBLE_STATE_ARRAYS    6   //[Num_states*LANES] arrays of a pack: x, k1 .. k4 and the stage state
+
+/*Pack of LANES members
+ Lane l holds member Members[l]; the lanes from Num_lanes on repeat the last member and are not output.
+ The arrays are carved out of the same allocation as the pack.
+ */
+struct VM_EnsemblePack {
+    int_T   Num_lanes;
+    int_T   Members[LANES];
+
+    //Muscle values and inputs [LANES]
+    real_T  MUSCF0[LANES];
+    real_T  FASCLMAX[LANES];
+    real_T  Viscocity[LANES];
+    real_T  c1[LANES], k1[LANES], Lr1[LANES];
+    real_T  c2[LANES], k2[LANES], Lr2[LANES];
+    real_T  cT[LANES], kT[LANES], LrT[LANES];
+    real_T  L0[LANES];
+    real_T  L0T[LANES];
+    real_T  invL0[LANES];
+    real_T  invL0T[LANES];
+    real_T  invMass[LANES];
+    real_T  Act[LANES];
+    real_T  Path[LANES];
+    real_T  Freq[LANES];
+    real_T  Lce[LANES];
+    real_T  Vce[LANES];
+    real_T  Fse[LANES];
+
+    //Fiber type values [TypesOf_fibers*LANES]
+    real_T* Tf1;
+    real_T* Tf2;
+    real_T* Tf3;
+    real_T* Tf4;
+    real_T* invTs;
+    real_T* aS1;
+    real_T* aS2;
+    real_T* cY;
+    real_T* VY;
+    real_T* af;
+    real_T* nf0;
+    real_T* nf1;
+    real_T* FL_omega;
+    real_T* FL_beta;
+    real_T* FL_rho;
+    real_T* Vmax;
+    real_T* cV0;
+    real_T* cV1;
+    real_T* aV0;
+    real_T* aV1;
+    real_T* aV2;
+    real_T* bV;
+    real_T* invf05;
+    real_T* Fract_PCSA;
+    real_T* af_nf;              //af*nf of the last VM_Activation
+    real_T* nf;
+    real_T* PEpFLtFV;
+
+    //Motor unit values [Total_Munits*LANES]; Natural Continuous: those of the fiber types (Type_threshold)
+    real_T* Unit_PCSA;
+    real_T* Threshold;
+    real_T* fenv_slope;
+    real_T* Unit_Fmin;
+    real_T* fenv;               //Work vector values, as VM_WORK_FENV, VM_WORK_AF and VM_WORK_RATE
+    real_T* Af;
+    real_T* rate;
+    real_T* YS;                 //Yield*Sag factor of Af
+
+    //States [VM_NUM_STATES(Total_Munits)*LANES]
+    real_T* x;
+    real_T* k[4];               //RK4 stage derivatives
+    real_T* xs;                 //RK4 stage state
+};
+
+
+
+/* Function: FL_Exact
+*  Description: Force-length curve, as FL_Exact of the engine
+*/
+static real_T FL_Exact(real_T Lce, real_T FL_omega, real_T FL_beta, real_T FL_rho)
+{
+    real_T temp = (pow(Lce,FL_beta)-1)/FL_omega;
+
+    if(temp<0.0)
+        temp = -temp;
+    return exp(-pow(temp,FL_rho));
+}
+
+
+
+/* Function: InitializeLane
+*  Description: Initial states of lane l of the pack state x at the path length of its input and no
+*              recruitment or activation yet, as VM_InitializeConditions
+*/
+static void InitializeLane(const VM_Ensemble *E, VM_EnsemblePack *P, real_T *x, int_T l)
+{
+    int_T N         = E->Total_Munits;
+    real_T L0       = P->L0[l];
+    real_T c1       = P->c1[l];
+    real_T k1       = P->k1[l];
+    real_T Lr1      = P->Lr1[l];
+    real_T kT       = P->kT[l];
+    real_T cT       = P->cT[l];
+    real_T LrT      = P->LrT[l];
+    real_T L0T      = P->L0T[l];
+    real_T Lmax     = P->FASCLMAX[l];
+    real_T Path     = P->Path[l];
+    int_T j         = 0;
+
+    for(j=0; j<N; j++){
+        x[(0*N+j)*LANES+l]  = 1;            //Yield
+        x[(1*N+j)*LANES+l]  = P->aS1[l];    //Sag, aS1 of the first fiber type as the engine
+        x[(2*N+j)*LANES+l]  = 0.0;          //fint
+        x[(3*N+j)*LANES+l]  = 0.0;          //feff
+        P->fenv[j*LANES+l]  = 0.0;
+        P->Af[j*LANES+l]    = 0.0;
+        P->rate[j*LANES+l]  = 0.0;
+    }
+    x[(4*N)*LANES+l]    = 0.0; //Vce
+    x[(4*N+1)*LANES+l]  = ((Path*100) -(-L0T*(kT/k1*Lr1-LrT-kT*log(c1/cT*k1/kT))))/(100*(1+kT/k1*L0T/Lmax*1/L0)); //Lce
+    x[(4*N+2)*LANES+l]  = 0.0; //Ulevel
+}
+
+
+
+/* Function: PackActivation
+*  Description: Recruitment, feff rise/fall rates and Af of all the lanes for the state x, as VM_Activation:
+*              the rates use the Af of the previous call
+*/
+static void PackActivation(const VM_Ensemble *E, VM_EnsemblePack *P, const real_T *x)
+{
+    int_T N                         = E->Total_Munits;
+    const real_T* VM_RESTRICT Yield = x;
+    const real_T* VM_RESTRICT Sag   = x+N*LANES;
+    const real_T* VM_RESTRICT fint  = x+2*N*LANES;
+    const real_T* VM_RESTRICT feff  = x+3*N*LANES;
+    const real_T* VM_RESTRICT Lce   = P->Lce;
+    real_T* VM_RESTRICT fenv        = P->fenv;
+    real_T* VM_RESTRICT Af          = P->Af;
+    real_T* VM_RESTRICT rate        = P->rate;
+    real_T* VM_RESTRICT YS          = P->YS;
+    //Fiber type values of the lanes, loop invariant copies
+    real_T Tf1_Lce2[LANES];
+    real_T Tf2[LANES];
+    real_T Tf3[LANES];
+    real_T Tf4[LANES];
+    real_T Yield_on[LANES];         //1 with yield, 0 without
+    real_T Sag_on[LANES];
+    real_T Yield_Munit      = 0.0;
+    real_T Sag_Munit        = 0.0;
+    real_T invTf1           = 0.0;
+    real_T invTf2           = 0.0;
+    real_T nf               = 0.0;
+    int_T i                 = 0;
+    int_T j                 = 0;
+    int_T l                 = 0;
+    int_T a                 = 0;
+    int_T b                 = 0;
+    int_T offset            = 0;
+
+    if (E->Recruitment_Type != 4) { //Natural, the recruited units are those with Act >= Threshold (Recruit)
+        for(j=0; j<N; j++){
+            for(l=0; l<LANES; l++){
+                a = j*LANES+l;
+                fenv[a] = (P->Act[l] >= P->Threshold[a]) ? P->fenv_slope[a] * (P->Act[l]-P->Threshold[a]) + P->Unit_Fmin[a]
+                                                         : 0.0;
+            }
+        }
+        offset = 0;
+        for(i=0; i<E->TypesOf_fibers; i++){
+            for(l=0; l<LANES; l++){
+                b = i*LANES+l;
+                Tf1_Lce2[l]     = P->Tf1[b]*pow(Lce[l],2);
+                Tf2[l]          = P->Tf2[b];
+                Tf3[l]          = P->Tf3[b];
+                Tf4[l]          = P->Tf4[b];
+                Yield_on[l]     = P->cY[b] > 0.001; //Only slow fibers have yield
+                Sag_on[l]       = P->aS1[b] != P->aS2[b]; //Only fast fibers have sag
+                P->nf[b]        = P->nf0[b]+P->nf1[b]*((1/Lce[l])-1);
+                P->af_nf[b]     = P->af[b]*P->nf[b];
+            }
+            if (E->Single_precision) { //rates in float (PRECISION 2), as MU_RiseFallFloat
+                for(j=offset; j<offset+E->Num_of_Munits[i]; j++){
+                    for(l=0; l<LANES; l++){
+                        a = j*LANES+l;
+                        invTf1  = 1.0f/((float)Tf1_Lce2[l]+(float)Tf2[l]*(float)fenv[a]); //feff'>0
+                        invTf2  = (float)Lce[l]/((float)Tf3[l]+(float)Tf4[l]*(float)Af[a]); //feff'<0
+                        rate[a] = ((fint[a]-feff[a])>=0) ? invTf1 : invTf2;
+                        YS[a]   = (Yield_on[l] != 0 ? Yield[a] : 1.0)*(Sag_on[l] != 0 ? Sag[a] : 1.0);
+                    }
+                }
+            }
+            else {
+                for(j=offset; j<offset+E->Num_of_Munits[i]; j++){
+                    for(l=0; l<LANES; l++){
+                        a = j*LANES+l;
+                        invTf1  = 1/(Tf1_Lce2[l]+Tf2[l]*fenv[a]); //feff'>0
+                        invTf2  = Lce[l]/(Tf3[l]+Tf4[l]*Af[a]); //feff'<0
+                        rate[a] = ((fint[a]-feff[a])>=0) ? invTf1 : invTf2;
+                        YS[a]   = (Yield_on[l] != 0 ? Yield[a] : 1.0)*(Sag_on[l] != 0 ? Sag[a] : 1.0);
+                    }
+                }
+            }
+            E->Af_lanes(Af+offset*LANES, YS+offset*LANES, feff+offset*LANES, E->Num_of_Munits[i], LANES,
+                        P->af_nf+i*LANES, P->nf+i*LANES);
+            offset += E->Num_of_Munits[i];
+        }
+        return;
+    }
+
+    //Intramuscular FES: one unit per fiber type
+    offset = 0;
+    for(i=0; i<E->TypesOf_fibers; i++){
+        for(j=offset; j<offset+E->Num_of_Munits[i]; j++){
+            for(l=0; l<LANES; l++){
+                fenv[j*LANES+l] = P->Freq[l]* P->invf05[i*LANES+l];
+            }
+        }
+        offset += E->Num_of_Munits[i];
+    }
+    for(i=0; i<E->TypesOf_fibers; i++){
+        for(l=0; l<LANES; l++){
+            a = i*LANES+l;
+            Yield_Munit = (P->cY[a] > 0.0) ? Yield[a] : 1.0;
+            nf          = P->nf0[a]+P->nf1[a]*((1/Lce[l])-1);
+            Sag_Munit   = (P->aS1[a] == P->aS2[a]) ? 1.0 : Sag[a];
+            if (E->Single_precision) {
+                Af[a]   = 1.0f-expf(-powf((float)Yield_Munit*(float)Sag_Munit*(float)fenv[a]/((float)P->af[a]*(float)nf),(float)nf));
+                invTf2  = (float)Lce[l]/((float)P->Tf3[a]+(float)P->Tf4[a]*((P->Act[l] > 0) ? 1.0f : 0.0f)); //feff'<0
+                invTf1  = 1.0f/((float)(P->Tf1[a]*pow(Lce[l],2))+(float)P->Tf2[a]*(float)fenv[a]); //feff'>0
+            }
+            else {
+                Af[a]   = 1-exp(-pow((Yield_Munit*Sag_Munit*(fenv[a])/(P->af[a]*nf)),nf));
+                invTf2  = (P->Act[l] > 0) ? Lce[l]/(P->Tf3[a]+P->Tf4[a]*1) : Lce[l]/(P->Tf3[a]+P->Tf4[a]*0); //feff'<0
+                invTf1  = 1/(P->Tf1[a]*pow(Lce[l],2)+P->Tf2[a]*(fenv[a])); //feff'>0
+            }
+            rate[a] = ((fint[a]-feff[a])>=0) ? invTf1 : invTf2;
+        }
+    }
+}
+
+
+
+/* Function: PackOutputs
+*  Description: Fse and the outputs of all the lanes for the state x (initialized first in the lanes where
+*              Lce is not positive), then PackActivation, as VM_Outputs. y: outputs of the ensemble, or NULL.
+*/
+static void PackOutputs(const VM_Ensemble *E, VM_EnsemblePack *P, real_T *x, real_T *y)
+{
+    int_T N         = E->Total_Munits;
+    int_T M         = E->Num_members;
+    real_T prov     = 0.0;
+    int_T l         = 0;
+
+    for(l=0; l<LANES; l++){
+        if (x[(4*N+1)*LANES+l] <= 0.0)
+            InitializeLane(E, P, x, l);
+    }
+    for(l=0; l<LANES; l++){
+        P->Lce[l]   = P->invL0[l]*x[(4*N+1)*LANES+l];
+        P->Vce[l]   = P->invL0[l]*x[(4*N)*LANES+l];
+        prov        = P->invL0T[l]*((P->Path[l]*100) - P->L0[l] * P->Lce[l]);
+        P->Fse[l]   = P->cT[l]*P->kT[l]*log( exp((prov-P->LrT[l])/P->kT[l]) + 1)*P->MUSCF0[l];
+    }
+    if (y != NULL) {
+        for(l=0; l<P->Num_lanes; l++){
+            y[VM_OUT_FSE*M+P->Members[l]]   = P->Fse[l];
+            y[VM_OUT_ACT*M+P->Members[l]]   = P->Act[l];
+            y[VM_OUT_FSEF0*M+P->Members[l]] = P->Fse[l]/P->MUSCF0[l];
+            y[VM_OUT_LCE*M+P->Members[l]]   = P->Lce[l];
+            y[VM_OUT_VCE*M+P->Members[l]]   = P->Vce[l];
+        }
+    }
+    PackActivation(E, P, x);
+}
+
+
+
+/* Function: PackDerivatives
+*  Description: Derivatives dx of all the lanes for the state x, with the values of PackOutputs for the same
+*              x, as VM_Derivatives. Both FV branches are computed and the one of the sign of Vce selected.
+*              Natural Continuous weighs the force of fiber type i by (Ulevel-Threshold[i])/U_deno, the
+*              sum running over the recruited types, as the engine.
+*/
+static void PackDerivatives(const VM_Ensemble *E, VM_EnsemblePack *P, const real_T *x, real_T *dx)
+{
+    int_T N                         = E->Total_Munits;
+    int_T Is_FES                    = E->Recruitment_Type == 4;
+    const real_T* VM_RESTRICT Yield = x;
+    const real_T* VM_RESTRICT Sag   = x+N*LANES;
+    const real_T* VM_RESTRICT fint  = x+2*N*LANES;
+    const real_T* VM_RESTRICT feff  = x+3*N*LANES;
+    const real_T* VM_RESTRICT U     = x+(4*N+2)*LANES;
+    real_T* VM_RESTRICT dYield      = dx;
+    real_T* VM_RESTRICT dSag        = dx+N*LANES;
+    real_T* VM_RESTRICT dfint       = dx+2*N*LANES;
+    real_T* VM_RESTRICT dfeff       = dx+3*N*LANES;
+    const real_T* VM_RESTRICT Lce   = P->Lce;
+    const real_T* VM_RESTRICT Vce   = P->Vce;
+    const real_T* VM_RESTRICT fenv  = P->fenv;
+    const real_T* VM_RESTRICT Af    = P->Af;
+    const real_T* VM_RESTRICT rate  = P->rate;
+    const real_T* VM_RESTRICT Unit_PCSA = P->Unit_PCSA;
+    //Fiber type values of the lanes, loop invariant copies
+    real_T Fract_PCSA[LANES];
+    real_T cY[LANES];
+    real_T aS1[LANES];
+    real_T aS2[LANES];
+    real_T invTs[LANES];
+    real_T Switch_on[LANES];        //sag switch of the fiber type
+    real_T Drive[LANES];            //fint target of FES (Act)
+    real_T Fpe1[LANES];
+    real_T Fpe2[LANES];
+    real_T Force[LANES];
+    real_T Total[LANES];
+    real_T Fpe[LANES];
+    real_T ActF[LANES];
+    real_T Yield_target[LANES];
+    real_T U_deno[LANES];
+    real_T FV_lengthening   = 0.0;
+    real_T FV_shortening    = 0.0;
+    real_T FL               = 0.0;
+    real_T FV               = 0.0;
+    real_T Af_type          = 0.0;
+    real_T Fce              = 0.0;
+    int_T i                 = 0;
+    int_T j                 = 0;
+    int_T l                 = 0;
+    int_T a                 = 0;
+    int_T b                 = 0;
+    int_T offset            = 0;
+
+    for(l=0; l<LANES; l++){
+        Fpe1[l] = P->Viscocity[l]*Vce[l]+P->c1[l]*P->k1[l]*log(exp((Lce[l]/P->FASCLMAX[l]-P->Lr1[l])/P->k1[l])+1);
+        Fpe2[l] = P->c2[l]*(exp(P->k2[l]*(Lce[l]-P->Lr2[l]))-1);
+        Fpe2[l] = (Fpe2[l]>0) ? 0.0 : Fpe2[l];
+        Total[l] = 0.0;
+        Fpe[l]   = 0.0;
+        ActF[l]  = 0.0;
+    }
+
+    for(i=0; i<E->TypesOf_fibers; i++){
+        for(l=0; l<LANES; l++){
+            b = i*LANES+l;
+            FV_lengthening  = (P->bV[b]-(P->aV0[b]+P->aV1[b]*Lce[l]+(P->aV2[b])*(Lce[l]*Lce[l]))*Vce[l])/(P->bV[b]+Vce[l]);
+            FV_shortening   = (P->Vmax[b]-Vce[l])/(P->Vmax[b]+(P->cV0[b]+P->cV1[b]*Lce[l])*Vce[l]);
+            FV = (Vce[l] > 0) ? FV_lengthening : FV_shortening;
+            FL = FL_Exact(Lce[l], P->FL_omega[b], P->FL_beta[b], P->FL_rho[b]);
+            P->PEpFLtFV[b] = Is_FES ? FL*FV : Fpe2[l]+(FL*FV);
+        }
+    }
+
+    //Natural Continuous: sum of the fiber type forces weighted by the Ulevel above their thresholds
+    if (E->Recruitment_Type == 3) {
+        for(l=0; l<LANES; l++){
+            U_deno[l] = 0.0;
+        }
+        for(i=0; i<E->TypesOf_fibers; i++){
+            for(l=0; l<LANES; l++){
+                b = i*LANES+l;
+                U_deno[l] += (U[l]-P->Threshold[b])*(U[l]>=P->Threshold[b]);
+            }
+        }
+        for(l=0; l<LANES; l++){
+            U_deno[l] = (U_deno[l]==0) ? 1 : U_deno[l]; //no type recruited
+        }
+        for(i=0; i<E->TypesOf_fibers; i++){
+            for(l=0; l<LANES; l++){
+                b = i*LANES+l;
+                Total[l] += Af[b]*P->PEpFLtFV[b]*(U[l]>=P->Threshold[b])*(U[l]-P->Threshold[b])/U_deno[l];
+            }
+        }
+        for(l=0; l<LANES; l++){
+            Total[l] = Total[l]*U[l];
+        }
+    }
+
+    //Sum of the motor unit forces, in motor unit order in each lane
+    offset = 0;
+    for(i=0; i<E->TypesOf_fibers && E->Recruitment_Type != 3; i++){
+        for(l=0; l<LANES; l++){
+            Force[l] = 0.0;
+            Fract_PCSA[l] = P->Fract_PCSA[i*LANES+l];
+        }
+        if (Is_FES) {
+            for(j=offset; j<offset+E->Num_of_Munits[i]; j++){
+                for(l=0; l<LANES; l++){
+                    Force[l] += Af[j*LANES+l]*Fract_PCSA[l];
+                }
+            }
+        }
+        else {
+            for(j=offset; j<offset+E->Num_of_Munits[i]; j++){
+                for(l=0; l<LANES; l++){
+                    Force[l] += Af[j*LANES+l]*Unit_PCSA[j*LANES+l]; //Af_op*Fpcsa
+                }
+            }
+        }
+        for(l=0; l<LANES; l++){
+            b = i*LANES+l;
+            if (Is_FES) {
+                Af_type  = Force[l];
+                Force[l] = Force[l] * P->PEpFLtFV[b];
+                Force[l] *= P->MUSCF0[l];
+                Fpe[l]  += Af_type*Fpe2[l];
+                ActF[l] += feff[b]* Force[l]; //feff of unit i, as the engine
+            }
+            else {
+                Force[l] = Force[l] * P->PEpFLtFV[b];
+                Total[l] += Force[l];
+            }
+        }
+        offset += E->Num_of_Munits[i];
+    }
+
+    for(l=0; l<LANES; l++){
+        if (Is_FES) {
+            Fpe[l] = (Fpe[l]+Fpe1[l])*P->MUSCF0[l];
+            Fpe[l] = (Fpe[l] < 0) ? 0.0 : Fpe[l];
+            Fce = ActF[l] + Fpe[l];
+        }
+        else
+            Fce = P->MUSCF0[l] * (Fpe1[l] + Total[l]);
+        Fce = (Fce < 0.0) ? 0.0 : Fce;
+        dx[(4*N)*LANES+l]   = (P->Fse[l] - Fce) * P->invMass[l]; //Vce = Int(Acc)
+        dx[(4*N+1)*LANES+l] = x[(4*N)*LANES+l]; //Lce = Int(Vce)
+        if (E->Recruitment_Type == 3) //Ulevel, rising and falling time constants
+            dx[(4*N+2)*LANES+l] = (P->Act[l]-U[l]>=0) ? (P->Act[l]-U[l])*1/0.03 : (P->Act[l]-U[l])*1/0.15;
+        else
+            dx[(4*N+2)*LANES+l] = 0.0;
+    }
+
+    //Motor units
+    offset = 0;
+    for(i=0; i<E->TypesOf_fibers; i++){
+        for(l=0; l<LANES; l++){
+            b = i*LANES+l;
+            cY[l]           = P->cY[b];
+            aS1[l]          = P->aS1[b];
+            aS2[l]          = P->aS2[b];
+            invTs[l]        = P->invTs[b];
+            Switch_on[l]    = aS1[l] != aS2[l]; //sag (only for fast fibers)
+            Drive[l]        = P->Act[l];
+            Yield_target[l] = 0.0;
+            if (cY[l] > 0) //yield (only for slow fibers), exp(-Vce/VY) lengthening, exp(Vce/VY) shortening
+                Yield_target[l] = 1-cY[l]*(1-exp(((Vce[l]>=0) ? -Vce[l] : Vce[l])/P->VY[b]));
+        }
+        for(j=offset; j<offset+E->Num_of_Munits[i]; j++){
+            for(l=0; l<LANES; l++){
+                a = j*LANES+l;
+                dYield[a] = (cY[l] > 0) ? 5*(Yield_target[l]-Yield[a]) : 0.0;
+                dfeff[a]  = (fint[a]-feff[a])*rate[a]; //d(feff_tmp)
+            }
+        }
+        if (Is_FES) {
+            for(j=offset; j<offset+E->Num_of_Munits[i]; j++){
+                for(l=0; l<LANES; l++){
+                    a = j*LANES+l;
+                    dSag[a]   = (Switch_on[l] != 0) ? invTs[l]*(((fenv[a]>0.1) ? aS2[l] : aS1[l])-Sag[a]) : 0.0;
+                    dfint[a]  = (Drive[l]-fint[a])*rate[a]; //d(fint)
+                }
+            }
+        }
+        else {
+            for(j=offset; j<offset+E->Num_of_Munits[i]; j++){
+                for(l=0; l<LANES; l++){
+                    a = j*LANES+l;
+                    dSag[a]   = (Switch_on[l] != 0) ? invTs[l]*(((feff[a]>0.1) ? aS2[l] : aS1[l])-Sag[a]) : 0.0;
+                    dfint[a]  = (fenv[a]-fint[a])*rate[a]; //d(fint)
+                }
+            }
+        }
+        offset += E->Num_of_Munits[i];
+    }
+}
+
+
+
+/* Function: LoadInputs
+*  Description: Inputs of the lanes of every pack from E->u
+*/
+static void LoadInputs(VM_Ensemble *E)
+{
+    VM_EnsemblePack *P  = NULL;
+    int_T p             = 0;
+    int_T l             = 0;
+
+    for(p=0; p<E->Num_packs; p++){
+        P = E->Packs[p];
+        for(l=0; l<LANES; l++){
+            P->Act[l]   = E->u[P->Members[l]].Act;
+            P->Path[l]  = E->u[P->Members[l]].Path;
+            P->Freq[l]  = E->u[P->Members[l]].Freq;
+        }
+    }
+}
+
+
+
+/* Function: VM_FreeEnsemble
+*  Description: Frees the ensemble and its packs (NULL is ignored)
+*/
+void VM_FreeEnsemble(VM_Ensemble *E)
+{
+    int_T p = 0;
+
+    if (E == NULL)
+        return;
+    for(p=0; p<E->Num_packs; p++){
+        free(E->Packs[p]);
+    }
+    free(E);
+}
+
+
+
+/* Function: CreatePack
+*  Description: Pack of the members First .. First+LANES-1 (the last member repeated beyond Num_members)
+*/
+static VM_EnsemblePack* CreatePack(const VM_Ensemble *E, VM_MuscleModel *const *Models, int_T First)
+{
+    VM_EnsemblePack *P  = NULL;
+    const VM_MuscleModel *Model = NULL;
+    int_T T             = E->TypesOf_fibers;
+    int_T N             = E->Total_Munits;
+    int_T S             = VM_NUM_STATES(N);
+    real_T *Mem         = NULL;
+    int_T i             = 0;
+    int_T j             = 0;
+    int_T l             = 0;
+    int_T a             = 0;
+
+    P = (VM_EnsemblePack*)calloc(1, sizeof(VM_EnsemblePack) + (VM_ENSEMBLE_FIBER_ARRAYS*T + VM_ENSEMBLE_UNIT_ARRAYS*N
+                                                               + VM_ENSEMBLE_STATE_ARRAYS*S)*LANES*sizeof(real_T));
+    if (P == NULL)
+        return NULL;
+    Mem = (real_T*)(P+1);
+    P->Tf1          = Mem; Mem += T*LANES;
+    P->Tf2          = Mem; Mem += T*LANES;
+    P->Tf3          = Mem; Mem += T*LANES;
+    P->Tf4          = Mem; Mem += T*LANES;
+    P->invTs        = Mem; Mem += T*LANES;
+    P->aS1          = Mem; Mem += T*LANES;
+    P->aS2          = Mem; Mem += T*LANES;
+    P->cY           = Mem; Mem += T*LANES;
+    P->VY           = Mem; Mem += T*LANES;
+    P->af           = Mem; Mem += T*LANES;
+    P->nf0          = Mem; Mem += T*LANES;
+    P->nf1          = Mem; Mem += T*LANES;
+    P->FL_omega     = Mem; Mem += T*LANES;
+    P->FL_beta      = Mem; Mem += T*LANES;
+    P->FL_rho       = Mem; Mem += T*LANES;
+    P->Vmax         = Mem; Mem += T*LANES;
+    P->cV0          = Mem; Mem += T*LANES;
+    P->cV1          = Mem; Mem += T*LANES;
+    P->aV0          = Mem; Mem += T*LANES;
+    P->aV1          = Mem; Mem += T*LANES;
+    P->aV2          = Mem; Mem += T*LANES;
+    P->bV           = Mem; Mem += T*LANES;
+    P->invf05       = Mem; Mem += T*LANES;
+    P->Fract_PCSA   = Mem; Mem += T*LANES;
+    P->af_nf        = Mem; Mem += T*LANES;
+    P->nf           = Mem; Mem += T*LANES;
+    P->PEpFLtFV     = Mem; Mem += T*LANES;
+    P->Unit_PCSA    = Mem; Mem += N*LANES;
+    P->Threshold    = Mem; Mem += N*LANES;
+    P->fenv_slope   = Mem; Mem += N*LANES;
+    P->Unit_Fmin    = Mem; Mem += N*LANES;
+    P->fenv         = Mem; Mem += N*LANES;
+    P->Af           = Mem; Mem += N*LANES;
+    P->rate         = Mem; Mem += N*LANES;
+    P->YS           = Mem; Mem += N*LANES;
+    P->x            = Mem; Mem += S*LANES;
+    P->k[0]         = Mem; Mem += S*LANES;
+    P->k[1]         = Mem; Mem += S*LANES;
+    P->k[2]         = Mem; Mem += S*LANES;
+    P->k[3]         = Mem; Mem += S*LANES;
+    P->xs           = Mem;
+
+    P->Num_lanes = (E->Num_members-First < LANES) ? E->Num_members-First : LANES;
+    for(l=0; l<LANES; l++){
+        P->Members[l]   = (l < P->Num_lanes) ? First+l : E->Num_members-1;
+        Model           = Models[P->Members[l]];
+        P->MUSCF0[l]    = Model->MUSCF0;
+        P->FASCLMAX[l]  = Model->FASCLMAX;
+        P->Viscocity[l] = Model->Viscocity;
+        P->c1[l]        = Model->c1;
+        P->k1[l]        = Model->k1;
+        P->Lr1[l]       = Model->Lr1;
+        P->c2[l]        = Model->c2;
+        P->k2[l]        = Model->k2;
+        P->Lr2[l]       = Model->Lr2;
+        P->cT[l]        = Model->cT;
+        P->kT[l]        = Model->kT;
+        P->LrT[l]       = Model->LrT;
+        P->L0[l]        = Model->L0;
+        P->L0T[l]       = Model->L0T;
+        P->invL0[l]     = Model->invL0;
+        P->invL0T[l]    = Model->invL0T;
+        P->invMass[l]   = Model->invMass;
+        for(i=0; i<T; i++){
+            a = i*LANES+l;
+            P->Tf1[a]           = Model->Tf1[i];
+            P->Tf2[a]           = Model->Tf2[i];
+            P->Tf3[a]           = Model->Tf3[i];
+            P->Tf4[a]           = Model->Tf4[i];
+            P->invTs[a]         = Model->invTs[i];
+            P->aS1[a]           = Model->aS1[i];
+            P->aS2[a]           = Model->aS2[i];
+            P->cY[a]            = Model->cY[i];
+            P->VY[a]            = Model->VY[i];
+            P->af[a]            = Model->af[i];
+            P->nf0[a]           = Model->nf0[i];
+            P->nf1[a]           = Model->nf1[i];
+            P->FL_omega[a]      = Model->FL_omega[i];
+            P->FL_beta[a]       = Model->FL_beta[i];
+            P->FL_rho[a]        = Model->FL_rho[i];
+            P->Vmax[a]          = Model->Vmax[i];
+            P->cV0[a]           = Model->cV0[i];
+            P->cV1[a]           = Model->cV1[i];
+            P->aV0[a]           = Model->aV0[i];
+            P->aV1[a]           = Model->aV1[i];
+            P->aV2[a]           = Model->aV2[i];
+            P->bV[a]            = Model->bV[i];
+            P->invf05[a]        = Model->invf05[i];
+            P->Fract_PCSA[a]    = Model->Fract_PCSA[i];
+            P->nf[a]            = 1.0; //until the first PackActivation
+            P->af_nf[a]         = 1.0;
+        }
+        for(j=0; j<N; j++){
+            a = j*LANES+l;
+            P->Unit_PCSA[a]     = Model->Unit_PCSA[j];
+            if (E->Recruitment_Type == 3) { //motor unit j is fiber type j
+                P->Threshold[a]     = Model->Type_threshold[j];
+                P->fenv_slope[a]    = (Model->Fmax[j]-Model->Fmin[j])/(1-Model->Type_threshold[j]);
+                P->Unit_Fmin[a]     = Model->Fmin[j];
+            }
+            else {
+                P->Threshold[a]     = Model->Threshold[j];
+                P->fenv_slope[a]    = Model->fenv_slope[j];
+                P->Unit_Fmin[a]     = Model->Unit_Fmin[j];
+            }
+        }
+    }
+    return P;
+}
+
+
+
+/* Function: VM_CreateEnsemble
+*  Description: Checks that the models can share the packs and copies their parameters into them
+*/
+VM_Ensemble* VM_CreateEnsemble(VM_MuscleModel *const *Models, int_T Num_members, const char **Error)
+{
+    VM_Ensemble *E          = NULL;
+    const VM_MuscleModel *First = NULL;
+    const VM_MuscleModel *Model = NULL;
+    int_T Num_packs         = 0;
+    int_T m                 = 0;
+    int_T i                 = 0;
+    int_T p                 = 0;
+
+    if (Num_members < 1) {
+        if (Error != NULL)
+            *Error = "An ensemble needs at least one member";
+        return NULL;
+    }
+    First = Models[0];
+    for(m=0; m<Num_members; m++){
+        Model = Models[m];
+        if (Model->Recruitment_Type < 2 || Model->Recruitment_Type > 4) {
+            if (Error != NULL)
+                *Error = "Ensembles support Natural Discrete, Natural Continuous and Intramuscular FES recruitment only";
+            return NULL;
+        }
+        if (Model->MU_step > 0 || Model->Active_tol > 0 || Model->FL_table != NULL || Model->Zero_cross
+            || Model->Steady_init) {
+            if (Error != NULL)
+                *Error = "Ensemble members need MUSTEP, ACTIVETOL, CURVETOL and ZEROCROSS 0 and INITSTATE 1";
+            return NULL;
+        }
+        if (Model->Single_precision != First->Single_precision) {
+            if (Error != NULL)
+                *Error = "Ensemble members need the same PRECISION";
+            return NULL;
+        }
+        if (Model->Recruitment_Type != First->Recruitment_Type || Model->TypesOf_fibers != First->TypesOf_fibers) {
+            if (Error != NULL)
+                *Error = "Ensemble members need the same recruitment type, fiber types and motor units";
+            return NULL;
+        }
+        for(i=0; i<First->TypesOf_fibers; i++){
+            if (Model->Num_of_Munits[i] != First->Num_of_Munits[i]) {
+                if (Error != NULL)
+                    *Error = "Ensemble members need the same recruitment type, fiber types and motor units";
+                return NULL;
+            }
+        }
+    }
+
+    //One allocation: ensemble, inputs, outputs, pack pointers, then the int_T arrays
+    Num_packs = (Num_members+LANES-1)/LANES;
+    E = (VM_Ensemble*)calloc(1, sizeof(VM_Ensemble) + Num_members*(sizeof(VM_Inputs) + VM_NUM_OUTPUTS*sizeof(real_T))
+                                + Num_packs*sizeof(VM_EnsemblePack*) + (Num_members+First->TypesOf_fibers)*sizeof(int_T));
+    if (E == NULL) {
+        if (Error != NULL)
+            *Error = "Could not allocate the ensemble";
+        return NULL;
+    }
+    E->u                = (VM_Inputs*)(E+1);
+    E->y                = (real_T*)(E->u+Num_members);
+    E->Packs            = (VM_EnsemblePack**)(E->y+VM_NUM_OUTPUTS*Num_members);
+    E->State_layout     = (int_T*)(E->Packs+Num_packs);
+    E->Num_of_Munits    = E->State_layout+Num_members;
+    E->Num_members      = Num_members;
+    E->TypesOf_fibers   = First->TypesOf_fibers;
+    E->Total_Munits     = First->Total_Munits;
+    E->Recruitment_Type = First->Recruitment_Type;
+    E->Single_precision = First->Single_precision;
+    E->Af_lanes         = E->Single_precision ? VM_SelectAfLanesFloat(LANES, &E->Af_isa) : VM_SelectAfLanes(LANES, &E->Af_isa);
+    for(i=0; i<E->TypesOf_fibers; i++){
+        E->Num_of_Munits[i] = First->Num_of_Munits[i];
+    }
+    for(m=0; m<Num_members; m++){
+        E->State_layout[m] = Models[m]->State_layout;
+    }
+    for(p=0; p<Num_packs; p++){
+        E->Packs[p] = CreatePack(E, Models, p*LANES);
+        if (E->Packs[p] == NULL) {
+            if (Error != NULL)
+                *Error = "Could not allocate the ensemble";
+            VM_FreeEnsemble(E);
+            return NULL;
+        }
+        E->Num_packs++;
+    }
+    return E;
+}
+
+
+
+/* Function: VM_InitializeEnsemble
+*  Description: Sets the time to t0, the inputs to Input(t0) (if Input is not NULL, else E->u is used), the
+*              initial states of every member and the outputs at t0
+*/
+void VM_InitializeEnsemble(VM_Ensemble *E, real_T t0, VM_EnsembleInputFcn Input, void *Context)
+{
+    VM_EnsemblePack *P  = NULL;
+    int_T p             = 0;
+    int_T l             = 0;
+
+    E->t = t0;
+    if (Input != NULL) {
+        Input(t0, E->u, Context);
+    }
+    LoadInputs(E);
+    for(p=0; p<E->Num_packs; p++){
+        P = E->Packs[p];
+        for(l=0; l<LANES; l++){
+            InitializeLane(E, P, P->x, l);
+        }
+        PackOutputs(E, P, P->x, E->y);
+    }
+}
+
+
+
+/* Function: Evaluate
+*  Description: Inputs, outputs y (NULL for the intermediate stages) and derivatives k[Stage] of every pack,
+*              at the state (Stage_state: the stage state xs, else x)
+*/
+static void Evaluate(VM_Ensemble *E, real_T t, int_T Stage_state, int_T Stage, real_T *y,
+                     VM_EnsembleInputFcn Input, void *Context)
+{
+    VM_EnsemblePack *P  = NULL;
+    real_T *x           = NULL;
+    int_T p             = 0;
+
+    if (Input != NULL) {
+        Input(t, E->u, Context);
+        LoadInputs(E);
+    }
+    for(p=0; p<E->Num_packs; p++){
+        P = E->Packs[p];
+        x = Stage_state ? P->xs : P->x;
+        PackOutputs(E, P, x, y);
+        PackDerivatives(E, P, x, P->k[Stage]);
+    }
+}
+
+
+
+/* Function: VM_SimulateEnsemble
+*  Description: Fixed step RK4 of every pack, as SimulateRK4 of the engine: the last step is shortened to end
+*              at t_end, and the derivatives at the end of a step are the first stage of the next one
+*/
+int_T VM_SimulateEnsemble(VM_Ensemble *E, real_T Step, real_T t_end,
+                          VM_EnsembleInputFcn Input, VM_EnsembleOutputFcn Output, void *Context)
+{
+    VM_EnsemblePack *P  = NULL;
+    int_T  n            = VM_NUM_STATES(E->Total_Munits)*LANES;
+    real_T* VM_RESTRICT x   = NULL;
+    real_T* VM_RESTRICT xs  = NULL;
+    const real_T* VM_RESTRICT k1 = NULL;
+    const real_T* VM_RESTRICT k2 = NULL;
+    const real_T* VM_RESTRICT k3 = NULL;
+    const real_T* VM_RESTRICT k4 = NULL;
+    real_T t0           = E->t;
+    real_T h            = 0.0;
+    int_T  Steps        = 0;
+    int_T  s            = 0;
+    int_T  p            = 0;
+    int_T  i            = 0;
+
+    if (t_end <= t0) {
+        return VM_SIM_OK;
+    }
+    Steps = (int_T)ceil((t_end-t0)/Step*(1-1e-12));
+    if (Steps < 1)
+        Steps = 1;
+
+    Evaluate(E, t0, 0, 0, E->y, Input, Context);
+    for(s=1; s<=Steps; s++){
+        h = ((s == Steps) ? t_end : t0+s*Step) - E->t;
+
+        for(p=0; p<E->Num_packs; p++){
+            x   = E->Packs[p]->x;
+            xs  = E->Packs[p]->xs;
+            k1  = E->Packs[p]->k[0];
+            for(i=0; i<n; i++)
+                xs[i] = x[i]+0.5*h*k1[i];
+        }
+        Evaluate(E, E->t+0.5*h, 1, 1, NULL, Input, Context);
+        for(p=0; p<E->Num_packs; p++){
+            x   = E->Packs[p]->x;
+            xs  = E->Packs[p]->xs;
+            k1  = E->Packs[p]->k[1];
+            for(i=0; i<n; i++)
+                xs[i] = x[i]+0.5*h*k1[i];
+        }
+        Evaluate(E, E->t+0.5*h, 1, 2, NULL, Input, Context);
+        for(p=0; p<E->Num_packs; p++){
+            x   = E->Packs[p]->x;
+            xs  = E->Packs[p]->xs;
+            k1  = E->Packs[p]->k[2];
+            for(i=0; i<n; i++)
+                xs[i] = x[i]+h*k1[i];
+        }
+        Evaluate(E, E->t+h, 1, 3, NULL, Input, Context);
+        for(p=0; p<E->Num_packs; p++){
+            P   = E->Packs[p];
+            x   = P->x;
+            k1  = P->k[0];
+            k2  = P->k[1];
+            k3  = P->k[2];
+            k4  = P->k[3];
+            for(i=0; i<n; i++)
+                x[i] += h/6*(k1[i]+2*k2[i]+2*k3[i]+k4[i]);
+        }
+
+        E->t = (s == Steps) ? t_end : t0+s*Step;
+        Evaluate(E, E->t, 0, 0, E->y, Input, Context);
+        if (Output != NULL && Output(E->t, E->y, Context)) {
+            return VM_SIM_STOPPED;
+        }
+    }
+    return VM_SIM_OK;
+}
+
+
+
+/* Function: VM_GetEnsembleStates
+*  Description: Copies the states of member m into x, in the state layout of its model
+*/
+void VM_GetEnsembleStates(const VM_Ensemble *E, int_T m, real_T *x)
+{
+    const VM_EnsemblePack *P    = E->Packs[m/LANES];
+    int_T l                     = m%LANES;
+    int_T N                     = E->Total_Munits;
+    int_T MU_stride             = (E->State_layout[m] == VM_LAYOUT_SOA) ? 1 : MU_NUM_STATES;
+    int_T MU_field              = (E->State_layout[m] == VM_LAYOUT_SOA) ? N : 1;
+    int_T j                     = 0;
+    int_T f                     = 0;
+
+    for(f=0; f<MU_NUM_STATES; f++){
+        for(j=0; j<N; j++){
+            x[j*MU_stride+f*MU_field] = P->x[(f*N+j)*LANES+l];
+        }
+    }
+    for(f=0; f<VM_NUM_MUSCLE_STATES; f++){
+        x[MU_NUM_STATES*N+f] = P->x[(MU_NUM_STATES*N+f)*LANES+l];
+    }
+}
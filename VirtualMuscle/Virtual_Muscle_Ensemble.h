@@ -0,0 +1,78 @@
+/* VIRTUAL_MUSCLE_ENSEMBLE.H
+ * Synopsis: Lane per muscle ensemble of the Virtual Muscle engine, for many independent muscles of the
+ *          same structure (fiber types and motor units per type) with their own parameters and inputs.
+ *
+ *          The members are packed VM_ENSEMBLE_LANES at a time. Every value of a pack (parameters, states,
+ *          work values) is stored lane minor: value k of lane l at [k*VM_ENSEMBLE_LANES+l]. The right hand
+ *          side of VM_Outputs and VM_Derivatives is evaluated for all the lanes at once: the loops over the
+ *          lanes have no branches (the Vce sign, rise/fall, recruitment and sag switches are selects) and
+ *          vectorize, and Af goes through the lane kernel selected for the CPU (VM_SelectAfLanes). The
+ *          packs are integrated with a shared fixed step RK4, as VM_Simulate (VM_SOLVER_RK4).
+ *
+ *          Each lane computes what VM_Outputs and VM_Derivatives compute for its member, in the same
+ *          order: with the scalar lane kernel (VM_DISABLE_SIMD, or no AVX2) the states are bitwise those
+ *          of VM_Simulate with the interleaved layout, with the vector kernels bitwise those of
+ *          VM_Simulate with the structure of arrays layout (same Af kernel, same instruction set).
+ *
+ *          Members: Natural Discrete (RTYPE 2), Natural Continuous (RTYPE 3, one motor unit per fiber
+ *          type) or Intramuscular FES (RTYPE 4) recruitment, continuous motor units (MUSTEP 0), every unit
+ *          evaluated (ACTIVETOL 0), exact FL curves (CURVETOL 0), no ZEROCROSS modes and resting initial
+ *          states (INITSTATE 1), all with the same PRECISION. The last pack is filled up with copies of
+ *          the last member.
+ *
+ * Date: 10-17-26
+ */
+
+#ifndef VIRTUAL_MUSCLE_ENSEMBLE_H
+#define VIRTUAL_MUSCLE_ENSEMBLE_H
+
+#include "Virtual_Muscle_Engine.h"
+
+//Muscles per pack: 8 fills an AVX-512 register (two AVX2 ones), 4 an AVX2 register
+#ifndef VM_ENSEMBLE_LANES
+#define VM_ENSEMBLE_LANES   8
+#endif
+
+//Inputs of all the members at time t, u[Num_members]
+typedef void (*VM_EnsembleInputFcn)(real_T t, VM_Inputs *u, void *Context);
+//Called after every step with the outputs of all the members (output k of member m at y[k*Num_members+m]);
+//a nonzero return stops the simulation
+typedef int_T (*VM_EnsembleOutputFcn)(real_T t, const real_T *y, void *Context);
+
+typedef struct VM_EnsemblePack VM_EnsemblePack;
+
+/*Ensemble
+ The parameters of the members are copied into the packs when the ensemble is created; the models may be
+ freed afterwards. u and y are the inputs and outputs of all the members, as in VM_MuscleSet.
+ */
+typedef struct {
+    int_T   Num_members;
+    int_T   Num_packs;
+    int_T   TypesOf_fibers;
+    int_T   Total_Munits;
+    int_T   Recruitment_Type;
+    int_T*  Num_of_Munits;      //[TypesOf_fibers]
+    real_T  t;
+    VM_Inputs* u;               //[Num_members]
+    real_T* y;                  //[VM_NUM_OUTPUTS*Num_members]
+    int_T*  State_layout;       //[Num_members] of the member models, for VM_GetEnsembleStates
+    VM_EnsemblePack** Packs;    //[Num_packs]
+    int_T   Single_precision;   //Rise/fall rates and Af in float (PRECISION 2 members)
+    VM_AfLanesFcn Af_lanes;     //Af kernel of the packs
+    int_T   Af_isa;             //Instruction set of Af_lanes (VM_ISA_*)
+} VM_Ensemble;
+
+/* Ensemble of the Num_members models. Returns NULL, with the reason in *Error (may be NULL), if the
+ * models do not have the same structure, use an unsupported option or the allocation fails.
+ */
+extern VM_Ensemble* VM_CreateEnsemble(VM_MuscleModel *const *Models, int_T Num_members, const char **Error);
+extern void VM_FreeEnsemble(VM_Ensemble *E);
+//Sets the time to t0, the inputs to Input(t0) (if Input is not NULL, else E->u is used), the initial states and the outputs
+extern void VM_InitializeEnsemble(VM_Ensemble *E, real_T t0, VM_EnsembleInputFcn Input, void *Context);
+//Fixed step RK4 of all the members up to t_end; returns VM_SIM_OK or VM_SIM_STOPPED
+extern int_T VM_SimulateEnsemble(VM_Ensemble *E, real_T Step, real_T t_end,
+                                 VM_EnsembleInputFcn Input, VM_EnsembleOutputFcn Output, void *Context);
+//State vector of member m in the layout of its model (VM_NUM_STATES(Total_Munits) values)
+extern void VM_GetEnsembleStates(const VM_Ensemble *E, int_T m, real_T *x);
+
+#endif /* VIRTUAL_MUSCLE_ENSEMBLE_H */
@@ -0,0 +1,160 @@
+/* VIRTUAL_MUSCLE_GENERATE.C
+ * Synopsis: Fixed muscle header of a parameter file, for engine builds specialized for one muscle.
+ *
+ *          vm_generate <param file> <header>
+ *
+ *          The muscle of the parameter file (NUMMUSCLES 1) is checked with VM_CreateModel and written
+ *          to the header as constants: its structure (VM_FIXED_TYPESOF_FIBERS, VM_FIXED_TOTAL_MUNITS,
+ *          VM_Fixed_num_of_munits, VM_FIXED_RTYPE, VM_FIXED_STATELAYOUT, and VM_FIXED_TYPES, the
+ *          fiber types with their first motor unit and motor unit count), the fiber type coefficients
+ *          derived by the model (VM_FIXED_COEFS, VM_Fixed_<name>: Tf/1000, 1/(Ts/1000), af, nf0, nf1,
+ *          the FL and FV coefficients, ...) and all its parameter values (VM_Fixed_values,
+ *          VM_Fixed_count), exactly as read. An engine built with -DVM_FIXED_MUSCLE=\"<header>\"
+ *          unrolls the motor unit loops per fiber type with constant counts, folds the coefficients
+ *          into them and rejects muscles of another structure or other fiber types; VM_GetFixedParams
+ *          gives the parameter set of the header, so the build needs no parameter file (vm_simulate
+ *          takes - as its parameter file).
+ *
+ *          af*nf and the rise/fall rates are not tabulated: nf and the rates depend on Lce.
+ *
+ * Date: 10-17-26
+ *
+ * Build: cc -O2 -DVM_STANDALONE Virtual_Muscle_Generate.c Virtual_Muscle_ParamFile.c Virtual_Muscle_Engine.c
+ *          Virtual_Muscle_SIMD.c Virtual_Muscle_Threads.c -lm -lpthread -o vm_generate
+ *
+ *        Fixed muscle build of a tool, e.g. vm_simulate:
+ *        cc -O2 -DVM_STANDALONE -DVM_FIXED_MUSCLE=\"muscle.h\" Virtual_Muscle_Simulate.c
+ *          Virtual_Muscle_ParamFile.c Virtual_Muscle_Engine.c Virtual_Muscle_SIMD.c Virtual_Muscle_Threads.c
+ *          -lm -lpthread -o vm_simulate_fixed
+ */
+
+#include "Virtual_Muscle_Engine.h"
+#include "Virtual_Muscle_ParamFile.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+
+/* Function: WriteCoefs
+*  Description: Writes the fiber type coefficient array VM_Fixed_<Name> of the n values v to File
+*/
+static void WriteCoefs(FILE *File, const char *Name, const real_T *v, int_T n)
+{
+    int_T i = 0;
+
+    fprintf(File, "static const real_T VM_Fixed_%s[VM_FIXED_TYPESOF_FIBERS] = {", Name);
+    for(i=0; i<n; i++){
+        fprintf(File, "%s%.17g", (i > 0) ? ", " : "", v[i]);
+    }
+    fprintf(File, "};\n");
+}
+
+
+
+/* Function: WriteHeader
+*  Description: Writes the fixed muscle header of the parameter set P (model Model) to File
+*/
+static void WriteHeader(FILE *File, const char *Param_file, const VM_ParamSet *P, const VM_MuscleModel *Model)
+{
+    int_T k         = 0;
+    int_T j         = 0;
+    int_T offset    = 0;
+
+    fprintf(File, "/* Fixed muscle header written by vm_generate from %s, do not edit.\n", Param_file);
+    fprintf(File, " * Build the engine with -DVM_FIXED_MUSCLE=\\\"<this header>\\\" (Virtual_Muscle_Generate.c).\n");
+    fprintf(File, " */\n\n");
+    fprintf(File, "#ifndef VM_FIXED_MUSCLE_H\n#define VM_FIXED_MUSCLE_H\n\n");
+
+    fprintf(File, "#define VM_FIXED_TYPESOF_FIBERS %d\n", (int)Model->TypesOf_fibers);
+    fprintf(File, "#define VM_FIXED_TOTAL_MUNITS   %d\n", (int)Model->Total_Munits);
+    fprintf(File, "#define VM_FIXED_RTYPE          %d\n", (int)Model->Recruitment_Type);
+    fprintf(File, "#define VM_FIXED_STATELAYOUT    %d\n", (int)Model->State_layout);
+    fprintf(File, "#define VM_FIXED_NUM_PARAMS     %d\n\n", (int)P->Num_params);
+
+    fprintf(File, "static const int_T VM_Fixed_num_of_munits[VM_FIXED_TYPESOF_FIBERS] = {");
+    for(k=0; k<Model->TypesOf_fibers; k++){
+        fprintf(File, "%s%d", (k > 0) ? ", " : "", (int)Model->Num_of_Munits[k]);
+    }
+    fprintf(File, "};\n\n");
+
+    //X(fiber type, first motor unit, motor units) of each fiber type, for the unrolled motor unit loops
+    fprintf(File, "#define VM_FIXED_TYPES(X)");
+    for(k=0; k<Model->TypesOf_fibers; k++){
+        fprintf(File, " \\\n    X(%d, %d, %d)", (int)k, (int)offset, (int)Model->Num_of_Munits[k]);
+        offset += Model->Num_of_Munits[k];
+    }
+    fprintf(File, "\n\n");
+
+    //Fiber type coefficients of the model
+#define WRITE_COEFS(Name) WriteCoefs(File, #Name, Model->Name, Model->TypesOf_fibers);
+    VM_FIXED_COEFS(WRITE_COEFS)
+#undef WRITE_COEFS
+    fprintf(File, "\n");
+
+    fprintf(File, "static const int_T VM_Fixed_count[VM_FIXED_NUM_PARAMS] = {");
+    for(k=0; k<P->Num_params; k++){
+        fprintf(File, "%s%s%d", (k > 0) ? "," : "", (k%16 == 0) ? "\n    " : " ", (int)P->Count[k]);
+    }
+    fprintf(File, "\n};\n\n");
+
+    //One line per parameter, in the order of Virtual_Muscle_Params.h
+    fprintf(File, "static const real_T VM_Fixed_values[] = {\n");
+    for(k=0; k<P->Num_params; k++){
+        fprintf(File, "    /*%2d*/", (int)k);
+        for(j=0; j<P->Count[k]; j++){
+            fprintf(File, " %.17g,", P->Value[k][j]);
+        }
+        fprintf(File, "\n");
+    }
+    fprintf(File, "};\n\n");
+
+    fprintf(File, "#endif /* VM_FIXED_MUSCLE_H */\n");
+}
+
+
+
+int main(int argc, char **argv)
+{
+    VM_ParamSet Param_set;
+    VM_MuscleModel *Model   = NULL;
+    real_T *Values          = NULL;
+    const char *Error       = NULL;
+    FILE *File              = NULL;
+    int_T Status            = 0;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <param file> <header>\n", argv[0]);
+        return 2;
+    }
+    if (!VM_ReadParamSet(argv[1], &Param_set, &Values)) {
+        fprintf(stderr, "Could not read the parameters from %s\n", argv[1]);
+        return 1;
+    }
+    if (VM_OPTIONAL_PARAM_VALUE(&Param_set,NUMMUSCLES_IDX,1) != 1) {
+        fprintf(stderr, "vm_generate takes single muscle parameter files (NUMMUSCLES 1)\n");
+        free(Values);
+        return 1;
+    }
+    Model = VM_CreateModel(&Param_set, &Error);
+    if (Model == NULL) {
+        fprintf(stderr, "%s\n", Error);
+        free(Values);
+        return 1;
+    }
+
+    File = fopen(argv[2], "w");
+    if (File == NULL) {
+        fprintf(stderr, "Could not write %s\n", argv[2]);
+        Status = 1;
+    } else {
+        WriteHeader(File, argv[1], &Param_set, Model);
+        if (fclose(File) != 0) {
+            fprintf(stderr, "Could not write %s\n", argv[2]);
+            Status = 1;
+        }
+    }
+
+    VM_FreeModel(Model);
+    free(Values);
+    return Status;
+}
@@ -0,0 +1,80 @@
+/* VIRTUAL_MUSCLE_PARAMFILE.C
+ * Synopsis: Parameter files of the native tools, see Virtual_Muscle_ParamFile.h
+ *
+ * Date: 10-17-26
+ */
+
+#include "Virtual_Muscle_ParamFile.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_LINE 65536
+
+
+
+/* Function: VM_ReadParamSet
+*  Description: Reads the parameter file into P (values allocated in one block). Returns 0 on error.
+*/
+int_T VM_ReadParamSet(const char *File_name, VM_ParamSet *P, real_T **Values)
+{
+    FILE *File          = fopen(File_name, "r");
+    char *Line          = NULL;
+    char *Next          = NULL;
+    char *End           = NULL;
+    real_T *Buffer      = NULL;
+    real_T *Grown       = NULL;
+    int_T Size          = 0;
+    int_T Used          = 0;
+    int_T Start[NPARAMS];
+    int_T k             = 0;
+    real_T v            = 0.0;
+
+    if (File == NULL) {
+        return 0;
+    }
+    Line = (char*)malloc(MAX_LINE);
+    if (Line == NULL) {
+        fclose(File);
+        return 0;
+    }
+    P->Num_params = 0;
+    while (P->Num_params < NPARAMS && fgets(Line, MAX_LINE, File) != NULL) {
+        Start[P->Num_params] = Used;
+        Next = Line;
+        for(;;){
+            v = strtod(Next, &End);
+            if (End == Next)
+                break;
+            if (Used == Size) {
+                Size = Size ? 2*Size : 1024;
+                Grown = (real_T*)realloc(Buffer, Size*sizeof(real_T));
+                if (Grown == NULL) {
+                    free(Buffer);
+                    free(Line);
+                    fclose(File);
+                    return 0;
+                }
+                Buffer = Grown;
+            }
+            Buffer[Used++] = v;
+            Next = End;
+        }
+        if (Used > Start[P->Num_params]) { //skip empty lines
+            P->Count[P->Num_params] = Used-Start[P->Num_params];
+            P->Num_params++;
+        }
+    }
+    free(Line);
+    fclose(File);
+    if (P->Num_params < NPARAMS_LEGACY) {
+        free(Buffer);
+        return 0;
+    }
+    for(k=0; k<NPARAMS; k++){
+        P->Value[k] = (k < P->Num_params) ? Buffer+Start[k] : NULL;
+        if (k >= P->Num_params)
+            P->Count[k] = 0;
+    }
+    *Values = Buffer;
+    return 1;
+}
@@ -0,0 +1,21 @@
+/* VIRTUAL_MUSCLE_PARAMFILE.H
+ * Synopsis: Parameter files of the native tools (Virtual_Muscle_Simulate.c, Virtual_Muscle_Sweep.c)
+ *
+ *          A parameter file holds the S-function parameters in the order of Virtual_Muscle_Params.h,
+ *          one parameter per line, values separated by spaces; empty lines are skipped. The first
+ *          NPARAMS_LEGACY parameters are required, the optional ones take their default if missing.
+ *
+ * Date: 10-17-26
+ */
+
+#ifndef VIRTUAL_MUSCLE_PARAMFILE_H
+#define VIRTUAL_MUSCLE_PARAMFILE_H
+
+#include "Virtual_Muscle_Engine.h"
+
+/* Reads the parameter file File_name into P. The values are allocated in one block returned in
+ * *Values, to be freed by the caller. Returns 0 if the file cannot be read or is incomplete.
+ */
+extern int_T VM_ReadParamSet(const char *File_name, VM_ParamSet *P, real_T **Values);
+
+#endif /* VIRTUAL_MUSCLE_PARAMFILE_H */
@@ -0,0 +1,262 @@
+/* VIRTUAL_MUSCLE_PARAMS.H
+ * Synopsis: Index of each parameter passed to the S-function (and to VM_CreateModel), and the
+ *          SimStruct accessor used by the S-function. See CreateSimulinkBlock_sfun.m for the mask.
+ *
+ * Date: 10-17-26
+ */
+
+#ifndef VIRTUAL_MUSCLE_PARAMS_H
+#define VIRTUAL_MUSCLE_PARAMS_H
+
+// parameters passed to the s-function
+
+#define TOFMUSFIB_IDX 0 //Number of muscle fiber types
+#define TOFMUSFIB_PARAM(S) ssGetSFcnParam(S,TOFMUSFIB_IDX)
+
+//Generic parameters to all muscle fiber types
+#define SARCLEN_IDX 1 //Optimal sarcomere length (um)
+#define SARCLEN_PARAM(S) ssGetSFcnParam(S,SARCLEN_IDX)
+
+#define SPTEN_IDX 2 //Specific Tension (N/cm2)
+#define SPTEN_PARAM(S) ssGetSFcnParam(S,SPTEN_IDX)
+
+#define VISC_IDX 3 //Viscosity (part of FPE1)
+#define VISC_PARAM(S) ssGetSFcnParam(S,VISC_IDX)
+
+#define C1_IDX 4 //FPE1 
+#define C1_PARAM(S) ssGetSFcnParam(S,C1_IDX)
+
+#define K1_IDX 5 //FPE1 
+#define K1_PARAM(S) ssGetSFcnParam(S,K1_IDX)
+
+#define LR1_IDX 6 //FPE1 
+#define LR1_PARAM(S) ssGetSFcnParam(S,LR1_IDX)
+
+#define C2_IDX 7 //FPE2 
+#define C2_PARAM(S) ssGetSFcnParam(S,C2_IDX)
+
+#define K2_IDX 8 //FPE2 
+#define K2_PARAM(S) ssGetSFcnParam(S,K2_IDX)
+
+#define LR2_IDX 9 //FPE2 
+#define LR2_PARAM(S) ssGetSFcnParam(S,LR2_IDX)
+
+#define CT_IDX 10 //FSE 
+#define CT_PARAM(S) ssGetSFcnParam(S,CT_IDX)
+
+#define KT_IDX 11 //FSE 
+#define KT_PARAM(S) ssGetSFcnParam(S,KT_IDX)
+
+#define LRT_IDX 12 //FSE 
+#define LRT_PARAM(S) ssGetSFcnParam(S,LRT_IDX)
+
+
+//Specific parameters to each muscle fiber type
+#define RRANK_IDX 13 //Recruitment Rank
+#define RRANK_PARAM(S) ssGetSFcnParam(S,RRANK_IDX)
+ 
+#define V05_IDX 14 //V0.5(Lo/s)
+#define V05_PARAM(S) ssGetSFcnParam(S,V05_IDX)
+
+#define F05_IDX 15 //f0.5(pps)
+#define F05_PARAM(S) ssGetSFcnParam(S,F05_IDX)
+
+#define FMIN_IDX 16 //fmin(f0.5)
+#define FMIN_PARAM(S) ssGetSFcnParam(S,FMIN_IDX)
+
+#define FMAX_IDX 17 //fmax(f0.5)
+#define FMAX_PARAM(S) ssGetSFcnParam(S,FMAX_IDX)
+
+#define FLOMEGA_IDX 18 //  FL_omega
+#define FLOMEGA_PARAM(S) ssGetSFcnParam(S,FLOMEGA_IDX)
+
+#define FLBETA_IDX 19 //FL_beta
+#define FLBETA_PARAM(S) ssGetSFcnParam(S,FLBETA_IDX)
+
+#define FLRHO_IDX 20 //FL_rho
+#define FLRHO_PARAM(S) ssGetSFcnParam(S,FLRHO_IDX)
+
+#define VMAX_IDX 21 //Vmax
+#define VMAX_PARAM(S) ssGetSFcnParam(S,VMAX_IDX)
+
+#define CV0_IDX 22 //cV0
+#define CV0_PARAM(S) ssGetSFcnParam(S,CV0_IDX)
+
+#define CV1_IDX 23 //cV1
+#define CV1_PARAM(S) ssGetSFcnParam(S,CV1_IDX)
+
+#define AV0_IDX 24 //aV0
+#define AV0_PARAM(S) ssGetSFcnParam(S,AV0_IDX)
+
+#define AV1_IDX 25 //aV1
+#define AV1_PARAM(S) ssGetSFcnParam(S,AV1_IDX)
+
+#define AV2_IDX 26 //aV2
+#define AV2_PARAM(S) ssGetSFcnParam(S,AV2_IDX)
+
+#define BV_IDX 27 //bV
+#define BV_PARAM(S) ssGetSFcnParam(S,BV_IDX)
+
+#define AF_IDX 28 //aF
+#define AF_PARAM(S) ssGetSFcnParam(S,AF_IDX)
+
+#define NF0_IDX 29 //nf0
+#define NF0_PARAM(S) ssGetSFcnParam(S,NF0_IDX)
+
+#define NF1_IDX 30 //nf1
+#define NF1_PARAM(S) ssGetSFcnParam(S,NF1_IDX)
+
+#define TL_IDX 31 //TL
+#define TL_PARAM(S) ssGetSFcnParam(S,TL_IDX)
+
+#define TF1_IDX 32 //Tf1
+#define TF1_PARAM(S) ssGetSFcnParam(S,TF1_IDX)
+
+#define TF2_IDX 33 //Tf2
+#define TF2_PARAM(S) ssGetSFcnParam(S,TF2_IDX)
+
+#define TF3_IDX 34 //Tf3
+#define TF3_PARAM(S) ssGetSFcnParam(S,TF3_IDX)
+
+#define TF4_IDX 35 //Tf4
+#define TF4_PARAM(S) ssGetSFcnParam(S,TF4_IDX)
+
+#define AS1_IDX 36 //AS1
+#define AS1_PARAM(S) ssGetSFcnParam(S,AS1_IDX)
+
+#define AS2_IDX 37 //AS2
+#define AS2_PARAM(S) ssGetSFcnParam(S,AS2_IDX)
+
+#define TS_IDX 38 //TS
+#define TS_PARAM(S) ssGetSFcnParam(S,TS_IDX)
+
+#define CY_IDX 39 //cY
+#define CY_PARAM(S) ssGetSFcnParam(S,CY_IDX)
+
+#define VY_IDX 40 //VY
+#define VY_PARAM(S) ssGetSFcnParam(S,VY_IDX)
+
+#define TY_IDX 41 //TY
+#define TY_PARAM(S) ssGetSFcnParam(S,TY_IDX)
+
+#define CH0_IDX 42 //ch0
+#define CH0_PARAM(S) ssGetSFcnParam(S,CH0_IDX)
+
+#define CH1_IDX 43 //ch1
+#define CH1_PARAM(S) ssGetSFcnParam(S,CH1_IDX)
+
+#define CH2_IDX 44 //ch2
+#define CH2_PARAM(S) ssGetSFcnParam(S,CH2_IDX)
+
+#define CH3_IDX 45 //ch3
+#define CH3_PARAM(S) ssGetSFcnParam(S,CH3_IDX)
+
+
+/*Muscle parameters*/
+
+// Muscle model parameters (generic to all muscles)
+#define RTYPE_IDX 46 //Recruitment Type (2-Natural, 3-Natural continuous 4-Intramuscular FES)
+#define RTYPE_PARAM(S) ssGetSFcnParam(S,RTYPE_IDX)
+                                                                     //---------------------------| 
+                                                                     // [1] - None                | 
+#define ADDPORTS_IDX 47 //Additional ports besides Force(N)          // [2] - Activation          |
+#define ADDPORTS_PARAM(S) ssGetSFcnParam(S,ADDPORTS_IDX)             // [3] - Force (F0)          |
+                                                                     // [4] - Fascicle Length     |     
+//Muscle morphometry values                                          // [5] - Fascicle Velocity   |
+                                                                     // [6] - Profile (optional,  |
+                                                                     //       VM_PROFILE builds)  |
+#define MMASS_IDX 48 //Muscle mass                                   //---------------------------|    
+#define MMASS_PARAM(S) ssGetSFcnParam(S,MMASS_IDX)
+
+#define FASCL0_IDX 49 //Fascicle length
+#define FASCL0_PARAM(S) ssGetSFcnParam(S,FASCL0_IDX)
+
+#define TENDL0T_IDX 50 //Tendon length
+#define TENDL0T_PARAM(S) ssGetSFcnParam(S,TENDL0T_IDX)
+
+#define LPATH_IDX 51 //Maximum path length
+#define LPATH_PARAM(S) ssGetSFcnParam(S,LPATH_IDX)
+
+#define UR_IDX 52 //Maximum recruitment activation
+#define UR_PARAM(S) ssGetSFcnParam(S,UR_IDX)
+
+#define NUMOFUNITS_IDX 53 //Number of motor units in each muscle fiber type (RTYPE 3 models have one per type)
+#define NUMOFUNITS_PARAM(S) ssGetSFcnParam(S,NUMOFUNITS_IDX)
+
+#define FPCSA_IDX 54 //Fractional PCSA for each muscle fiber type
+#define FPCSA_PARAM(S) ssGetSFcnParam(S,FPCSA_IDX)
+
+#define UPCSA_IDX 55 //Unit PCSA for each motor unit (depends on apportion method)
+#define UPCSA_PARAM(S) ssGetSFcnParam(S,UPCSA_IDX)
+                                                                        //------------------------------|
+#define APPORTMTD_IDX 56 //Apportion method for each muscle type        // [1] - Manual                 |
+#define APPORTMTD_PARAM(S) ssGetSFcnParam(S,APPORTMTD_IDX)              // [2] - Default Algorithm      |
+                                                                        // [3] - Equal sizes            |
+#define GEOPCSA_IDX 57 //Fractional increase in geometric unit PCSA     // [4] - Geometric Algorithm    |
+#define GEOPCSA_PARAM(S) ssGetSFcnParam(S,GEOPCSA_IDX)                  //------------------------------|
+
+
+//Optional parameters. Blocks built before these were added pass only the first NPARAMS_LEGACY
+//parameters; a missing optional parameter takes its default value.
+                                                                        //------------------------------|
+#define STATELAYOUT_IDX 58 //Motor unit state layout                    // [1] - Interleaved (default)  |
+#define STATELAYOUT_PARAM(S) ssGetSFcnParam(S,STATELAYOUT_IDX)          // [2] - Structure of arrays    |
+                                                                        //------------------------------|
+#define CURVETOL_IDX 59 //Maximum FL table error                        // [0] - Exact curves (default) |
+#define CURVETOL_PARAM(S) ssGetSFcnParam(S,CURVETOL_IDX)                // [>0] - Tabulated FL curves   |
+                                                                        //------------------------------|
+#define NUMMUSCLES_IDX 60 //Number of muscles of the block              // [1] - One muscle (default)   |
+#define NUMMUSCLES_PARAM(S) ssGetSFcnParam(S,NUMMUSCLES_IDX)            // [M] - Vector ports of width M|
+                                                                        //------------------------------|
+#define MUSTEP_IDX 61 //Sample time of the motor unit states (s)       // [0] - Continuous (default)   |
+#define MUSTEP_PARAM(S) ssGetSFcnParam(S,MUSTEP_IDX)                    // [>0] - Discrete, exact       |
+                                                                        //       exponential update     |
+                                                                        //------------------------------|
+#define MULTIRATE_IDX 62 //Recruitment and Af at the MUSTEP rate        // [0] - Every call (default)   |
+#define MULTIRATE_PARAM(S) ssGetSFcnParam(S,MULTIRATE_IDX)              // [1] - Held between motor     |
+                                                                        //       unit updates (MUSTEP>0)|
+                                                                        //------------------------------|
+#define ACTIVETOL_IDX 63 //fint and feff below which an unrecruited     // [0] - All units evaluated    |
+#define ACTIVETOL_PARAM(S) ssGetSFcnParam(S,ACTIVETOL_IDX) //unit rests // [>0] - Active units only    |
+                                                                        //       (Natural Discrete),    |
+                                                                        //       approximate: resting   |
+                                                                        //       units have Af 0        |
+                                                                        //------------------------------|
+#define ZEROCROSS_IDX 64 //feff rise/fall and FV branches as modes      // [0] - Switch at every call   |
+#define ZEROCROSS_PARAM(S) ssGetSFcnParam(S,ZEROCROSS_IDX) //located by // [1] - Zero crossing          |
+                                                           //the solver //       detection              |
+                                                                        //------------------------------|
+#define NUMTHREADS_IDX 65 //Threads of the motor unit loops             // [1] - Serial (default)       |
+#define NUMTHREADS_PARAM(S) ssGetSFcnParam(S,NUMTHREADS_IDX)            // [T] - T threads (muscles of  |
+                                                                        //       512 units or more)     |
+                                                                        //------------------------------|
+#define PRECISION_IDX 66 //Precision of the motor unit kernels          // [1] - Double (default)       |
+#define PRECISION_PARAM(S) ssGetSFcnParam(S,PRECISION_IDX)              // [2] - Single: rise/fall rates|
+                                                                        //       and Af in float        |
+                                                                        //------------------------------|
+#define INITSTATE_IDX 67 //Initial states                               // [1] - Resting units, passive |
+#define INITSTATE_PARAM(S) ssGetSFcnParam(S,INITSTATE_IDX)              //       Lce (default)          |
+                                                                        // [2] - Steady state at the    |
+                                                                        //       initial inputs         |
+                                                                        //------------------------------|
+
+//Optional S-function parameter, after those of the engine (VM_ParamSet holds NPARAMS): a char array
+                                                                        //------------------------------|
+#define SURROGATE_IDX 68 //Surrogate table file                         // [''] - Full model (default)  |
+#define SURROGATE_PARAM(S) ssGetSFcnParam(S,SURROGATE_IDX)              // ['file'] - Surrogate muscle  |
+                                                                        //       of the table (vm_      |
+                                                                        //       tabulate), 3 states    |
+                                                                        //------------------------------|
+
+/*Multi-muscle blocks (NUMMUSCLES = M > 1)
+ RTYPE, ADDPORTS, STATELAYOUT, CURVETOL, NUMMUSCLES, MUSTEP, MULTIRATE, ACTIVETOL, ZEROCROSS, NUMTHREADS,
+ PRECISION, INITSTATE and SURROGATE are shared by all the muscles; a surrogate block holds one muscle. Every other parameter holds the values of the M muscles one after the other: M values for the scalar parameters,
+ the sum of TOFMUSFIB values for the fiber type parameters and the total number of motor units for
+ UPCSA.
+ */
+
+#define NPARAMS_LEGACY 58
+#define NPARAMS 68
+#define NPARAMS_SFUNCTION 69
+
+#endif /* VIRTUAL_MUSCLE_PARAMS_H */
@@ -0,0 +1,1015 @@
+/* VIRTUAL_MUSCLE_SIMD.C
+ * Synopsis: Batched activation-frequency (Af) kernels, see Virtual_Muscle_SIMD.h
+ *
+ * Comments: The vector exp and log follow fdlibm e_exp.c and e_log.c (Sun Microsystems, 1993)
+ *          with the branches replaced by blends; the coefficients are unchanged, so the < 1 ULP
+ *          bounds of fdlibm carry over. They are only valid over the range used by the Af kernel:
+ *          exp returns 0 below -708 (instead of a subnormal) and saturates at exp(709), which
+ *          leaves Af unchanged since 1-exp(-p) is already 0 or 1 there.
+ *
+ *          The power z^nf is computed as exp(nf*log(z)). For the Af range where the result is
+ *          not already rounded to 0 or 1 (nf*log(z) < 3.6), the rounding of the product adds
+ *          about 2 ULP to the relative error of z^nf, which becomes an absolute error of at most
+ *          0.37*(2+1) ULP in Af; with the errors of the two exp calls the bound of
+ *          VM_AF_SIMD_MAX_ERROR (4 ULP of 1.0) follows. Fiber types with nf <= 0 (fascicle
+ *          lengths far beyond the physiological range) use the scalar kernel, as do negative
+ *          bases with an integer nf, where pow and exp(nf*log(z)) legitimately differ.
+ *
+ *          The code is compiled with FMA contraction disabled so that the AVX2 and AVX-512
+ *          kernels round identically. Build with the S-function:
+ *              mex Virtual_Muscle_SFunction.c Virtual_Muscle_Engine.c Virtual_Muscle_SIMD.c Virtual_Muscle_Threads.c
+ *                  Virtual_Muscle_Surrogate.c
+ *          No additional compiler flags are needed; the vector kernels carry their own target
+ *          attributes (GCC/Clang) or rely on the intrinsics being always available (MSVC).
+ *
+ * Date: 10-17-26
+ */
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+#include "Virtual_Muscle_SIMD.h"
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#if !defined(VM_DISABLE_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define VM_HAVE_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define VM_TARGET_AVX2
+#define VM_TARGET_AVX512
+#else
+#define VM_TARGET_AVX2   __attribute__((target("avx2")))
+#define VM_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+
+
+/* Function: VM_AfBatch_Scalar
+*  Description: Reference kernel, identical to the per motor unit loop of the S-function
+*/
+void VM_AfBatch_Scalar(real_T *Af, const real_T *Yield, const real_T *Sag, const real_T *feff,
+                       int_T n, real_T af_nf, real_T nf)
+{
+    real_T Yield_Munit  = 1.0;
+    real_T Sag_Munit    = 1.0;
+    int_T  j            = 0;
+
+    for(j=0; j<n; j++){
+        Yield_Munit = (Yield != NULL) ? Yield[j] : 1.0;
+        Sag_Munit   = (Sag != NULL) ? Sag[j] : 1.0;
+        Af[j] = 1-exp(-pow(Yield_Munit*Sag_Munit*feff[j]/af_nf,nf));
+    }
+}
+
+
+
+/* Function: VM_AfLanes_Scalar
+*  Description: Reference lane kernel, identical to the per motor unit loop of the S-function for
+*              YS = Yield*Sag
+*/
+void VM_AfLanes_Scalar(real_T *Af, const real_T *YS, const real_T *feff, int_T n, int_T Lanes,
+                       const real_T *af_nf, const real_T *nf)
+{
+    int_T  j            = 0;
+    int_T  l            = 0;
+
+    for(j=0; j<n; j++){
+        for(l=0; l<Lanes; l++){
+            Af[j*Lanes+l] = 1-exp(-pow(YS[j*Lanes+l]*feff[j*Lanes+l]/af_nf[l],nf[l]));
+        }
+    }
+}
+
+
+
+/* Function: VM_AfBatchFloat_Scalar
+*  Description: Reference float kernel: the inputs are rounded to float and Af is computed with powf and expf
+*/
+void VM_AfBatchFloat_Scalar(real_T *Af, const real_T *Yield, const real_T *Sag, const real_T *feff,
+                            int_T n, real_T af_nf, real_T nf)
+{
+    float af_nf_f       = (float)af_nf;
+    float nf_f          = (float)nf;
+    float Yield_Munit   = 1.0f;
+    float Sag_Munit     = 1.0f;
+    int_T j             = 0;
+
+    for(j=0; j<n; j++){
+        Yield_Munit = (Yield != NULL) ? (float)Yield[j] : 1.0f;
+        Sag_Munit   = (Sag != NULL) ? (float)Sag[j] : 1.0f;
+        Af[j] = 1.0f-expf(-powf(Yield_Munit*Sag_Munit*(float)feff[j]/af_nf_f,nf_f));
+    }
+}
+
+
+
+/* Function: VM_AfLanesFloat_Scalar
+*  Description: Reference float lane kernel, as VM_AfBatchFloat_Scalar for YS = Yield*Sag
+*/
+void VM_AfLanesFloat_Scalar(real_T *Af, const real_T *YS, const real_T *feff, int_T n, int_T Lanes,
+                            const real_T *af_nf, const real_T *nf)
+{
+    int_T  j            = 0;
+    int_T  l            = 0;
+
+    for(j=0; j<n; j++){
+        for(l=0; l<Lanes; l++){
+            Af[j*Lanes+l] = 1.0f-expf(-powf((float)YS[j*Lanes+l]*(float)feff[j*Lanes+l]/(float)af_nf[l],
+                                            (float)nf[l]));
+        }
+    }
+}
+
+
+
+#ifdef VM_HAVE_X86_SIMD
+
+/* Function: LanesVectorizable
+*  Description: The vector kernels need nf > 0 and not an integer in every lane (see VM_AfBatch_AVX2)
+*/
+static int_T LanesVectorizable(int_T Lanes, const real_T *nf)
+{
+    int_T l = 0;
+
+    for(l=0; l<Lanes; l++){
+        if(!(nf[l] > 0) || (nf[l] == floor(nf[l])))
+            return 0;
+    }
+    return 1;
+}
+
+
+
+//fdlibm e_exp.c
+#define VM_EXP_LO       -708.0
+#define VM_EXP_HI       709.0
+#define VM_LN2_HI       6.93147180369123816490e-01
+#define VM_LN2_LO       1.90821492927058770002e-10
+#define VM_INV_LN2      1.44269504088896338700e+00
+#define VM_EXP_P1       1.66666666666666019037e-01
+#define VM_EXP_P2       -2.77777777770155933842e-03
+#define VM_EXP_P3       6.61375632143793436117e-05
+#define VM_EXP_P4       -1.65339022054652515390e-06
+#define VM_EXP_P5       4.13813679705723846039e-08
+
+//fdlibm e_log.c
+#define VM_LOG_LG1      6.666666666666735130e-01
+#define VM_LOG_LG2      3.999999999940941908e-01
+#define VM_LOG_LG3      2.857142874366239149e-01
+#define VM_LOG_LG4      2.222219843214978396e-01
+#define VM_LOG_LG5      1.818357216161805012e-01
+#define VM_LOG_LG6      1.531383769920937332e-01
+#define VM_LOG_LG7      1.479819860511658591e-01
+#define VM_DBL_MIN      2.2250738585072014e-308
+#define VM_TWO54        1.80143985094819840000e+16
+
+//1.5*2^52: adding it to a small integer valued double leaves the integer in the low mantissa bits
+#define VM_ROUND_MAGIC      6755399441055744.0
+#define VM_ROUND_MAGIC_BITS 0x4338000000000000LL
+
+
+/* Function: Exp_AVX2
+*  Description: exp(x) for 4 lanes (fdlibm e_exp.c)
+*/
+VM_TARGET_AVX2 static __m256d Exp_AVX2(__m256d x)
+{
+    __m256d xc = _mm256_min_pd(_mm256_set1_pd(VM_EXP_HI), _mm256_max_pd(_mm256_set1_pd(VM_EXP_LO), x));
+    __m256d kd = _mm256_round_pd(_mm256_mul_pd(xc, _mm256_set1_pd(VM_INV_LN2)),
+                                 _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d hi = _mm256_sub_pd(xc, _mm256_mul_pd(kd, _mm256_set1_pd(VM_LN2_HI)));
+    __m256d lo = _mm256_mul_pd(kd, _mm256_set1_pd(VM_LN2_LO));
+    __m256d r  = _mm256_sub_pd(hi, lo);
+    __m256d t  = _mm256_mul_pd(r, r);
+    __m256d c, y;
+    __m256i k;
+
+    c = _mm256_add_pd(_mm256_set1_pd(VM_EXP_P4), _mm256_mul_pd(t, _mm256_set1_pd(VM_EXP_P5)));
+    c = _mm256_add_pd(_mm256_set1_pd(VM_EXP_P3), _mm256_mul_pd(t, c));
+    c = _mm256_add_pd(_mm256_set1_pd(VM_EXP_P2), _mm256_mul_pd(t, c));
+    c = _mm256_add_pd(_mm256_set1_pd(VM_EXP_P1), _mm256_mul_pd(t, c));
+    c = _mm256_sub_pd(r, _mm256_mul_pd(t, c));
+    y = _mm256_div_pd(_mm256_mul_pd(r, c), _mm256_sub_pd(_mm256_set1_pd(2.0), c));
+    y = _mm256_sub_pd(_mm256_set1_pd(1.0), _mm256_sub_pd(_mm256_sub_pd(lo, y), hi));
+
+    //y*2^k, k in [-1021,1023]
+    k = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(kd, _mm256_set1_pd(VM_ROUND_MAGIC))),
+                         _mm256_set1_epi64x(VM_ROUND_MAGIC_BITS));
+    k = _mm256_slli_epi64(_mm256_add_epi64(k, _mm256_set1_epi64x(1023)), 52);
+    y = _mm256_mul_pd(y, _mm256_castsi256_pd(k));
+
+    return _mm256_andnot_pd(_mm256_cmp_pd(x, _mm256_set1_pd(VM_EXP_LO), _CMP_LT_OQ), y);
+}
+
+
+/* Function: Log_AVX2
+*  Description: log(x) for 4 lanes (fdlibm e_log.c), including subnormal, zero, negative, inf and NaN inputs
+*/
+VM_TARGET_AVX2 static __m256d Log_AVX2(__m256d x)
+{
+    __m256d tiny = _mm256_cmp_pd(x, _mm256_set1_pd(VM_DBL_MIN), _CMP_LT_OQ);
+    __m256d xs   = _mm256_blendv_pd(x, _mm256_mul_pd(x, _mm256_set1_pd(VM_TWO54)), tiny);
+    __m256i bits = _mm256_castpd_si256(xs);
+    __m256i hx   = _mm256_srli_epi64(bits, 32);
+    __m256i k    = _mm256_sub_epi64(_mm256_srli_epi64(hx, 20), _mm256_set1_epi64x(1023));
+    __m256i i, sel;
+    __m256d f, s, z, w, t1, t2, R, hfsq, dk, resA, resB, res;
+
+    k  = _mm256_add_epi64(k, _mm256_and_si256(_mm256_castpd_si256(tiny), _mm256_set1_epi64x(-54)));
+    hx = _mm256_and_si256(hx, _mm256_set1_epi64x(0x000fffff));
+
+    //normalize x or x/2 into [sqrt(2)/2, sqrt(2))
+    i    = _mm256_and_si256(_mm256_add_epi64(hx, _mm256_set1_epi64x(0x95f64)), _mm256_set1_epi64x(0x100000));
+    bits = _mm256_or_si256(_mm256_slli_epi64(_mm256_or_si256(hx, _mm256_xor_si256(i, _mm256_set1_epi64x(0x3ff00000))), 32),
+                           _mm256_and_si256(bits, _mm256_set1_epi64x(0xffffffffLL)));
+    k    = _mm256_add_epi64(k, _mm256_srli_epi64(i, 20));
+    dk   = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(k, _mm256_set1_epi64x(VM_ROUND_MAGIC_BITS))),
+                         _mm256_set1_pd(VM_ROUND_MAGIC));
+
+    f  = _mm256_sub_pd(_mm256_castsi256_pd(bits), _mm256_set1_pd(1.0));
+    s  = _mm256_div_pd(f, _mm256_add_pd(_mm256_set1_pd(2.0), f));
+    z  = _mm256_mul_pd(s, s);
+    w  = _mm256_mul_pd(z, z);
+    t1 = _mm256_add_pd(_mm256_set1_pd(VM_LOG_LG4), _mm256_mul_pd(w, _mm256_set1_pd(VM_LOG_LG6)));
+    t1 = _mm256_mul_pd(w, _mm256_add_pd(_mm256_set1_pd(VM_LOG_LG2), _mm256_mul_pd(w, t1)));
+    t2 = _mm256_add_pd(_mm256_set1_pd(VM_LOG_LG5), _mm256_mul_pd(w, _mm256_set1_pd(VM_LOG_LG7)));
+    t2 = _mm256_add_pd(_mm256_set1_pd(VM_LOG_LG3), _mm256_mul_pd(w, t2));
+    t2 = _mm256_mul_pd(z, _mm256_add_pd(_mm256_set1_pd(VM_LOG_LG1), _mm256_mul_pd(w, t2)));
+    R  = _mm256_add_pd(t2, t1);
+
+    //dk*ln2_hi-((hfsq-(s*(hfsq+R)+dk*ln2_lo))-f) when the mantissa is far from 1, else dk*ln2_hi-((s*(f-R)-dk*ln2_lo)-f)
+    hfsq = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(0.5), f), f);
+    resA = _mm256_add_pd(_mm256_mul_pd(s, _mm256_add_pd(hfsq, R)), _mm256_mul_pd(dk, _mm256_set1_pd(VM_LN2_LO)));
+    resA = _mm256_sub_pd(_mm256_mul_pd(dk, _mm256_set1_pd(VM_LN2_HI)), _mm256_sub_pd(_mm256_sub_pd(hfsq, resA), f));
+    resB = _mm256_sub_pd(_mm256_mul_pd(s, _mm256_sub_pd(f, R)), _mm256_mul_pd(dk, _mm256_set1_pd(VM_LN2_LO)));
+    resB = _mm256_sub_pd(_mm256_mul_pd(dk, _mm256_set1_pd(VM_LN2_HI)), _mm256_sub_pd(resB, f));
+    sel  = _mm256_or_si256(_mm256_sub_epi64(hx, _mm256_set1_epi64x(0x6147a)),
+                           _mm256_sub_epi64(_mm256_set1_epi64x(0x6b851), hx));
+    sel  = _mm256_cmpgt_epi64(sel, _mm256_setzero_si256());
+    res  = _mm256_blendv_pd(resB, resA, _mm256_castsi256_pd(sel));
+
+    //special values: log(+-0) = -inf, log(x<0) = NaN, log(inf) = inf, log(NaN) = NaN
+    res = _mm256_blendv_pd(res, x, _mm256_cmp_pd(x, _mm256_set1_pd(HUGE_VAL), _CMP_NLT_UQ));
+    res = _mm256_blendv_pd(res, _mm256_set1_pd(-HUGE_VAL), _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_EQ_OQ));
+    res = _mm256_blendv_pd(res, _mm256_set1_pd(NAN), _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_LT_OQ));
+    return res;
+}
+
+
+/* Function: Af_AVX2
+*  Description: Af for 4 lanes; z = 0 gives Af = 0 (nf > 0)
+*/
+VM_TARGET_AVX2 static __m256d Af_AVX2(__m256d Yield, __m256d Sag, __m256d feff, __m256d af_nf, __m256d nf)
+{
+    __m256d z = _mm256_div_pd(_mm256_mul_pd(_mm256_mul_pd(Yield, Sag), feff), af_nf);
+    __m256d p = Exp_AVX2(_mm256_mul_pd(nf, Log_AVX2(z)));
+
+    p = _mm256_andnot_pd(_mm256_cmp_pd(z, _mm256_setzero_pd(), _CMP_EQ_OQ), p);
+    return _mm256_sub_pd(_mm256_set1_pd(1.0), Exp_AVX2(_mm256_sub_pd(_mm256_setzero_pd(), p)));
+}
+
+
+/* Function: VM_AfBatch_AVX2
+*  Description: AVX2 kernel, the remainder is handled with masked loads and stores
+*/
+VM_TARGET_AVX2 static void VM_AfBatch_AVX2(real_T *Af, const real_T *Yield, const real_T *Sag, const real_T *feff,
+                                           int_T n, real_T af_nf, real_T nf)
+{
+    __m256d one  = _mm256_set1_pd(1.0);
+    __m256d vaf  = _mm256_set1_pd(af_nf);
+    __m256d vnf  = _mm256_set1_pd(nf);
+    __m256i mask;
+    int_T   j    = 0;
+
+    if(!(nf > 0) || (nf == floor(nf))){
+        VM_AfBatch_Scalar(Af, Yield, Sag, feff, n, af_nf, nf);
+        return;
+    }
+
+    for(j=0; j+4<=n; j+=4){
+        _mm256_storeu_pd(Af+j, Af_AVX2((Yield != NULL) ? _mm256_loadu_pd(Yield+j) : one,
+                                       (Sag != NULL) ? _mm256_loadu_pd(Sag+j) : one,
+                                       _mm256_loadu_pd(feff+j), vaf, vnf));
+    }
+    if(j < n){
+        mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(n-j), _mm256_setr_epi64x(0, 1, 2, 3));
+        _mm256_maskstore_pd(Af+j, mask, Af_AVX2((Yield != NULL) ? _mm256_maskload_pd(Yield+j, mask) : one,
+                                                (Sag != NULL) ? _mm256_maskload_pd(Sag+j, mask) : one,
+                                                _mm256_maskload_pd(feff+j, mask), vaf, vnf));
+    }
+}
+
+
+/* Function: VM_AfLanes_AVX2
+*  Description: AVX2 lane kernel (Lanes a multiple of 4); YS*1.0 keeps the rounding of Yield*Sag
+*/
+VM_TARGET_AVX2 static void VM_AfLanes_AVX2(real_T *Af, const real_T *YS, const real_T *feff, int_T n, int_T Lanes,
+                                           const real_T *af_nf, const real_T *nf)
+{
+    __m256d one  = _mm256_set1_pd(1.0);
+    int_T   j    = 0;
+    int_T   l    = 0;
+
+    if(!LanesVectorizable(Lanes, nf)){
+        VM_AfLanes_Scalar(Af, YS, feff, n, Lanes, af_nf, nf);
+        return;
+    }
+
+    for(j=0; j<n*Lanes; j+=Lanes){
+        for(l=0; l<Lanes; l+=4){
+            _mm256_storeu_pd(Af+j+l, Af_AVX2(_mm256_loadu_pd(YS+j+l), one, _mm256_loadu_pd(feff+j+l),
+                                             _mm256_loadu_pd(af_nf+l), _mm256_loadu_pd(nf+l)));
+        }
+    }
+}
+
+
+/* Function: Exp_AVX512
+*  Description: exp(x) for 8 lanes, same operations as Exp_AVX2
+*/
+VM_TARGET_AVX512 static __m512d Exp_AVX512(__m512d x)
+{
+    __m512d xc = _mm512_min_pd(_mm512_set1_pd(VM_EXP_HI), _mm512_max_pd(_mm512_set1_pd(VM_EXP_LO), x));
+    __m512d kd = _mm512_roundscale_pd(_mm512_mul_pd(xc, _mm512_set1_pd(VM_INV_LN2)),
+                                      _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d hi = _mm512_sub_pd(xc, _mm512_mul_pd(kd, _mm512_set1_pd(VM_LN2_HI)));
+    __m512d lo = _mm512_mul_pd(kd, _mm512_set1_pd(VM_LN2_LO));
+    __m512d r  = _mm512_sub_pd(hi, lo);
+    __m512d t  = _mm512_mul_pd(r, r);
+    __m512d c, y;
+    __m512i k;
+
+    c = _mm512_add_pd(_mm512_set1_pd(VM_EXP_P4), _mm512_mul_pd(t, _mm512_set1_pd(VM_EXP_P5)));
+    c = _mm512_add_pd(_mm512_set1_pd(VM_EXP_P3), _mm512_mul_pd(t, c));
+    c = _mm512_add_pd(_mm512_set1_pd(VM_EXP_P2), _mm512_mul_pd(t, c));
+    c = _mm512_add_pd(_mm512_set1_pd(VM_EXP_P1), _mm512_mul_pd(t, c));
+    c = _mm512_sub_pd(r, _mm512_mul_pd(t, c));
+    y = _mm512_div_pd(_mm512_mul_pd(r, c), _mm512_sub_pd(_mm512_set1_pd(2.0), c));
+    y = _mm512_sub_pd(_mm512_set1_pd(1.0), _mm512_sub_pd(_mm512_sub_pd(lo, y), hi));
+
+    k = _mm512_sub_epi64(_mm512_castpd_si512(_mm512_add_pd(kd, _mm512_set1_pd(VM_ROUND_MAGIC))),
+                         _mm512_set1_epi64(VM_ROUND_MAGIC_BITS));
+    k = _mm512_slli_epi64(_mm512_add_epi64(k, _mm512_set1_epi64(1023)), 52);
+    y = _mm512_mul_pd(y, _mm512_castsi512_pd(k));
+
+    return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_set1_pd(VM_EXP_LO), _CMP_LT_OQ), y, _mm512_setzero_pd());
+}
+
+
+/* Function: Log_AVX512
+*  Description: log(x) for 8 lanes, same operations as Log_AVX2
+*/
+VM_TARGET_AVX512 static __m512d Log_AVX512(__m512d x)
+{
+    __mmask8 tiny = _mm512_cmp_pd_mask(x, _mm512_set1_pd(VM_DBL_MIN), _CMP_LT_OQ);
+    __m512d  xs   = _mm512_mask_blend_pd(tiny, x, _mm512_mul_pd(x, _mm512_set1_pd(VM_TWO54)));
+    __m512i  bits = _mm512_castpd_si512(xs);
+    __m512i  hx   = _mm512_srli_epi64(bits, 32);
+    __m512i  k    = _mm512_sub_epi64(_mm512_srli_epi64(hx, 20), _mm512_set1_epi64(1023));
+    __m512i  i;
+    __mmask8 sel;
+    __m512d  f, s, z, w, t1, t2, R, hfsq, dk, resA, resB, res;
+
+    k  = _mm512_mask_add_epi64(k, tiny, k, _mm512_set1_epi64(-54));
+    hx = _mm512_and_epi64(hx, _mm512_set1_epi64(0x000fffff));
+
+    i    = _mm512_and_epi64(_mm512_add_epi64(hx, _mm512_set1_epi64(0x95f64)), _mm512_set1_epi64(0x100000));
+    bits = _mm512_or_epi64(_mm512_slli_epi64(_mm512_or_epi64(hx, _mm512_xor_epi64(i, _mm512_set1_epi64(0x3ff00000))), 32),
+                           _mm512_and_epi64(bits, _mm512_set1_epi64(0xffffffffLL)));
+    k    = _mm512_add_epi64(k, _mm512_srli_epi64(i, 20));
+    dk   = _mm512_sub_pd(_mm512_castsi512_pd(_mm512_add_epi64(k, _mm512_set1_epi64(VM_ROUND_MAGIC_BITS))),
+                         _mm512_set1_pd(VM_ROUND_MAGIC));
+
+    f  = _mm512_sub_pd(_mm512_castsi512_pd(bits), _mm512_set1_pd(1.0));
+    s  = _mm512_div_pd(f, _mm512_add_pd(_mm512_set1_pd(2.0), f));
+    z  = _mm512_mul_pd(s, s);
+    w  = _mm512_mul_pd(z, z);
+    t1 = _mm512_add_pd(_mm512_set1_pd(VM_LOG_LG4), _mm512_mul_pd(w, _mm512_set1_pd(VM_LOG_LG6)));
+    t1 = _mm512_mul_pd(w, _mm512_add_pd(_mm512_set1_pd(VM_LOG_LG2), _mm512_mul_pd(w, t1)));
+    t2 = _mm512_add_pd(_mm512_set1_pd(VM_LOG_LG5), _mm512_mul_pd(w, _mm512_set1_pd(VM_LOG_LG7)));
+    t2 = _mm512_add_pd(_mm512_set1_pd(VM_LOG_LG3), _mm512_mul_pd(w, t2));
+    t2 = _mm512_mul_pd(z, _mm512_add_pd(_mm512_set1_pd(VM_LOG_LG1), _mm512_mul_pd(w, t2)));
+    R  = _mm512_add_pd(t2, t1);
+
+    hfsq = _mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(0.5), f), f);
+    resA = _mm512_add_pd(_mm512_mul_pd(s, _mm512_add_pd(hfsq, R)), _mm512_mul_pd(dk, _mm512_set1_pd(VM_LN2_LO)));
+    resA = _mm512_sub_pd(_mm512_mul_pd(dk, _mm512_set1_pd(VM_LN2_HI)), _mm512_sub_pd(_mm512_sub_pd(hfsq, resA), f));
+    resB = _mm512_sub_pd(_mm512_mul_pd(s, _mm512_sub_pd(f, R)), _mm512_mul_pd(dk, _mm512_set1_pd(VM_LN2_LO)));
+    resB = _mm512_sub_pd(_mm512_mul_pd(dk, _mm512_set1_pd(VM_LN2_HI)), _mm512_sub_pd(resB, f));
+    sel  = _mm512_cmpgt_epi64_mask(_mm512_or_epi64(_mm512_sub_epi64(hx, _mm512_set1_epi64(0x6147a)),
+                                                   _mm512_sub_epi64(_mm512_set1_epi64(0x6b851), hx)),
+                                   _mm512_setzero_si512());
+    res  = _mm512_mask_blend_pd(sel, resB, resA);
+
+    res = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_set1_pd(HUGE_VAL), _CMP_NLT_UQ), res, x);
+    res = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_EQ_OQ), res, _mm512_set1_pd(-HUGE_VAL));
+    res = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_LT_OQ), res, _mm512_set1_pd(NAN));
+    return res;
+}
+
+
+/* Function: Af_AVX512
+*  Description: Af for 8 lanes, same operations as Af_AVX2
+*/
+VM_TARGET_AVX512 static __m512d Af_AVX512(__m512d Yield, __m512d Sag, __m512d feff, __m512d af_nf, __m512d nf)
+{
+    __m512d z = _mm512_div_pd(_mm512_mul_pd(_mm512_mul_pd(Yield, Sag), feff), af_nf);
+    __m512d p = Exp_AVX512(_mm512_mul_pd(nf, Log_AVX512(z)));
+
+    p = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(z, _mm512_setzero_pd(), _CMP_EQ_OQ), p, _mm512_setzero_pd());
+    return _mm512_sub_pd(_mm512_set1_pd(1.0), Exp_AVX512(_mm512_sub_pd(_mm512_setzero_pd(), p)));
+}
+
+
+/* Function: VM_AfBatch_AVX512
+*  Description: AVX-512 kernel, the remainder is handled with masked loads and stores
+*/
+VM_TARGET_AVX512 static void VM_AfBatch_AVX512(real_T *Af, const real_T *Yield, const real_T *Sag, const real_T *feff,
+                                               int_T n, real_T af_nf, real_T nf)
+{
+    __m512d  one  = _mm512_set1_pd(1.0);
+    __m512d  vaf  = _mm512_set1_pd(af_nf);
+    __m512d  vnf  = _mm512_set1_pd(nf);
+    __mmask8 mask;
+    int_T    j    = 0;
+
+    if(!(nf > 0) || (nf == floor(nf))){
+        VM_AfBatch_Scalar(Af, Yield, Sag, feff, n, af_nf, nf);
+        return;
+    }
+
+    for(j=0; j+8<=n; j+=8){
+        _mm512_storeu_pd(Af+j, Af_AVX512((Yield != NULL) ? _mm512_loadu_pd(Yield+j) : one,
+                                         (Sag != NULL) ? _mm512_loadu_pd(Sag+j) : one,
+                                         _mm512_loadu_pd(feff+j), vaf, vnf));
+    }
+    if(j < n){
+        mask = (__mmask8)((1u << (n-j)) - 1);
+        _mm512_mask_storeu_pd(Af+j, mask, Af_AVX512((Yield != NULL) ? _mm512_maskz_loadu_pd(mask, Yield+j) : one,
+                                                    (Sag != NULL) ? _mm512_maskz_loadu_pd(mask, Sag+j) : one,
+                                                    _mm512_maskz_loadu_pd(mask, feff+j), vaf, vnf));
+    }
+}
+
+
+/* Function: VM_AfLanes_AVX512
+*  Description: AVX-512 lane kernel (Lanes a multiple of 8), same operations as VM_AfLanes_AVX2
+*/
+VM_TARGET_AVX512 static void VM_AfLanes_AVX512(real_T *Af, const real_T *YS, const real_T *feff, int_T n, int_T Lanes,
+                                               const real_T *af_nf, const real_T *nf)
+{
+    __m512d one  = _mm512_set1_pd(1.0);
+    int_T   j    = 0;
+    int_T   l    = 0;
+
+    if(!LanesVectorizable(Lanes, nf)){
+        VM_AfLanes_Scalar(Af, YS, feff, n, Lanes, af_nf, nf);
+        return;
+    }
+
+    for(j=0; j<n*Lanes; j+=Lanes){
+        for(l=0; l<Lanes; l+=8){
+            _mm512_storeu_pd(Af+j+l, Af_AVX512(_mm512_loadu_pd(YS+j+l), one, _mm512_loadu_pd(feff+j+l),
+                                               _mm512_loadu_pd(af_nf+l), _mm512_loadu_pd(nf+l)));
+        }
+    }
+}
+
+
+//fdlibm e_expf.c
+#define VM_EXPF_LO      -87.0f
+#define VM_EXPF_HI      88.0f
+#define VM_EXPF_LN2_HI  6.9314575195e-01f
+#define VM_EXPF_LN2_LO  1.4286067653e-06f
+#define VM_EXPF_INV_LN2 1.4426950216e+00f
+#define VM_EXPF_P1      1.6666625440e-01f
+#define VM_EXPF_P2      -2.7667332906e-03f
+
+//fdlibm e_logf.c
+#define VM_LOGF_LN2_HI  6.9313812256e-01f
+#define VM_LOGF_LN2_LO  9.0580006145e-06f
+#define VM_LOGF_LG1     6.6666662693e-01f
+#define VM_LOGF_LG2     4.0000972152e-01f
+#define VM_LOGF_LG3     2.8498786688e-01f
+#define VM_LOGF_LG4     2.4279078841e-01f
+#define VM_FLT_MIN      1.17549435e-38f
+#define VM_TWO25        3.3554432e+07f
+
+
+/* Function: ExpF_AVX2
+*  Description: expf(x) for 8 lanes (fdlibm e_expf.c), 0 below -87, saturated at exp(88)
+*/
+VM_TARGET_AVX2 static __m256 ExpF_AVX2(__m256 x)
+{
+    __m256 xc = _mm256_min_ps(_mm256_set1_ps(VM_EXPF_HI), _mm256_max_ps(_mm256_set1_ps(VM_EXPF_LO), x));
+    __m256 kd = _mm256_round_ps(_mm256_mul_ps(xc, _mm256_set1_ps(VM_EXPF_INV_LN2)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 hi = _mm256_sub_ps(xc, _mm256_mul_ps(kd, _mm256_set1_ps(VM_EXPF_LN2_HI)));
+    __m256 lo = _mm256_mul_ps(kd, _mm256_set1_ps(VM_EXPF_LN2_LO));
+    __m256 r  = _mm256_sub_ps(hi, lo);
+    __m256 t  = _mm256_mul_ps(r, r);
+    __m256 c, y;
+    __m256i k;
+
+    c = _mm256_add_ps(_mm256_set1_ps(VM_EXPF_P1), _mm256_mul_ps(t, _mm256_set1_ps(VM_EXPF_P2)));
+    c = _mm256_sub_ps(r, _mm256_mul_ps(t, c));
+    y = _mm256_div_ps(_mm256_mul_ps(r, c), _mm256_sub_ps(_mm256_set1_ps(2.0f), c));
+    y = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_sub_ps(_mm256_sub_ps(lo, y), hi));
+
+    //y*2^k, k in [-126,127]
+    k = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(kd), _mm256_set1_epi32(127)), 23);
+    y = _mm256_mul_ps(y, _mm256_castsi256_ps(k));
+
+    return _mm256_andnot_ps(_mm256_cmp_ps(x, _mm256_set1_ps(VM_EXPF_LO), _CMP_LT_OQ), y);
+}
+
+
+/* Function: LogF_AVX2
+*  Description: logf(x) for 8 lanes (fdlibm e_logf.c), including subnormal, zero, negative, inf and NaN inputs
+*/
+VM_TARGET_AVX2 static __m256 LogF_AVX2(__m256 x)
+{
+    __m256  tiny = _mm256_cmp_ps(x, _mm256_set1_ps(VM_FLT_MIN), _CMP_LT_OQ);
+    __m256  xs   = _mm256_blendv_ps(x, _mm256_mul_ps(x, _mm256_set1_ps(VM_TWO25)), tiny);
+    __m256i hx   = _mm256_castps_si256(xs);
+    __m256i k    = _mm256_sub_epi32(_mm256_srli_epi32(hx, 23), _mm256_set1_epi32(127));
+    __m256i i, sel;
+    __m256  f, s, z, w, t1, t2, R, hfsq, dk, resA, resB, res;
+
+    k  = _mm256_add_epi32(k, _mm256_and_si256(_mm256_castps_si256(tiny), _mm256_set1_epi32(-25)));
+    hx = _mm256_and_si256(hx, _mm256_set1_epi32(0x007fffff));
+
+    //normalize x or x/2 into [sqrt(2)/2, sqrt(2))
+    i  = _mm256_and_si256(_mm256_add_epi32(hx, _mm256_set1_epi32(0x4afb0d)), _mm256_set1_epi32(0x800000));
+    f  = _mm256_castsi256_ps(_mm256_or_si256(hx, _mm256_xor_si256(i, _mm256_set1_epi32(0x3f800000))));
+    k  = _mm256_add_epi32(k, _mm256_srli_epi32(i, 23));
+    dk = _mm256_cvtepi32_ps(k);
+
+    f  = _mm256_sub_ps(f, _mm256_set1_ps(1.0f));
+    s  = _mm256_div_ps(f, _mm256_add_ps(_mm256_set1_ps(2.0f), f));
+    z  = _mm256_mul_ps(s, s);
+    w  = _mm256_mul_ps(z, z);
+    t1 = _mm256_mul_ps(w, _mm256_add_ps(_mm256_set1_ps(VM_LOGF_LG2), _mm256_mul_ps(w, _mm256_set1_ps(VM_LOGF_LG4))));
+    t2 = _mm256_mul_ps(z, _mm256_add_ps(_mm256_set1_ps(VM_LOGF_LG1), _mm256_mul_ps(w, _mm256_set1_ps(VM_LOGF_LG3))));
+    R  = _mm256_add_ps(t2, t1);
+
+    //as Log_AVX2
+    hfsq = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), f), f);
+    resA = _mm256_add_ps(_mm256_mul_ps(s, _mm256_add_ps(hfsq, R)), _mm256_mul_ps(dk, _mm256_set1_ps(VM_LOGF_LN2_LO)));
+    resA = _mm256_sub_ps(_mm256_mul_ps(dk, _mm256_set1_ps(VM_LOGF_LN2_HI)), _mm256_sub_ps(_mm256_sub_ps(hfsq, resA), f));
+    resB = _mm256_sub_ps(_mm256_mul_ps(s, _mm256_sub_ps(f, R)), _mm256_mul_ps(dk, _mm256_set1_ps(VM_LOGF_LN2_LO)));
+    resB = _mm256_sub_ps(_mm256_mul_ps(dk, _mm256_set1_ps(VM_LOGF_LN2_HI)), _mm256_sub_ps(resB, f));
+    sel  = _mm256_or_si256(_mm256_sub_epi32(hx, _mm256_set1_epi32(0x6147a<<3)),
+                           _mm256_sub_epi32(_mm256_set1_epi32(0x6b851<<3), hx));
+    sel  = _mm256_cmpgt_epi32(sel, _mm256_setzero_si256());
+    res  = _mm256_blendv_ps(resB, resA, _mm256_castsi256_ps(sel));
+
+    res = _mm256_blendv_ps(res, x, _mm256_cmp_ps(x, _mm256_set1_ps(HUGE_VALF), _CMP_NLT_UQ));
+    res = _mm256_blendv_ps(res, _mm256_set1_ps(-HUGE_VALF), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_EQ_OQ));
+    res = _mm256_blendv_ps(res, _mm256_set1_ps(NAN), _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+    return res;
+}
+
+
+/* Function: AfF_AVX2
+*  Description: Af in float for 8 lanes, as Af_AVX2
+*/
+VM_TARGET_AVX2 static __m256 AfF_AVX2(__m256 Yield, __m256 Sag, __m256 feff, __m256 af_nf, __m256 nf)
+{
+    __m256 z = _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(Yield, Sag), feff), af_nf);
+    __m256 p = ExpF_AVX2(_mm256_mul_ps(nf, LogF_AVX2(z)));
+
+    p = _mm256_andnot_ps(_mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_EQ_OQ), p);
+    return _mm256_sub_ps(_mm256_set1_ps(1.0f), ExpF_AVX2(_mm256_sub_ps(_mm256_setzero_ps(), p)));
+}
+
+
+/* Function: LoadF_AVX2
+*  Description: 8 doubles rounded to float
+*/
+VM_TARGET_AVX2 static __m256 LoadF_AVX2(const real_T *p)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(_mm256_loadu_pd(p))),
+                                _mm256_cvtpd_ps(_mm256_loadu_pd(p+4)), 1);
+}
+
+
+/* Function: StoreF_AVX2
+*  Description: 8 floats stored as doubles
+*/
+VM_TARGET_AVX2 static void StoreF_AVX2(real_T *p, __m256 v)
+{
+    _mm256_storeu_pd(p, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+    _mm256_storeu_pd(p+4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+}
+
+
+/* Function: PadTail
+*  Description: Copies the last n < Width units into Width wide buffers, padded with units at rest
+*              (Yield and Sag 1, feff 0); Yield or Sag NULL stay NULL
+*/
+static void PadTail(const real_T *Yield, const real_T *Sag, const real_T *feff, int_T n, int_T Width,
+                    real_T *Yield_pad, real_T *Sag_pad, real_T *feff_pad)
+{
+    int_T j = 0;
+
+    for(j=0; j<Width; j++){
+        Yield_pad[j]    = (Yield != NULL && j < n) ? Yield[j] : 1.0;
+        Sag_pad[j]      = (Sag != NULL && j < n) ? Sag[j] : 1.0;
+        feff_pad[j]     = (j < n) ? feff[j] : 0.0;
+    }
+}
+
+
+/* Function: VM_AfBatchFloat_AVX2
+*  Description: AVX2 float kernel, 8 motor units per vector; the remainder is evaluated on a padded copy
+*/
+VM_TARGET_AVX2 static void VM_AfBatchFloat_AVX2(real_T *Af, const real_T *Yield, const real_T *Sag, const real_T *feff,
+                                                int_T n, real_T af_nf, real_T nf)
+{
+    __m256 one  = _mm256_set1_ps(1.0f);
+    __m256 vaf  = _mm256_set1_ps((float)af_nf);
+    __m256 vnf  = _mm256_set1_ps((float)nf);
+    real_T Yield_pad[8], Sag_pad[8], feff_pad[8], Af_pad[8];
+    int_T  j    = 0;
+
+    if(!((float)nf > 0) || ((float)nf == floorf((float)nf))){
+        VM_AfBatchFloat_Scalar(Af, Yield, Sag, feff, n, af_nf, nf);
+        return;
+    }
+
+    for(j=0; j+8<=n; j+=8){
+        StoreF_AVX2(Af+j, AfF_AVX2((Yield != NULL) ? LoadF_AVX2(Yield+j) : one,
+                                   (Sag != NULL) ? LoadF_AVX2(Sag+j) : one,
+                                   LoadF_AVX2(feff+j), vaf, vnf));
+    }
+    if(j < n){
+        PadTail((Yield != NULL) ? Yield+j : NULL, (Sag != NULL) ? Sag+j : NULL, feff+j, n-j, 8,
+                Yield_pad, Sag_pad, feff_pad);
+        StoreF_AVX2(Af_pad, AfF_AVX2(LoadF_AVX2(Yield_pad), LoadF_AVX2(Sag_pad), LoadF_AVX2(feff_pad), vaf, vnf));
+        memcpy(Af+j, Af_pad, (n-j)*sizeof(real_T));
+    }
+}
+
+
+/* Function: LanesVectorizableF
+*  Description: LanesVectorizable for the float kernels (nf rounded to float)
+*/
+static int_T LanesVectorizableF(int_T Lanes, const real_T *nf)
+{
+    int_T l = 0;
+
+    for(l=0; l<Lanes; l++){
+        if(!((float)nf[l] > 0) || ((float)nf[l] == floorf((float)nf[l])))
+            return 0;
+    }
+    return 1;
+}
+
+
+/* Function: VM_AfLanesFloat_AVX2
+*  Description: AVX2 float lane kernel (Lanes a multiple of 8)
+*/
+VM_TARGET_AVX2 static void VM_AfLanesFloat_AVX2(real_T *Af, const real_T *YS, const real_T *feff, int_T n, int_T Lanes,
+                                                const real_T *af_nf, const real_T *nf)
+{
+    __m256 one  = _mm256_set1_ps(1.0f);
+    int_T  j    = 0;
+    int_T  l    = 0;
+
+    if(!LanesVectorizableF(Lanes, nf)){
+        VM_AfLanesFloat_Scalar(Af, YS, feff, n, Lanes, af_nf, nf);
+        return;
+    }
+
+    for(j=0; j<n*Lanes; j+=Lanes){
+        for(l=0; l<Lanes; l+=8){
+            StoreF_AVX2(Af+j+l, AfF_AVX2(LoadF_AVX2(YS+j+l), one, LoadF_AVX2(feff+j+l),
+                                         LoadF_AVX2(af_nf+l), LoadF_AVX2(nf+l)));
+        }
+    }
+}
+
+
+/* Function: ExpF_AVX512
+*  Description: expf(x) for 16 lanes, same operations as ExpF_AVX2
+*/
+VM_TARGET_AVX512 static __m512 ExpF_AVX512(__m512 x)
+{
+    __m512 xc = _mm512_min_ps(_mm512_set1_ps(VM_EXPF_HI), _mm512_max_ps(_mm512_set1_ps(VM_EXPF_LO), x));
+    __m512 kd = _mm512_roundscale_ps(_mm512_mul_ps(xc, _mm512_set1_ps(VM_EXPF_INV_LN2)),
+                                     _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 hi = _mm512_sub_ps(xc, _mm512_mul_ps(kd, _mm512_set1_ps(VM_EXPF_LN2_HI)));
+    __m512 lo = _mm512_mul_ps(kd, _mm512_set1_ps(VM_EXPF_LN2_LO));
+    __m512 r  = _mm512_sub_ps(hi, lo);
+    __m512 t  = _mm512_mul_ps(r, r);
+    __m512 c, y;
+    __m512i k;
+
+    c = _mm512_add_ps(_mm512_set1_ps(VM_EXPF_P1), _mm512_mul_ps(t, _mm512_set1_ps(VM_EXPF_P2)));
+    c = _mm512_sub_ps(r, _mm512_mul_ps(t, c));
+    y = _mm512_div_ps(_mm512_mul_ps(r, c), _mm512_sub_ps(_mm512_set1_ps(2.0f), c));
+    y = _mm512_sub_ps(_mm512_set1_ps(1.0f), _mm512_sub_ps(_mm512_sub_ps(lo, y), hi));
+
+    k = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(kd), _mm512_set1_epi32(127)), 23);
+    y = _mm512_mul_ps(y, _mm512_castsi512_ps(k));
+
+    return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(VM_EXPF_LO), _CMP_LT_OQ), y, _mm512_setzero_ps());
+}
+
+
+/* Function: LogF_AVX512
+*  Description: logf(x) for 16 lanes, same operations as LogF_AVX2
+*/
+VM_TARGET_AVX512 static __m512 LogF_AVX512(__m512 x)
+{
+    __mmask16 tiny = _mm512_cmp_ps_mask(x, _mm512_set1_ps(VM_FLT_MIN), _CMP_LT_OQ);
+    __m512    xs   = _mm512_mask_blend_ps(tiny, x, _mm512_mul_ps(x, _mm512_set1_ps(VM_TWO25)));
+    __m512i   hx   = _mm512_castps_si512(xs);
+    __m512i   k    = _mm512_sub_epi32(_mm512_srli_epi32(hx, 23), _mm512_set1_epi32(127));
+    __m512i   i;
+    __mmask16 sel;
+    __m512    f, s, z, w, t1, t2, R, hfsq, dk, resA, resB, res;
+
+    k  = _mm512_mask_add_epi32(k, tiny, k, _mm512_set1_epi32(-25));
+    hx = _mm512_and_epi32(hx, _mm512_set1_epi32(0x007fffff));
+
+    i  = _mm512_and_epi32(_mm512_add_epi32(hx, _mm512_set1_epi32(0x4afb0d)), _mm512_set1_epi32(0x800000));
+    f  = _mm512_castsi512_ps(_mm512_or_epi32(hx, _mm512_xor_epi32(i, _mm512_set1_epi32(0x3f800000))));
+    k  = _mm512_add_epi32(k, _mm512_srli_epi32(i, 23));
+    dk = _mm512_cvtepi32_ps(k);
+
+    f  = _mm512_sub_ps(f, _mm512_set1_ps(1.0f));
+    s  = _mm512_div_ps(f, _mm512_add_ps(_mm512_set1_ps(2.0f), f));
+    z  = _mm512_mul_ps(s, s);
+    w  = _mm512_mul_ps(z, z);
+    t1 = _mm512_mul_ps(w, _mm512_add_ps(_mm512_set1_ps(VM_LOGF_LG2), _mm512_mul_ps(w, _mm512_set1_ps(VM_LOGF_LG4))));
+    t2 = _mm512_mul_ps(z, _mm512_add_ps(_mm512_set1_ps(VM_LOGF_LG1), _mm512_mul_ps(w, _mm512_set1_ps(VM_LOGF_LG3))));
+    R  = _mm512_add_ps(t2, t1);
+
+    hfsq = _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(0.5f), f), f);
+    resA = _mm512_add_ps(_mm512_mul_ps(s, _mm512_add_ps(hfsq, R)), _mm512_mul_ps(dk, _mm512_set1_ps(VM_LOGF_LN2_LO)));
+    resA = _mm512_sub_ps(_mm512_mul_ps(dk, _mm512_set1_ps(VM_LOGF_LN2_HI)), _mm512_sub_ps(_mm512_sub_ps(hfsq, resA), f));
+    resB = _mm512_sub_ps(_mm512_mul_ps(s, _mm512_sub_ps(f, R)), _mm512_mul_ps(dk, _mm512_set1_ps(VM_LOGF_LN2_LO)));
+    resB = _mm512_sub_ps(_mm512_mul_ps(dk, _mm512_set1_ps(VM_LOGF_LN2_HI)), _mm512_sub_ps(resB, f));
+    sel  = _mm512_cmpgt_epi32_mask(_mm512_or_epi32(_mm512_sub_epi32(hx, _mm512_set1_epi32(0x6147a<<3)),
+                                                   _mm512_sub_epi32(_mm512_set1_epi32(0x6b851<<3), hx)),
+                                   _mm512_setzero_si512());
+    res  = _mm512_mask_blend_ps(sel, resB, resA);
+
+    res = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_set1_ps(HUGE_VALF), _CMP_NLT_UQ), res, x);
+    res = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_EQ_OQ), res, _mm512_set1_ps(-HUGE_VALF));
+    res = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_LT_OQ), res, _mm512_set1_ps(NAN));
+    return res;
+}
+
+
+/* Function: AfF_AVX512
+*  Description: Af in float for 16 lanes, same operations as AfF_AVX2
+*/
+VM_TARGET_AVX512 static __m512 AfF_AVX512(__m512 Yield, __m512 Sag, __m512 feff, __m512 af_nf, __m512 nf)
+{
+    __m512 z = _mm512_div_ps(_mm512_mul_ps(_mm512_mul_ps(Yield, Sag), feff), af_nf);
+    __m512 p = ExpF_AVX512(_mm512_mul_ps(nf, LogF_AVX512(z)));
+
+    p = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(z, _mm512_setzero_ps(), _CMP_EQ_OQ), p, _mm512_setzero_ps());
+    return _mm512_sub_ps(_mm512_set1_ps(1.0f), ExpF_AVX512(_mm512_sub_ps(_mm512_setzero_ps(), p)));
+}
+
+
+/* Function: LoadF_AVX512
+*  Description: 16 doubles rounded to float
+*/
+VM_TARGET_AVX512 static __m512 LoadF_AVX512(const real_T *p)
+{
+    __m256 lo = _mm512_cvtpd_ps(_mm512_loadu_pd(p));
+    __m256 hi = _mm512_cvtpd_ps(_mm512_loadu_pd(p+8));
+
+    return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castpd256_pd512(_mm256_castps_pd(lo)), _mm256_castps_pd(hi), 1));
+}
+
+
+/* Function: StoreF_AVX512
+*  Description: 16 floats stored as doubles
+*/
+VM_TARGET_AVX512 static void StoreF_AVX512(real_T *p, __m512 v)
+{
+    _mm512_storeu_pd(p, _mm512_cvtps_pd(_mm512_castps512_ps256(v)));
+    _mm512_storeu_pd(p+8, _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1))));
+}
+
+
+/* Function: VM_AfBatchFloat_AVX512
+*  Description: AVX-512 float kernel, 16 motor units per vector, same operations as VM_AfBatchFloat_AVX2
+*/
+VM_TARGET_AVX512 static void VM_AfBatchFloat_AVX512(real_T *Af, const real_T *Yield, const real_T *Sag, const real_T *feff,
+                                                    int_T n, real_T af_nf, real_T nf)
+{
+    __m512 one  = _mm512_set1_ps(1.0f);
+    __m512 vaf  = _mm512_set1_ps((float)af_nf);
+    __m512 vnf  = _mm512_set1_ps((float)nf);
+    real_T Yield_pad[16], Sag_pad[16], feff_pad[16], Af_pad[16];
+    int_T  j    = 0;
+
+    if(!((float)nf > 0) || ((float)nf == floorf((float)nf))){
+        VM_AfBatchFloat_Scalar(Af, Yield, Sag, feff, n, af_nf, nf);
+        return;
+    }
+
+    for(j=0; j+16<=n; j+=16){
+        StoreF_AVX512(Af+j, AfF_AVX512((Yield != NULL) ? LoadF_AVX512(Yield+j) : one,
+                                       (Sag != NULL) ? LoadF_AVX512(Sag+j) : one,
+                                       LoadF_AVX512(feff+j), vaf, vnf));
+    }
+    if(j < n){
+        PadTail((Yield != NULL) ? Yield+j : NULL, (Sag != NULL) ? Sag+j : NULL, feff+j, n-j, 16,
+                Yield_pad, Sag_pad, feff_pad);
+        StoreF_AVX512(Af_pad, AfF_AVX512(LoadF_AVX512(Yield_pad), LoadF_AVX512(Sag_pad), LoadF_AVX512(feff_pad),
+                                         vaf, vnf));
+        memcpy(Af+j, Af_pad, (n-j)*sizeof(real_T));
+    }
+}
+
+
+/* Function: VM_AfLanesFloat_AVX512
+*  Description: AVX-512 float lane kernel (Lanes a multiple of 16, or 8: two motor units per vector, the
+*              last odd one on a padded copy)
+*/
+VM_TARGET_AVX512 static void VM_AfLanesFloat_AVX512(real_T *Af, const real_T *YS, const real_T *feff, int_T n, int_T Lanes,
+                                                    const real_T *af_nf, const real_T *nf)
+{
+    __m512 one  = _mm512_set1_ps(1.0f);
+    __m512 vaf, vnf;
+    real_T Param_pad[16], YS_pad[16], Sag_pad[16], feff_pad[16], Af_pad[16];
+    int_T  j    = 0;
+    int_T  l    = 0;
+
+    if(!LanesVectorizableF(Lanes, nf)){
+        VM_AfLanesFloat_Scalar(Af, YS, feff, n, Lanes, af_nf, nf);
+        return;
+    }
+
+    if(Lanes % 16 == 0){
+        for(j=0; j<n*Lanes; j+=Lanes){
+            for(l=0; l<Lanes; l+=16){
+                StoreF_AVX512(Af+j+l, AfF_AVX512(LoadF_AVX512(YS+j+l), one, LoadF_AVX512(feff+j+l),
+                                                 LoadF_AVX512(af_nf+l), LoadF_AVX512(nf+l)));
+            }
+        }
+        return;
+    }
+    for(l=0; l<16; l++){
+        Param_pad[l] = af_nf[l%8];
+    }
+    vaf = LoadF_AVX512(Param_pad);
+    for(l=0; l<16; l++){
+        Param_pad[l] = nf[l%8];
+    }
+    vnf = LoadF_AVX512(Param_pad);
+    for(j=0; j+16<=n*8; j+=16){
+        StoreF_AVX512(Af+j, AfF_AVX512(LoadF_AVX512(YS+j), one, LoadF_AVX512(feff+j), vaf, vnf));
+    }
+    if(j < n*8){
+        PadTail(YS+j, NULL, feff+j, 8, 16, YS_pad, Sag_pad, feff_pad);
+        StoreF_AVX512(Af_pad, AfF_AVX512(LoadF_AVX512(YS_pad), one, LoadF_AVX512(feff_pad), vaf, vnf));
+        memcpy(Af+j, Af_pad, 8*sizeof(real_T));
+    }
+}
+
+
+/* Function: CPU_Isa
+*  Description: Widest instruction set supported by both the CPU and the OS (saved AVX/AVX-512 state)
+*/
+static int_T CPU_Isa(void)
+{
+#if defined(_MSC_VER)
+    int      info[4];
+    unsigned __int64 xcr0 = 0;
+    int_T    Isa          = VM_ISA_SCALAR;
+
+    __cpuid(info, 0);
+    if(info[0] < 7)
+        return VM_ISA_SCALAR;
+    __cpuid(info, 1);
+    if(!(info[2] & (1 << 27)) || !(info[2] & (1 << 28))) //OSXSAVE, AVX
+        return VM_ISA_SCALAR;
+    xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if((xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)))
+        Isa = VM_ISA_AVX2;
+    if((xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)))
+        Isa = VM_ISA_AVX512;
+    return Isa;
+#else
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return VM_ISA_AVX512;
+    if(__builtin_cpu_supports("avx2"))
+        return VM_ISA_AVX2;
+    return VM_ISA_SCALAR;
+#endif
+}
+
+#endif /* VM_HAVE_X86_SIMD */
+
+
+
+/* Function: VM_SelectAfBatch
+*  Description: Runtime dispatch, called once per parameter set
+*/
+VM_AfBatchFcn VM_SelectAfBatch(int_T *Isa)
+{
+    int_T Cpu_isa = VM_ISA_SCALAR;
+
+#ifdef VM_HAVE_X86_SIMD
+    Cpu_isa = CPU_Isa();
+#endif
+    if(Isa != NULL)
+        *Isa = Cpu_isa;
+#ifdef VM_HAVE_X86_SIMD
+    if(Cpu_isa == VM_ISA_AVX512)
+        return VM_AfBatch_AVX512;
+    if(Cpu_isa == VM_ISA_AVX2)
+        return VM_AfBatch_AVX2;
+#endif
+    return VM_AfBatch_Scalar;
+}
+
+
+
+/* Function: VM_SelectAfLanes
+*  Description: Runtime dispatch of the lane kernels, called once per ensemble
+*/
+VM_AfLanesFcn VM_SelectAfLanes(int_T Lanes, int_T *Isa)
+{
+#ifdef VM_HAVE_X86_SIMD
+    int_T Cpu_isa = CPU_Isa();
+
+    if(Cpu_isa == VM_ISA_AVX512 && Lanes % 8 == 0){
+        if(Isa != NULL)
+            *Isa = VM_ISA_AVX512;
+        return VM_AfLanes_AVX512;
+    }
+    if(Cpu_isa >= VM_ISA_AVX2 && Lanes % 4 == 0){
+        if(Isa != NULL)
+            *Isa = VM_ISA_AVX2;
+        return VM_AfLanes_AVX2;
+    }
+#endif
+    if(Isa != NULL)
+        *Isa = VM_ISA_SCALAR;
+    return VM_AfLanes_Scalar;
+}
+
+
+
+/* Function: VM_SelectAfBatchFloat
+*  Description: Runtime dispatch of the float kernels (PRECISION 2), called once per parameter set
+*/
+VM_AfBatchFcn VM_SelectAfBatchFloat(int_T *Isa)
+{
+    int_T Cpu_isa = VM_ISA_SCALAR;
+
+#ifdef VM_HAVE_X86_SIMD
+    Cpu_isa = CPU_Isa();
+#endif
+    if(Isa != NULL)
+        *Isa = Cpu_isa;
+#ifdef VM_HAVE_X86_SIMD
+    if(Cpu_isa == VM_ISA_AVX512)
+        return VM_AfBatchFloat_AVX512;
+    if(Cpu_isa == VM_ISA_AVX2)
+        return VM_AfBatchFloat_AVX2;
+#endif
+    return VM_AfBatchFloat_Scalar;
+}
+
+
+
+/* Function: VM_SelectAfLanesFloat
+*  Description: Runtime dispatch of the float lane kernels, called once per ensemble
+*/
+VM_AfLanesFcn VM_SelectAfLanesFloat(int_T Lanes, int_T *Isa)
+{
+#ifdef VM_HAVE_X86_SIMD
+    int_T Cpu_isa = CPU_Isa();
+
+    if(Cpu_isa == VM_ISA_AVX512 && (Lanes % 16 == 0 || Lanes == 8)){
+        if(Isa != NULL)
+            *Isa = VM_ISA_AVX512;
+        return VM_AfLanesFloat_AVX512;
+    }
+    if(Cpu_isa >= VM_ISA_AVX2 && Lanes % 8 == 0){
+        if(Isa != NULL)
+            *Isa = VM_ISA_AVX2;
+        return VM_AfLanesFloat_AVX2;
+    }
+#endif
+    if(Isa != NULL)
+        *Isa = VM_ISA_SCALAR;
+    return VM_AfLanesFloat_Scalar;
+}
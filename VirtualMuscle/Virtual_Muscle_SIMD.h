@@ -0,0 +1,81 @@
+/* VIRTUAL_MUSCLE_SIMD.H
+ * Synopsis: Batched activation-frequency (Af) kernels for Virtual_Muscle_SFunction.c
+ *
+ *              Af = 1 - exp(-(Y*S*feff/(af*nf))^nf)
+ *
+ *          evaluated for all the motor units of one fiber type at once. The scalar kernel uses
+ *          the C math library (pow, exp) and matches the per motor unit code of the S-function
+ *          bit for bit. The AVX2 and AVX-512 kernels use vectorized exp and log derived from
+ *          fdlibm (e_exp.c, e_log.c), both with an error below 1 ULP, and compute the power as
+ *          exp(nf*log(z)). Over the whole input range their Af differs from the scalar kernel by
+ *          at most VM_AF_SIMD_MAX_ERROR (4 ULP of 1.0, absolute). Both vector kernels perform
+ *          the same operations in the same order, so they give identical results.
+ *
+ *          VM_SelectAfBatch picks the widest kernel supported by the CPU (and the OS) at run
+ *          time. Define VM_DISABLE_SIMD to always use the scalar kernel.
+ *
+ *          The lane kernels (VM_AfLanesFcn) evaluate the same Af for the packs of muscles of the
+ *          ensemble engine (Virtual_Muscle_Ensemble.h), one muscle per lane with its own af*nf and
+ *          nf, with the same vector exp and log and the same error bound.
+ *
+ *          The float kernels (VM_SelectAfBatchFloat, VM_SelectAfLanesFloat; PRECISION 2) take and
+ *          return the same double arrays but compute Af in single precision: the scalar one with
+ *          powf and expf, the vector ones, twice as wide, with the float exp and log of fdlibm
+ *          (e_expf.c, e_logf.c). Their Af differs from the double scalar kernel by at most
+ *          VM_AF_FLOAT_MAX_ERROR; the effect on the force is measured by Virtual_Muscle_Validate.c.
+ *
+ * Date: 10-17-26
+ */
+
+#ifndef VIRTUAL_MUSCLE_SIMD_H
+#define VIRTUAL_MUSCLE_SIMD_H
+
+#include "Virtual_Muscle_Types.h"
+
+//Maximum absolute difference between the vector and the scalar Af kernels (4*2^-52)
+#define VM_AF_SIMD_MAX_ERROR 8.8817841970012523e-16
+//Maximum absolute difference between the float and the double Af kernels (4.2e-7 measured for nf 0.5-5)
+#define VM_AF_FLOAT_MAX_ERROR 1e-6
+
+//Kernel instruction sets (VM_AfBatchIsa)
+#define VM_ISA_SCALAR 0
+#define VM_ISA_AVX2   1
+#define VM_ISA_AVX512 2
+
+/* Af[j] = 1-exp(-pow(Yield[j]*Sag[j]*feff[j]/af_nf, nf)) for j = 0..n-1. The arrays are
+ * contiguous; Yield or Sag may be NULL for fiber types without yield or sag (1.0 is used).
+ */
+typedef void (*VM_AfBatchFcn)(real_T *Af, const real_T *Yield, const real_T *Sag, const real_T *feff,
+                              int_T n, real_T af_nf, real_T nf);
+
+extern void VM_AfBatch_Scalar(real_T *Af, const real_T *Yield, const real_T *Sag, const real_T *feff,
+                              int_T n, real_T af_nf, real_T nf);
+
+/* Returns the fastest kernel supported by the CPU, and its instruction set in *Isa (may be NULL) */
+extern VM_AfBatchFcn VM_SelectAfBatch(int_T *Isa);
+
+//Af in float, same arguments
+extern void VM_AfBatchFloat_Scalar(real_T *Af, const real_T *Yield, const real_T *Sag, const real_T *feff,
+                                   int_T n, real_T af_nf, real_T nf);
+extern VM_AfBatchFcn VM_SelectAfBatchFloat(int_T *Isa);
+
+/* Af[j*Lanes+l] = 1-exp(-pow(YS[j*Lanes+l]*feff[j*Lanes+l]/af_nf[l], nf[l])) for the n motor units j of
+ * Lanes muscles l. YS is the product of the yield and sag factors of the unit (1.0 without them).
+ */
+typedef void (*VM_AfLanesFcn)(real_T *Af, const real_T *YS, const real_T *feff, int_T n, int_T Lanes,
+                              const real_T *af_nf, const real_T *nf);
+
+extern void VM_AfLanes_Scalar(real_T *Af, const real_T *YS, const real_T *feff, int_T n, int_T Lanes,
+                              const real_T *af_nf, const real_T *nf);
+
+/* Returns the fastest lane kernel supported by the CPU whose vector width divides Lanes, and its
+ * instruction set in *Isa (may be NULL)
+ */
+extern VM_AfLanesFcn VM_SelectAfLanes(int_T Lanes, int_T *Isa);
+
+//Lane kernels in float, same arguments
+extern void VM_AfLanesFloat_Scalar(real_T *Af, const real_T *YS, const real_T *feff, int_T n, int_T Lanes,
+                                   const real_T *af_nf, const real_T *nf);
+extern VM_AfLanesFcn VM_SelectAfLanesFloat(int_T Lanes, int_T *Isa);
+
+#endif /* VIRTUAL_MUSCLE_SIMD_H */
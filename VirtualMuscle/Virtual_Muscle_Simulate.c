@@ -0,0 +1,101 @@
+/* VIRTUAL_MUSCLE_SIMULATE.C
+ * Synopsis: Native batch simulation of one muscle with the Virtual Muscle engine, outside Simulink.
+ *
+ *          vm_simulate <param file> <t_end (s)> <Act> <Path (m)> [rk4|dopri5] [step (s)] [Freq (pps)]
+ *
+ *          The parameter file holds the S-function parameters in the order of
+ *          Virtual_Muscle_Params.h, one parameter per line, values separated by spaces
+ *          (Virtual_Muscle_ParamFile.h); in fixed muscle builds (VM_FIXED_MUSCLE, see
+ *          Virtual_Muscle_Generate.c) - takes the muscle of the build. The inputs are held constant; the outputs are written to
+ *          stdout as CSV (t, Force (N), Activation, Force (F0), Fascicle Length (Lo), Fascicle Velocity (Lo/s)).
+ *
+ * Date: 10-17-26
+ *
+ * Build: cc -O2 -DVM_STANDALONE Virtual_Muscle_Simulate.c Virtual_Muscle_ParamFile.c Virtual_Muscle_Engine.c
+ *          Virtual_Muscle_SIMD.c Virtual_Muscle_Threads.c -lm -lpthread -o vm_simulate
+ */
+
+#include "Virtual_Muscle_Engine.h"
+#include "Virtual_Muscle_ParamFile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+/* Function: WriteOutputs
+*  Description: Output function, one CSV line per step
+*/
+static int_T WriteOutputs(real_T t, const real_T *x, const real_T *y, void *Context)
+{
+    printf("%.6f,%.10g,%.10g,%.10g,%.10g,%.10g\n", t, y[VM_OUT_FSE], y[VM_OUT_ACT], y[VM_OUT_FSEF0],
+           y[VM_OUT_LCE], y[VM_OUT_VCE]);
+    return 0;
+}
+
+
+
+int main(int argc, char **argv)
+{
+    VM_ParamSet Param_set;
+    VM_SolverOptions Options;
+    VM_MuscleModel *Model   = NULL;
+    VM_Simulation *Sim      = NULL;
+    real_T *Values          = NULL;
+    const char *Error       = NULL;
+    real_T t_end            = 0.0;
+    int_T Status            = 0;
+
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s <param file> <t_end (s)> <Act> <Path (m)> [rk4|dopri5] [step (s)] [Freq (pps)]\n",
+                argv[0]);
+        return 2;
+    }
+#ifdef VM_FIXED_MUSCLE
+    if (strcmp(argv[1], "-") == 0) {
+        VM_GetFixedParams(&Param_set);
+    } else
+#endif
+    if (!VM_ReadParamSet(argv[1], &Param_set, &Values)) {
+        fprintf(stderr, "Could not read the parameters from %s\n", argv[1]);
+        return 1;
+    }
+    Model = VM_CreateModel(&Param_set, &Error);
+    if (Model == NULL) {
+        fprintf(stderr, "%s\n", Error);
+        free(Values);
+        return 1;
+    }
+    Sim = VM_CreateSimulation(Model);
+    if (Sim == NULL) {
+        fprintf(stderr, "Could not allocate the simulation\n");
+        VM_FreeModel(Model);
+        free(Values);
+        return 1;
+    }
+
+    t_end               = atof(argv[2]);
+    Options.Solver      = (argc > 5 && strcmp(argv[5], "dopri5") == 0) ? VM_SOLVER_DOPRI5 : VM_SOLVER_RK4;
+    Options.Step        = (argc > 6) ? atof(argv[6]) : 1e-4;
+    Options.Rel_tol     = 1e-6;
+    Options.Abs_tol     = 1e-8;
+    Options.Min_step    = 1e-12;
+    Options.Max_step    = 0.01;
+
+    Sim->u.Act  = atof(argv[3]);
+    Sim->u.Path = atof(argv[4]);
+    Sim->u.Freq = (argc > 7) ? atof(argv[7]) : 0.0; //Intramuscular FES only
+    VM_InitializeSimulation(Sim, 0.0, NULL, NULL);
+
+    printf("t,Force,Activation,ForceF0,Lce,Vce\n");
+    WriteOutputs(Sim->t, Sim->x, Sim->y, NULL);
+    Status = VM_Simulate(Sim, &Options, t_end, NULL, WriteOutputs, NULL);
+    if (Status == VM_SIM_STEP_FAILED) {
+        fprintf(stderr, "Step size fell below %g at t = %g\n", Options.Min_step, Sim->t);
+    }
+
+    VM_FreeSimulation(Sim);
+    VM_FreeModel(Model);
+    free(Values);
+    return (Status == VM_SIM_OK) ? 0 : 1;
+}
@@ -0,0 +1,533 @@
+/* VIRTUAL_MUSCLE_SURROGATE.C
+ * Synopsis: Surrogate muscles of the Virtual Muscle engine, see Virtual_Muscle_Surrogate.h
+ *
+ * Comments: The tendon, mass and output equations are those of VM_Outputs and VM_Derivatives; only
+ *          Fce comes from the table and the motor unit states are replaced by the activation state.
+ *
+ *          Build: add Virtual_Muscle_Surrogate.c to the engine sources.
+ *
+ * Date: 10-17-26
+ */
+
+#include "Virtual_Muscle_Surrogate.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+//Header values of a table file after the magic: int32 then double
+#define VM_SURROGATE_FILE_INTS  5
+#define VM_SURROGATE_FILE_REALS 14
+
+//Bisection steps of the initial Lce (VM_SurrogateInitializeConditions)
+#define VM_SURROGATE_INIT_BISECTIONS 60
+
+
+
+/* Function: CheckGrid
+*  Description: Reason why the grid is invalid, NULL if it is valid. The number of nodes is checked one axis
+*              at a time against VM_SURROGATE_MAX_NODES, so that the sizes read from a file cannot overflow it.
+*/
+static const char* CheckGrid(const VM_SurrogateGrid *Grid)
+{
+    if (Grid->Num_lce < 2 || Grid->Num_act < 2 || Grid->Num_freq < 1)
+        return "Surrogate grids need 2 Lce and activation nodes and 1 frequency node at least";
+    if (Grid->Num_vce < 3 || Grid->Num_vce%2 == 0)
+        return "Surrogate grids need an odd number of Vce nodes, 3 at least";
+    if (Grid->Num_lce > VM_SURROGATE_MAX_NODES/Grid->Num_vce
+        || Grid->Num_lce*Grid->Num_vce > VM_SURROGATE_MAX_NODES/Grid->Num_act
+        || Grid->Num_lce*Grid->Num_vce*Grid->Num_act > VM_SURROGATE_MAX_NODES/Grid->Num_freq)
+        return "Surrogate grids have at most VM_SURROGATE_MAX_NODES nodes";
+    if (!(Grid->Lce_min > 0) || !(Grid->Lce_max > Grid->Lce_min) || !(Grid->Vce_max > 0))
+        return "Surrogate grids need 0 < Lce_min < Lce_max and Vce_max > 0";
+    if (Grid->Num_freq > 1 ? !(Grid->Freq_max > Grid->Freq_min) : !(Grid->Freq_max == Grid->Freq_min))
+        return "Surrogate grids need Freq_min < Freq_max (Freq_min = Freq_max with one frequency node)";
+    return NULL;
+}
+
+
+
+/* Function: NumNodes
+*  Description: Number of nodes of a grid that passed CheckGrid
+*/
+static size_t NumNodes(const VM_SurrogateGrid *Grid)
+{
+    return (size_t)Grid->Num_lce*Grid->Num_vce*Grid->Num_act*Grid->Num_freq;
+}
+
+
+
+/* Function: AllocateTable
+*  Description: Table and nodes of the grid in one allocation, zeroed; NULL if the allocation fails
+*/
+static VM_SurrogateTable* AllocateTable(const VM_SurrogateGrid *Grid)
+{
+    VM_SurrogateTable *Table = NULL;
+
+    Table = (VM_SurrogateTable*)calloc(1, sizeof(VM_SurrogateTable) + NumNodes(Grid)*sizeof(float));
+    if (Table == NULL) {
+        return NULL;
+    }
+    Table->Grid = *Grid;
+    Table->Fce  = (float*)(Table+1);
+    return Table;
+}
+
+
+
+/* Function: DeriveValues
+*  Description: Values of the table derived from the grid and the muscle constants
+*/
+static void DeriveValues(VM_SurrogateTable *Table)
+{
+    const VM_SurrogateGrid *Grid = &Table->Grid;
+
+    Table->invL0        = 1/(Table->L0/100);
+    Table->invL0T       = 1/Table->L0T;
+    Table->invMass      = 1/(Table->Mass/2000);
+    Table->Lce_invh     = (Grid->Num_lce-1)/(Grid->Lce_max-Grid->Lce_min);
+    Table->Vce_scale    = 1/Grid->Vce_max;
+    Table->Freq_invh    = (Grid->Num_freq > 1) ? (Grid->Num_freq-1)/(Grid->Freq_max-Grid->Freq_min) : 0.0;
+}
+
+
+
+/* Function: VM_DefaultSurrogateGrid
+*  Description: Default grid of the model: VM_SURROGATE_NUM_* nodes, Lce from VM_SURROGATE_LCE_MIN to FASCLMAX,
+*              Vce up to the largest |Vmax| of the fiber types, and for Intramuscular FES frequencies from 0 to
+*              the largest fmax (pps)
+*/
+void VM_DefaultSurrogateGrid(const VM_MuscleModel *Model, VM_SurrogateGrid *Grid)
+{
+    int_T i = 0;
+
+    Grid->Num_lce   = VM_SURROGATE_NUM_LCE;
+    Grid->Num_vce   = VM_SURROGATE_NUM_VCE;
+    Grid->Num_act   = VM_SURROGATE_NUM_ACT;
+    Grid->Num_freq  = (Model->Recruitment_Type == 4) ? VM_SURROGATE_NUM_FREQ : 1;
+    Grid->Lce_min   = VM_SURROGATE_LCE_MIN;
+    Grid->Lce_max   = (Model->FASCLMAX > VM_SURROGATE_LCE_MIN) ? Model->FASCLMAX : 2*VM_SURROGATE_LCE_MIN;
+    Grid->Vce_max   = 0.0;
+    Grid->Freq_min  = 0.0;
+    Grid->Freq_max  = 0.0;
+    for(i=0; i<Model->TypesOf_fibers; i++){
+        if (fabs(Model->Vmax[i]) > Grid->Vce_max)
+            Grid->Vce_max = fabs(Model->Vmax[i]);
+        if (Grid->Num_freq > 1 && Model->Fmax[i]/Model->invf05[i] > Grid->Freq_max)
+            Grid->Freq_max = Model->Fmax[i]/Model->invf05[i];
+    }
+}
+
+
+
+/* Function: VM_BuildSurrogateTable
+*  Description: Table of the model over the grid: Fce/F0 of VM_SteadyStateForce at every node. The activation
+*              time constants are the fiber type ones at Lo weighted by the fractional PCSA, rise Tf1+Tf2/2 and
+*              fall Tf3+Tf4/2 (half recruited); Virtual_Muscle_Tabulate.c fits them to the model instead.
+*/
+VM_SurrogateTable* VM_BuildSurrogateTable(const VM_MuscleModel *Model, const VM_SurrogateGrid *Grid,
+                                          const char **Error)
+{
+    VM_SurrogateTable *Table    = NULL;
+    VM_Simulation *Scratch      = NULL;
+    const char *Reason          = CheckGrid(Grid);
+    float *Fce                  = NULL;
+    VM_Inputs u;
+
+    real_T PCSA     = 0.0;
+    real_T s        = 0.0;
+    real_T Vce      = 0.0;
+    int_T i         = 0;
+    int_T l         = 0;
+    int_T v         = 0;
+    int_T a         = 0;
+    int_T f         = 0;
+
+    if (Reason == NULL) {
+        Table = AllocateTable(Grid);
+        Scratch = (Table != NULL) ? VM_CreateSimulation(Model) : NULL;
+        if (Scratch == NULL) {
+            free(Table);
+            Table = NULL;
+            Reason = "Could not allocate the surrogate table";
+        }
+    }
+    if (Reason != NULL) {
+        if (Error != NULL)
+            *Error = Reason;
+        return NULL;
+    }
+
+    Table->Recruitment_Type = Model->Recruitment_Type;
+    Table->MUSCF0   = Model->MUSCF0;
+    Table->L0       = Model->L0;
+    Table->L0T      = Model->L0T;
+    Table->cT       = Model->cT;
+    Table->kT       = Model->kT;
+    Table->LrT      = Model->LrT;
+    Table->Mass     = Model->Mass;
+    for(i=0; i<Model->TypesOf_fibers; i++){
+        PCSA            += Model->Fract_PCSA[i];
+        Table->Tau_rise += Model->Fract_PCSA[i]*(Model->Tf1[i]+0.5*Model->Tf2[i]);
+        Table->Tau_fall += Model->Fract_PCSA[i]*(Model->Tf3[i]+0.5*Model->Tf4[i]);
+    }
+    Table->Tau_rise /= PCSA;
+    Table->Tau_fall /= PCSA;
+    DeriveValues(Table);
+
+    //Nodes, Lce fastest
+    Fce = Table->Fce;
+    u.Path = 0.0;
+    for(f=0; f<Grid->Num_freq; f++){
+        u.Freq = Grid->Freq_min + ((Grid->Num_freq > 1) ? f/Table->Freq_invh : 0.0);
+        for(a=0; a<Grid->Num_act; a++){
+            u.Act = (real_T)a/(Grid->Num_act-1);
+            for(v=0; v<Grid->Num_vce; v++){
+                s = -1+2.0*v/(Grid->Num_vce-1);
+                Vce = Grid->Vce_max*s*fabs(s);
+                for(l=0; l<Grid->Num_lce; l++){
+                    *Fce++ = (float)(VM_SteadyStateForce(Model, Scratch->x, Scratch->Work, &u, Grid->Lce_min+l/Table->Lce_invh,
+                                                         Vce, Scratch->Scratch, Scratch->Arena)/Model->MUSCF0);
+                }
+            }
+        }
+    }
+
+    VM_FreeSimulation(Scratch);
+    return Table;
+}
+
+
+
+/* Function: VM_FreeSurrogateTable
+*  Description: Frees the table and its nodes
+*/
+void VM_FreeSurrogateTable(VM_SurrogateTable *Table)
+{
+    free(Table);
+}
+
+
+
+/* Function: VM_WriteSurrogateTable
+*  Description: Writes the magic, the header (int32 and double values) and the float nodes to File_name
+*/
+int_T VM_WriteSurrogateTable(const VM_SurrogateTable *Table, const char *File_name)
+{
+    const VM_SurrogateGrid *Grid = &Table->Grid;
+    int32_t Ints[VM_SURROGATE_FILE_INTS];
+    double Reals[VM_SURROGATE_FILE_REALS];
+    FILE *File  = NULL;
+    int_T Ok    = 0;
+
+    Ints[0]     = (int32_t)Table->Recruitment_Type;
+    Ints[1]     = (int32_t)Grid->Num_lce;
+    Ints[2]     = (int32_t)Grid->Num_vce;
+    Ints[3]     = (int32_t)Grid->Num_act;
+    Ints[4]     = (int32_t)Grid->Num_freq;
+    Reals[0]    = Grid->Lce_min;
+    Reals[1]    = Grid->Lce_max;
+    Reals[2]    = Grid->Vce_max;
+    Reals[3]    = Grid->Freq_min;
+    Reals[4]    = Grid->Freq_max;
+    Reals[5]    = Table->MUSCF0;
+    Reals[6]    = Table->L0;
+    Reals[7]    = Table->L0T;
+    Reals[8]    = Table->cT;
+    Reals[9]    = Table->kT;
+    Reals[10]   = Table->LrT;
+    Reals[11]   = Table->Mass;
+    Reals[12]   = Table->Tau_rise;
+    Reals[13]   = Table->Tau_fall;
+
+    File = fopen(File_name, "wb");
+    if (File == NULL) {
+        return 0;
+    }
+    Ok = fwrite(VM_SURROGATE_MAGIC, 1, VM_SURROGATE_MAGIC_SIZE, File) == VM_SURROGATE_MAGIC_SIZE
+         && fwrite(Ints, sizeof(Ints[0]), VM_SURROGATE_FILE_INTS, File) == VM_SURROGATE_FILE_INTS
+         && fwrite(Reals, sizeof(Reals[0]), VM_SURROGATE_FILE_REALS, File) == VM_SURROGATE_FILE_REALS
+         && fwrite(Table->Fce, sizeof(float), NumNodes(Grid), File) == NumNodes(Grid);
+    if (fclose(File) != 0)
+        Ok = 0;
+    return Ok;
+}
+
+
+
+/* Function: VM_ReadSurrogateTable
+*  Description: Reads a table written by VM_WriteSurrogateTable
+*/
+VM_SurrogateTable* VM_ReadSurrogateTable(const char *File_name, const char **Error)
+{
+    VM_SurrogateTable *Table    = NULL;
+    const char *Reason          = NULL;
+    char Magic[VM_SURROGATE_MAGIC_SIZE];
+    int32_t Ints[VM_SURROGATE_FILE_INTS];
+    double Reals[VM_SURROGATE_FILE_REALS];
+    VM_SurrogateGrid Grid;
+    FILE *File                  = NULL;
+
+    File = fopen(File_name, "rb");
+    if (File == NULL) {
+        if (Error != NULL)
+            *Error = "Could not open the surrogate table";
+        return NULL;
+    }
+    if (fread(Magic, 1, VM_SURROGATE_MAGIC_SIZE, File) != VM_SURROGATE_MAGIC_SIZE
+        || memcmp(Magic, VM_SURROGATE_MAGIC, VM_SURROGATE_MAGIC_SIZE) != 0
+        || fread(Ints, sizeof(Ints[0]), VM_SURROGATE_FILE_INTS, File) != VM_SURROGATE_FILE_INTS
+        || fread(Reals, sizeof(Reals[0]), VM_SURROGATE_FILE_REALS, File) != VM_SURROGATE_FILE_REALS) {
+        Reason = "Not a surrogate table file";
+    }
+    else {
+        Grid.Num_lce    = Ints[1];
+        Grid.Num_vce    = Ints[2];
+        Grid.Num_act    = Ints[3];
+        Grid.Num_freq   = Ints[4];
+        Grid.Lce_min    = Reals[0];
+        Grid.Lce_max    = Reals[1];
+        Grid.Vce_max    = Reals[2];
+        Grid.Freq_min   = Reals[3];
+        Grid.Freq_max   = Reals[4];
+        Reason = CheckGrid(&Grid);
+        if (Reason == NULL && !(Reals[5] > 0 && Reals[6] > 0 && Reals[7] > 0 && Reals[11] > 0 && Reals[12] > 0 && Reals[13] > 0))
+            Reason = "Surrogate table with invalid muscle constants";
+    }
+    if (Reason == NULL) {
+        Table = AllocateTable(&Grid);
+        if (Table == NULL)
+            Reason = "Could not allocate the surrogate table";
+        else if (fread(Table->Fce, sizeof(float), NumNodes(&Grid), File) != NumNodes(&Grid))
+            Reason = "Surrogate table file too short";
+    }
+    fclose(File);
+    if (Reason != NULL) {
+        free(Table);
+        if (Error != NULL)
+            *Error = Reason;
+        return NULL;
+    }
+
+    Table->Recruitment_Type = Ints[0];
+    Table->MUSCF0   = Reals[5];
+    Table->L0       = Reals[6];
+    Table->L0T      = Reals[7];
+    Table->cT       = Reals[8];
+    Table->kT       = Reals[9];
+    Table->LrT      = Reals[10];
+    Table->Mass     = Reals[11];
+    Table->Tau_rise = Reals[12];
+    Table->Tau_fall = Reals[13];
+    DeriveValues(Table);
+    return Table;
+}
+
+
+
+/* Function: Locate
+*  Description: Interval and fraction of the node coordinate s on an axis of N nodes, clamped to the axis
+*/
+static void Locate(real_T s, int_T N, int_T *Index, real_T *Frac)
+{
+    if (N < 2 || !(s > 0)) {
+        *Index  = 0;
+        *Frac   = 0.0;
+    }
+    else if (s >= N-1) {
+        *Index  = N-2;
+        *Frac   = 1.0;
+    }
+    else {
+        *Index  = (int_T)s;
+        *Frac   = s-*Index;
+    }
+}
+
+
+
+/* Function: VM_SurrogateForce
+*  Description: Fce/F0 of the table at (Lce, Vce, Act, Freq): bilinear in (Lce, Vce) on the four (Act, Freq)
+*              planes around the point, then bilinear between the planes
+*/
+real_T VM_SurrogateForce(const VM_SurrogateTable *Table, real_T Lce, real_T Vce, real_T Act, real_T Freq)
+{
+    const VM_SurrogateGrid *Grid = &Table->Grid;
+    const float *Fce    = Table->Fce;
+    int_T d_vce         = Grid->Num_lce;
+    int_T d_act         = d_vce*Grid->Num_vce;
+    int_T d_freq        = (Grid->Num_freq > 1) ? d_act*Grid->Num_act : 0;
+    real_T Plane[4];
+
+    real_T s            = 0.0;
+    real_T fl           = 0.0;
+    real_T fv           = 0.0;
+    real_T fa           = 0.0;
+    real_T ff           = 0.0;
+    int_T il            = 0;
+    int_T iv            = 0;
+    int_T ia            = 0;
+    int_T jf            = 0;
+    int_T Node          = 0;
+    int_T k             = 0;
+
+    s = Vce*Table->Vce_scale;
+    s = (s < 0) ? -sqrt(-s) : sqrt(s);
+    Locate((Lce-Grid->Lce_min)*Table->Lce_invh, Grid->Num_lce, &il, &fl);
+    Locate(0.5*(s+1)*(Grid->Num_vce-1), Grid->Num_vce, &iv, &fv);
+    Locate(Act*(Grid->Num_act-1), Grid->Num_act, &ia, &fa);
+    Locate((Freq-Grid->Freq_min)*Table->Freq_invh, Grid->Num_freq, &jf, &ff);
+
+    for(k=0; k<4; k++){
+        Node = ((jf*Grid->Num_act+ia)*Grid->Num_vce+iv)*Grid->Num_lce+il + (k&1)*d_act + (k>>1)*d_freq;
+        Plane[k] = (1-fv)*((1-fl)*Fce[Node]+fl*Fce[Node+1])
+                   + fv*((1-fl)*Fce[Node+d_vce]+fl*Fce[Node+d_vce+1]);
+    }
+    return (1-ff)*((1-fa)*Plane[0]+fa*Plane[1]) + ff*((1-fa)*Plane[2]+fa*Plane[3]);
+}
+
+
+
+/* Function: SeriesElasticForce
+*  Description: Fse (N) at the fascicle length Lce (Lo) and the path length Path (m), as VM_Outputs
+*/
+static real_T SeriesElasticForce(const VM_SurrogateTable *Table, real_T Lce, real_T Path)
+{
+    real_T prov = Table->invL0T*((Path*100) - Table->L0 * Lce);
+
+    return Table->cT*Table->kT*log( exp((prov-Table->LrT)/Table->kT) + 1)*Table->MUSCF0;
+}
+
+
+
+/* Function: ContractileForce
+*  Description: Fce (N) of the states x at the frequency Freq, not negative as in VM_Derivatives
+*/
+static real_T ContractileForce(const VM_SurrogateTable *Table, const real_T *x, real_T Freq)
+{
+    real_T Fce = Table->MUSCF0*VM_SurrogateForce(Table, Table->invL0*x[1], Table->invL0*x[0], x[2], Freq);
+
+    return (Fce < 0.0) ? 0.0 : Fce;
+}
+
+
+
+/* Function: VM_SurrogateInitializeConditions
+*  Description: Vce 0, activation 0 (or u->Act if Steady), and Lce where Fse = Fce, by bisection over the Lce
+*              range of the table (Fse falls and the force of the table mostly rises with Lce); the end of
+*              the range if there is no crossing in it
+*/
+void VM_SurrogateInitializeConditions(const VM_SurrogateTable *Table, real_T *x0, const VM_Inputs *u,
+                                      int_T Steady)
+{
+    const VM_SurrogateGrid *Grid = &Table->Grid;
+    real_T Low      = Grid->Lce_min;
+    real_T High     = Grid->Lce_max;
+    real_T Lce      = 0.0;
+    int_T k         = 0;
+
+    x0[0] = 0.0;
+    x0[2] = Steady ? u->Act : 0.0;
+    for(k=0; k<VM_SURROGATE_INIT_BISECTIONS; k++){
+        Lce = 0.5*(Low+High);
+        x0[1] = Lce*Table->L0/100;
+        if (SeriesElasticForce(Table, Lce, u->Path) > ContractileForce(Table, x0, u->Freq))
+            Low = Lce;
+        else
+            High = Lce;
+    }
+    x0[1] = 0.5*(Low+High)*Table->L0/100;
+}
+
+
+
+/* Function: VM_SurrogateOutputs
+*  Description: Outputs of the states x and the inputs u, as VM_Outputs
+*/
+void VM_SurrogateOutputs(const VM_SurrogateTable *Table, const real_T *x, const VM_Inputs *u, real_T *y)
+{
+    real_T Lce = Table->invL0*x[1];
+    real_T Fse = SeriesElasticForce(Table, Lce, u->Path);
+
+    y[VM_OUT_FSE]   = Fse;
+    y[VM_OUT_ACT]   = x[2];
+    y[VM_OUT_FSEF0] = Fse/Table->MUSCF0;
+    y[VM_OUT_LCE]   = Lce;
+    y[VM_OUT_VCE]   = Table->invL0*x[0];
+}
+
+
+
+/* Function: VM_SurrogateDerivatives
+*  Description: Derivatives of Vce (muscle mass), Lce and the activation
+*/
+void VM_SurrogateDerivatives(const VM_SurrogateTable *Table, const real_T *x, const VM_Inputs *u, real_T *dx)
+{
+    real_T Fse = SeriesElasticForce(Table, Table->invL0*x[1], u->Path);
+    real_T Fce = ContractileForce(Table, x, u->Freq);
+
+    dx[0] = (Fse - Fce) * Table->invMass;
+    dx[1] = x[0];
+    dx[2] = (u->Act-x[2])/((u->Act >= x[2]) ? Table->Tau_rise : Table->Tau_fall);
+}
+
+
+
+/* Function: VM_SimulateSurrogate
+*  Description: Fixed step 4th order Runge-Kutta, stepped as SimulateRK4 of the engine: the last step is
+*              shortened to end at t_end, and the output function gets the states and outputs at the end
+*              of every step. The inputs are those of Input at the times of the stages.
+*/
+int_T VM_SimulateSurrogate(const VM_SurrogateTable *Table, real_T *x, real_T t0, real_T Step, real_T t_end,
+                           VM_InputFcn Input, VM_OutputFcn Output, void *Context)
+{
+    real_T k1[VM_SURROGATE_NUM_STATES];
+    real_T k2[VM_SURROGATE_NUM_STATES];
+    real_T k3[VM_SURROGATE_NUM_STATES];
+    real_T k4[VM_SURROGATE_NUM_STATES];
+    real_T xs[VM_SURROGATE_NUM_STATES];
+    real_T y[VM_NUM_OUTPUTS];
+    VM_Inputs u;
+    real_T t        = t0;
+    real_T h        = 0.0;
+    int_T  Steps    = 0;
+    int_T  s        = 0;
+    int_T  i        = 0;
+
+    if (t_end <= t0) {
+        return VM_SIM_OK;
+    }
+    Steps = (int_T)ceil((t_end-t0)/Step*(1-1e-12));
+    if (Steps < 1)
+        Steps = 1;
+
+    Input(t0, &u, Context);
+    VM_SurrogateDerivatives(Table, x, &u, k1);
+    for(s=1; s<=Steps; s++){
+        h = ((s == Steps) ? t_end : t0+s*Step) - t;
+
+        Input(t+0.5*h, &u, Context);
+        for(i=0; i<VM_SURROGATE_NUM_STATES; i++)
+            xs[i] = x[i]+0.5*h*k1[i];
+        VM_SurrogateDerivatives(Table, xs, &u, k2);
+        for(i=0; i<VM_SURROGATE_NUM_STATES; i++)
+            xs[i] = x[i]+0.5*h*k2[i];
+        VM_SurrogateDerivatives(Table, xs, &u, k3);
+        Input(t+h, &u, Context);
+        for(i=0; i<VM_SURROGATE_NUM_STATES; i++)
+            xs[i] = x[i]+h*k3[i];
+        VM_SurrogateDerivatives(Table, xs, &u, k4);
+        for(i=0; i<VM_SURROGATE_NUM_STATES; i++)
+            x[i] += h/6*(k1[i]+2*k2[i]+2*k3[i]+k4[i]);
+
+        t = (s == Steps) ? t_end : t0+s*Step;
+        VM_SurrogateDerivatives(Table, x, &u, k1);
+        if (Output != NULL) {
+            VM_SurrogateOutputs(Table, x, &u, y);
+            if (Output(t, x, y, Context))
+                return VM_SIM_STOPPED;
+        }
+    }
+    return VM_SIM_OK;
+}
@@ -0,0 +1,126 @@
+/* VIRTUAL_MUSCLE_SURROGATE.H
+ * Synopsis: Surrogate muscles of the Virtual Muscle engine: the steady state force of the contractile
+ *          element tabulated over (Lce, Vce, activation, FES frequency), for whole-limb models that do
+ *          not need the motor unit detail.
+ *
+ *          A table is built once from a muscle model (VM_BuildSurrogateTable): every node is the Fce of
+ *          VM_SteadyStateForce, the motor units at their steady state for the activation (and frequency)
+ *          with the fascicle held at the length and velocity of the node, divided by F0. The tables are
+ *          saved in a compact binary file (float nodes) that also holds the tendon, mass and activation
+ *          constants, so a surrogate muscle runs from the table alone.
+ *
+ *          A surrogate muscle has three states: Vce and Lce as in the engine, and an activation a that
+ *          follows the input Act with first order dynamics (time constant Tau_rise while Act > a,
+ *          Tau_fall otherwise). Fce is the multilinear interpolation of the table at (Lce, Vce, a, Freq),
+ *          clamped to the ranges of the table, so a muscle costs the same for any number of motor units.
+ *          VM_SurrogateOutputs and VM_SurrogateDerivatives follow the call order of VM_Outputs and
+ *          VM_Derivatives; VM_SimulateSurrogate integrates them with fixed step RK4.
+ *
+ *          Grids: Lce and the activation are uniform; Vce is quadratic in the node index, Vce_max*s*|s|
+ *          for s uniform over [-1, 1] with a node at 0, so that the nodes are densest around the kink of
+ *          the FV curves. The frequency axis has one node unless the muscle is Intramuscular FES (RTYPE 4).
+ *          Virtual_Muscle_Tabulate.c builds the table of a parameter file, fits the time constants and
+ *          reports the error of the surrogate against the full model.
+ *
+ *          In Simulink, a Virtual_Muscle_SFunction block whose SURROGATE parameter names a table file is a
+ *          surrogate muscle of that table: the three states above, the ports of its RTYPE and ADDPORTS, and
+ *          INITSTATE 2 for the steady state activation. The motor unit parameters of the block only size
+ *          its ports; the table must have been built for the same RTYPE.
+ *
+ * Date: 10-17-26
+ */
+
+#ifndef VIRTUAL_MUSCLE_SURROGATE_H
+#define VIRTUAL_MUSCLE_SURROGATE_H
+
+#include "Virtual_Muscle_Engine.h"
+
+//Surrogate table file: magic, then the header and the nodes in native byte order
+#define VM_SURROGATE_MAGIC      "VMSURR01"
+#define VM_SURROGATE_MAGIC_SIZE 8
+
+//States of a surrogate muscle: Vce (m/s), Lce (m) and the activation
+#define VM_SURROGATE_NUM_STATES 3
+
+//Default grid (VM_DefaultSurrogateGrid)
+#define VM_SURROGATE_NUM_LCE    41
+#define VM_SURROGATE_NUM_VCE    41
+#define VM_SURROGATE_NUM_ACT    21
+#define VM_SURROGATE_NUM_FREQ   17      //Intramuscular FES only
+#define VM_SURROGATE_LCE_MIN    0.5     //Lo
+
+//Largest number of nodes of a table (float nodes, 256 MB)
+#define VM_SURROGATE_MAX_NODES  (1 << 26)
+
+/*Grid
+ Nodes and ranges of a table. Num_vce is odd (the node at Vce 0); Num_freq is 1, with Freq_min =
+ Freq_max = 0, unless the muscle is Intramuscular FES. At most VM_SURROGATE_MAX_NODES nodes in all.
+ */
+typedef struct {
+    int_T   Num_lce;
+    int_T   Num_vce;
+    int_T   Num_act;            //Activation from 0 to 1
+    int_T   Num_freq;
+    real_T  Lce_min;            //Lo
+    real_T  Lce_max;            //Lo
+    real_T  Vce_max;            //Lo/s, the nodes span [-Vce_max, Vce_max]
+    real_T  Freq_min;           //pps
+    real_T  Freq_max;           //pps
+} VM_SurrogateGrid;
+
+/*Surrogate table
+ The grid, the constants of the muscle (as in VM_MuscleModel) and the nodes, Fce/F0 of node
+ (lce, vce, act, freq) at Fce[((freq*Num_act+act)*Num_vce+vce)*Num_lce+lce]. The values after Fce
+ are derived from the others when the table is built or read.
+ */
+typedef struct {
+    VM_SurrogateGrid Grid;
+    int_T   Recruitment_Type;   //Of the muscle the table was built from
+    real_T  MUSCF0;             //Muscle Fo (N)
+    real_T  L0;                 //Fascicle length (cm)
+    real_T  L0T;                //Tendon length
+    real_T  cT, kT, LrT;        //FSE
+    real_T  Mass;               //Muscle mass
+    real_T  Tau_rise;           //Activation time constants (s)
+    real_T  Tau_fall;
+    float*  Fce;                //[Num_freq][Num_act][Num_vce][Num_lce], same allocation as the table
+
+    real_T  invL0;              //1/(L0/100)
+    real_T  invL0T;             //1/L0T
+    real_T  invMass;            //1/(Mass/2000)
+    real_T  Lce_invh;           //Nodes per Lo
+    real_T  Vce_scale;          //1/Vce_max
+    real_T  Freq_invh;          //Nodes per pps, 0 for one node
+} VM_SurrogateTable;
+
+//Grid of the model: the defaults above, Lce up to FASCLMAX, Vce up to the largest |Vmax|, Freq up to the largest fmax
+extern void VM_DefaultSurrogateGrid(const VM_MuscleModel *Model, VM_SurrogateGrid *Grid);
+/* Table of the model over Grid, with the time constants of the fiber types weighted by their PCSA
+ * (Tf1+Tf2/2 and Tf3+Tf4/2 at Lo). Returns NULL, with the reason in *Error (may be NULL), if the grid is
+ * invalid or the allocation fails.
+ */
+extern VM_SurrogateTable* VM_BuildSurrogateTable(const VM_MuscleModel *Model, const VM_SurrogateGrid *Grid,
+                                                 const char **Error);
+extern void VM_FreeSurrogateTable(VM_SurrogateTable *Table);
+//Returns 0 if the file cannot be written
+extern int_T VM_WriteSurrogateTable(const VM_SurrogateTable *Table, const char *File_name);
+//Returns NULL, with the reason in *Error (may be NULL), if the file cannot be read or is not a table
+extern VM_SurrogateTable* VM_ReadSurrogateTable(const char *File_name, const char **Error);
+
+//Fce/F0 at Lce (Lo), Vce (Lo/s), activation Act and frequency Freq (pps), by multilinear interpolation
+extern real_T VM_SurrogateForce(const VM_SurrogateTable *Table, real_T Lce, real_T Vce, real_T Act, real_T Freq);
+
+//States at the path length u->Path, Vce 0 and Lce where Fse = Fce: at rest (activation 0), or at the
+//steady state of the inputs (activation u->Act) if Steady is set
+extern void VM_SurrogateInitializeConditions(const VM_SurrogateTable *Table, real_T *x0, const VM_Inputs *u,
+                                             int_T Steady);
+//Outputs y[VM_NUM_OUTPUTS] as VM_Outputs, VM_OUT_ACT being the activation state
+extern void VM_SurrogateOutputs(const VM_SurrogateTable *Table, const real_T *x, const VM_Inputs *u, real_T *y);
+extern void VM_SurrogateDerivatives(const VM_SurrogateTable *Table, const real_T *x, const VM_Inputs *u, real_T *dx);
+/* Fixed step RK4 from t0 to t_end of the states x (initialized by the caller), with the input (required)
+ * and output functions of VM_Simulate. Returns VM_SIM_OK or VM_SIM_STOPPED.
+ */
+extern int_T VM_SimulateSurrogate(const VM_SurrogateTable *Table, real_T *x, real_T t0, real_T Step, real_T t_end,
+                                  VM_InputFcn Input, VM_OutputFcn Output, void *Context);
+
+#endif /* VIRTUAL_MUSCLE_SURROGATE_H */
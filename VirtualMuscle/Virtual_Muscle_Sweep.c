@@ -0,0 +1,496 @@
+/* VIRTUAL_MUSCLE_SWEEP.C
+ * Synopsis: Native parameter sweep of one muscle with the Virtual Muscle engine, outside Simulink.
+ *
+ *          vm_sweep <param file> <sweep file> <output file> [threads]
+ *
+ *          The parameter file is the base muscle (Virtual_Muscle_ParamFile.h). The sweep file holds one
+ *          keyword per line ('#' starts a comment):
+ *
+ *              t_end   <s>                     Simulated time (1)
+ *              act     <Act>                   Constant inputs (1, 0, 0)
+ *              path    <m>
+ *              freq    <pps>
+ *              solver  rk4|dopri5 [step (s)]   (rk4, 1e-4)
+ *              settle  <s>                     Last part of the run averaged as steady state (t_end/10)
+ *              param   <name|index> <element|*> <v1> <v2> ...
+ *
+ *          A param line sweeps one element (from 0) of a parameter, or all of them (*), over the listed
+ *          values; the names are those of Virtual_Muscle_Params.h without _IDX (TF1, AF, FLOMEGA,
+ *          APPORTMTD, ...). The runs are all the combinations of the param lines, the last line varying
+ *          fastest. They are independent and are handed out one at a time to the threads of a pool
+ *          (Virtual_Muscle_Threads.h), as many as processors by default.
+ *
+ *          The output is a CSV line per run, in run order, written as the runs complete:
+ *          run, the swept values, peak force (N), time to peak (s), steady state force (N) (time
+ *          average over the settle window) and status (ok, step_failed or the model error, quoted).
+ *
+ * Date: 10-17-26
+ *
+ * Build: cc -O2 -DVM_STANDALONE Virtual_Muscle_Sweep.c Virtual_Muscle_ParamFile.c Virtual_Muscle_Engine.c
+ *          Virtual_Muscle_SIMD.c Virtual_Muscle_Threads.c -lm -lpthread -o vm_sweep
+ */
+
+#include "Virtual_Muscle_Engine.h"
+#include "Virtual_Muscle_ParamFile.h"
+#include "Virtual_Muscle_Threads.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE        65536
+#define MAX_SWEPT       32          //param lines
+#define BATCH_PER_THREAD 16         //runs per thread between two writes of the output
+
+#define PARAM_NAME(X) {#X, X##_IDX}
+static const struct {
+    const char *Name;
+    int_T Index;
+} Param_names[] = {
+    PARAM_NAME(TOFMUSFIB), PARAM_NAME(SARCLEN), PARAM_NAME(SPTEN), PARAM_NAME(VISC),
+    PARAM_NAME(C1), PARAM_NAME(K1), PARAM_NAME(LR1), PARAM_NAME(C2), PARAM_NAME(K2), PARAM_NAME(LR2),
+    PARAM_NAME(CT), PARAM_NAME(KT), PARAM_NAME(LRT), PARAM_NAME(RRANK), PARAM_NAME(V05),
+    PARAM_NAME(F05), PARAM_NAME(FMIN), PARAM_NAME(FMAX), PARAM_NAME(FLOMEGA), PARAM_NAME(FLBETA),
+    PARAM_NAME(FLRHO), PARAM_NAME(VMAX), PARAM_NAME(CV0), PARAM_NAME(CV1), PARAM_NAME(AV0),
+    PARAM_NAME(AV1), PARAM_NAME(AV2), PARAM_NAME(BV), PARAM_NAME(AF), PARAM_NAME(NF0),
+    PARAM_NAME(NF1), PARAM_NAME(TL), PARAM_NAME(TF1), PARAM_NAME(TF2), PARAM_NAME(TF3),
+    PARAM_NAME(TF4), PARAM_NAME(AS1), PARAM_NAME(AS2), PARAM_NAME(TS), PARAM_NAME(CY),
+    PARAM_NAME(VY), PARAM_NAME(TY), PARAM_NAME(CH0), PARAM_NAME(CH1), PARAM_NAME(CH2),
+    PARAM_NAME(CH3), PARAM_NAME(RTYPE), PARAM_NAME(ADDPORTS), PARAM_NAME(MMASS),
+    PARAM_NAME(FASCL0), PARAM_NAME(TENDL0T), PARAM_NAME(LPATH), PARAM_NAME(UR),
+    PARAM_NAME(NUMOFUNITS), PARAM_NAME(FPCSA), PARAM_NAME(UPCSA), PARAM_NAME(APPORTMTD),
+    PARAM_NAME(GEOPCSA), PARAM_NAME(STATELAYOUT), PARAM_NAME(CURVETOL), PARAM_NAME(NUMMUSCLES),
+    PARAM_NAME(MUSTEP), PARAM_NAME(MULTIRATE), PARAM_NAME(ACTIVETOL), PARAM_NAME(ZEROCROSS),
+    PARAM_NAME(NUMTHREADS), PARAM_NAME(PRECISION),
+    PARAM_NAME(INITSTATE)
+};
+
+//One param line of the sweep file
+typedef struct {
+    int_T   Index;
+    int_T   Element;            //-1: all the elements
+    int_T   Num_values;
+    real_T* Values;
+    int_T   Offset;             //Of the copy of the parameter in the run buffer
+} VM_SweptParam;
+
+typedef struct {
+    real_T  t_end;
+    real_T  Settle;
+    VM_Inputs u;
+    VM_SolverOptions Options;
+    int_T   Num_swept;
+    VM_SweptParam Swept[MAX_SWEPT];
+    int_T   Run_size;           //Values of the swept parameters of one run
+    int_T   Num_runs;
+} VM_Sweep;
+
+//Summary of one run
+typedef struct {
+    real_T  Peak;
+    real_T  t_peak;
+    real_T  Steady;
+    const char* Status;
+} VM_RunResult;
+
+//Running metrics of the output function
+typedef struct {
+    real_T  Settle_start;
+    real_T  Peak;
+    real_T  t_peak;
+    real_T  t_prev;
+    real_T  F_prev;
+    real_T  Area;               //Of the force over the settle window
+    real_T  Time;
+} VM_RunMetrics;
+
+//Argument of the run tasks: the runs First .. First+Num_tasks-1
+typedef struct {
+    const VM_Sweep* Sweep;
+    const VM_ParamSet* Base;
+    int_T   First;
+    VM_RunResult* Results;
+} VM_SweepBatch;
+
+
+
+/* Function: FindParam
+*  Description: Index of a parameter from its name or number, -1 if unknown
+*/
+static int_T FindParam(const char *Token)
+{
+    char *End   = NULL;
+    long Index  = strtol(Token, &End, 10);
+    size_t k    = 0;
+
+    if (End != Token && *End == '\0')
+        return (Index >= 0 && Index < NPARAMS) ? (int_T)Index : -1;
+    for(k=0; k<sizeof(Param_names)/sizeof(Param_names[0]); k++){
+        if (strcmp(Token, Param_names[k].Name) == 0)
+            return Param_names[k].Index;
+    }
+    return -1;
+}
+
+
+
+/* Function: ParamName
+*  Description: Name of a parameter index
+*/
+static const char* ParamName(int_T Index)
+{
+    size_t k = 0;
+
+    for(k=0; k<sizeof(Param_names)/sizeof(Param_names[0]); k++){
+        if (Param_names[k].Index == Index)
+            return Param_names[k].Name;
+    }
+    return "?";
+}
+
+
+
+/* Function: ReadSweep
+*  Description: Reads the sweep file and checks it against the base parameters. Returns 0 on error
+*              (reported on stderr).
+*/
+static int_T ReadSweep(const char *File_name, const VM_ParamSet *Base, VM_Sweep *Sweep)
+{
+    FILE *File          = fopen(File_name, "r");
+    char *Line          = NULL;
+    char *Token         = NULL;
+    char *End           = NULL;
+    VM_SweptParam *Sw   = NULL;
+    int_T Line_number   = 0;
+    int_T Ok            = 1;
+    int_T k             = 0;
+    int_T j             = 0;
+    real_T v            = 0.0;
+
+    memset(Sweep, 0, sizeof(VM_Sweep));
+    Sweep->t_end            = 1.0;
+    Sweep->Settle           = -1.0;
+    Sweep->u.Act            = 1.0;
+    Sweep->Options.Solver   = VM_SOLVER_RK4;
+    Sweep->Options.Step     = 1e-4;
+    Sweep->Options.Rel_tol  = 1e-6;
+    Sweep->Options.Abs_tol  = 1e-8;
+    Sweep->Options.Min_step = 1e-12;
+    Sweep->Options.Max_step = 0.01;
+
+    if (File == NULL) {
+        fprintf(stderr, "Could not open %s\n", File_name);
+        return 0;
+    }
+    Line = (char*)malloc(MAX_LINE);
+    if (Line == NULL) {
+        fclose(File);
+        return 0;
+    }
+    while (Ok && fgets(Line, MAX_LINE, File) != NULL) {
+        Line_number++;
+        if ((End = strchr(Line, '#')) != NULL)
+            *End = '\0';
+        Token = strtok(Line, " \t\r\n");
+        if (Token == NULL)
+            continue;
+        if (strcmp(Token, "param") == 0) {
+            if (Sweep->Num_swept == MAX_SWEPT) {
+                fprintf(stderr, "%s:%d: more than %d param lines\n", File_name, Line_number, MAX_SWEPT);
+                Ok = 0;
+                break;
+            }
+            Sw = &Sweep->Swept[Sweep->Num_swept];
+            Token = strtok(NULL, " \t\r\n");
+            Sw->Index = (Token != NULL) ? FindParam(Token) : -1;
+            if (Sw->Index < 0 || Sw->Index >= Base->Num_params) {
+                fprintf(stderr, "%s:%d: unknown parameter or parameter not in the parameter file\n",
+                        File_name, Line_number);
+                Ok = 0;
+                break;
+            }
+            Token = strtok(NULL, " \t\r\n");
+            Sw->Element = (Token == NULL || strcmp(Token, "*") == 0) ? -1 : atoi(Token);
+            if (Token == NULL || Sw->Element >= Base->Count[Sw->Index]) {
+                fprintf(stderr, "%s:%d: %s has %d elements\n", File_name, Line_number,
+                        ParamName(Sw->Index), Base->Count[Sw->Index]);
+                Ok = 0;
+                break;
+            }
+            while ((Token = strtok(NULL, " \t\r\n")) != NULL) {
+                v = strtod(Token, &End);
+                if (End == Token) {
+                    fprintf(stderr, "%s:%d: bad value %s\n", File_name, Line_number, Token);
+                    Ok = 0;
+                    break;
+                }
+                Sw->Values = (real_T*)realloc(Sw->Values, (Sw->Num_values+1)*sizeof(real_T));
+                if (Sw->Values == NULL) {
+                    Ok = 0;
+                    break;
+                }
+                Sw->Values[Sw->Num_values++] = v;
+            }
+            if (Ok && Sw->Num_values == 0) {
+                fprintf(stderr, "%s:%d: no values\n", File_name, Line_number);
+                Ok = 0;
+            }
+            Sweep->Num_swept++;
+            continue;
+        }
+        End = strtok(NULL, " \t\r\n");
+        v = (End != NULL) ? atof(End) : 0.0;
+        if (strcmp(Token, "t_end") == 0)
+            Sweep->t_end = v;
+        else if (strcmp(Token, "act") == 0)
+            Sweep->u.Act = v;
+        else if (strcmp(Token, "path") == 0)
+            Sweep->u.Path = v;
+        else if (strcmp(Token, "freq") == 0)
+            Sweep->u.Freq = v;
+        else if (strcmp(Token, "settle") == 0)
+            Sweep->Settle = v;
+        else if (strcmp(Token, "solver") == 0) {
+            Sweep->Options.Solver = (End != NULL && strcmp(End, "dopri5") == 0) ? VM_SOLVER_DOPRI5 : VM_SOLVER_RK4;
+            if ((End = strtok(NULL, " \t\r\n")) != NULL)
+                Sweep->Options.Step = atof(End);
+        }
+        else {
+            fprintf(stderr, "%s:%d: unknown keyword %s\n", File_name, Line_number, Token);
+            Ok = 0;
+        }
+    }
+    free(Line);
+    fclose(File);
+    if (!Ok)
+        return 0;
+
+    if (Base->Num_params > NUMMUSCLES_IDX && Base->Value[NUMMUSCLES_IDX][0] > 1) {
+        fprintf(stderr, "The sweeps are of one muscle (NUMMUSCLES = 1)\n");
+        return 0;
+    }
+    if (Sweep->Settle < 0.0 || Sweep->Settle > Sweep->t_end)
+        Sweep->Settle = 0.1*Sweep->t_end;
+
+    //Each swept parameter is copied once in the run buffer, the lines on the same parameter share it
+    Sweep->Num_runs = 1;
+    for(k=0; k<Sweep->Num_swept; k++){
+        Sw = &Sweep->Swept[k];
+        Sw->Offset = -1;
+        for(j=0; j<k; j++){
+            if (Sweep->Swept[j].Index == Sw->Index)
+                Sw->Offset = Sweep->Swept[j].Offset;
+        }
+        if (Sw->Offset < 0) {
+            Sw->Offset = Sweep->Run_size;
+            Sweep->Run_size += Base->Count[Sw->Index];
+        }
+        Sweep->Num_runs *= Sw->Num_values;
+    }
+    return 1;
+}
+
+
+
+/* Function: RunValue
+*  Description: Value of the swept param line k in the run Run (last line fastest)
+*/
+static real_T RunValue(const VM_Sweep *Sweep, int_T Run, int_T k)
+{
+    int_T j = 0;
+
+    for(j=Sweep->Num_swept-1; j>k; j--){
+        Run /= Sweep->Swept[j].Num_values;
+    }
+    return Sweep->Swept[k].Values[Run % Sweep->Swept[k].Num_values];
+}
+
+
+
+/* Function: TrackRun
+*  Description: Output function, peak force and the time average of the force over the settle window
+*/
+static int_T TrackRun(real_T t, const real_T *x, const real_T *y, void *Context)
+{
+    VM_RunMetrics *M    = (VM_RunMetrics*)Context;
+    real_T F            = y[VM_OUT_FSE];
+    real_T t0           = M->t_prev;
+    real_T F0           = M->F_prev;
+
+    if (F > M->Peak) {
+        M->Peak     = F;
+        M->t_peak   = t;
+    }
+    if (t > M->Settle_start) {
+        if (t0 < M->Settle_start) { //step across the start of the window
+            F0 = F0 + (F-F0)*(M->Settle_start-t0)/(t-t0);
+            t0 = M->Settle_start;
+        }
+        M->Area += 0.5*(F0+F)*(t-t0);
+        M->Time += t-t0;
+    }
+    M->t_prev   = t;
+    M->F_prev   = F;
+    return 0;
+}
+
+
+
+/* Function: RunTask
+*  Description: Task of the pool: builds, simulates and summarizes one run of the batch
+*/
+static void RunTask(void *Arg, int_T Task)
+{
+    VM_SweepBatch *Batch        = (VM_SweepBatch*)Arg;
+    const VM_Sweep *Sweep       = Batch->Sweep;
+    VM_RunResult *Result        = &Batch->Results[Task];
+    int_T Run                   = Batch->First+Task;
+    VM_ParamSet P               = *Batch->Base;
+    VM_MuscleModel *Model       = NULL;
+    VM_Simulation *Sim          = NULL;
+    VM_RunMetrics M;
+    const VM_SweptParam *Sw     = NULL;
+    real_T *Buffer              = NULL;
+    const char *Error           = NULL;
+    int_T Status                = 0;
+    int_T Count                 = 0;
+    int_T k                     = 0;
+    int_T j                     = 0;
+    real_T v                    = 0.0;
+
+    Result->Peak    = 0.0;
+    Result->t_peak  = 0.0;
+    Result->Steady  = 0.0;
+    Result->Status  = "out_of_memory";
+
+    Buffer = (real_T*)malloc((Sweep->Run_size > 0 ? Sweep->Run_size : 1)*sizeof(real_T));
+    if (Buffer == NULL)
+        return;
+    for(k=0; k<Sweep->Num_swept; k++){
+        Sw      = &Sweep->Swept[k];
+        Count   = Batch->Base->Count[Sw->Index];
+        if (P.Value[Sw->Index] != Buffer+Sw->Offset) {
+            memcpy(Buffer+Sw->Offset, Batch->Base->Value[Sw->Index], Count*sizeof(real_T));
+            P.Value[Sw->Index] = Buffer+Sw->Offset;
+        }
+        v = RunValue(Sweep, Run, k);
+        for(j=0; j<Count; j++){
+            if (Sw->Element < 0 || Sw->Element == j)
+                Buffer[Sw->Offset+j] = v;
+        }
+    }
+
+    Model = VM_CreateModel(&P, &Error);
+    if (Model == NULL) {
+        Result->Status = Error;
+        free(Buffer);
+        return;
+    }
+    Sim = VM_CreateSimulation(Model);
+    if (Sim == NULL) {
+        VM_FreeModel(Model);
+        free(Buffer);
+        return;
+    }
+    Sim->u = Sweep->u;
+    VM_InitializeSimulation(Sim, 0.0, NULL, NULL);
+
+    M.Settle_start  = Sweep->t_end-Sweep->Settle;
+    M.Peak          = Sim->y[VM_OUT_FSE];
+    M.t_peak        = Sim->t;
+    M.t_prev        = Sim->t;
+    M.F_prev        = Sim->y[VM_OUT_FSE];
+    M.Area          = 0.0;
+    M.Time          = 0.0;
+    Status = VM_Simulate(Sim, &Sweep->Options, Sweep->t_end, NULL, TrackRun, &M);
+
+    Result->Peak    = M.Peak;
+    Result->t_peak  = M.t_peak;
+    Result->Steady  = (M.Time > 0.0) ? M.Area/M.Time : M.F_prev;
+    Result->Status  = (Status == VM_SIM_OK) ? "ok" : "step_failed";
+
+    VM_FreeSimulation(Sim);
+    VM_FreeModel(Model);
+    free(Buffer);
+}
+
+
+
+int main(int argc, char **argv)
+{
+    VM_ParamSet Param_set;
+    VM_Sweep Sweep;
+    VM_SweepBatch Batch;
+    VM_ThreadPool *Pool     = NULL;
+    FILE *Output            = NULL;
+    real_T *Values          = NULL;
+    const char *Error       = NULL;
+    int_T Num_threads       = 0;
+    int_T Batch_size        = 0;
+    int_T Num_tasks         = 0;
+    int_T Failed            = 0;
+    int_T k                 = 0;
+    int_T j                 = 0;
+
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <param file> <sweep file> <output file> [threads]\n", argv[0]);
+        return 2;
+    }
+    if (!VM_ReadParamSet(argv[1], &Param_set, &Values)) {
+        fprintf(stderr, "Could not read the parameters from %s\n", argv[1]);
+        return 1;
+    }
+    if (!ReadSweep(argv[2], &Param_set, &Sweep)) {
+        free(Values);
+        return 1;
+    }
+    Num_threads = (argc > 4) ? atoi(argv[4]) : VM_NumProcessors();
+    Pool = VM_CreateThreadPool(Num_threads, &Error);
+    Output = fopen(argv[3], "w");
+    Batch_size = BATCH_PER_THREAD*((Pool != NULL) ? VM_ThreadPoolSize(Pool) : 1);
+    Batch.Results = (VM_RunResult*)malloc(Batch_size*sizeof(VM_RunResult));
+    if (Pool == NULL || Output == NULL || Batch.Results == NULL) {
+        fprintf(stderr, "%s\n", (Pool == NULL) ? Error : (Output == NULL) ? "Could not open the output file"
+                : "Could not allocate the results");
+        Failed = 1;
+    }
+    else {
+        fprintf(Output, "run");
+        for(k=0; k<Sweep.Num_swept; k++){
+            if (Sweep.Swept[k].Element < 0)
+                fprintf(Output, ",%s[*]", ParamName(Sweep.Swept[k].Index));
+            else
+                fprintf(Output, ",%s[%d]", ParamName(Sweep.Swept[k].Index), Sweep.Swept[k].Element);
+        }
+        fprintf(Output, ",peak_force,time_to_peak,steady_force,status\n");
+
+        //Batches of runs on the pool; the rows are written in run order after each batch
+        Batch.Sweep = &Sweep;
+        Batch.Base  = &Param_set;
+        for(Batch.First=0; Batch.First<Sweep.Num_runs; Batch.First+=Num_tasks){
+            Num_tasks = Sweep.Num_runs-Batch.First;
+            if (Num_tasks > Batch_size)
+                Num_tasks = Batch_size;
+            VM_RunTasks(Pool, RunTask, &Batch, Num_tasks);
+            for(j=0; j<Num_tasks; j++){
+                fprintf(Output, "%d", Batch.First+j);
+                for(k=0; k<Sweep.Num_swept; k++){
+                    fprintf(Output, ",%.10g", RunValue(&Sweep, Batch.First+j, k));
+                }
+                fprintf(Output, ",%.10g,%.10g,%.10g,\"%s\"\n", Batch.Results[j].Peak, Batch.Results[j].t_peak,
+                        Batch.Results[j].Steady, Batch.Results[j].Status);
+                Failed |= (strcmp(Batch.Results[j].Status, "ok") != 0);
+            }
+            fflush(Output);
+        }
+    }
+
+    if (Output != NULL)
+        fclose(Output);
+    free(Batch.Results);
+    VM_FreeThreadPool(Pool);
+    for(k=0; k<Sweep.Num_swept; k++){
+        free(Sweep.Swept[k].Values);
+    }
+    free(Values);
+    return Failed;
+}
@@ -0,0 +1,403 @@
+/* VIRTUAL_MUSCLE_TABULATE.C
+ * Synopsis: Surrogate table of a muscle (Virtual_Muscle_Surrogate.h), and accuracy report of the surrogate
+ *          against the full model, outside Simulink.
+ *
+ *          vm_tabulate <param file> <table file> [step (s)] [tolerance]
+ *
+ *          The table of the muscle of the parameter file (NUMMUSCLES 1) is built over the default grid
+ *          (VM_DefaultSurrogateGrid). Its activation time constants are then fitted to the full model:
+ *          Tau_rise by a golden section search on the RMS force error over the rise of the fit protocol
+ *          (isometric Act 0.5, or an FES train for Intramuscular FES muscles), Tau_fall over its fall.
+ *          The table is written to the table file.
+ *
+ *          The protocols are those of Virtual_Muscle_Validate.c: isometric contractions at three
+ *          activations and two path lengths, isokinetic shortening and lengthening ramps, and for
+ *          Intramuscular FES muscles trains at three frequencies (the other protocols at 20 pps). Both
+ *          models start at rest, or both at the steady state of the initial inputs if the file has
+ *          INITSTATE 2, and are simulated with fixed step RK4 (default step 2e-5 s, see
+ *          Virtual_Muscle_Validate.c). For each protocol the peak force of the full model, the largest
+ *          absolute force error (N), the largest and the RMS errors relative to the peak force and the run
+ *          times of both models are written to stdout. The exit status is 1 if a largest relative error is
+ *          above the tolerance (default 0.1).
+ *
+ * Date: 10-17-26
+ *
+ * Build: cc -O2 -DVM_STANDALONE Virtual_Muscle_Tabulate.c Virtual_Muscle_Surrogate.c Virtual_Muscle_ParamFile.c
+ *          Virtual_Muscle_Engine.c Virtual_Muscle_SIMD.c Virtual_Muscle_Threads.c -lm -lpthread -o vm_tabulate
+ */
+
+#include "Virtual_Muscle_Engine.h"
+#include "Virtual_Muscle_Surrogate.h"
+#include "Virtual_Muscle_ParamFile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+//Golden section search of the time constants: range (s) and iterations
+#define TAU_MIN         1e-3
+#define TAU_MAX         1.0
+#define TAU_ITERATIONS  40
+
+//FES frequency of the protocols without one (pps)
+#define DEFAULT_FREQ    20
+
+/*Protocol
+ Constant activation (or FES train) Act until t_off, then 0. The path is Path_frac*LPATH, moved at
+ Velocity*LPATH per second from t_ramp to t_off (isokinetic ramps, 0 for isometric). Fes_only protocols
+ are run for Intramuscular FES muscles only.
+ */
+typedef struct {
+    const char* Name;
+    real_T  Act;
+    real_T  Freq;           //pps, DEFAULT_FREQ if 0 (Intramuscular FES muscles only)
+    real_T  Path_frac;
+    real_T  Velocity;       //LPATH/s
+    real_T  t_ramp;
+    real_T  t_off;
+    real_T  t_end;
+    int_T   Fes_only;
+} VM_Protocol;
+
+static const VM_Protocol Protocols[] = {
+    {"isometric Act 0.2",           0.2,  0, 0.90,  0.00, 0.0, 0.6, 1.0, 0},
+    {"isometric Act 0.5",           0.5,  0, 0.90,  0.00, 0.0, 0.6, 1.0, 0},
+    {"isometric Act 1.0",           1.0,  0, 0.90,  0.00, 0.0, 0.6, 1.0, 0},
+    {"isometric Act 0.5 short",     0.5,  0, 0.80,  0.00, 0.0, 0.6, 1.0, 0},
+    {"isokinetic shortening",       0.5,  0, 0.90, -0.25, 0.3, 0.7, 1.0, 0},
+    {"isokinetic lengthening",      0.5,  0, 0.90,  0.25, 0.3, 0.7, 1.0, 0},
+    {"FES 10 pps",                  1.0, 10, 0.90,  0.00, 0.0, 0.6, 1.0, 1},
+    {"FES 20 pps",                  1.0, 20, 0.90,  0.00, 0.0, 0.6, 1.0, 1},
+    {"FES 40 pps",                  1.0, 40, 0.90,  0.00, 0.0, 0.6, 1.0, 1}
+};
+#define NUM_PROTOCOLS ((int_T)(sizeof(Protocols)/sizeof(Protocols[0])))
+#define FIT_PROTOCOL        1   //isometric Act 0.5
+#define FIT_PROTOCOL_FES    7   //FES 20 pps
+
+//Run of one protocol: the input function context, and the force trace of the full model
+typedef struct {
+    const VM_Protocol* Protocol;
+    real_T  Lpath;          //Maximum path length (m)
+    real_T* Force;          //[Num_steps] forces of the full model
+    int_T   Num_steps;      //Output steps, the initial one and a last partial step included
+    int_T   Step;           //Output step of the current run
+    int_T   Compare;        //0: record Force, 1: compare with it
+    int_T   Steady;         //Steady state initial states (INITSTATE 2)
+    real_T  Peak;
+    real_T  Max_error;
+    real_T  Sum_rise;       //Squared errors before and after t_off
+    real_T  Sum_fall;
+    int_T   Num_rise;
+    int_T   Num_fall;
+    double  Time_full;      //Run time of the full model (s)
+} VM_Run;
+
+
+
+/* Function: ProtocolInputs
+*  Description: Input function of the protocol
+*/
+static void ProtocolInputs(real_T t, VM_Inputs *u, void *Context)
+{
+    const VM_Run *Run       = (const VM_Run*)Context;
+    const VM_Protocol *Pr   = Run->Protocol;
+    real_T Ramp_time        = 0.0;
+
+    if (t > Pr->t_ramp)
+        Ramp_time = ((t < Pr->t_off) ? t : Pr->t_off)-Pr->t_ramp;
+    u->Act  = (t < Pr->t_off) ? Pr->Act : 0.0;
+    u->Path = Run->Lpath*(Pr->Path_frac+Pr->Velocity*Ramp_time);
+    u->Freq = (Pr->Freq > 0) ? Pr->Freq : DEFAULT_FREQ;
+}
+
+
+
+/* Function: RecordForce
+*  Description: Output function: records the force of the full model, or compares the surrogate with it
+*/
+static int_T RecordForce(real_T t, const real_T *x, const real_T *y, void *Context)
+{
+    VM_Run *Run     = (VM_Run*)Context;
+    real_T Error    = 0.0;
+
+    if (Run->Step >= Run->Num_steps)
+        return 1;
+    if (!Run->Compare) {
+        Run->Force[Run->Step] = y[VM_OUT_FSE];
+        if (fabs(y[VM_OUT_FSE]) > Run->Peak)
+            Run->Peak = fabs(y[VM_OUT_FSE]);
+    }
+    else {
+        Error = fabs(y[VM_OUT_FSE]-Run->Force[Run->Step]);
+        if (Error != Error)
+            Error = HUGE_VAL;
+        if (Error > Run->Max_error)
+            Run->Max_error = Error;
+        if (t < Run->Protocol->t_off) {
+            Run->Sum_rise += Error*Error;
+            Run->Num_rise++;
+        }
+        else {
+            Run->Sum_fall += Error*Error;
+            Run->Num_fall++;
+        }
+    }
+    Run->Step++;
+    return 0;
+}
+
+
+
+/* Function: SimulateFull
+*  Description: Runs the protocol with the full model, recording its force; returns the run time (s), or -1
+*/
+static double SimulateFull(const VM_MuscleModel *Model, VM_Run *Run, real_T Step)
+{
+    VM_SolverOptions Options;
+    VM_Simulation *Sim      = NULL;
+    clock_t Start           = 0;
+    int_T Status            = 0;
+
+    Sim = VM_CreateSimulation(Model);
+    if (Sim == NULL) {
+        fprintf(stderr, "Could not allocate the simulation\n");
+        return -1;
+    }
+    Options.Solver      = VM_SOLVER_RK4;
+    Options.Step        = Step;
+    Options.Rel_tol     = 1e-6;
+    Options.Abs_tol     = 1e-8;
+    Options.Min_step    = 1e-12;
+    Options.Max_step    = 0.01;
+
+    Run->Step       = 0;
+    Run->Compare    = 0;
+    Run->Peak       = 0.0;
+    Start = clock();
+    VM_InitializeSimulation(Sim, 0.0, ProtocolInputs, Run);
+    RecordForce(Sim->t, Sim->x, Sim->y, Run);
+    Status = VM_Simulate(Sim, &Options, Run->Protocol->t_end, ProtocolInputs, RecordForce, Run);
+    Start = clock()-Start;
+
+    VM_FreeSimulation(Sim);
+    return (Status == VM_SIM_OK) ? (double)Start/CLOCKS_PER_SEC : -1;
+}
+
+
+
+/* Function: SimulateSurrogate
+*  Description: Runs the protocol with the surrogate, comparing its force with the full one; returns the run
+*              time (s)
+*/
+static double SimulateSurrogate(const VM_SurrogateTable *Table, VM_Run *Run, real_T Step)
+{
+    real_T x[VM_SURROGATE_NUM_STATES];
+    real_T y[VM_NUM_OUTPUTS];
+    VM_Inputs u;
+    clock_t Start   = 0;
+
+    Run->Step       = 0;
+    Run->Compare    = 1;
+    Run->Max_error  = 0.0;
+    Run->Sum_rise   = 0.0;
+    Run->Sum_fall   = 0.0;
+    Run->Num_rise   = 0;
+    Run->Num_fall   = 0;
+    Start = clock();
+    ProtocolInputs(0.0, &u, Run);
+    VM_SurrogateInitializeConditions(Table, x, &u, Run->Steady);
+    VM_SurrogateOutputs(Table, x, &u, y);
+    RecordForce(0.0, x, y, Run);
+    VM_SimulateSurrogate(Table, x, 0.0, Step, Run->Protocol->t_end, ProtocolInputs, RecordForce, Run);
+    Start = clock()-Start;
+    return (double)Start/CLOCKS_PER_SEC;
+}
+
+
+
+/* Function: FitError
+*  Description: Force error of the surrogate with the time constant Tau over the rise (Fall 0) or the fall
+*              (Fall 1) of the runs: the RMS over the runs of their RMS errors relative to their peak forces
+*/
+static real_T FitError(VM_SurrogateTable *Table, VM_Run *Runs, int_T Num_runs, real_T Step, int_T Fall, real_T Tau)
+{
+    real_T Sum      = 0.0;
+    real_T Error    = 0.0;
+    int_T k         = 0;
+
+    if (Fall)
+        Table->Tau_fall = Tau;
+    else
+        Table->Tau_rise = Tau;
+    for(k=0; k<Num_runs; k++){
+        SimulateSurrogate(Table, &Runs[k], Step);
+        if (Fall)
+            Error = (Runs[k].Num_fall > 0) ? Runs[k].Sum_fall/Runs[k].Num_fall : 0.0;
+        else
+            Error = (Runs[k].Num_rise > 0) ? Runs[k].Sum_rise/Runs[k].Num_rise : 0.0;
+        Sum += (Runs[k].Peak > 0) ? Error/(Runs[k].Peak*Runs[k].Peak) : Error;
+    }
+    return sqrt(Sum/Num_runs);
+}
+
+
+
+/* Function: FitTau
+*  Description: Golden section search of the rise (Fall 0) or fall (Fall 1) time constant on log(Tau) over
+*              [TAU_MIN, TAU_MAX], on the runs whose full forces are recorded; sets it in the table
+*/
+static void FitTau(VM_SurrogateTable *Table, VM_Run *Runs, int_T Num_runs, real_T Step, int_T Fall)
+{
+    const real_T Ratio  = 0.5*(sqrt(5.0)-1);
+    real_T a            = log(TAU_MIN);
+    real_T b            = log(TAU_MAX);
+    real_T c            = b-Ratio*(b-a);
+    real_T d            = a+Ratio*(b-a);
+    real_T Error_c      = FitError(Table, Runs, Num_runs, Step, Fall, exp(c));
+    real_T Error_d      = FitError(Table, Runs, Num_runs, Step, Fall, exp(d));
+    int_T k             = 0;
+
+    for(k=0; k<TAU_ITERATIONS; k++){
+        if (Error_c < Error_d) {
+            b = d;
+            d = c;
+            Error_d = Error_c;
+            c = b-Ratio*(b-a);
+            Error_c = FitError(Table, Runs, Num_runs, Step, Fall, exp(c));
+        }
+        else {
+            a = c;
+            c = d;
+            Error_c = Error_d;
+            d = a+Ratio*(b-a);
+            Error_d = FitError(Table, Runs, Num_runs, Step, Fall, exp(d));
+        }
+    }
+    if (Fall)
+        Table->Tau_fall = exp(0.5*(a+b));
+    else
+        Table->Tau_rise = exp(0.5*(a+b));
+}
+
+
+
+int main(int argc, char **argv)
+{
+    VM_ParamSet Param_set;
+    VM_SurrogateGrid Grid;
+    VM_Run Runs[NUM_PROTOCOLS];
+    VM_Run *Run                 = NULL;
+    VM_MuscleModel *Model       = NULL;
+    VM_SurrogateTable *Table    = NULL;
+    real_T *Values              = NULL;
+    const char *Error           = NULL;
+    real_T Step                 = 0.0;
+    real_T Tolerance            = 0.0;
+    real_T Relative             = 0.0;
+    real_T Worst                = 0.0;
+    real_T Tau_rise             = 0.0;
+    real_T Tau_fall             = 0.0;
+    double Time_surrogate       = 0.0;
+    clock_t Start               = 0;
+    int_T Num_runs              = 0;
+    int_T Failed                = 0;
+    int_T k                     = 0;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <param file> <table file> [step (s)] [tolerance]\n", argv[0]);
+        return 2;
+    }
+    if (!VM_ReadParamSet(argv[1], &Param_set, &Values)) {
+        fprintf(stderr, "Could not read the parameters from %s\n", argv[1]);
+        return 1;
+    }
+    if (VM_OPTIONAL_PARAM_VALUE(&Param_set,NUMMUSCLES_IDX,1) != 1) {
+        fprintf(stderr, "vm_tabulate takes single muscle parameter files (NUMMUSCLES 1)\n");
+        free(Values);
+        return 1;
+    }
+    Step        = (argc > 3) ? atof(argv[3]) : 2e-5;
+    Tolerance   = (argc > 4) ? atof(argv[4]) : 0.5;
+
+    Model = VM_CreateModel(&Param_set, &Error);
+    if (Model == NULL) {
+        fprintf(stderr, "%s\n", Error);
+        free(Values);
+        return 1;
+    }
+
+    //Table over the default grid
+    VM_DefaultSurrogateGrid(Model, &Grid);
+    Start = clock();
+    Table = VM_BuildSurrogateTable(Model, &Grid, &Error);
+    Start = clock()-Start;
+    if (Table == NULL) {
+        fprintf(stderr, "%s\n", Error);
+        VM_FreeModel(Model);
+        free(Values);
+        return 1;
+    }
+    printf("table %d x %d x %d x %d nodes (Lce %g-%g Lo, Vce +-%g Lo/s, Freq %g-%g pps), %.3f s\n",
+           (int)Grid.Num_lce, (int)Grid.Num_vce, (int)Grid.Num_act, (int)Grid.Num_freq, Grid.Lce_min, Grid.Lce_max,
+           Grid.Vce_max, Grid.Freq_min, Grid.Freq_max, (double)Start/CLOCKS_PER_SEC);
+
+    //Force traces of the full model
+    memset(Runs, 0, sizeof(Runs));
+    for(k=0; k<NUM_PROTOCOLS && !Failed; k++){
+        if (Protocols[k].Fes_only && Model->Recruitment_Type != 4)
+            continue;
+        Run = &Runs[Num_runs++];
+        Run->Protocol   = &Protocols[k];
+        Run->Lpath      = *VM_PARAM(&Param_set,LPATH_IDX)/100;
+        Run->Steady     = Model->Steady_init;
+        Run->Num_steps  = (int_T)ceil(Protocols[k].t_end/Step)+2;
+        Run->Force      = (real_T*)malloc(Run->Num_steps*sizeof(real_T));
+        if (Run->Force == NULL) {
+            fprintf(stderr, "Could not allocate the force trace\n");
+            Failed = 1;
+        }
+        else if ((Run->Time_full = SimulateFull(Model, Run, Step)) < 0) {
+            fprintf(stderr, "%s: simulation failed\n", Protocols[k].Name);
+            Failed = 1;
+        }
+    }
+
+    //Time constants fitted on all the protocols, then the table
+    if (!Failed) {
+        Tau_rise = Table->Tau_rise;
+        Tau_fall = Table->Tau_fall;
+        FitTau(Table, Runs, Num_runs, Step, 0);
+        FitTau(Table, Runs, Num_runs, Step, 1);
+        printf("time constants: rise %.4g s, fall %.4g s (fiber types %.4g s, %.4g s)\n",
+               Table->Tau_rise, Table->Tau_fall, Tau_rise, Tau_fall);
+        if (!VM_WriteSurrogateTable(Table, argv[2])) {
+            fprintf(stderr, "Could not write %s\n", argv[2]);
+            Failed = 1;
+        }
+    }
+
+    if (!Failed) {
+        printf("%-26s %12s %12s %12s %12s %9s %9s\n", "protocol", "peak (N)", "max abs (N)", "max rel", "rms rel",
+               "full(s)", "surr(s)");
+        for(k=0; k<Num_runs; k++){
+            Run = &Runs[k];
+            Time_surrogate = SimulateSurrogate(Table, Run, Step);
+            Relative = (Run->Peak > 0) ? Run->Max_error/Run->Peak : Run->Max_error;
+            if (Relative > Worst)
+                Worst = Relative;
+            printf("%-26s %12.6g %12.3e %12.3e %12.3e %9.3f %9.3f\n", Run->Protocol->Name, Run->Peak, Run->Max_error,
+                   Relative, sqrt((Run->Sum_rise+Run->Sum_fall)/(Run->Num_rise+Run->Num_fall))/((Run->Peak > 0) ? Run->Peak : 1),
+                   Run->Time_full, Time_surrogate);
+        }
+        printf("maximum relative force error %.3e (tolerance %.1e)\n", Worst, Tolerance);
+    }
+
+    for(k=0; k<Num_runs; k++){
+        free(Runs[k].Force);
+    }
+    VM_FreeSurrogateTable(Table);
+    VM_FreeModel(Model);
+    free(Values);
+    return (Failed || !(Worst <= Tolerance)) ? 1 : 0;
+}
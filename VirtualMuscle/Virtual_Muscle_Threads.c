@@ -0,0 +1,251 @@
+/* VIRTUAL_MUSCLE_THREADS.C
+ * Synopsis: Persistent thread pool, see Virtual_Muscle_Threads.h
+ *
+ * Comments: One lock guards the whole pool. A call publishes its tasks and bumps Generation; the
+ *          workers woken by it and the caller then take the next task under the lock until none is
+ *          left. The tasks are coarse (tens of motor units), so the lock is not contended. The caller
+ *          waits until every task is Completed, after which no thread touches Fcn or Arg again.
+ *
+ * Date: 10-17-26
+ */
+
+#include "Virtual_Muscle_Threads.h"
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+typedef HANDLE              VM_Thread;
+typedef CRITICAL_SECTION    VM_Mutex;
+typedef CONDITION_VARIABLE  VM_Cond;
+#define MutexInit(m)        InitializeCriticalSection(m)
+#define MutexDestroy(m)     DeleteCriticalSection(m)
+#define MutexLock(m)        EnterCriticalSection(m)
+#define MutexUnlock(m)      LeaveCriticalSection(m)
+#define CondInit(c)         InitializeConditionVariable(c)
+#define CondDestroy(c)      ((void)0)
+#define CondWait(c,m)       SleepConditionVariableCS(c, m, INFINITE)
+#define CondSignal(c)       WakeConditionVariable(c)
+#define CondBroadcast(c)    WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <unistd.h>
+typedef pthread_t           VM_Thread;
+typedef pthread_mutex_t     VM_Mutex;
+typedef pthread_cond_t      VM_Cond;
+#define MutexInit(m)        pthread_mutex_init(m, NULL)
+#define MutexDestroy(m)     pthread_mutex_destroy(m)
+#define MutexLock(m)        pthread_mutex_lock(m)
+#define MutexUnlock(m)      pthread_mutex_unlock(m)
+#define CondInit(c)         pthread_cond_init(c, NULL)
+#define CondDestroy(c)      pthread_cond_destroy(c)
+#define CondWait(c,m)       pthread_cond_wait(c, m)
+#define CondSignal(c)       pthread_cond_signal(c)
+#define CondBroadcast(c)    pthread_cond_broadcast(c)
+#endif
+
+struct VM_ThreadPool {
+    int_T       Num_threads;        //Workers and the caller
+    int_T       Num_workers;        //Workers started
+    VM_Thread*  Workers;            //[Num_threads-1]
+    VM_Mutex    Lock;
+    VM_Cond     Wake;               //New call (Generation) or Quit
+    VM_Cond     Done;               //All the tasks of the call Completed
+    unsigned long Generation;       //Number of calls with tasks published
+    int_T       Quit;
+
+    //Current call
+    VM_TaskFcn  Fcn;
+    void*       Arg;
+    int_T       Num_tasks;
+    int_T       Next;               //Next task to hand out
+    int_T       Completed;
+};
+
+
+
+/* Function: RunAvailable
+*  Description: Runs the tasks of the current call that are left, with the lock held on entry and exit
+*/
+static void RunAvailable(VM_ThreadPool *Pool)
+{
+    VM_TaskFcn Fcn  = NULL;
+    void *Arg       = NULL;
+    int_T Task      = 0;
+
+    while (Pool->Next < Pool->Num_tasks) {
+        Task = Pool->Next++;
+        Fcn  = Pool->Fcn;
+        Arg  = Pool->Arg;
+        MutexUnlock(&Pool->Lock);
+        Fcn(Arg, Task);
+        MutexLock(&Pool->Lock);
+        if (++Pool->Completed == Pool->Num_tasks)
+            CondSignal(&Pool->Done);
+    }
+}
+
+
+
+/* Function: Worker
+*  Description: Worker thread: sleeps until a call publishes tasks, helps with them, until Quit
+*/
+static void Worker(VM_ThreadPool *Pool)
+{
+    unsigned long Seen = 0;
+
+    MutexLock(&Pool->Lock);
+    for(;;){
+        while (!Pool->Quit && Pool->Generation == Seen)
+            CondWait(&Pool->Wake, &Pool->Lock);
+        if (Pool->Quit)
+            break;
+        Seen = Pool->Generation;
+        RunAvailable(Pool);
+    }
+    MutexUnlock(&Pool->Lock);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI WorkerEntry(LPVOID Pool)
+{
+    Worker((VM_ThreadPool*)Pool);
+    return 0;
+}
+#else
+static void* WorkerEntry(void *Pool)
+{
+    Worker((VM_ThreadPool*)Pool);
+    return NULL;
+}
+#endif
+
+
+
+/* Function: VM_FreeThreadPool
+*  Description: Stops and joins the workers and frees the pool (NULL is ignored)
+*/
+void VM_FreeThreadPool(VM_ThreadPool *Pool)
+{
+    int_T k = 0;
+
+    if (Pool == NULL)
+        return;
+    MutexLock(&Pool->Lock);
+    Pool->Quit = 1;
+    CondBroadcast(&Pool->Wake);
+    MutexUnlock(&Pool->Lock);
+    for(k=0; k<Pool->Num_workers; k++){
+#if defined(_WIN32)
+        WaitForSingleObject(Pool->Workers[k], INFINITE);
+        CloseHandle(Pool->Workers[k]);
+#else
+        pthread_join(Pool->Workers[k], NULL);
+#endif
+    }
+    CondDestroy(&Pool->Done);
+    CondDestroy(&Pool->Wake);
+    MutexDestroy(&Pool->Lock);
+    free(Pool);
+}
+
+
+
+/* Function: VM_CreateThreadPool
+*  Description: Starts Num_threads-1 workers (Num_threads >= 1)
+*/
+VM_ThreadPool* VM_CreateThreadPool(int_T Num_threads, const char **Error)
+{
+    VM_ThreadPool *Pool = NULL;
+    int_T Started       = 0;
+    int_T k             = 0;
+
+    if (Num_threads < 1)
+        Num_threads = 1;
+    Pool = (VM_ThreadPool*)calloc(1, sizeof(VM_ThreadPool) + (Num_threads-1)*sizeof(VM_Thread));
+    if (Pool == NULL) {
+        if (Error != NULL)
+            *Error = "Could not allocate the thread pool";
+        return NULL;
+    }
+    Pool->Num_threads   = Num_threads;
+    Pool->Workers       = (VM_Thread*)(Pool+1);
+    MutexInit(&Pool->Lock);
+    CondInit(&Pool->Wake);
+    CondInit(&Pool->Done);
+
+    for(k=0; k<Num_threads-1; k++){
+#if defined(_WIN32)
+        Pool->Workers[k] = CreateThread(NULL, 0, WorkerEntry, Pool, 0, NULL);
+        Started = (Pool->Workers[k] != NULL);
+#else
+        Started = (pthread_create(&Pool->Workers[k], NULL, WorkerEntry, Pool) == 0);
+#endif
+        if (!Started) {
+            if (Error != NULL)
+                *Error = "Could not start the threads of the thread pool";
+            VM_FreeThreadPool(Pool);
+            return NULL;
+        }
+        Pool->Num_workers++;
+    }
+    return Pool;
+}
+
+
+
+/* Function: VM_ThreadPoolSize
+*  Description: Number of threads, the caller included
+*/
+int_T VM_ThreadPoolSize(const VM_ThreadPool *Pool)
+{
+    return Pool->Num_threads;
+}
+
+
+
+/* Function: VM_NumProcessors
+*  Description: Processors online, at least 1 (default threads of the sweeps)
+*/
+int_T VM_NumProcessors(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO Info;
+
+    GetSystemInfo(&Info);
+    return (Info.dwNumberOfProcessors > 0) ? (int_T)Info.dwNumberOfProcessors : 1;
+#else
+    long Num    = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (Num > 0) ? (int_T)Num : 1;
+#endif
+}
+
+
+
+/* Function: VM_RunTasks
+*  Description: Runs the Num_tasks tasks on the pool; serially on the calling thread without workers
+*              or with a single task
+*/
+void VM_RunTasks(VM_ThreadPool *Pool, VM_TaskFcn Fcn, void *Arg, int_T Num_tasks)
+{
+    int_T k = 0;
+
+    if (Pool->Num_workers == 0 || Num_tasks <= 1) {
+        for(k=0; k<Num_tasks; k++){
+            Fcn(Arg, k);
+        }
+        return;
+    }
+    MutexLock(&Pool->Lock);
+    Pool->Fcn       = Fcn;
+    Pool->Arg       = Arg;
+    Pool->Num_tasks = Num_tasks;
+    Pool->Next      = 0;
+    Pool->Completed = 0;
+    Pool->Generation++;
+    CondBroadcast(&Pool->Wake);
+    RunAvailable(Pool);
+    while (Pool->Completed < Pool->Num_tasks)
+        CondWait(&Pool->Done, &Pool->Lock);
+    MutexUnlock(&Pool->Lock);
+}
@@ -0,0 +1,40 @@
+/* VIRTUAL_MUSCLE_THREADS.H
+ * Synopsis: Persistent thread pool of the threaded motor unit evaluation (NUMTHREADS)
+ *
+ *          The pool is created once (mdlStart) with Num_threads-1 worker threads that sleep between
+ *          calls. VM_RunTasks hands the tasks 0 .. Num_tasks-1 of one call out to the workers and to
+ *          the calling thread, in any order, and returns when all of them are done. The tasks of a
+ *          call must write disjoint data; anything they have to add up is reduced by the caller
+ *          afterwards, in a fixed order, so that the results do not depend on the number of threads.
+ *
+ *          Windows threads on Windows, POSIX threads elsewhere (link with -lpthread if the compiler
+ *          does not do it).
+ *
+ * Date: 10-17-26
+ */
+
+#ifndef VIRTUAL_MUSCLE_THREADS_H
+#define VIRTUAL_MUSCLE_THREADS_H
+
+#include "Virtual_Muscle_Types.h"
+
+//Task Task of a VM_RunTasks call
+typedef void (*VM_TaskFcn)(void *Arg, int_T Task);
+
+typedef struct VM_ThreadPool VM_ThreadPool;
+
+/* Pool of Num_threads threads, the caller of VM_RunTasks included (Num_threads-1 workers). Returns
+ * NULL, with the reason in *Error (may be NULL), if the threads cannot be created.
+ */
+extern VM_ThreadPool* VM_CreateThreadPool(int_T Num_threads, const char **Error);
+extern void VM_FreeThreadPool(VM_ThreadPool *Pool);
+extern int_T VM_ThreadPoolSize(const VM_ThreadPool *Pool);
+//Number of processors available, at least 1
+extern int_T VM_NumProcessors(void);
+
+/* Runs Fcn(Arg, k) for k = 0 .. Num_tasks-1 on the threads of the pool and returns when all the
+ * tasks are done. Not reentrant: one call at a time per pool.
+ */
+extern void VM_RunTasks(VM_ThreadPool *Pool, VM_TaskFcn Fcn, void *Arg, int_T Num_tasks);
+
+#endif /* VIRTUAL_MUSCLE_THREADS_H */
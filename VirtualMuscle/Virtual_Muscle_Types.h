@@ -0,0 +1,18 @@
+/* VIRTUAL_MUSCLE_TYPES.H
+ * Synopsis: Basic types of the Virtual Muscle engine. Inside MATLAB/Simulink they come from
+ *          tmwtypes.h; native builds (VM_STANDALONE, see Virtual_Muscle_Simulate.c) define them here.
+ *
+ * Date: 10-17-26
+ */
+
+#ifndef VIRTUAL_MUSCLE_TYPES_H
+#define VIRTUAL_MUSCLE_TYPES_H
+
+#ifdef VM_STANDALONE
+typedef double real_T;
+typedef int    int_T;
+#else
+#include "tmwtypes.h"
+#endif
+
+#endif /* VIRTUAL_MUSCLE_TYPES_H */
@@ -0,0 +1,295 @@
+/* VIRTUAL_MUSCLE_VALIDATE.C
+ * Synopsis: Accuracy report of the single precision motor unit kernels (PRECISION 2) against the
+ *          double ones (PRECISION 1), outside Simulink.
+ *
+ *          vm_validate <param file> [step (s)] [tolerance]
+ *
+ *          The muscle of the parameter file (NUMMUSCLES 1) is simulated twice per protocol, with
+ *          PRECISION 1 and 2 and everything else as in the file, with fixed step RK4 (default step
+ *          2e-5 s: at 1e-4 s the force of the motor unit heavy muscles still changes by 10% and more
+ *          with the step, and that integration error, not the kernels, dominates the comparison).
+ *          The protocols are isometric contractions at three activations and two path lengths,
+ *          isokinetic shortening and lengthening ramps, and Intramuscular FES trains at three
+ *          frequencies; the FES protocols use the muscle of the file with one motor unit per
+ *          fiber type (RTYPE 4, unit PCSA = fractional PCSA) unless it already is an FES muscle.
+ *          Every protocol turns the stimulation off before its end, so the fall rates are covered too.
+ *
+ *          For each protocol the peak force of the double run, the largest absolute force
+ *          difference (N) and the largest relative one (by the peak force) are written to stdout,
+ *          with the run times of both modes. For scale, the last column is the relative difference
+ *          between the double run and a double run at half the step: a float error of the order of
+ *          this integration error means the step is too coarse for the muscle, not that the
+ *          kernels are too inaccurate. The exit status is 1 if a relative float error is
+ *          above the tolerance (default 1e-3).
+ *
+ * Date: 10-17-26
+ *
+ * Build: cc -O2 -DVM_STANDALONE Virtual_Muscle_Validate.c Virtual_Muscle_ParamFile.c Virtual_Muscle_Engine.c
+ *          Virtual_Muscle_SIMD.c Virtual_Muscle_Threads.c -lm -lpthread -o vm_validate
+ */
+
+#include "Virtual_Muscle_Engine.h"
+#include "Virtual_Muscle_ParamFile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+//Defaults of the optional parameters STATELAYOUT .. INITSTATE, for files written before they existed
+static const real_T Optional_defaults[NPARAMS-NPARAMS_LEGACY] = {1, 0, 1, 0, 0, 0, 0, 1, 1, 1};
+
+static const real_T Double_precision = 1;
+static const real_T Single_precision = 2;
+
+//Intramuscular FES muscle derived from a Natural one
+static const real_T Fes_rtype       = 4;
+static const real_T Manual_apportion = 1;
+
+/*Protocol
+ Constant activation (or FES train) Act until t_off, then 0. The path is Path_frac*LPATH, moved at
+ Velocity*LPATH per second from t_ramp to t_off (isokinetic ramps, 0 for isometric).
+ */
+typedef struct {
+    const char* Name;
+    real_T  Act;
+    real_T  Freq;           //pps, FES protocols only (0 otherwise)
+    real_T  Path_frac;
+    real_T  Velocity;       //LPATH/s
+    real_T  t_ramp;
+    real_T  t_off;
+    real_T  t_end;
+} VM_Protocol;
+
+static const VM_Protocol Protocols[] = {
+    {"isometric Act 0.2",           0.2,  0, 0.90,  0.00, 0.0, 0.6, 1.0},
+    {"isometric Act 0.5",           0.5,  0, 0.90,  0.00, 0.0, 0.6, 1.0},
+    {"isometric Act 1.0",           1.0,  0, 0.90,  0.00, 0.0, 0.6, 1.0},
+    {"isometric Act 0.5 short",     0.5,  0, 0.80,  0.00, 0.0, 0.6, 1.0},
+    {"isokinetic shortening",       0.5,  0, 0.90, -0.25, 0.3, 0.7, 1.0},
+    {"isokinetic lengthening",      0.5,  0, 0.90,  0.25, 0.3, 0.7, 1.0},
+    {"FES 10 pps",                  1.0, 10, 0.90,  0.00, 0.0, 0.6, 1.0},
+    {"FES 20 pps",                  1.0, 20, 0.90,  0.00, 0.0, 0.6, 1.0},
+    {"FES 40 pps",                  1.0, 40, 0.90,  0.00, 0.0, 0.6, 1.0}
+};
+#define NUM_PROTOCOLS ((int_T)(sizeof(Protocols)/sizeof(Protocols[0])))
+
+//Run of one protocol: the input function context, and the force trace of the double run
+typedef struct {
+    const VM_Protocol* Protocol;
+    real_T  Lpath;          //Maximum path length (m)
+    real_T* Force;          //[Num_steps] forces of the double run
+    int_T   Num_steps;      //Output steps, the initial one and a last partial step included
+    int_T   Step;           //Output step of the current run
+    int_T   Compare;        //0: record Force, 1: compare with it
+    int_T   Stride;         //Output steps of the current run per step of the double run
+    real_T  Peak;
+    real_T  Max_error;
+} VM_Run;
+
+
+
+/* Function: ProtocolInputs
+*  Description: Input function of the protocol
+*/
+static void ProtocolInputs(real_T t, VM_Inputs *u, void *Context)
+{
+    const VM_Run *Run       = (const VM_Run*)Context;
+    const VM_Protocol *Pr   = Run->Protocol;
+    real_T Ramp_time        = 0.0;
+
+    if (t > Pr->t_ramp)
+        Ramp_time = ((t < Pr->t_off) ? t : Pr->t_off)-Pr->t_ramp;
+    u->Act  = (t < Pr->t_off) ? Pr->Act : 0.0;
+    u->Path = Run->Lpath*(Pr->Path_frac+Pr->Velocity*Ramp_time);
+    u->Freq = Pr->Freq;
+}
+
+
+
+/* Function: RecordForce
+*  Description: Output function: records the force of the double run, or compares the single one with it
+*/
+static int_T RecordForce(real_T t, const real_T *x, const real_T *y, void *Context)
+{
+    VM_Run *Run     = (VM_Run*)Context;
+    real_T Error    = 0.0;
+
+    if (Run->Step/Run->Stride >= Run->Num_steps)
+        return 1;
+    if (!Run->Compare) {
+        Run->Force[Run->Step] = y[VM_OUT_FSE];
+        if (fabs(y[VM_OUT_FSE]) > Run->Peak)
+            Run->Peak = fabs(y[VM_OUT_FSE]);
+    }
+    else if (Run->Step%Run->Stride == 0) {
+        Error = fabs(y[VM_OUT_FSE]-Run->Force[Run->Step/Run->Stride]);
+        if (Error > Run->Max_error || Error != Error)
+            Run->Max_error = (Error != Error) ? HUGE_VAL : Error;
+    }
+    Run->Step++;
+    return 0;
+}
+
+
+
+/* Function: SimulateProtocol
+*  Description: Runs the protocol with the model and returns the run time (s), or -1 on failure
+*/
+static double SimulateProtocol(const VM_ParamSet *P, VM_Run *Run, real_T Step)
+{
+    VM_SolverOptions Options;
+    VM_MuscleModel *Model   = NULL;
+    VM_Simulation *Sim      = NULL;
+    const char *Error       = NULL;
+    clock_t Start           = 0;
+    int_T Status            = 0;
+
+    Model = VM_CreateModel(P, &Error);
+    if (Model == NULL) {
+        fprintf(stderr, "%s\n", Error);
+        return -1;
+    }
+    Sim = VM_CreateSimulation(Model);
+    if (Sim == NULL) {
+        fprintf(stderr, "Could not allocate the simulation\n");
+        VM_FreeModel(Model);
+        return -1;
+    }
+    Options.Solver      = VM_SOLVER_RK4;
+    Options.Step        = Step;
+    Options.Rel_tol     = 1e-6;
+    Options.Abs_tol     = 1e-8;
+    Options.Min_step    = 1e-12;
+    Options.Max_step    = 0.01;
+
+    Run->Step = 0;
+    Start = clock();
+    VM_InitializeSimulation(Sim, 0.0, ProtocolInputs, Run);
+    RecordForce(Sim->t, Sim->x, Sim->y, Run);
+    Status = VM_Simulate(Sim, &Options, Run->Protocol->t_end, ProtocolInputs, RecordForce, Run);
+    Start = clock()-Start;
+
+    VM_FreeSimulation(Sim);
+    VM_FreeModel(Model);
+    return (Status == VM_SIM_OK) ? (double)Start/CLOCKS_PER_SEC : -1;
+}
+
+
+
+int main(int argc, char **argv)
+{
+    VM_ParamSet Param_set;
+    VM_ParamSet Natural;
+    VM_ParamSet Fes;
+    VM_ParamSet Single;
+    VM_Run Run;
+    const VM_ParamSet *P    = NULL;
+    real_T *Values          = NULL;
+    real_T *Units           = NULL;
+    real_T Step             = 0.0;
+    real_T Tolerance        = 0.0;
+    real_T Relative         = 0.0;
+    real_T Step_error       = 0.0;
+    real_T Worst            = 0.0;
+    double Time_double      = 0.0;
+    double Time_single      = 0.0;
+    int_T TypesOf_fibers    = 0;
+    int_T Failed            = 0;
+    int_T k                 = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <param file> [step (s)] [tolerance]\n", argv[0]);
+        return 2;
+    }
+    if (!VM_ReadParamSet(argv[1], &Param_set, &Values)) {
+        fprintf(stderr, "Could not read the parameters from %s\n", argv[1]);
+        return 1;
+    }
+    if (VM_OPTIONAL_PARAM_VALUE(&Param_set,NUMMUSCLES_IDX,1) != 1) {
+        fprintf(stderr, "vm_validate takes single muscle parameter files (NUMMUSCLES 1)\n");
+        free(Values);
+        return 1;
+    }
+    Step        = (argc > 2) ? atof(argv[2]) : 2e-5;
+    Tolerance   = (argc > 3) ? atof(argv[3]) : 1e-3;
+
+    //All the optional parameters present, so that PRECISION can be set
+    Natural = Param_set;
+    for(k=Param_set.Num_params; k<NPARAMS; k++){
+        Natural.Value[k] = &Optional_defaults[k-NPARAMS_LEGACY];
+        Natural.Count[k] = 1;
+    }
+    Natural.Num_params = NPARAMS;
+    Natural.Value[PRECISION_IDX] = &Double_precision;
+
+    //Intramuscular FES muscle: one motor unit per fiber type, with the fiber type PCSA
+    Fes = Natural;
+    TypesOf_fibers = (int_T)*VM_PARAM(&Natural,TOFMUSFIB_IDX);
+    if (*VM_PARAM(&Natural,RTYPE_IDX) != 4) {
+        Units = (real_T*)malloc(TypesOf_fibers*sizeof(real_T));
+        if (Units == NULL) {
+            fprintf(stderr, "Could not allocate the parameters\n");
+            free(Values);
+            return 1;
+        }
+        for(k=0; k<TypesOf_fibers; k++){
+            Units[k] = 1;
+        }
+        Fes.Value[RTYPE_IDX]        = &Fes_rtype;
+        Fes.Value[NUMOFUNITS_IDX]   = Units;
+        Fes.Value[UPCSA_IDX]        = Fes.Value[FPCSA_IDX];
+        Fes.Count[UPCSA_IDX]        = Fes.Count[FPCSA_IDX];
+        Fes.Value[APPORTMTD_IDX]    = &Manual_apportion;
+    }
+
+    printf("%-26s %12s %12s %12s %9s %9s %12s\n", "protocol", "peak (N)", "max abs (N)", "max rel", "double(s)",
+           "single(s)", "step rel");
+    memset(&Run, 0, sizeof(Run));
+    for(k=0; k<NUM_PROTOCOLS; k++){
+        P = (Protocols[k].Freq > 0) ? &Fes : &Natural;
+        Single = *P;
+        Single.Value[PRECISION_IDX] = &Single_precision;
+
+        Run.Protocol    = &Protocols[k];
+        Run.Lpath       = *VM_PARAM(P,LPATH_IDX)/100;
+        Run.Num_steps   = (int_T)ceil(Protocols[k].t_end/Step)+2;
+        Run.Force       = (real_T*)malloc(Run.Num_steps*sizeof(real_T));
+        Run.Peak        = 0.0;
+        if (Run.Force == NULL) {
+            fprintf(stderr, "Could not allocate the force trace\n");
+            Failed = 1;
+            break;
+        }
+        Run.Compare     = 0;
+        Run.Stride      = 1;
+        Time_double     = SimulateProtocol(P, &Run, Step);
+        Run.Compare     = 1;
+        Run.Max_error   = 0.0;
+        Run.Stride      = 2;
+        if (Time_double >= 0 && SimulateProtocol(P, &Run, Step/2) >= 0)
+            Step_error = Run.Max_error;
+        else
+            Time_double = -1;
+        Run.Max_error   = 0.0;
+        Run.Stride      = 1;
+        Time_single     = (Time_double >= 0) ? SimulateProtocol(&Single, &Run, Step) : -1;
+        free(Run.Force);
+        if (Time_double < 0 || Time_single < 0) {
+            fprintf(stderr, "%s: simulation failed\n", Protocols[k].Name);
+            Failed = 1;
+            continue;
+        }
+
+        Relative = (Run.Peak > 0) ? Run.Max_error/Run.Peak : Run.Max_error;
+        if (Relative > Worst)
+            Worst = Relative;
+        printf("%-26s %12.6g %12.3e %12.3e %9.3f %9.3f %12.3e\n", Protocols[k].Name, Run.Peak, Run.Max_error, Relative,
+               Time_double, Time_single, (Run.Peak > 0) ? Step_error/Run.Peak : Step_error);
+    }
+    printf("maximum relative force error %.3e (tolerance %.1e)\n", Worst, Tolerance);
+
+    free(Units);
+    free(Values);
+    return (Failed || !(Worst <= Tolerance)) ? 1 : 0;
+}